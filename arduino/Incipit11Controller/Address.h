@@ -0,0 +1,109 @@
+//***************************************************************
+// Software assigned I2C address.
+//
+// The strap pins give a unit one of 8 addresses. On a bigger bus the seesaw
+// controller gives each unit an address of its own instead, kept in EEPROM
+// at CONFIG_ADDRESS_EEPROM_ADDR:
+//   - Written to a unit, DOA_SEESAW_ADDRESS_ADDRESS moves it to the address
+//     (0 moves it back to the strap pins).
+//   - Units without an address of their own, and the units in the groups of
+//     a DOA_SEESAW_BROADCAST_ENUMERATE, also answer on
+//     CONFIG_I2C_ENUMERATION_ADDR until they are given one. The controller
+//     reads DOA_SEESAW_ADDRESS_ID there and every enumerating unit sends
+//     its id at once: the SIGROW serial number, then a tie-break byte. I2C
+//     is wired-AND and the TWI stops sending as soon as it sees a 0 on the
+//     bus where it sent a 1 (SSTATUS.COLL), so the controller reads the
+//     lowest id whole. It writes the id and an address to
+//     DOA_SEESAW_ADDRESS_ASSIGN on the enumeration address and the unit with
+//     that id moves there. This is repeated until the ID read is NACKed.
+// So each unit takes one read and one write, however many there are. The
+// tie-break byte is the low byte of micros() at the ID read, which differs
+// between units that booted together as their oscillators drift apart. It
+// only matters if two serial numbers were the same.
+//
+// Define CONFIG_ADDRESS_EEPROM_ADDR before including this file to move the
+// address in EEPROM.
+//***************************************************************
+
+#ifndef Address_h
+#define Address_h
+
+#include "Arduino.h"
+#include "Telemetry.h"
+#include <EEPROM.h>
+
+#ifndef CONFIG_ADDRESS_EEPROM_ADDR
+  #define CONFIG_ADDRESS_EEPROM_ADDR 0xE1
+#endif
+
+#define ADDRESS_SERIAL_SIZE 10 // SIGROW.SERNUM0 to SERNUM9
+#define ADDRESS_ID_SIZE (ADDRESS_SERIAL_SIZE + 1) // and the tie-break byte
+#define ADDRESS_NONE 0
+
+uint8_t addressOwn = ADDRESS_NONE;  // address from EEPROM
+bool addressEnumerating = false;    // answering on the enumeration address
+uint8_t addressTieBreak = 0;        // sent with the last id
+
+// True for the 7 bit addresses that aren't reserved by the I2C standard.
+bool addressValid(uint8_t address) {
+  return address >= 0x08 && address <= 0x77;
+}
+
+// Loads the address. Enumerates when there is none.
+void addressBegin() {
+  addressOwn = EEPROM.read(CONFIG_ADDRESS_EEPROM_ADDR);
+  if (!addressValid(addressOwn)) {
+    addressOwn = ADDRESS_NONE;
+  }
+  addressEnumerating = (addressOwn == ADDRESS_NONE);
+}
+
+// Byte index of the id.
+uint8_t addressId(uint8_t index) {
+  if (index < ADDRESS_SERIAL_SIZE) {
+    return (&SIGROW.SERNUM0)[index];
+  }
+  return addressTieBreak;
+}
+
+// Called for each ID read on the enumeration address.
+void addressDrawTieBreak() {
+  addressTieBreak = micros();
+}
+
+// Answers on the enumeration address until an address is assigned.
+void addressEnumerate() {
+  addressEnumerating = true;
+}
+
+// Takes address (ADDRESS_NONE for the strap pins), to be saved with
+// addressSave(). Returns false if it isn't one a unit can take. Called from
+// the I2C receive ISR.
+bool addressSet(uint8_t address) {
+  if (address != ADDRESS_NONE && !addressValid(address)) {
+    return false;
+  }
+  addressOwn = address;
+  addressEnumerating = (address == ADDRESS_NONE);
+  return true;
+}
+
+// Keeps the address in EEPROM. Called from loop().
+void addressSave() {
+  uint8_t address = addressOwn;
+  telemetryEEPROMPut(CONFIG_ADDRESS_EEPROM_ADDR, address);
+}
+
+// Takes a DOA_SEESAW_ADDRESS_ASSIGN. Returns true if it was for this unit.
+bool addressAssign(const uint8_t *id, uint8_t address) {
+  if (!addressEnumerating) {
+    return false;
+  }
+  for (uint8_t i = 0; i < ADDRESS_ID_SIZE; i++) {
+    if (id[i] != addressId(i)) {
+      return false;
+    }
+  }
+  return addressSet(address);
+}
+#endif
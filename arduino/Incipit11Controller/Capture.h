@@ -0,0 +1,183 @@
+//***************************************************************
+// Capture of what happens to a unit, for replay on the host.
+//
+// Define CAPTURE before including DOA_seesawCompatibility.h to record, from
+// reset, the inputs and the seesaw commands that came in and what the
+// firmware did with them into a RAM buffer:
+//   #define CAPTURE
+//
+// The records are the button and trigger edges, the bytes of each seesaw
+// write and each read, the state the state machine went to, the effect
+// each channel changed to, and each EEPROM byte written with its old value.
+// The buffer fills from reset and then stops (counting what it dropped), as
+// a replay has to start from reset. It is read through the
+// DOA_SEESAW_CAPTURE_BASE registers together with the raw EEPROM; undoing
+// the captured writes gives the EEPROM as it was at reset. host/sim/replay.cpp
+// turns that into a trace and replays it through the host build.
+//
+// Each record is a kind, the length of the data, millis() (uint32, big
+// endian) and the data:
+//   CAPTURE_RECORD_INPUT    input (0 button, 1 trigger), level
+//   CAPTURE_RECORD_RECEIVE  address (0 for a general call), the bytes written
+//   CAPTURE_RECORD_REQUEST  address
+//   CAPTURE_RECORD_STATE    state, in the order of capturedStates in the sketch
+//   CAPTURE_RECORD_EFFECT   channel, effect
+//   CAPTURE_RECORD_EEPROM   address, old byte, new byte
+//
+// millis() stops in standby (Power.h), so the records taken by the ISR that
+// ends a standby get the time it was set to on waking up.
+//
+// The EEPROM has no room for the capture next to the settings, and writing
+// it would wear it, so the capture is only kept in RAM and lost on reset.
+//
+// If CAPTURE is not defined the macros are blank and no RAM is used.
+//***************************************************************
+
+#ifndef Capture_h
+#define Capture_h
+
+#include "Arduino.h"
+#include <EEPROM.h>
+
+enum CaptureRecord : uint8_t {
+  CAPTURE_RECORD_INPUT = 1,
+  CAPTURE_RECORD_RECEIVE,
+  CAPTURE_RECORD_REQUEST,
+  CAPTURE_RECORD_STATE,
+  CAPTURE_RECORD_EFFECT,
+  CAPTURE_RECORD_EEPROM,
+};
+
+#define CAPTURE_HEADER_SIZE 6 // kind, length, time
+
+// Flags of DOA_SEESAW_CAPTURE_INFO
+#define CAPTURE_FULL_bm          0x01 // records were dropped
+#define CAPTURE_EEPROM_LOST_bm   0x02 // EEPROM written after the buffer was full
+
+#ifdef CAPTURE
+
+// Bytes of RAM. Read in 32 byte chunks, up to 64 of them.
+#ifndef CAPTURE_BUFFER_SIZE
+  #define CAPTURE_BUFFER_SIZE 512
+#endif
+static_assert(CAPTURE_BUFFER_SIZE <= 64 * 32, "CAPTURE_BUFFER_SIZE is more than the registers reach");
+
+uint8_t captureBuffer[CAPTURE_BUFFER_SIZE];
+volatile uint16_t captureUsed = 0;
+volatile uint16_t captureDropped = 0;
+volatile uint8_t captureFlags = 0;
+uint16_t captureStandbyStart = 0; // first record of this standby
+uint8_t captureInputs = 0xFF; // levels last seen, bit per input (released)
+uint8_t captureState = 0xFF;
+
+// Add a record. Safe to call from an ISR.
+void capture(uint8_t kind, const uint8_t *data, uint8_t length) {
+  uint32_t now = millis();
+
+  uint8_t sreg = SREG;
+  cli();
+  uint16_t used = captureUsed;
+  if (used + CAPTURE_HEADER_SIZE + length > CAPTURE_BUFFER_SIZE) {
+    captureFlags |= CAPTURE_FULL_bm;
+    if (kind == CAPTURE_RECORD_EEPROM) {
+      captureFlags |= CAPTURE_EEPROM_LOST_bm;
+    }
+    if (captureDropped != 0xFFFF) {
+      captureDropped++;
+    }
+  } else {
+    uint8_t *record = &captureBuffer[used];
+    record[0] = kind;
+    record[1] = length;
+    record[2] = now >> 24;
+    record[3] = now >> 16;
+    record[4] = now >> 8;
+    record[5] = now;
+    memcpy(record + CAPTURE_HEADER_SIZE, data, length);
+    captureUsed = used + CAPTURE_HEADER_SIZE + length;
+  }
+  SREG = sreg;
+}
+
+// Called as millis() stops for a standby.
+void captureStandby() {
+  captureStandbyStart = captureUsed;
+}
+
+// Called once millis() is set again after a standby: the records taken
+// since get the time.
+void captureWake() {
+  uint32_t now = millis();
+  uint8_t sreg = SREG;
+  cli();
+  for (uint16_t i = captureStandbyStart; i < captureUsed; i += CAPTURE_HEADER_SIZE + captureBuffer[i + 1]) {
+    captureBuffer[i + 2] = now >> 24;
+    captureBuffer[i + 3] = now >> 16;
+    captureBuffer[i + 4] = now >> 8;
+    captureBuffer[i + 5] = now;
+  }
+  SREG = sreg;
+}
+
+// A seesaw write: the address it came in on and the bytes.
+void captureReceive(uint8_t address, const uint8_t *data, uint8_t length) {
+  uint8_t record[1 + 32];
+  if (length > sizeof(record) - 1) {
+    return;
+  }
+  record[0] = address;
+  memcpy(record + 1, data, length);
+  capture(CAPTURE_RECORD_RECEIVE, record, 1 + length);
+}
+
+// Called from loop() with the level of each input; records the edges.
+void captureInput(uint8_t input, uint8_t level) {
+  uint8_t mask = 1 << input;
+  if (((captureInputs & mask) != 0) != (level != LOW)) {
+    captureInputs ^= mask;
+    uint8_t data[] = {input, level != LOW};
+    capture(CAPTURE_RECORD_INPUT, data, sizeof(data));
+  }
+}
+
+// Called from loop() after the state machine ran.
+void captureStateChange(uint8_t state) {
+  if (state != captureState) {
+    captureState = state;
+    capture(CAPTURE_RECORD_STATE, &state, 1);
+  }
+}
+
+// Called before an EEPROM byte is written.
+void captureEEPROM(int addr, uint8_t value) {
+  uint8_t data[] = {(uint8_t)addr, EEPROM.read(addr), value};
+  if (data[1] != value) {
+    capture(CAPTURE_RECORD_EEPROM, data, sizeof(data));
+  }
+}
+
+#define CAPTURE_INPUT(input, level)     captureInput(input, level)
+#define CAPTURE_RECEIVE(address, data, length) captureReceive(address, data, length)
+#define CAPTURE_REQUEST(address)        do { uint8_t _address = address; capture(CAPTURE_RECORD_REQUEST, &_address, 1); } while (0)
+#define CAPTURE_STATE(state)            captureStateChange(state)
+#define CAPTURE_EFFECT(channel, effect) do { uint8_t _data[] = {channel, effect}; capture(CAPTURE_RECORD_EFFECT, _data, 2); } while (0)
+#define CAPTURE_EEPROM(addr, value)     captureEEPROM(addr, value)
+#define CAPTURE_STANDBY()               captureStandby()
+#define CAPTURE_WAKE()                  captureWake()
+
+//***************************************************************
+#else
+
+#define CAPTURE_INPUT(input, level)
+#define CAPTURE_RECEIVE(address, data, length)
+#define CAPTURE_REQUEST(address)
+#define CAPTURE_STATE(state)
+#define CAPTURE_EFFECT(channel, effect)
+#define CAPTURE_EEPROM(addr, value)
+#define CAPTURE_STANDBY()
+#define CAPTURE_WAKE()
+
+#endif
+//***************************************************************
+
+#endif
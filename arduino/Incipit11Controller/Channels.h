@@ -0,0 +1,210 @@
+//***************************************************************
+// Output channels.
+//
+// Each channel of an OutputBank (OutputStage.h) runs its own effect. The
+// channel state is kept as arrays indexed by the channel, next to the effect
+// run state in EffectSlots (Effect.h), and channelsUpdate() updates every
+// channel in one pass from loop().
+//
+// The effects write to the EffectMixer rather than to the outputs. When a
+// channel switches effects with a fade time, the outgoing effect keeps
+// running in the fade slot (channel + OUTPUT_CHANNELS) and the two levels
+// are crossfaded in linear light (through gamma_lut) until the incoming
+// effect has the channel to itself. The crossfade is computed in fixed
+// point: a 16 bit mix rate is worked out once when the fade starts and each
+// update takes a multiply and a search of gamma_lut. A switch during a
+// fade fades on from the level the fade got to, held in the fade slot by
+// channelHold.
+//
+// A channel is either running its effect or driven by the seesaw controller
+// (the seesaw PWM pin is the channel number) with the level in
+// channelLevel[]. channelPeripheral has a bit per channel that the
+// controller has taken over. The I2C receive ISR sets the bits, so loop()
+// changes them with channelSetPeripheral().
+//
+// Set OUTPUT_CHANNELS to the number of pins in the bank before including
+// Effect.h.
+//***************************************************************
+
+#ifndef Channels_h
+#define Channels_h
+
+#include "Arduino.h"
+#include "Clock.h"
+#include "Effect.h"
+#include "Power.h"
+#include "Sync.h"
+
+#if OUTPUT_CHANNELS > 8
+  #error "channelPeripheral has a bit per channel"
+#endif
+
+Effect *channelEffect[OUTPUT_CHANNELS];   // NULL when the channel has no effect
+uint8_t channelLevel[OUTPUT_CHANNELS];    // level set by the seesaw controller
+volatile uint8_t channelPeripheral = 0;   // bit per channel driven by the seesaw controller
+
+Effect *channelFadeFrom[OUTPUT_CHANNELS]; // effect fading out, NULL when not fading
+unsigned long channelFadeStart[OUTPUT_CHANNELS];
+uint16_t channelFadeTime[OUTPUT_CHANNELS];
+uint16_t channelFadeRate[OUTPUT_CHANNELS]; // mix per millisecond (0xFFFF is all in)
+
+uint8_t channelOutput[OUTPUT_CHANNELS]; // level last written to each channel
+
+uint8_t slotLevel[EFFECT_SLOTS]; // level last written by the effect in each slot
+
+// Output of the effects (see Effect.h): keeps the level of each slot for
+// channelsUpdate() to mix.
+struct EffectMixer {
+  static void write(uint8_t slot, uint8_t level) {
+    slotLevel[slot] = level;
+  }
+
+  static uint8_t getTarget(uint8_t slot) {
+    return slotLevel[slot];
+  }
+};
+
+// Stands in for the outgoing effect of a fade that started during another
+// one: the level stays where the other fade was.
+class ChannelHold : public Effect {
+public:
+  void update(uint8_t slot, unsigned long now = 0) override {
+    // slotLevel[slot] was set when the fade started
+  }
+};
+
+ChannelHold channelHold;
+
+// Hands a channel to the seesaw controller or gives it back to its effect,
+// from loop(). Safe against the I2C receive ISR taking another channel.
+void channelSetPeripheral(uint8_t channel, bool peripheral) {
+  uint8_t sreg = SREG;
+  cli();
+  if (peripheral) {
+    channelPeripheral |= 1 << channel;
+  } else {
+    channelPeripheral &= ~(1 << channel);
+  }
+  SREG = sreg;
+}
+
+// Smallest level that gamma_lut takes to at least linear.
+uint8_t channelLevelOf(uint8_t linear) {
+  uint8_t level = 0;
+  for (uint8_t step = 128; step > 0; step >>= 1) {
+    if (gamma_lut[level + step - 1] < linear) {
+      level += step;
+    }
+  }
+  return level;
+}
+
+// Level between from (mix 0) and to (mix 255), mixed in linear light.
+uint8_t channelMix(uint8_t from, uint8_t to, uint8_t mix) {
+  int16_t linearFrom = gamma_lut[from];
+  int16_t linearTo = gamma_lut[to];
+  return channelLevelOf(linearFrom + (int16_t)(((int32_t)(linearTo - linearFrom) * mix) >> 8));
+}
+
+// Switches a channel to an effect, starting it from the beginning. With a
+// fadeTime (milliseconds) the previous effect keeps running and fades out
+// while the new one fades in. If a fade is still going, the new one fades
+// in from the level that fade got to.
+void channelSetEffect(uint8_t channel, Effect *effect, uint16_t fadeTime = 0) {
+  uint8_t fadeSlot = channel + OUTPUT_CHANNELS;
+  bool fading = channelFadeFrom[channel] != NULL;
+
+  if (fading) {
+    channelFadeFrom[channel]->exit(fadeSlot);
+    channelFadeFrom[channel] = NULL;
+  }
+
+  if (channelEffect[channel] != NULL) {
+    if (fadeTime > 0 && effect != NULL) {
+      if (fading) {
+        // the level is a mix of two effects; hold it rather than jump to
+        // the one that was fading in
+        channelEffect[channel]->exit(channel);
+        slotLevel[fadeSlot] = channelOutput[channel];
+        channelFadeFrom[channel] = &channelHold;
+      } else {
+        // carry on from where it is in the fade slot
+        effectSlotsMove(channel, fadeSlot);
+        slotLevel[fadeSlot] = slotLevel[channel];
+        channelFadeFrom[channel] = channelEffect[channel];
+      }
+      channelFadeStart[channel] = syncMillis();
+      channelFadeTime[channel] = fadeTime;
+      channelFadeRate[channel] = 0xFFFF / fadeTime;
+    } else {
+      channelEffect[channel]->exit(channel);
+    }
+  }
+
+  channelEffect[channel] = effect;
+  if (effect != NULL) {
+    effect->enter(channel);
+  }
+}
+
+// Starts the effects of all the channels again, without fading. Called
+// when the shared clock (Sync.h) was set, which leaves the effects' times
+// behind.
+void channelsRestart() {
+  for (uint8_t channel = 0; channel < OUTPUT_CHANNELS; channel++) {
+    Effect *effect = channelEffect[channel];
+    if (effect != NULL) {
+      channelSetEffect(channel, NULL);
+      channelSetEffect(channel, effect);
+    }
+  }
+}
+
+// Updates the outputs of all the channels and asks Power.h to wake up when
+// the next one changes. now is millis(); the effects run on the shared clock.
+template <class Outputs>
+void channelsUpdate(unsigned long now) {
+  unsigned long effectNow = syncMillisAt(now);
+
+  for (uint8_t channel = 0; channel < OUTPUT_CHANNELS; channel++) {
+    if (channelPeripheral & (1 << channel)) {
+      channelOutput[channel] = channelLevel[channel];
+      Outputs::write(channel, channelLevel[channel]);
+    } else if (channelEffect[channel] != NULL) {
+      channelEffect[channel]->update(channel, effectNow);
+      uint8_t level = slotLevel[channel];
+
+      Effect *from = channelFadeFrom[channel];
+      if (from != NULL) {
+        uint8_t fadeSlot = channel + OUTPUT_CHANNELS;
+        unsigned long elapsed = effectNow - channelFadeStart[channel];
+
+        if (elapsed >= channelFadeTime[channel]) {
+          // faded in
+          from->exit(fadeSlot);
+          channelFadeFrom[channel] = NULL;
+        } else {
+          from->update(fadeSlot, effectNow);
+          // elapsed < fadeTime, so this stays within 16 bits
+          uint16_t mix = (uint16_t)elapsed * channelFadeRate[channel];
+          level = channelMix(slotLevel[fadeSlot], level, mix >> 8);
+          // next step of the fade
+          powerWakeIn(1);
+          clockBusy();
+        }
+      }
+
+      channelOutput[channel] = level;
+      Outputs::write(channel, level);
+      powerWakeIn(channelEffect[channel]->getIdleTime(channel, effectNow));
+    }
+  }
+
+  Outputs::update(now);
+  if (!Outputs::settled()) {
+    // slewing to the level written by an effect
+    powerWakeIn(1);
+    clockBusy();
+  }
+}
+#endif
@@ -0,0 +1,198 @@
+//***************************************************************
+// CPU clock governor.
+//
+// Define CLOCK_SCALING before including this file (it is included by
+// DOA_seesawCompatibility.h) to run the CPU at F_CPU / CLOCK_LOW_DIVISOR
+// while there is little to do:
+//   #define CLOCK_SCALING
+//
+// The clock is lowered while loop() idles between passes, which is when it
+// pays: the idle current goes down with the clock, while a pass costs about
+// the same charge at any clock (it takes longer at a lower current). That
+// is a CONSTANT_* preset, a slow sine or any other effect with the PWM
+// running and nothing else to do. clockUpdate() at the end of loop() raises
+// the clock right away for
+//   - heavy work, which calls clockBusy(): a crossfade, output slewing,
+//     debouncing the button or trigger, rendering a pixel frame, a status
+//     pixel held back by an I2C read, and every seesaw write (from the ISR),
+//   - a pass that has to run again right away,
+//   - a standby, so the pass that wakes up from it runs on time (millis()
+//     stops in standby, so the length of that pass would add up),
+//   - the pass that ends a hold of CLOCK_SETTLE or more, for the same
+//     reason: its step can turn the outputs off and go to standby, and
+//   - debug serial output waiting in the buffer,
+// and lowers it again once none of these happened for CLOCK_SETTLE
+// milliseconds.
+//
+// What depends on the CPU clock is kept the same across a change:
+//   - TCA0 gets a prescaler CLOCK_LOW_DIVISOR times smaller, so the PWM
+//     frequency stays the same.
+//   - The USART baud register is divided by CLOCK_LOW_DIVISOR, after the
+//     bytes in flight were sent.
+//   - millis() and micros() count TCD0, which megaTinyCore clocks from the
+//     unprescaled oscillator, so they don't see the change.
+//   - tinyNeoPixel's show() times the bits in cycles of F_CPU, so the clock
+//     is raised with clockFull() before it.
+// The profiler (Profiler.h) counts cycles of the CPU clock, so its counts
+// are still cycles, but its microsecond budgets assume F_CPU. A seesaw write
+// that comes in at the low clock takes longer to handle, which delays a
+// shared clock sync (Sync.h) by a few hundred microseconds, the same on
+// every unit.
+//
+// The part has to run from the unprescaled oscillator (F_CPU of 20 or 16
+// MHz) for this; otherwise clockBegin() leaves the clock alone.
+//
+// If CLOCK_SCALING is not defined the functions do nothing.
+//***************************************************************
+
+#ifndef Clock_h
+#define Clock_h
+
+#include "Arduino.h"
+#include "Power.h"
+
+#ifdef CLOCK_SCALING
+
+#if !defined(MILLIS_USE_TIMERD0)
+  #error "CLOCK_SCALING needs TCD0 as the millis timer, which runs from the unprescaled oscillator"
+#endif
+
+#ifndef CLOCK_LOW_DIVISOR
+  #define CLOCK_LOW_DIVISOR 4 // 2, 4 or 8; 5 MHz from 20 MHz
+#endif
+
+#if CLOCK_LOW_DIVISOR == 2
+  #define CLOCK_LOW_PDIV CLKCTRL_PDIV_2X_gc
+#elif CLOCK_LOW_DIVISOR == 4
+  #define CLOCK_LOW_PDIV CLKCTRL_PDIV_4X_gc
+#elif CLOCK_LOW_DIVISOR == 8
+  #define CLOCK_LOW_PDIV CLKCTRL_PDIV_8X_gc
+#else
+  #error "CLOCK_LOW_DIVISOR has to be 2, 4 or 8"
+#endif
+
+#ifndef CLOCK_SETTLE
+  #define CLOCK_SETTLE 50 // milliseconds of little to do before lowering the clock
+#endif
+
+// Smallest USART baud register value the receiver and transmitter work with.
+#define CLOCK_MIN_BAUD 64
+
+bool clockEnabled = false;
+bool clockLow = false;
+volatile bool clockActivity = false;
+unsigned long clockQuietSince = 0;
+bool clockHolding = false; // in a hold of CLOCK_SETTLE or more
+uint8_t clockTcaFull = 0;   // TCA0 CLKSEL at F_CPU
+uint8_t clockTcaLow = 0;    // TCA0 CLKSEL at the low clock
+uint16_t clockBaudFull = 0; // USART0 baud register at F_CPU
+
+// Prescaler of each TCA0 CLKSEL value.
+const uint16_t clockTcaDivisors[] = {1, 2, 4, 8, 16, 64, 256, 1024};
+
+// Called for work that needs the full clock for the next passes, also from
+// ISRs.
+inline void clockBusy() {
+  clockActivity = true;
+}
+
+// Called after Serial.begin() and after TCA0 was set up.
+void clockBegin() {
+  clockEnabled = false;
+  if (CLKCTRL.MCLKCTRLB & CLKCTRL_PEN_bm) {
+    // the clock is prescaled already
+    return;
+  }
+
+  // the TCA0 prescaler that gives the same PWM frequency at the low clock
+  clockTcaFull = TCA0.SPLIT.CTRLA & TCA_SPLIT_CLKSEL_gm;
+  uint16_t tcaLow = clockTcaDivisors[clockTcaFull >> 1] / CLOCK_LOW_DIVISOR;
+  uint8_t found = 0xFF;
+  for (uint8_t i = 0; i < sizeof(clockTcaDivisors) / sizeof(clockTcaDivisors[0]); i++) {
+    if (clockTcaDivisors[i] == tcaLow) {
+      found = i;
+    }
+  }
+  if (found == 0xFF) {
+    return;
+  }
+  clockTcaLow = found << 1;
+
+  clockBaudFull = USART0.BAUD;
+  if ((USART0.CTRLB & USART_TXEN_bm) && clockBaudFull / CLOCK_LOW_DIVISOR < CLOCK_MIN_BAUD) {
+    // the baud rate is too high for the low clock
+    return;
+  }
+  clockEnabled = true;
+}
+
+void clockSet(bool low) {
+  if (low == clockLow) {
+    return;
+  }
+#ifdef DEBUG
+  // the bytes in flight go out at the old rate
+  Serial.flush();
+#endif
+
+  uint8_t sreg = SREG;
+  cli();
+  _PROTECTED_WRITE(CLKCTRL.MCLKCTRLB, low ? (CLOCK_LOW_PDIV | CLKCTRL_PEN_bm) : 0);
+  TCA0.SPLIT.CTRLA = (TCA0.SPLIT.CTRLA & ~TCA_SPLIT_CLKSEL_gm) | (low ? clockTcaLow : clockTcaFull);
+  if (USART0.CTRLB & USART_TXEN_bm) {
+    USART0.BAUD = low ? clockBaudFull / CLOCK_LOW_DIVISOR : clockBaudFull;
+  }
+  clockLow = low;
+  SREG = sreg;
+}
+
+// Full speed for work timed in cycles of F_CPU.
+void clockFull() {
+  if (clockLow) {
+    clockSet(false);
+  }
+}
+
+// Called at the end of loop(), before powerSleep().
+void clockUpdate(unsigned long now) {
+  if (!clockEnabled) {
+    return;
+  }
+  uint8_t sreg = SREG;
+  cli();
+  bool activity = clockActivity;
+  clockActivity = false;
+  SREG = sreg;
+
+  bool serialBusy = false;
+#ifdef DEBUG
+  // megaTinyCore sends from the buffer in the data register empty interrupt
+  serialBusy = (USART0.CTRLA & USART_DREIE_bm) != 0;
+#endif
+  if (activity || powerSleepMillis == 0 || powerWillStandby() || serialBusy) {
+    clockQuietSince = now;
+    clockSet(false);
+  } else if (clockHolding && powerSleepMillis <= 1) {
+    clockSet(false);
+  } else if (!clockLow && now - clockQuietSince >= CLOCK_SETTLE) {
+    clockSet(true);
+  }
+  if (powerSleepMillis >= CLOCK_SETTLE) {
+    clockHolding = true;
+  } else if (powerSleepMillis <= 1) {
+    clockHolding = false;
+  }
+}
+
+//***************************************************************
+#else
+
+void clockBegin() {}
+inline void clockBusy() {}
+void clockFull() {}
+void clockUpdate(unsigned long now) {}
+
+#endif
+//***************************************************************
+
+#endif
@@ -11,11 +11,81 @@
 #define _DOA_SEESAWCOMPATIBILITY_H
 
 #include "Adafruit_seesaw.h"
+#include "Address.h"
+#include "Capture.h"
+#include "Clock.h"
 #include "DebugMacros.h"
+#include "Keyframes.h"
+#include "Power.h"
+#include "Profiler.h"
+#include "Sync.h"
+#include "Telemetry.h"
+#include "Trace.h"
+#include <EEPROM.h>
 #include <Wire.h>
 
 #define SEESAW_HW_ID 0x88 // assigned to ATtiny1616 value
 
+// Incipit11 register bases. These are above the bases assigned by Adafruit.
+#define DOA_SEESAW_PROFILER_BASE 0x80
+#define DOA_SEESAW_TELEMETRY_BASE 0x81
+#define DOA_SEESAW_POWER_BASE 0x82
+#define DOA_SEESAW_KEYFRAMES_BASE 0x83
+#define DOA_SEESAW_SYNC_BASE 0x84
+#define DOA_SEESAW_ADDRESS_BASE 0x85
+#define DOA_SEESAW_BROADCAST_BASE 0x86 // even: a general call starting with an odd byte is a hardware general call
+#define DOA_SEESAW_CAPTURE_BASE 0x87
+
+// DOA_SEESAW_PROFILER_BASE registers
+#define DOA_SEESAW_PROFILER_INFO      0x00 // read: phase count, histogram bins, histogram shift, F_CPU
+#define DOA_SEESAW_PROFILER_SUMMARY   0x10 // + phase. read: count, min, mean, max (uint32 each)
+#define DOA_SEESAW_PROFILER_HISTOGRAM 0x20 // + phase. read: histogram bins (uint16 each)
+#define DOA_SEESAW_PROFILER_RESET     0x7F // write: clear all phases
+
+// DOA_SEESAW_TELEMETRY_BASE registers
+#define DOA_SEESAW_TELEMETRY_COUNTERS    0x00 // + first counter. read: counters up to the last one (uint32 each)
+#define DOA_SEESAW_TELEMETRY_RESET_FLAGS 0x10 // read: RSTCTRL.RSTFR of the last reset
+#define DOA_SEESAW_TELEMETRY_BOOT_TIME   0x11 // read: microseconds from init() to the first output level (uint32)
+#define DOA_SEESAW_TELEMETRY_CLEAR       0x7F // write: clear the lifetime counters
+
+// DOA_SEESAW_POWER_BASE registers
+#define DOA_SEESAW_POWER_MILLIS        0x00 // + first mode. read: milliseconds in run, idle, standby up to the last one (uint32 each)
+#define DOA_SEESAW_POWER_STANDBY_COUNT 0x10 // read: times standby was entered (uint32)
+
+// DOA_SEESAW_KEYFRAMES_BASE registers
+#define DOA_SEESAW_KEYFRAMES_PROGRAM 0x00 // + byte offset. read/write: program bytes from the offset (see Keyframes.h)
+
+// DOA_SEESAW_SYNC_BASE registers
+#define DOA_SEESAW_SYNC_EPOCH 0x00 // write: controller time in milliseconds (uint32, see Sync.h). read: the effect clock (uint32)
+#define DOA_SEESAW_SYNC_ERROR 0x01 // read: microseconds the clock was behind at the last sync (int32)
+
+// DOA_SEESAW_ADDRESS_BASE registers (see Address.h)
+#define DOA_SEESAW_ADDRESS_ADDRESS 0x00 // read: address in use. write: address to move to and keep (0: back to the strap pins)
+#define DOA_SEESAW_ADDRESS_ID      0x01 // read on the enumeration address: SIGROW serial number and tie-break byte
+#define DOA_SEESAW_ADDRESS_ASSIGN  0x02 // write on the enumeration address: id, address for the unit with the id
+
+// DOA_SEESAW_BROADCAST_BASE registers. Written to the general call address
+// (0) a command reaches every unit in one transaction. The byte after the
+// register is a mask of groups and a unit only takes the command when it is
+// in one of them (all of them until DOA_SEESAW_BROADCAST_GROUPS is written).
+// The commands can also be written to a single unit's address.
+#define DOA_SEESAW_BROADCAST_EFFECT  0x00 // write: groups, channel, ambient effect
+#define DOA_SEESAW_BROADCAST_LEVEL   0x01 // write: groups, channel, level (uint16) like SEESAW_TIMER_PWM
+#define DOA_SEESAW_BROADCAST_SYNC    0x02 // write: groups, controller time in milliseconds (uint32) like DOA_SEESAW_SYNC_EPOCH
+#define DOA_SEESAW_BROADCAST_TRIGGER 0x03 // write: groups
+#define DOA_SEESAW_BROADCAST_ENUMERATE 0x04 // write: groups. They answer on the enumeration address until assigned one
+#define DOA_SEESAW_BROADCAST_GROUPS  0x10 // read/write: groups this unit is in (bit mask, saved to EEPROM; not by general call)
+
+// DOA_SEESAW_CAPTURE_BASE registers (see Capture.h). The accesses to them
+// aren't captured.
+#define DOA_SEESAW_CAPTURE_INFO   0x00 // read: bytes of records, buffer size, records dropped (uint16 each), flags
+#define DOA_SEESAW_CAPTURE_EEPROM 0x20 // + chunk. read: the 32 EEPROM bytes from chunk * 32
+#define DOA_SEESAW_CAPTURE_DATA   0x40 // + chunk. read: the 32 bytes of records from chunk * 32
+
+#ifndef CONFIG_GROUPS_EEPROM_ADDR
+  #define CONFIG_GROUPS_EEPROM_ADDR 0xE0
+#endif
+
 // Define in controller.
 extern volatile uint32_t g_bufferedBulkGPIORead;
 
@@ -26,12 +96,16 @@ typedef void (*SeesawResetFP)();
 // Callback function for EEPROM read access
 typedef uint8_t (*EEPROMReadFP)(uint8_t);
 // Callback function for EEPROM write addess
-typedef void (*EEPROMWriteFP)(uint8_t, uint8_t *, uint8_t);
+typedef void (*EEPROMWriteFP)(uint8_t, const uint8_t *, uint8_t);
+// Callback function for the broadcast commands not handled here
+// (uint8_t command, const uint8_t *arguments, uint8_t size)
+typedef void (*BroadcastFP)(uint8_t, const uint8_t *, uint8_t);
 
 PWMCallbackFP _pwmCallbackPtr = NULL;
 SeesawResetFP _seesawResetPtr = NULL;
 EEPROMReadFP _eepromReadPtr = NULL;
 EEPROMWriteFP _eepromWritePtr = NULL;
+BroadcastFP _broadcastPtr = NULL;
 
 // Will be set to the date that the executable was compiled.
 uint16_t DATE_CODE = 0;
@@ -53,6 +127,31 @@ uint16_t DATE_CODE = 0;
   #define CONFIG_ADDR_INVERTED 0
 #endif
 
+// Define 'CONFIG_I2C_BROADCAST' to take the DOA_SEESAW_BROADCAST_BASE
+// commands written to the general call address (0).
+#ifdef CONFIG_I2C_BROADCAST
+  #undef CONFIG_I2C_BROADCAST
+  #define CONFIG_I2C_BROADCAST 1
+#else
+  #define CONFIG_I2C_BROADCAST 0
+#endif
+
+// Define 'CONFIG_I2C_ENUMERATION_ADDR' to the address the units without an
+// address of their own answer on for enumeration (see Address.h).
+#ifdef CONFIG_I2C_ENUMERATION_ADDR
+  #define CONFIG_I2C_ENUMERATION 1
+#else
+  #define CONFIG_I2C_ENUMERATION 0
+  #define CONFIG_I2C_ENUMERATION_ADDR 0
+#endif
+
+// Define 'CONFIG_INTERRUPT_PIN' to a pin that is pulled low while there are
+// key events queued and the controller turned the keypad interrupt on
+// (SEESAW_KEYPAD_INTENSET). The controller then reads the units that have
+// events instead of polling SEESAW_KEYPAD_COUNT on every one. The pin is
+// open drain (never driven high), so the units can share one line with a
+// pull-up.
+
 #ifdef CONFIG_ADDR_0_PIN
   #define CONFIG_ADDR_0 1
 #else
@@ -78,8 +177,71 @@ uint16_t DATE_CODE = 0;
   #define CONFIG_ADDR_3_PIN 0
 #endif
 
-volatile uint8_t i2c_buffer[32];
-uint8_t buffer[32]; // local buffer
+// Only used in the TWI interrupt (receiveData() and requestData()).
+uint8_t i2c_buffer[32];
+
+// The registers are dispatched through a table (seesawRegisters) keyed by
+// base and module. An entry covers the modules first to last of a base, with
+// a handler for writes and one for reads (either can be NULL):
+//   - A write handler gets the module and the bytes written after it, in
+//     place in i2c_buffer, and checks their number itself.
+//   - The controller reads by writing just the base and module, which calls
+//     the write handler without bytes and selects the entry. The read
+//     handler of the selected entry then writes the answer.
+// The table is constexpr, so it is kept in flash, which the tinyAVR maps
+// into the data space.
+//
+// A sketch adds register blocks of its own with
+// DOA_seesawCompatibility_addRegisters() (up to
+// CONFIG_SEESAW_REGISTER_BLOCKS), looked up after the built in ones:
+//   const SeesawRegister myRegisters[] = {
+//     {0x90, 0x00, 0x0F, &myWrite, &myRead},
+//   };
+//   DOA_seesawCompatibility_addRegisters(myRegisters, 1);
+
+// Register write handler (uint8_t module, const uint8_t *data, uint8_t size)
+typedef void (*SeesawWriteFP)(uint8_t, const uint8_t *, uint8_t);
+// Register read handler (uint8_t module)
+typedef void (*SeesawReadFP)(uint8_t);
+
+struct SeesawRegister {
+  uint8_t base;
+  uint8_t first; // modules first to last
+  uint8_t last;
+  SeesawWriteFP write;
+  SeesawReadFP read;
+};
+
+struct SeesawRegisterBlock {
+  const SeesawRegister *registers;
+  uint8_t count;
+};
+
+#ifndef CONFIG_SEESAW_REGISTER_BLOCKS
+  #define CONFIG_SEESAW_REGISTER_BLOCKS 2
+#endif
+
+SeesawRegisterBlock seesawBlocks[CONFIG_SEESAW_REGISTER_BLOCKS];
+uint8_t seesawBlockCount = 0;
+const SeesawRegister *seesawSelected = NULL; // by the last write, for requestData()
+
+// How the write being dispatched was addressed.
+bool seesawGeneralCall = false;
+bool seesawEnumerationCall = false;
+
+// A write of just the register is the first half of a read. The controller
+// reads the answer shortly after, so until then (or SEESAW_REQUEST_TIMEOUT)
+// loop() should hold off work that turns interrupts off.
+#define SEESAW_REQUEST_TIMEOUT 5 // milliseconds
+volatile bool seesawRequestPending = false;
+volatile uint8_t seesawRequestMillis = 0; // low byte of millis()
+
+uint8_t seesawGroups = 0xFF; // DOA_SEESAW_BROADCAST_GROUPS
+volatile bool seesawGroupsChanged = false; // and not saved to EEPROM yet
+
+// The unit moved to another address. The TWI can't be restarted from its
+// own ISR, so DOA_seesawCompatibility_run() does it after the transaction.
+volatile bool seesawListenPending = false;
 
 // key event ring buffer
 #define KEY_BUFFER_CAPACITY 5
@@ -88,6 +250,18 @@ keyEventRaw keyBuffer[KEY_BUFFER_CAPACITY];
 uint8_t keyHead = 0;
 uint8_t keyTail = 0;
 uint8_t keyCount = 0;
+volatile bool keyInterruptEnabled = false; // SEESAW_KEYPAD_INTENSET
+
+// Pulls CONFIG_INTERRUPT_PIN low while there are key events to read.
+void updateKeyInterrupt() {
+#ifdef CONFIG_INTERRUPT_PIN
+  if (keyInterruptEnabled && keyCount > 0) {
+    pinModeFast(CONFIG_INTERRUPT_PIN, OUTPUT); // low, set in DOA_seesawCompatibility_begin()
+  } else {
+    pinModeFast(CONFIG_INTERRUPT_PIN, INPUT);
+  }
+#endif
+}
 
 // key pad event logic
 // rising edge: press
@@ -97,24 +271,27 @@ keyEventRaw emptyKeyEvent = { {SEESAW_KEYPAD_EDGE_LOW, 0} };
 // Add a key press to the queue (Push)
 bool enqueueKeyEvent(keyEventRaw evt) {
   if (keyCount == KEY_BUFFER_CAPACITY) {
-    DPRINTLN(F("Warning: Queue is full"));
+    TRACE(TRACE_KEY_QUEUE_FULL);
+    telemetryIncrement(TELEMETRY_KEY_EVENTS_DROPPED);
     return false;
   }
   keyBuffer[keyTail] = evt;
   keyTail = (keyTail + 1) % KEY_BUFFER_CAPACITY; // wrap around if reaching end of array
   keyCount++;
+  updateKeyInterrupt();
   return true;
 }
 
 // Remove a key press from the queue (Pop)
 keyEventRaw dequeueKeyEvent() {
   if (keyCount == 0) {
-    DPRINTLN(F("Error: Queue is empty"));
+    TRACE(TRACE_KEY_QUEUE_EMPTY);
     return emptyKeyEvent;
   }
   keyEventRaw evt = keyBuffer[keyHead];
   keyHead = (keyHead + 1) % KEY_BUFFER_CAPACITY; // wrap around if reaching end of array
   keyCount--;
+  updateKeyInterrupt();
   return evt;
 }
 
@@ -126,6 +303,12 @@ void DOA_seesawCompatibility_write32(uint32_t value) {
   return;
 }
 
+void DOA_seesawCompatibility_write16(uint16_t value) {
+  Wire.write(value >> 8);
+  Wire.write(value);
+  return;
+}
+
 void DOA_seesawCompatibility_write8(uint8_t value) {
   Wire.write(value);
   return;
@@ -133,13 +316,17 @@ void DOA_seesawCompatibility_write8(uint8_t value) {
 
 void DOA_seesawCompatibility_setDatecode(void);
 void DOA_seesawCompatibility_reset(void);
+void DOA_seesawCompatibility_listen(void);
 void receiveData(int numBytes);
 void requestData(void);
 void DOA_seesawCompatibility_run(void);
+bool DOA_seesawCompatibility_busy(unsigned long now);
 void DOA_seesawCompatibility_setPWMCallback(PWMCallbackFP pwmCallbackPtr);
 void DOA_seesawCompatibility_setSeesawReset(SeesawResetFP seesawResetPtr);
 void DOA_seesawCompatibility_setEEPROMReadCallback(EEPROMReadFP eepromReadPtr);
 void DOA_seesawCompatibility_setEEPROMWriteCallback(EEPROMWriteFP eepromWritePtr);
+void DOA_seesawCompatibility_setBroadcastCallback(BroadcastFP broadcastPtr);
+bool DOA_seesawCompatibility_addRegisters(const SeesawRegister *registers, uint8_t count);
 
 void DOA_seesawCompatibility_setDatecode(void) {
   char buf[12];
@@ -171,6 +358,10 @@ void DOA_seesawCompatibility_setDatecode(void) {
 
 bool DOA_seesawCompatibility_begin(void) {
 
+  addressBegin();
+#ifdef CONFIG_INTERRUPT_PIN
+  digitalWriteFast(CONFIG_INTERRUPT_PIN, LOW);
+#endif
   DOA_seesawCompatibility_reset();
 
   Wire.onReceive(receiveData);
@@ -185,7 +376,16 @@ void DOA_seesawCompatibility_reset(void) {
     _seesawResetPtr();
   }
 
-  DPRINTLN(F("Wire end"));
+  seesawGroups = EEPROM.read(CONFIG_GROUPS_EEPROM_ADDR);
+  keyInterruptEnabled = false;
+  updateKeyInterrupt();
+
+  DOA_seesawCompatibility_listen();
+}
+
+// (Re)starts the TWI on the unit's address: its own one (Address.h) or the
+// strap pins'.
+void DOA_seesawCompatibility_listen(void) {
   Wire.end();
 
   uint8_t _i2c_addr = CONFIG_I2C_PERIPH_ADDR;
@@ -215,16 +415,43 @@ void DOA_seesawCompatibility_reset(void) {
     }
   #endif
 
-  DPRINT(F("Wire begin. Address: "));
-  if (_i2c_addr < 16) {
-    DPRINT(F("0"));
+  if (addressOwn != ADDRESS_NONE) {
+    _i2c_addr = addressOwn;
+  }
+
+  // the second address is TWI0.SADDRMASK: the address << 1 with ADDREN
+  // (bit 0) set, as without it the register is an address mask
+  uint8_t enumerationAddr = 0;
+  if (CONFIG_I2C_ENUMERATION && addressEnumerating) {
+    enumerationAddr = (CONFIG_I2C_ENUMERATION_ADDR << 1) | TWI_ADDREN_bm;
   }
-  DPRINTLN(_i2c_addr, HEX);
-  Wire.begin(_i2c_addr);
+
+  TRACE1(TRACE_I2C_BEGIN, ((uint32_t)(enumerationAddr >> 1) << 8) | _i2c_addr);
+  Wire.begin(_i2c_addr, CONFIG_I2C_BROADCAST, enumerationAddr);
 }
 
+// Called from loop(). Does what the I2C receive ISR left for later.
 void DOA_seesawCompatibility_run(void) {
-  // nothing done in this function yet. available for future enhancement.
+  if (seesawGroupsChanged) {
+    seesawGroupsChanged = false;
+    uint8_t groups = seesawGroups;
+    telemetryEEPROMPut(CONFIG_GROUPS_EEPROM_ADDR, groups);
+  }
+  if (seesawListenPending) {
+    seesawListenPending = false;
+    addressSave();
+    DOA_seesawCompatibility_listen();
+  }
+  keyframesCommit();
+}
+
+// True while the controller is expected to read a register it selected.
+bool DOA_seesawCompatibility_busy(unsigned long now) {
+  if (seesawRequestPending &&
+      (uint8_t)((uint8_t)now - seesawRequestMillis) >= SEESAW_REQUEST_TIMEOUT) {
+    seesawRequestPending = false;
+  }
+  return seesawRequestPending;
 }
 
 /**
@@ -249,15 +476,378 @@ void DOA_seesawCompatibility_setEEPROMWriteCallback(EEPROMWriteFP eepromWritePtr
   _eepromWritePtr = eepromWritePtr;
 }
 
+/**
+* Set the callback for the broadcast commands other than the level and sync.
+*/
+void DOA_seesawCompatibility_setBroadcastCallback(BroadcastFP broadcastPtr) {
+  _broadcastPtr = broadcastPtr;
+}
+
+// The big endian uint32 at data.
+uint32_t DOA_seesawCompatibility_read32(const uint8_t *data) {
+  return ((uint32_t)data[0] << 24) | ((uint32_t)data[1] << 16) |
+         ((uint32_t)data[2] << 8) | data[3];
+}
+
+// Takes a DOA_SEESAW_BROADCAST_BASE command: the groups, then size bytes of
+// arguments.
+void DOA_seesawCompatibility_broadcast(uint8_t command, const uint8_t *groups, uint8_t size) {
+  if (!(groups[0] & seesawGroups)) {
+    // for other groups
+    return;
+  }
+  TRACE1(TRACE_BROADCAST, ((uint32_t)command << 8) | groups[0]);
+
+  const uint8_t *arguments = groups + 1;
+  if (command == DOA_SEESAW_BROADCAST_LEVEL) {
+    if (size == 3 && _pwmCallbackPtr != NULL) {
+      _pwmCallbackPtr(arguments[0], ((uint16_t)arguments[1] << 8) | arguments[2]);
+    }
+  } else if (command == DOA_SEESAW_BROADCAST_SYNC) {
+    if (size == 4) {
+      syncReceive(DOA_seesawCompatibility_read32(arguments));
+    }
+  } else if (command == DOA_SEESAW_BROADCAST_ENUMERATE) {
+    if (CONFIG_I2C_ENUMERATION && !addressEnumerating) {
+      addressEnumerate();
+      seesawListenPending = true;
+    }
+  } else if (_broadcastPtr != NULL) {
+    _broadcastPtr(command, arguments, size);
+  }
+}
+
+// --- Register handlers ---
+// A write handler gets the module and the bytes after it (none when the
+// controller only selects the register to read it). A read handler writes
+// the answer.
+
+void seesawSoftwareReset(uint8_t module, const uint8_t *data, uint8_t size) {
+  DOA_seesawCompatibility_reset();
+}
+
+void seesawHardwareIdRead(uint8_t module) {
+  DOA_seesawCompatibility_write8(SEESAW_HW_ID);
+}
+
+void seesawVersionRead(uint8_t module) {
+  DOA_seesawCompatibility_write32(CONFIG_VERSION | DATE_CODE);
+}
+
+// SEESAW_GPIO_BULK, _SET and _CLR: the pins as a uint32.
+void seesawGpioWrite(uint8_t module, const uint8_t *data, uint8_t size) {
+  if (size != 4) {
+    return;
+  }
+  uint32_t pins = DOA_seesawCompatibility_read32(data);
+  if (module == SEESAW_GPIO_BULK) {
+    g_bufferedBulkGPIORead = pins;
+  } else if (module == SEESAW_GPIO_BULK_SET) {
+    g_bufferedBulkGPIORead |= pins;
+  } else {
+    g_bufferedBulkGPIORead &= ~pins;
+  }
+}
+
+void seesawGpioRead(uint8_t module) {
+  DOA_seesawCompatibility_write32(g_bufferedBulkGPIORead);
+}
+
+// SEESAW_KEYPAD_INTENSET and _INTENCLR: bit 0 is the key events' interrupt.
+void seesawKeypadInterruptWrite(uint8_t module, const uint8_t *data, uint8_t size) {
+  if (size == 1 && (data[0] & 0x01)) {
+    keyInterruptEnabled = (module == SEESAW_KEYPAD_INTENSET);
+    updateKeyInterrupt();
+  }
+}
+
+void seesawKeypadCountRead(uint8_t module) {
+  DOA_seesawCompatibility_write8(keyCount);
+}
+
+void seesawKeypadFifoRead(uint8_t module) {
+  while (keyCount > 0) {
+    DOA_seesawCompatibility_write8(dequeueKeyEvent().reg);
+  }
+}
+
+// SEESAW_TIMER_PWM: pin (the channel), level (uint16).
+void seesawPwmWrite(uint8_t module, const uint8_t *data, uint8_t size) {
+  if (size == 3 && _pwmCallbackPtr != NULL) {
+    _pwmCallbackPtr(data[0], ((uint16_t)data[1] << 8) | data[2]);
+  }
+}
+
+void seesawEEPROMWrite(uint8_t module, const uint8_t *data, uint8_t size) {
+  if (_eepromWritePtr != NULL) {
+    _eepromWritePtr(module, data, size);
+  }
+}
+
+void seesawEEPROMRead(uint8_t module) {
+  if (_eepromReadPtr != NULL) {
+    TRACE1(TRACE_EEPROM_READ, module);
+    DOA_seesawCompatibility_write8(_eepromReadPtr(module));
+  } else {
+    TRACE1(TRACE_EEPROM_READ_NO_CALLBACK, module);
+    DOA_seesawCompatibility_write8(0);
+  }
+}
+
+void seesawKeyframesWrite(uint8_t module, const uint8_t *data, uint8_t size) {
+  if (size > 0) {
+    keyframesWrite(module - DOA_SEESAW_KEYFRAMES_PROGRAM, data, size);
+  }
+}
+
+void seesawKeyframesRead(uint8_t module) {
+  uint8_t offset = module - DOA_SEESAW_KEYFRAMES_PROGRAM;
+  for (uint8_t i = 0; i < 32 && offset < KEYFRAMES_PROGRAM_SIZE; i++, offset++) {
+    DOA_seesawCompatibility_write8(keyframesRead(offset));
+  }
+}
+
+void seesawSyncEpochWrite(uint8_t module, const uint8_t *data, uint8_t size) {
+  if (size == 4) {
+    syncReceive(DOA_seesawCompatibility_read32(data));
+  }
+}
+
+void seesawSyncEpochRead(uint8_t module) {
+  DOA_seesawCompatibility_write32(syncMillis());
+}
+
+void seesawSyncErrorRead(uint8_t module) {
+  DOA_seesawCompatibility_write32(syncError);
+}
+
+void seesawAddressWrite(uint8_t module, const uint8_t *data, uint8_t size) {
+  if (size == 1 && !seesawEnumerationCall && addressSet(data[0])) {
+    TRACE1(TRACE_ADDRESS, data[0]);
+    seesawListenPending = true;
+  }
+}
+
+void seesawAddressRead(uint8_t module) {
+  DOA_seesawCompatibility_write8(Wire.getIncomingAddress() >> 1);
+}
+
+void seesawAddressIdRead(uint8_t module) {
+  if (CONFIG_I2C_ENUMERATION && (Wire.getIncomingAddress() >> 1) == CONFIG_I2C_ENUMERATION_ADDR) {
+    if (!addressEnumerating) {
+      // assigned an address and still listening here until loop() moves
+      // the TWI; the released bus leaves the other units' ids alone
+      return;
+    }
+    addressDrawTieBreak();
+  }
+  for (uint8_t i = 0; i < ADDRESS_ID_SIZE; i++) {
+    DOA_seesawCompatibility_write8(addressId(i));
+  }
+}
+
+// DOA_SEESAW_ADDRESS_ASSIGN: id, address.
+void seesawAddressAssignWrite(uint8_t module, const uint8_t *data, uint8_t size) {
+  if (size == ADDRESS_ID_SIZE + 1 && seesawEnumerationCall &&
+      addressAssign(data, data[ADDRESS_ID_SIZE])) {
+    TRACE1(TRACE_ADDRESS, data[ADDRESS_ID_SIZE]);
+    seesawListenPending = true;
+  }
+}
+
+void seesawBroadcastWrite(uint8_t module, const uint8_t *data, uint8_t size) {
+  if (size > 0) {
+    DOA_seesawCompatibility_broadcast(module, data, size - 1);
+  }
+}
+
+void seesawGroupsWrite(uint8_t module, const uint8_t *data, uint8_t size) {
+  if (size == 1 && !seesawGeneralCall) {
+    seesawGroups = data[0];
+    seesawGroupsChanged = true;
+  }
+}
+
+void seesawGroupsRead(uint8_t module) {
+  DOA_seesawCompatibility_write8(seesawGroups);
+}
+
+void seesawTelemetryClearWrite(uint8_t module, const uint8_t *data, uint8_t size) {
+  telemetryClearRequested = true;
+}
+
+void seesawTelemetryCountersRead(uint8_t module) {
+  for (uint8_t counter = module; counter < TELEMETRY_COUNTER_COUNT; counter++) {
+    DOA_seesawCompatibility_write32(telemetryCounters[counter]);
+  }
+}
+
+void seesawTelemetryResetFlagsRead(uint8_t module) {
+  DOA_seesawCompatibility_write8(telemetryResetFlags);
+}
+
+void seesawTelemetryBootTimeRead(uint8_t module) {
+  DOA_seesawCompatibility_write32(telemetryBootToLight);
+}
+
+void seesawPowerMillisRead(uint8_t module) {
+  for (uint8_t mode = module; mode < POWER_MODE_COUNT; mode++) {
+    DOA_seesawCompatibility_write32(powerGetMillis(mode));
+  }
+}
+
+void seesawPowerStandbyCountRead(uint8_t module) {
+  DOA_seesawCompatibility_write32(powerStandbyCount);
+}
+
+#ifdef PROFILER
+void seesawProfilerResetWrite(uint8_t module, const uint8_t *data, uint8_t size) {
+  profilerReset();
+}
+
+void seesawProfilerInfoRead(uint8_t module) {
+  DOA_seesawCompatibility_write8(PROFILER_PHASE_COUNT);
+  DOA_seesawCompatibility_write8(PROFILER_HISTOGRAM_BINS);
+  DOA_seesawCompatibility_write8(PROFILER_HISTOGRAM_SHIFT);
+  DOA_seesawCompatibility_write32(F_CPU);
+}
+
+// DOA_SEESAW_PROFILER_SUMMARY and _HISTOGRAM: the phase is the low nibble.
+void seesawProfilerStatsRead(uint8_t module) {
+  uint8_t phase = module & 0x0F;
+  ProfilerStats stats;
+
+  if (phase >= PROFILER_PHASE_COUNT) {
+    return;
+  }
+  profilerGetStats(phase, &stats);
+  if ((module & 0xF0) == DOA_SEESAW_PROFILER_SUMMARY) {
+    DOA_seesawCompatibility_write32(stats.count);
+    DOA_seesawCompatibility_write32(stats.min);
+    DOA_seesawCompatibility_write32(stats.total); // mean
+    DOA_seesawCompatibility_write32(stats.max);
+  } else {
+    for (uint8_t bin = 0; bin < PROFILER_HISTOGRAM_BINS; bin++) {
+      DOA_seesawCompatibility_write16(stats.histogram[bin]);
+    }
+  }
+}
+#endif
+
+#ifdef CAPTURE
+void seesawCaptureInfoRead(uint8_t module) {
+  DOA_seesawCompatibility_write16(captureUsed);
+  DOA_seesawCompatibility_write16(CAPTURE_BUFFER_SIZE);
+  DOA_seesawCompatibility_write16(captureDropped);
+  DOA_seesawCompatibility_write8(captureFlags);
+}
+
+// DOA_SEESAW_CAPTURE_EEPROM and _DATA: the chunk is the low 5 (EEPROM) or
+// 6 bits.
+void seesawCaptureChunkRead(uint8_t module) {
+  if (module < DOA_SEESAW_CAPTURE_DATA) {
+    uint16_t offset = (uint16_t)(module - DOA_SEESAW_CAPTURE_EEPROM) * 32;
+    for (uint8_t i = 0; i < 32 && offset < EEPROM.length(); i++, offset++) {
+      DOA_seesawCompatibility_write8(EEPROM.read(offset));
+    }
+  } else {
+    uint16_t offset = (uint16_t)(module - DOA_SEESAW_CAPTURE_DATA) * 32;
+    for (uint8_t i = 0; i < 32 && offset < CAPTURE_BUFFER_SIZE; i++, offset++) {
+      DOA_seesawCompatibility_write8(captureBuffer[offset]);
+    }
+  }
+}
+#endif
+
+// The registers, looked up in order: the ones a controller writes while the
+// effects run come first.
+constexpr SeesawRegister seesawRegisters[] = {
+  // base                      first module                     last module                      write                        read
+  {SEESAW_TIMER_BASE,          SEESAW_TIMER_PWM,                SEESAW_TIMER_PWM,                &seesawPwmWrite,             NULL},
+  {DOA_SEESAW_BROADCAST_BASE,  0x00,                            0x0F,                            &seesawBroadcastWrite,       NULL},
+  {DOA_SEESAW_SYNC_BASE,       DOA_SEESAW_SYNC_EPOCH,           DOA_SEESAW_SYNC_EPOCH,           &seesawSyncEpochWrite,       &seesawSyncEpochRead},
+  {SEESAW_KEYPAD_BASE,         SEESAW_KEYPAD_COUNT,             SEESAW_KEYPAD_COUNT,             NULL,                        &seesawKeypadCountRead},
+  {SEESAW_KEYPAD_BASE,         SEESAW_KEYPAD_FIFO,              SEESAW_KEYPAD_FIFO,              NULL,                        &seesawKeypadFifoRead},
+  {SEESAW_GPIO_BASE,           SEESAW_GPIO_BULK,                SEESAW_GPIO_BULK,                &seesawGpioWrite,            &seesawGpioRead},
+  {SEESAW_GPIO_BASE,           SEESAW_GPIO_BULK_SET,            SEESAW_GPIO_BULK_CLR,            &seesawGpioWrite,            NULL},
+  {SEESAW_KEYPAD_BASE,         SEESAW_KEYPAD_INTENSET,          SEESAW_KEYPAD_INTENCLR,          &seesawKeypadInterruptWrite, NULL},
+  {SEESAW_EEPROM_BASE,         0x00,                            0xFF,                            &seesawEEPROMWrite,          &seesawEEPROMRead},
+  {DOA_SEESAW_KEYFRAMES_BASE,  0x00,                            0xFF,                            &seesawKeyframesWrite,       &seesawKeyframesRead},
+  {DOA_SEESAW_SYNC_BASE,       DOA_SEESAW_SYNC_ERROR,           DOA_SEESAW_SYNC_ERROR,           NULL,                        &seesawSyncErrorRead},
+  {DOA_SEESAW_BROADCAST_BASE,  DOA_SEESAW_BROADCAST_GROUPS,     DOA_SEESAW_BROADCAST_GROUPS,     &seesawGroupsWrite,          &seesawGroupsRead},
+  {DOA_SEESAW_ADDRESS_BASE,    DOA_SEESAW_ADDRESS_ADDRESS,      DOA_SEESAW_ADDRESS_ADDRESS,      &seesawAddressWrite,         &seesawAddressRead},
+  {DOA_SEESAW_ADDRESS_BASE,    DOA_SEESAW_ADDRESS_ID,           DOA_SEESAW_ADDRESS_ID,           NULL,                        &seesawAddressIdRead},
+  {DOA_SEESAW_ADDRESS_BASE,    DOA_SEESAW_ADDRESS_ASSIGN,       DOA_SEESAW_ADDRESS_ASSIGN,       &seesawAddressAssignWrite,   NULL},
+  {SEESAW_STATUS_BASE,         SEESAW_STATUS_HW_ID,             SEESAW_STATUS_HW_ID,             NULL,                        &seesawHardwareIdRead},
+  {SEESAW_STATUS_BASE,         SEESAW_STATUS_VERSION,           SEESAW_STATUS_VERSION,           NULL,                        &seesawVersionRead},
+  {SEESAW_STATUS_BASE,         SEESAW_STATUS_SWRST,             SEESAW_STATUS_SWRST,             &seesawSoftwareReset,        NULL},
+  {DOA_SEESAW_TELEMETRY_BASE,  DOA_SEESAW_TELEMETRY_COUNTERS,   0x0F,                            NULL,                        &seesawTelemetryCountersRead},
+  {DOA_SEESAW_TELEMETRY_BASE,  DOA_SEESAW_TELEMETRY_RESET_FLAGS, DOA_SEESAW_TELEMETRY_RESET_FLAGS, NULL,                      &seesawTelemetryResetFlagsRead},
+  {DOA_SEESAW_TELEMETRY_BASE,  DOA_SEESAW_TELEMETRY_BOOT_TIME,  DOA_SEESAW_TELEMETRY_BOOT_TIME,  NULL,                        &seesawTelemetryBootTimeRead},
+  {DOA_SEESAW_TELEMETRY_BASE,  DOA_SEESAW_TELEMETRY_CLEAR,      DOA_SEESAW_TELEMETRY_CLEAR,      &seesawTelemetryClearWrite,  NULL},
+  {DOA_SEESAW_POWER_BASE,      DOA_SEESAW_POWER_MILLIS,         0x0F,                            NULL,                        &seesawPowerMillisRead},
+  {DOA_SEESAW_POWER_BASE,      DOA_SEESAW_POWER_STANDBY_COUNT,  DOA_SEESAW_POWER_STANDBY_COUNT,  NULL,                        &seesawPowerStandbyCountRead},
+#ifdef PROFILER
+  {DOA_SEESAW_PROFILER_BASE,   DOA_SEESAW_PROFILER_INFO,        DOA_SEESAW_PROFILER_INFO,        NULL,                        &seesawProfilerInfoRead},
+  {DOA_SEESAW_PROFILER_BASE,   DOA_SEESAW_PROFILER_SUMMARY,     DOA_SEESAW_PROFILER_HISTOGRAM + 0x0F, NULL,                   &seesawProfilerStatsRead},
+  {DOA_SEESAW_PROFILER_BASE,   DOA_SEESAW_PROFILER_RESET,       DOA_SEESAW_PROFILER_RESET,       &seesawProfilerResetWrite,   NULL},
+#endif
+#ifdef CAPTURE
+  {DOA_SEESAW_CAPTURE_BASE,    DOA_SEESAW_CAPTURE_INFO,         DOA_SEESAW_CAPTURE_INFO,         NULL,                        &seesawCaptureInfoRead},
+  {DOA_SEESAW_CAPTURE_BASE,    DOA_SEESAW_CAPTURE_EEPROM,       DOA_SEESAW_CAPTURE_DATA + 0x3F,  NULL,                        &seesawCaptureChunkRead},
+#endif
+};
+
+#define SEESAW_REGISTER_COUNT (sizeof(seesawRegisters) / sizeof(seesawRegisters[0]))
+
+/**
+* Add a block of registers of the sketch's own. Call before
+* DOA_seesawCompatibility_begin(); the table has to stay around. Returns
+* false when CONFIG_SEESAW_REGISTER_BLOCKS are already added.
+*/
+bool DOA_seesawCompatibility_addRegisters(const SeesawRegister *registers, uint8_t count) {
+  if (seesawBlockCount == CONFIG_SEESAW_REGISTER_BLOCKS) {
+    return false;
+  }
+  seesawBlocks[seesawBlockCount].registers = registers;
+  seesawBlocks[seesawBlockCount].count = count;
+  seesawBlockCount++;
+  return true;
+}
+
+const SeesawRegister *seesawFind(const SeesawRegister *registers, uint8_t count, uint8_t base, uint8_t module) {
+  for (uint8_t i = 0; i < count; i++) {
+    const SeesawRegister *reg = &registers[i];
+    if (reg->base == base && module >= reg->first && module <= reg->last) {
+      return reg;
+    }
+  }
+  return NULL;
+}
+
+// The register of base and module, NULL if there is none.
+const SeesawRegister *seesawLookup(uint8_t base, uint8_t module) {
+  const SeesawRegister *reg = seesawFind(seesawRegisters, SEESAW_REGISTER_COUNT, base, module);
+  for (uint8_t i = 0; reg == NULL && i < seesawBlockCount; i++) {
+    reg = seesawFind(seesawBlocks[i].registers, seesawBlocks[i].count, base, module);
+  }
+  return reg;
+}
+
 // --- I2C support ---
 void receiveData(int numBytes) {
-  for (uint8_t i = numBytes; i < sizeof(i2c_buffer); i++) {
-    i2c_buffer[i] = 0;
-  }
+  PROFILE_SCOPE(PROFILE_I2C_RECEIVE);
+
+  // loop() has to look at what was received before sleeping again
+  powerInterrupt();
+  clockBusy();
+
+  seesawSelected = NULL;
 
   // check to see if number of bytes received is more than allocated in the buffer
   if ((uint32_t)numBytes > sizeof(i2c_buffer)) {
-    DPRINTLN(F("Requested more bytes than allocated in the buffer."));
+    TRACE1(TRACE_I2C_OVERRUN, numBytes);
+    telemetryIncrement(TELEMETRY_I2C_OVERRUNS);
     return;
   }
 
@@ -265,95 +855,55 @@ void receiveData(int numBytes) {
   for (uint8_t i = 0; i < numBytes; i++) {
     i2c_buffer[i] = Wire.read();
   }
+  if (numBytes < 2) {
+    return;
+  }
 
   uint8_t base_cmd = i2c_buffer[0];
   uint8_t module_cmd = i2c_buffer[1];
+  seesawGeneralCall = Wire.getIncomingAddress() == 0;
+  seesawEnumerationCall = CONFIG_I2C_ENUMERATION &&
+                          (Wire.getIncomingAddress() >> 1) == CONFIG_I2C_ENUMERATION_ADDR;
 
-  if (base_cmd == SEESAW_STATUS_BASE) {
-    if (module_cmd == SEESAW_STATUS_SWRST) {
-      DOA_seesawCompatibility_reset();
-      DPRINTLN(F("Resetting"));
-    }
-  } else if (base_cmd == SEESAW_GPIO_BASE) {
-    uint32_t temp;
-    temp = i2c_buffer[2];
-    temp <<= 8;
-    temp |= i2c_buffer[3];
-    temp <<= 8;
-    temp |= i2c_buffer[4];
-    temp <<= 8;
-    temp |= i2c_buffer[5];
-
-    switch (module_cmd) {
-      case SEESAW_GPIO_BULK:
-        g_bufferedBulkGPIORead = temp;
-        break;
-
-      case SEESAW_GPIO_BULK_SET:
-      case SEESAW_GPIO_BULK_CLR:
-        for (uint8_t pin = 0; pin < 32; pin++) {
-          if ((temp >> pin) & 0x1) {
-            if (module_cmd == SEESAW_GPIO_BULK_SET) {
-              g_bufferedBulkGPIORead |= (1UL << pin);
-            } else if (module_cmd == SEESAW_GPIO_BULK_CLR) {
-              g_bufferedBulkGPIORead &= ~(1UL << pin);
-            }
-          }
-        }
-    }
-  } else if (base_cmd == SEESAW_TIMER_BASE) {
-    if (module_cmd == SEESAW_TIMER_PWM) {
-      uint8_t pin = i2c_buffer[2];
-      uint16_t value = ((uint16_t)i2c_buffer[3] << 8) | i2c_buffer[4];
-      if (_pwmCallbackPtr != NULL) {
-        _pwmCallbackPtr(pin, value);
-      }
-    }
-  } else if (base_cmd == SEESAW_EEPROM_BASE) {
-    if (_eepromWritePtr != NULL) {
-      for (int i = 0; i < numBytes - 2; i++) {
-        buffer[i] = i2c_buffer[i+2];
-      }
-      _eepromWritePtr(module_cmd, buffer, numBytes - 2);
-    }
+  if (seesawGeneralCall && base_cmd != DOA_SEESAW_BROADCAST_BASE) {
+    // meant for other devices on the bus (0x06 is the I2C reset)
+    return;
+  }
+  if (seesawEnumerationCall && base_cmd != DOA_SEESAW_ADDRESS_BASE) {
+    // every enumerating unit gets it
+    return;
+  }
+  if (base_cmd != DOA_SEESAW_CAPTURE_BASE) {
+    CAPTURE_RECEIVE(Wire.getIncomingAddress() >> 1, i2c_buffer, numBytes);
+  }
+
+  if (numBytes == 2 && !seesawGeneralCall) {
+    seesawRequestPending = true;
+    seesawRequestMillis = millis();
+  }
+
+  const SeesawRegister *reg = seesawLookup(base_cmd, module_cmd);
+  if (reg == NULL) {
+    return;
+  }
+  seesawSelected = reg;
+  if (reg->write != NULL) {
+    reg->write(module_cmd, &i2c_buffer[2], numBytes - 2);
   }
 }
 
 void requestData(void) {
-  uint8_t base_cmd = i2c_buffer[0];
-  uint8_t module_cmd = i2c_buffer[1];
+  PROFILE_SCOPE(PROFILE_I2C_REQUEST);
 
-  if (base_cmd == SEESAW_STATUS_BASE) {
-    if (module_cmd == SEESAW_STATUS_HW_ID) {
-      Wire.write(SEESAW_HW_ID);
-    }
-    if (module_cmd == SEESAW_STATUS_VERSION) {
-      DOA_seesawCompatibility_write32(CONFIG_VERSION | DATE_CODE);
-    }
-  } else if (base_cmd == SEESAW_GPIO_BASE) {
-    if (module_cmd == SEESAW_GPIO_BULK) {
-      DOA_seesawCompatibility_write32(g_bufferedBulkGPIORead);
-    }
-  } else if (base_cmd == SEESAW_KEYPAD_BASE) {
-    if (module_cmd == SEESAW_KEYPAD_COUNT) {
-      DOA_seesawCompatibility_write8(keyCount);
-    } else if (module_cmd == SEESAW_KEYPAD_FIFO) {
-      while (keyCount > 0) {
-        DOA_seesawCompatibility_write8(dequeueKeyEvent().reg);
-      }
-    }
-  } else if (base_cmd == SEESAW_EEPROM_BASE) {
-    if (_eepromReadPtr != NULL) {
-      DPRINT("Reading EEPROM address ");
-      DPRINTLN(module_cmd);
-      DOA_seesawCompatibility_write8(_eepromReadPtr(module_cmd));
-    } else {
-      DPRINT("Would be reading EEPROM address ");
-      DPRINT(module_cmd);
-      DPRINTLN(" if callback was configured.");
-      DOA_seesawCompatibility_write8(0);
-    }
+  seesawRequestPending = false;
+
+  const SeesawRegister *reg = seesawSelected;
+  if (reg == NULL || reg->base != DOA_SEESAW_CAPTURE_BASE) {
+    CAPTURE_REQUEST(Wire.getIncomingAddress() >> 1);
+  }
+  if (reg != NULL && reg->read != NULL) {
+    reg->read(i2c_buffer[1]);
   }
 }
 
-#endif
\ No newline at end of file
+#endif
@@ -1,6 +1,30 @@
+//***************************************************************
+// Incipit11 controller.
+//
+// Button:
+//   click         next ambient effect, saved once it has settled for 15 s
+//   double click  run the trigger
+//   long press    record the trigger: after four yellow blinks the status
+//                 LED turns red and what is done to channel 0 is recorded.
+//                 A click steps the effect and is recorded with the rest;
+//                 a long press stops the recording. (A click used to stop
+//                 it.)
+//
+// The trigger input runs the triggered effect, or replays the recording,
+// for the triggered length.
+//***************************************************************
+
 #define DEBUG  // comment out to turn off debug serial output
 #include "DebugMacros.h"
 
+//#define PROFILER // uncomment to measure loop() phases and I2C callbacks in cycles
+//#define CAPTURE // uncomment to record inputs, seesaw commands and what they did for replay on the host (Capture.h)
+//#define POWER_SAVE // uncomment to sleep between loop() passes (only measured in the host simulator so far)
+//#define CLOCK_SCALING // uncomment to lower the CPU clock while loop() idles (Clock.h, only measured in the host simulator so far)
+//#define OUTPUT_MAX_SLEW 16 // uncomment to limit output changes to this many brightness steps per millisecond
+#define OUTPUT_CHANNELS 1 // PWM outputs running their own effect (the pins are listed in PwmOutputs)
+//#define PIXEL_STRIP 8 // uncomment to show channel 0's effect on this many NeoPixels after the status pixel
+
 //
 // Adafruit Seesaw compatibility
 //
@@ -18,12 +42,24 @@ volatile uint32_t g_bufferedBulkGPIORead = 0;
 #define CONFIG_ADDR_0_PIN PIN_PA1
 #define CONFIG_ADDR_1_PIN PIN_PA2
 #define CONFIG_ADDR_2_PIN PIN_PA3
+#define CONFIG_INTERRUPT_PIN PIN_PB3 // RX: keypad interrupt (the debug serial port only sends); comment out to leave RX alone
+#define CONFIG_I2C_BROADCAST // comment out to ignore the broadcast commands sent to the general call address
+//#define CONFIG_I2C_ENUMERATION_ADDR 0x61 // uncomment to answer on this address (the SMBus ARP default) for enumeration while the unit has no address of its own (only run in the host simulator so far)
 
 #include "DOA_seesawCompatibility.h"
 // end Adafruit Seesaw compatibility
 
 #include "Effect.h"
+#include "Modulator.h"
+#include "Keyframes.h"
+#include "Recording.h"
+#include "Channels.h"
 #include "StateMachine.h"
+#include "StatusLed.h"
+#ifdef PIXEL_STRIP
+  #include "PixelStrip.h"
+#endif
+#include "Trace.h"
 
 #include <tinyNeoPixel_Static.h>
 #include <OneButton.h>
@@ -35,13 +71,21 @@ volatile uint32_t g_bufferedBulkGPIORead = 0;
 #define TX         PIN_PB2
 #define RX         PIN_PB3
 
+#if defined(DEBUG) && defined(CONFIG_INTERRUPT_PIN) && CONFIG_INTERRUPT_PIN == TX
+  #error "the debug serial port sends on TX; turn DEBUG off for the keypad interrupt on it"
+#endif
+
 #define PIN_BUTTON  PIN_PA4
 #define PIN_TRIGGER PIN_PA6
 
 const uint32_t MILLIS_30_MINUTES = 1800000L;
 const uint32_t MILLIS_10_SECONDS = 10000L;
 
-#define NUMLEDS 1
+#ifdef PIXEL_STRIP
+  #define NUMLEDS (1 + PIXEL_STRIP)
+#else
+  #define NUMLEDS 1
+#endif
 byte pixels[NUMLEDS * 3];
 tinyNeoPixel leds = tinyNeoPixel(NUMLEDS, NEOPIXEL, NEO_GRB, pixels);
 
@@ -90,43 +134,52 @@ unsigned long previousMillis = 0;
 const long interval = 1000; // 1 second duration for testing
 const long stepInterval = 25;
 
-const uint8_t recordingPrepLength = 4;
-const long recordingPrepOn = 200; // milliseconds on
-const long recordingPrepOff = 1000 - recordingPrepOn; // milliseconds off
-uint8_t recordingPrepState = false; // on (true) or off (false)
-uint8_t recordingPrepCount = 0;
+const uint8_t recordingPrepLength = 4; // blinks
+const uint16_t recordingPrepOn = 200; // milliseconds on
+const uint16_t recordingPrepOff = 1000 - recordingPrepOn; // milliseconds off
 
 // Wait for the effect change to "settle" before writing to EEPROM
 const uint32_t ambientEffectSettleTime = 15000; // milliseconds; 15 seconds
 
 bool ambientEffectSaved = true; // start with the effect saved to EEPROM
 
+// Ambient effects written over seesaw or selected by a broadcast
+// (DOA_SEESAW_BROADCAST_EFFECT) for loop() to switch to, EFFECTS_COUNT when
+// there is none.
+volatile uint8_t selectedEffect[OUTPUT_CHANNELS];
+
+// Channel 0 as last recorded (Recording.h) or replayed: the level set by the
+// seesaw controller while it drives the channel.
+bool recordedPeripheral = false;
+uint8_t recordedLevel = 0;
+bool replayPeripheral = false;
+
 void fClicked() {
-  DPRINTLN("Click.");
+  TRACE(TRACE_BUTTON_CLICK);
   BUTTON_FLAG_SET(FLAG_BUTTON_CLICKED);
   enqueueKeyEvent(buttonClickedEvent);
 }
 
 void fPressed() {
-  DPRINTLN("Pressed.");
+  TRACE(TRACE_BUTTON_PRESS);
   BUTTON_FLAG_SET(FLAG_BUTTON_PRESSED);
   enqueueKeyEvent(buttonPressedEvent);
 }
 
 void fTriggerPressed() {
-  DPRINTLN("Trigger pressed.");
+  TRACE(TRACE_TRIGGER_PRESS);
   BUTTON_FLAG_SET(FLAG_TRIGGER_PRESSED);
   enqueueKeyEvent(triggerPressedEvent);
 }
 
 void fDoubleClick() {
-  DPRINTLN("Double click.");
+  TRACE(TRACE_BUTTON_DOUBLE_CLICK);
   BUTTON_FLAG_SET(FLAG_BUTTON_DOUBLE_CLICKED);
   enqueueKeyEvent(buttonDoubleClickedEvent);
 }
 
 void fLongPressStart() {
-  DPRINTLN("Long press start.");
+  TRACE(TRACE_BUTTON_LONG_PRESS_START);
   BUTTON_FLAG_SET(FLAG_BUTTON_LONG_PRESS_STARTED);
   enqueueKeyEvent(triggerPressedEvent);
 }
@@ -140,12 +193,10 @@ void clearButtons() {
 //
 // Peripheral mode (set by seesaw controller setting an output value)
 
-bool peripheralMode = false;
-
-// Special peripheral effect for when in peripheral mode.
-// This effect is not added to the effects array as it is not part of the
-// standard set of effects.
-Dimmer peripheralDimmer = Dimmer(PWM_OUTPUT);
+// The PWM outputs, one per channel. Extra channels go on the free TCA0 pins,
+// e.g. OutputBank<PWM_OUTPUT, PIN_PB0, PIN_PB1>.
+typedef OutputBank<PWM_OUTPUT> PwmOutputs;
+static_assert(PwmOutputs::CHANNELS == OUTPUT_CHANNELS, "OUTPUT_CHANNELS doesn't match PwmOutputs");
 
 /*
  **********
@@ -188,361 +239,408 @@ const uint8_t SINE_WAVE_MIN_40_3 = 32;
 const uint8_t HEARTBEAT_1 = 0;
 const uint8_t HEARTBEAT_2 = 1;
 const uint8_t HEARTBEAT_3 = 2;
-const uint8_t EFFECTS_COUNT = 35; // keep this at the end
+const uint8_t KEYFRAMES = 35; // uploaded through DOA_SEESAW_KEYFRAMES_BASE
+const uint8_t EFFECTS_COUNT = 36; // keep this at the end
 
 const uint8_t DEFAULT_EFFECT = 0;   // there should always be an effect with index 0
 
-uint8_t ambientEffect = DEFAULT_EFFECT;
-uint8_t triggeredEffect = DEFAULT_EFFECT;
+// per channel; the button and the trigger recording work on channel 0
+uint8_t ambientEffect[OUTPUT_CHANNELS];
+uint8_t triggeredEffect[OUTPUT_CHANNELS];
 uint32_t triggeredLengthMillis = 0;
 
 // EEPROM Addresses
+// (the telemetry counters are saved at CONFIG_TELEMETRY_EEPROM_ADDR)
 const int ADDR_AMBIENT_EFFECT = 0;
-const int ADDR_TRIGGERED_EFFECT = ADDR_AMBIENT_EFFECT + sizeof(ambientEffect);
-const int ADDR_TRIGGERED_LENGTH = ADDR_TRIGGERED_EFFECT + sizeof(triggeredEffect);
-
-Effect *effects[EFFECTS_COUNT];
-uint8_t currentEffect = EFFECTS_COUNT;
-
-Dimmer dimmer0 = Dimmer(PWM_OUTPUT);
-Dimmer dimmer20 = Dimmer(PWM_OUTPUT);
-Dimmer dimmer40 = Dimmer(PWM_OUTPUT);
-Dimmer dimmer60 = Dimmer(PWM_OUTPUT);
-Dimmer dimmer80 = Dimmer(PWM_OUTPUT);
-Dimmer dimmer100 = Dimmer(PWM_OUTPUT);
-Dimmer strobe1 = Dimmer(PWM_OUTPUT);
-Dimmer strobe3 = Dimmer(PWM_OUTPUT);
-Dimmer strobe7 = Dimmer(PWM_OUTPUT);
-Dimmer strobe12 = Dimmer(PWM_OUTPUT);
-Dimmer strobe20 = Dimmer(PWM_OUTPUT);
-Sparkle sparkle1 = Sparkle(PWM_OUTPUT);
-Sparkle sparkle2 = Sparkle(PWM_OUTPUT);
-Sparkle sparkle3 = Sparkle(PWM_OUTPUT);
-FlickerOff flickerOff1 = FlickerOff(PWM_OUTPUT);
-FlickerOff flickerOff2 = FlickerOff(PWM_OUTPUT);
-FlickerOff flickerOff3 = FlickerOff(PWM_OUTPUT);
-FlickerOn flickerOnFast1 = FlickerOn(PWM_OUTPUT);
-FlickerOn flickerOnFast2 = FlickerOn(PWM_OUTPUT);
-FlickerOn flickerOnFast3 = FlickerOn(PWM_OUTPUT);
-FlickerOn flickerOnSlow1 = FlickerOn(PWM_OUTPUT);
-FlickerOn flickerOnSlow2 = FlickerOn(PWM_OUTPUT);
-FlickerOn flickerOnSlow3 = FlickerOn(PWM_OUTPUT);
-SineWave sineWave1 = SineWave(PWM_OUTPUT);
-SineWave sineWave2 = SineWave(PWM_OUTPUT);
-SineWave sineWave3 = SineWave(PWM_OUTPUT);
-SineWave sineWaveMin201 = SineWave(PWM_OUTPUT);
-SineWave sineWaveMin202 = SineWave(PWM_OUTPUT);
-SineWave sineWaveMin203 = SineWave(PWM_OUTPUT);
-SineWave sineWaveMin401 = SineWave(PWM_OUTPUT);
-SineWave sineWaveMin402 = SineWave(PWM_OUTPUT);
-SineWave sineWaveMin403 = SineWave(PWM_OUTPUT);
-Heartbeat heartbeat1 = Heartbeat(PWM_OUTPUT);
-Heartbeat heartbeat2 = Heartbeat(PWM_OUTPUT);
-Heartbeat heartbeat3 = Heartbeat(PWM_OUTPUT);
-
-void logCurrentEffect() {
-  switch (currentEffect) {
-    case CONSTANT_0:
-      DPRINTLN("Current effect: CONSTANT_0");
-      break;
-
-    case CONSTANT_20:
-      DPRINTLN("Current effect: CONSTANT_20");
-      break;
-
-    case CONSTANT_40:
-      DPRINTLN("Current effect: CONSTANT_40");
-      break;
-
-    case CONSTANT_60:
-      DPRINTLN("Current effect: CONSTANT_60");
-      break;
-
-    case CONSTANT_80:
-      DPRINTLN("Current effect: CONSTANT_80");
-      break;
-
-    case CONSTANT_100:
-      DPRINTLN("Current effect: CONSTANT_100");
-      break;
-
-    case STROBE_1:
-      DPRINTLN("Current effect: STROBE_1");
-      break;
-
-    case STROBE_3:
-      DPRINTLN("Current effect: STROBE_3");
-      break;
-
-    case STROBE_7:
-      DPRINTLN("Current effect: STROBE_7");
-      break;
-
-    case STROBE_12:
-      DPRINTLN("Current effect: STROBE_12");
-      break;
-
-    case STROBE_20:
-      DPRINTLN("Current effect: STROBE_20");
-      break;
-
-    case SPARKLE_1:
-      DPRINTLN("Current effect: SPARKLE_1");
-      break;
-
-    case SPARKLE_2:
-      DPRINTLN("Current effect: SPARKLE_2");
-      break;
-
-    case SPARKLE_3:
-      DPRINTLN("Current effect: SPARKLE_3");
-      break;
-
-    case FLICKER_OFF_1:
-      DPRINTLN("Current effect: FLICKER_OFF_1");
-      break;
-
-    case FLICKER_OFF_2:
-      DPRINTLN("Current effect: FLICKER_OFF_2");
-      break;
-
-    case FLICKER_OFF_3:
-      DPRINTLN("Current effect: FLICKER_OFF_3");
-      break;
-
-    case FLICKER_ON_FAST_1:
-      DPRINTLN("Current effect: FLICKER_ON_FAST_1");
-      break;
-
-    case FLICKER_ON_FAST_2:
-      DPRINTLN("Current effect: FLICKER_ON_FAST_2");
-      break;
-
-    case FLICKER_ON_FAST_3:
-      DPRINTLN("Current effect: FLICKER_ON_FAST_3");
-      break;
-
-    case FLICKER_ON_SLOW_1:
-      DPRINTLN("Current effect: FLICKER_ON_SLOW_1");
-      break;
-
-    case FLICKER_ON_SLOW_2:
-      DPRINTLN("Current effect: FLICKER_ON_SLOW_2");
-      break;
-
-    case FLICKER_ON_SLOW_3:
-      DPRINTLN("Current effect: FLICKER_ON_SLOW_3");
-      break;
-
-    case SINE_WAVE_1:
-      DPRINTLN("Current effect: SINE_WAVE_1");
-      break;
-
-    case SINE_WAVE_2:
-      DPRINTLN("Current effect: SINE_WAVE_2");
-      break;
-
-    case SINE_WAVE_3:
-      DPRINTLN("Current effect: SINE_WAVE_3");
-      break;
-
-    case SINE_WAVE_MIN_20_1:
-      DPRINTLN("Current effect: SINE_WAVE_MIN_20_1");
-      break;
-
-    case SINE_WAVE_MIN_20_2:
-      DPRINTLN("Current effect: SINE_WAVE_MIN_20_2");
-      break;
-
-    case SINE_WAVE_MIN_20_3:
-      DPRINTLN("Current effect: SINE_WAVE_MIN_20_3");
-      break;
-
-    case SINE_WAVE_MIN_40_1:
-      DPRINTLN("Current effect: SINE_WAVE_MIN_40_1");
-      break;
-
-    case SINE_WAVE_MIN_40_2:
-      DPRINTLN("Current effect: SINE_WAVE_MIN_40_2");
-      break;
-
-    case SINE_WAVE_MIN_40_3:
-      DPRINTLN("Current effect: SINE_WAVE_MIN_40_3");
-      break;
-
-    case HEARTBEAT_1:
-      DPRINTLN("Current effect: HEARTBEAT_1");
-      break;
-
-    case HEARTBEAT_2:
-      DPRINTLN("Current effect: HEARTBEAT_2");
-      break;
-
-    case HEARTBEAT_3:
-      DPRINTLN("Current effect: HEARTBEAT_3");
-      break;
-
-    default:
-      DPRINT("Current effect (unknown): ");
-      DPRINTLN(currentEffect);
-      break;
+const int ADDR_TRIGGERED_EFFECT = ADDR_AMBIENT_EFFECT + sizeof(uint8_t);
+const int ADDR_TRIGGERED_LENGTH = ADDR_TRIGGERED_EFFECT + sizeof(uint8_t);
+const int ADDR_CHANNEL_EFFECTS = 0x10; // ambient and triggered effect of channels 1 and up
+
+// EEPROM address of the ambient effect of a channel. The triggered effect
+// is the next byte.
+int channelEffectsAddress(uint8_t channel) {
+  if (channel == 0) {
+    return ADDR_AMBIENT_EFFECT;
   }
+  return ADDR_CHANNEL_EFFECTS + 2 * (channel - 1);
 }
 
-void intializeEffects() {
-  dimmer0.setBrightness(0); // off
-  effects[CONSTANT_0] = &dimmer0;
-
-  dimmer20.setBrightness(51); // ~20%
-  effects[CONSTANT_20] = &dimmer20;
-
-  dimmer40.setBrightness(102); // ~40%
-  effects[CONSTANT_40] = &dimmer40;
-
-  dimmer60.setBrightness(153); // ~60%
-  effects[CONSTANT_60] = &dimmer60;
-
-  dimmer80.setBrightness(204); // ~80%
-  effects[CONSTANT_80] = &dimmer80;
-
-  dimmer100.setBrightness(255); // 100%
-  effects[CONSTANT_100] = &dimmer100;
-
-  strobe1.setBrightness(255); // 100%
-  strobe1.setStrobe(1); // 1 Hz
-  effects[STROBE_1] = &strobe1;
-
-  strobe3.setBrightness(255); // 100%
-  strobe3.setStrobe(3); // 3 Hz
-  effects[STROBE_3] = &strobe3;
-
-  strobe7.setBrightness(255); // 100%
-  strobe7.setStrobe(7); // 7 Hz
-  effects[STROBE_7] = &strobe7;
-
-  strobe12.setBrightness(255); // 100%
-  strobe12.setStrobe(12); // 12 Hz
-  effects[STROBE_12] = &strobe12;
-
-  strobe20.setBrightness(255); // 100%
-  strobe20.setStrobe(20); // 20 Hz
-  effects[STROBE_20] = &strobe20;
-
-  sparkle1.setBrightness(255); // 100%
-  sparkle1.setIntensity(1);
-  effects[SPARKLE_1] = &sparkle1;
-
-  sparkle2.setBrightness(255); // 100%
-  sparkle2.setIntensity(2);
-  effects[SPARKLE_2] = &sparkle2;
-
-  sparkle3.setBrightness(255); // 100%
-  sparkle3.setIntensity(3);
-  effects[SPARKLE_3] = &sparkle3;
-
-  effects[FLICKER_OFF_1] = &flickerOff1;
-
-  flickerOff2.setBrightness(158);
-  effects[FLICKER_OFF_2] = &flickerOff2;
-
-  flickerOff3.setBrightness(50);
-  effects[FLICKER_OFF_3] = &flickerOff3;
-
-  effects[FLICKER_ON_FAST_1] = &flickerOnFast1;
-
-  flickerOnFast2.setBaseBrightness(51); // ~20%
-  effects[FLICKER_ON_FAST_2] = &flickerOnFast2;
-
-  flickerOnFast3.setBaseBrightness(102); // ~40%
-  effects[FLICKER_ON_FAST_3] = &flickerOnFast3;
-
-  flickerOnSlow1.setIntensity(50);
-  flickerOnSlow1.setThreshold(46);
-  effects[FLICKER_ON_SLOW_1] = &flickerOnSlow1;
-
-  flickerOnSlow2.setBaseBrightness(51); // ~20%
-  flickerOnSlow2.setIntensity(50);
-  flickerOnSlow2.setThreshold(46);
-  effects[FLICKER_ON_SLOW_2] = &flickerOnSlow2;
-
-  flickerOnSlow3.setBaseBrightness(102); // ~40%
-  flickerOnSlow3.setIntensity(50);
-  flickerOnSlow3.setThreshold(46);
-  effects[FLICKER_ON_SLOW_3] = &flickerOnSlow3;
-
-  sineWave1.setFrequency(2);
-  effects[SINE_WAVE_1] = &sineWave1;
-
-  sineWave2.setFrequency(1, 2);
-  effects[SINE_WAVE_2] = &sineWave2;
-
-  sineWave3.setFrequency(1, 4);
-  effects[SINE_WAVE_3] = &sineWave3;
-
-  sineWaveMin201.setFrequency(1);
-  sineWaveMin201.setMinimumBrightness(51); // ~20%
-  effects[SINE_WAVE_MIN_20_1] = &sineWaveMin201;
-
-  sineWaveMin202.setFrequency(1, 2);
-  sineWaveMin202.setMinimumBrightness(51); // ~20%
-  effects[SINE_WAVE_MIN_20_2] = &sineWaveMin202;
-
-  sineWaveMin203.setFrequency(1, 4);
-  sineWaveMin203.setMinimumBrightness(51); // ~20%
-  effects[SINE_WAVE_MIN_20_3] = &sineWaveMin203;
-
-  sineWaveMin401.setFrequency(1);
-  sineWaveMin401.setMinimumBrightness(102); // ~40%
-  effects[SINE_WAVE_MIN_40_1] = &sineWaveMin401;
-
-  sineWaveMin402.setFrequency(1, 2);
-  sineWaveMin402.setMinimumBrightness(102); // ~40%
-  effects[SINE_WAVE_MIN_40_2] = &sineWaveMin402;
+Effect *effects[EFFECTS_COUNT];
+uint8_t currentEffect[OUTPUT_CHANNELS];
 
-  sineWaveMin403.setFrequency(1, 4);
-  sineWaveMin403.setMinimumBrightness(102); // ~40%
-  effects[SINE_WAVE_MIN_40_3] = &sineWaveMin403;
+//
+// Effect programs (see Modulator.h), one per effect
+//
 
-  heartbeat1.setBrightness(0);
-  heartbeat1.setSpace(500); // 1/2 second
-  effects[HEARTBEAT_1] = &heartbeat1;
+// constant off
+const ModStage dimmer0Program[] = {
+  { MOD_LEVEL, 0, 0, 0 },
+  { MOD_END, 0, 0, 0 },
+};
+
+// constant ~20%
+const ModStage dimmer20Program[] = {
+  { MOD_LEVEL, 51, 0, 0 },
+  { MOD_END, 0, 0, 0 },
+};
+
+// constant ~40%
+const ModStage dimmer40Program[] = {
+  { MOD_LEVEL, 102, 0, 0 },
+  { MOD_END, 0, 0, 0 },
+};
+
+// constant ~60%
+const ModStage dimmer60Program[] = {
+  { MOD_LEVEL, 153, 0, 0 },
+  { MOD_END, 0, 0, 0 },
+};
+
+// constant ~80%
+const ModStage dimmer80Program[] = {
+  { MOD_LEVEL, 204, 0, 0 },
+  { MOD_END, 0, 0, 0 },
+};
+
+// constant 100%
+const ModStage dimmer100Program[] = {
+  { MOD_LEVEL, 255, 0, 0 },
+  { MOD_END, 0, 0, 0 },
+};
+
+// strobe at 1 Hz: on and off for half a period each
+const ModStage strobe1Program[] = {
+  { MOD_LEVEL, 255, 0, 0 },
+  { MOD_GATE, 0, 0, 0 },
+  { MOD_HOLD, 0, 0, 500 },
+  { MOD_END, 0, 0, 0 },
+};
+
+// strobe at 3 Hz: on and off for half a period each
+const ModStage strobe3Program[] = {
+  { MOD_LEVEL, 255, 0, 0 },
+  { MOD_GATE, 0, 0, 0 },
+  { MOD_HOLD, 0, 0, 166 },
+  { MOD_END, 0, 0, 0 },
+};
+
+// strobe at 7 Hz: on and off for half a period each
+const ModStage strobe7Program[] = {
+  { MOD_LEVEL, 255, 0, 0 },
+  { MOD_GATE, 0, 0, 0 },
+  { MOD_HOLD, 0, 0, 71 },
+  { MOD_END, 0, 0, 0 },
+};
+
+// strobe at 12 Hz: on and off for half a period each
+const ModStage strobe12Program[] = {
+  { MOD_LEVEL, 255, 0, 0 },
+  { MOD_GATE, 0, 0, 0 },
+  { MOD_HOLD, 0, 0, 41 },
+  { MOD_END, 0, 0, 0 },
+};
+
+// strobe at 20 Hz: on and off for half a period each
+const ModStage strobe20Program[] = {
+  { MOD_LEVEL, 255, 0, 0 },
+  { MOD_GATE, 0, 0, 0 },
+  { MOD_HOLD, 0, 0, 25 },
+  { MOD_END, 0, 0, 0 },
+};
+
+// sparkle: on for 20-75 ms, off for 200-1000 ms
+const ModStage sparkle1Program[] = {
+  { MOD_LEVEL, 255, 0, 0 },
+  { MOD_GATE, 3, 0, 0 }, // off: skip to the off time
+  { MOD_HOLD, 0, 0, 20 },
+  { MOD_JITTER, 0, 0, 55 },
+  { MOD_END, 0, 0, 0 },
+  { MOD_HOLD, 0, 0, 200 },
+  { MOD_JITTER, 0, 0, 800 },
+  { MOD_END, 0, 0, 0 },
+};
+
+// sparkle: on for 20-100 ms, off for 60-400 ms
+const ModStage sparkle2Program[] = {
+  { MOD_LEVEL, 255, 0, 0 },
+  { MOD_GATE, 3, 0, 0 }, // off: skip to the off time
+  { MOD_HOLD, 0, 0, 20 },
+  { MOD_JITTER, 0, 0, 80 },
+  { MOD_END, 0, 0, 0 },
+  { MOD_HOLD, 0, 0, 60 },
+  { MOD_JITTER, 0, 0, 340 },
+  { MOD_END, 0, 0, 0 },
+};
+
+// sparkle: on for 30-200 ms, off for 50-300 ms
+const ModStage sparkle3Program[] = {
+  { MOD_LEVEL, 255, 0, 0 },
+  { MOD_GATE, 3, 0, 0 }, // off: skip to the off time
+  { MOD_HOLD, 0, 0, 30 },
+  { MOD_JITTER, 0, 0, 170 },
+  { MOD_END, 0, 0, 0 },
+  { MOD_HOLD, 0, 0, 50 },
+  { MOD_JITTER, 0, 0, 250 },
+  { MOD_END, 0, 0, 0 },
+};
+
+// flickering off from full every 60 ms
+const ModStage flickerOff1Program[] = {
+  { MOD_NOISE, 120, 0, 0 },
+  { MOD_ADD, 135, 0, 0 },
+  { MOD_HOLD, 0, 0, 60 },
+  { MOD_END, 0, 0, 0 },
+};
+
+// flickering off from brightness 158 every 60 ms
+const ModStage flickerOff2Program[] = {
+  { MOD_NOISE, 120, 0, 0 },
+  { MOD_ADD, 38, 0, 0 },
+  { MOD_HOLD, 0, 0, 60 },
+  { MOD_END, 0, 0, 0 },
+};
+
+// flickering off from brightness 50 every 60 ms
+const ModStage flickerOff3Program[] = {
+  { MOD_NOISE, 120, 0, 0 },
+  { MOD_ADD, 0, 0, 0 },
+  { MOD_HOLD, 0, 0, 60 },
+  { MOD_END, 0, 0, 0 },
+};
+
+// flickering on to full from off every 60 ms
+const ModStage flickerOnFast1Program[] = {
+  { MOD_NOISE, 45, 0, 0 },
+  { MOD_BELOW, 30, 0, 0 }, // base
+  { MOD_ADD, 210, 0, 0 },
+  { MOD_HOLD, 0, 0, 60 },
+  { MOD_END, 0, 0, 0 },
+};
+
+// flickering on to full from ~20% every 60 ms
+const ModStage flickerOnFast2Program[] = {
+  { MOD_NOISE, 45, 0, 0 },
+  { MOD_BELOW, 30, 51, 0 }, // base
+  { MOD_ADD, 210, 0, 0 },
+  { MOD_HOLD, 0, 0, 60 },
+  { MOD_END, 0, 0, 0 },
+};
+
+// flickering on to full from ~40% every 60 ms
+const ModStage flickerOnFast3Program[] = {
+  { MOD_NOISE, 45, 0, 0 },
+  { MOD_BELOW, 30, 102, 0 }, // base
+  { MOD_ADD, 210, 0, 0 },
+  { MOD_HOLD, 0, 0, 60 },
+  { MOD_END, 0, 0, 0 },
+};
+
+// flickering on to full from off every 60 ms
+const ModStage flickerOnSlow1Program[] = {
+  { MOD_NOISE, 50, 0, 0 },
+  { MOD_BELOW, 46, 0, 0 }, // base
+  { MOD_ADD, 205, 0, 0 },
+  { MOD_HOLD, 0, 0, 60 },
+  { MOD_END, 0, 0, 0 },
+};
+
+// flickering on to full from ~20% every 60 ms
+const ModStage flickerOnSlow2Program[] = {
+  { MOD_NOISE, 50, 0, 0 },
+  { MOD_BELOW, 46, 51, 0 }, // base
+  { MOD_ADD, 205, 0, 0 },
+  { MOD_HOLD, 0, 0, 60 },
+  { MOD_END, 0, 0, 0 },
+};
+
+// flickering on to full from ~40% every 60 ms
+const ModStage flickerOnSlow3Program[] = {
+  { MOD_NOISE, 50, 0, 0 },
+  { MOD_BELOW, 46, 102, 0 }, // base
+  { MOD_ADD, 205, 0, 0 },
+  { MOD_HOLD, 0, 0, 60 },
+  { MOD_END, 0, 0, 0 },
+};
+
+// sine wave at 2 Hz, 100 steps a period
+const ModStage sineWave1Program[] = {
+  { MOD_WAVE, 100, 0, 0 },
+  { MOD_HOLD, 0, 0, 5 },
+  { MOD_END, 0, 0, 0 },
+};
+
+// sine wave at 1/2 Hz
+const ModStage sineWave2Program[] = {
+  { MOD_WAVE, 100, 0, 0 },
+  { MOD_HOLD, 0, 0, 20 },
+  { MOD_END, 0, 0, 0 },
+};
+
+// sine wave at 1/4 Hz
+const ModStage sineWave3Program[] = {
+  { MOD_WAVE, 100, 0, 0 },
+  { MOD_HOLD, 0, 0, 40 },
+  { MOD_END, 0, 0, 0 },
+};
+
+// sine wave at 1 Hz, at least ~20%
+const ModStage sineWaveMin201Program[] = {
+  { MOD_WAVE, 100, 0, 0 },
+  { MOD_MIN, 51, 0, 0 },
+  { MOD_HOLD, 0, 0, 10 },
+  { MOD_END, 0, 0, 0 },
+};
+
+// sine wave at 1/2 Hz, at least ~20%
+const ModStage sineWaveMin202Program[] = {
+  { MOD_WAVE, 100, 0, 0 },
+  { MOD_MIN, 51, 0, 0 },
+  { MOD_HOLD, 0, 0, 20 },
+  { MOD_END, 0, 0, 0 },
+};
+
+// sine wave at 1/4 Hz, at least ~20%
+const ModStage sineWaveMin203Program[] = {
+  { MOD_WAVE, 100, 0, 0 },
+  { MOD_MIN, 51, 0, 0 },
+  { MOD_HOLD, 0, 0, 40 },
+  { MOD_END, 0, 0, 0 },
+};
+
+// sine wave at 1 Hz, at least ~40%
+const ModStage sineWaveMin401Program[] = {
+  { MOD_WAVE, 100, 0, 0 },
+  { MOD_MIN, 102, 0, 0 },
+  { MOD_HOLD, 0, 0, 10 },
+  { MOD_END, 0, 0, 0 },
+};
+
+// sine wave at 1/2 Hz, at least ~40%
+const ModStage sineWaveMin402Program[] = {
+  { MOD_WAVE, 100, 0, 0 },
+  { MOD_MIN, 102, 0, 0 },
+  { MOD_HOLD, 0, 0, 20 },
+  { MOD_END, 0, 0, 0 },
+};
+
+// sine wave at 1/4 Hz, at least ~40%
+const ModStage sineWaveMin403Program[] = {
+  { MOD_WAVE, 100, 0, 0 },
+  { MOD_MIN, 102, 0, 0 },
+  { MOD_HOLD, 0, 0, 40 },
+  { MOD_END, 0, 0, 0 },
+};
+
+// two beats (the sine table from its trough, 97 steps of 5 ms), then off for 1/2 second
+const ModStage heartbeat1Program[] = {
+  { MOD_WAVE, 99, 76, 0 },
+  { MOD_BURST, 97, 2, 500 },
+  { MOD_HOLD, 0, 0, 5 },
+  { MOD_END, 0, 0, 0 },
+};
+
+// two beats (the sine table from its trough, 97 steps of 5 ms), then off for 1 second
+const ModStage heartbeat2Program[] = {
+  { MOD_WAVE, 99, 76, 0 },
+  { MOD_BURST, 97, 2, 1000 },
+  { MOD_HOLD, 0, 0, 5 },
+  { MOD_END, 0, 0, 0 },
+};
+
+// two beats (the sine table from its trough, 97 steps of 5 ms), then off for 2 seconds
+const ModStage heartbeat3Program[] = {
+  { MOD_WAVE, 99, 76, 0 },
+  { MOD_BURST, 97, 2, 2000 },
+  { MOD_HOLD, 0, 0, 5 },
+  { MOD_END, 0, 0, 0 },
+};
+
+Modulator<EffectMixer> modulators[KEYFRAMES]; // the built-in effects
+Keyframes<EffectMixer> keyframes;
 
-  heartbeat2.setBrightness(0);
-  heartbeat2.setSpace(1000); // 1 second
-  effects[HEARTBEAT_2] = &heartbeat2;
+void intializeEffects() {
+  modulators[CONSTANT_0].setProgram(dimmer0Program);
+  modulators[CONSTANT_20].setProgram(dimmer20Program);
+  modulators[CONSTANT_40].setProgram(dimmer40Program);
+  modulators[CONSTANT_60].setProgram(dimmer60Program);
+  modulators[CONSTANT_80].setProgram(dimmer80Program);
+  modulators[CONSTANT_100].setProgram(dimmer100Program);
+  modulators[STROBE_1].setProgram(strobe1Program);
+  modulators[STROBE_3].setProgram(strobe3Program);
+  modulators[STROBE_7].setProgram(strobe7Program);
+  modulators[STROBE_12].setProgram(strobe12Program);
+  modulators[STROBE_20].setProgram(strobe20Program);
+  modulators[SPARKLE_1].setProgram(sparkle1Program);
+  modulators[SPARKLE_2].setProgram(sparkle2Program);
+  modulators[SPARKLE_3].setProgram(sparkle3Program);
+  modulators[FLICKER_OFF_1].setProgram(flickerOff1Program);
+  modulators[FLICKER_OFF_2].setProgram(flickerOff2Program);
+  modulators[FLICKER_OFF_3].setProgram(flickerOff3Program);
+  modulators[FLICKER_ON_FAST_1].setProgram(flickerOnFast1Program);
+  modulators[FLICKER_ON_FAST_2].setProgram(flickerOnFast2Program);
+  modulators[FLICKER_ON_FAST_3].setProgram(flickerOnFast3Program);
+  modulators[FLICKER_ON_SLOW_1].setProgram(flickerOnSlow1Program);
+  modulators[FLICKER_ON_SLOW_2].setProgram(flickerOnSlow2Program);
+  modulators[FLICKER_ON_SLOW_3].setProgram(flickerOnSlow3Program);
+  modulators[SINE_WAVE_1].setProgram(sineWave1Program);
+  modulators[SINE_WAVE_2].setProgram(sineWave2Program);
+  modulators[SINE_WAVE_3].setProgram(sineWave3Program);
+  modulators[SINE_WAVE_MIN_20_1].setProgram(sineWaveMin201Program);
+  modulators[SINE_WAVE_MIN_20_2].setProgram(sineWaveMin202Program);
+  modulators[SINE_WAVE_MIN_20_3].setProgram(sineWaveMin203Program);
+  modulators[SINE_WAVE_MIN_40_1].setProgram(sineWaveMin401Program);
+  modulators[SINE_WAVE_MIN_40_2].setProgram(sineWaveMin402Program);
+  modulators[SINE_WAVE_MIN_40_3].setProgram(sineWaveMin403Program);
+  modulators[HEARTBEAT_1].setProgram(heartbeat1Program);
+  modulators[HEARTBEAT_2].setProgram(heartbeat2Program);
+  modulators[HEARTBEAT_3].setProgram(heartbeat3Program);
+
+  // on/off effects: switch right away
+  for (uint8_t type = STROBE_1; type <= SPARKLE_3; type++) {
+    modulators[type].setFadeTime(0);
+  }
 
-  heartbeat3.setBrightness(0);
-  heartbeat3.setSpace(2000); // 2 seconds
-  effects[HEARTBEAT_3] = &heartbeat3;
+  for (uint8_t type = 0; type < KEYFRAMES; type++) {
+    effects[type] = &modulators[type];
+  }
+  effects[KEYFRAMES] = &keyframes;
 }
 
-void setEffect(uint8_t type) {
-  if (currentEffect != type) {
-    // exit current effect
-    if (currentEffect != EFFECTS_COUNT) {
-      effects[currentEffect]->exit();
-    }
-
+void setEffect(uint8_t channel, uint8_t type) {
+  if (currentEffect[channel] != type) {
     // assign current effect
-    currentEffect = type;
-
-    // enter current effect
-    if (currentEffect != EFFECTS_COUNT) {
-      effects[currentEffect]->enter();
+    currentEffect[channel] = type;
+    telemetryIncrement(TELEMETRY_EFFECT_CHANGES);
+
+    // crossfade from the old effect into the new one
+    Effect *effect = (type != EFFECTS_COUNT) ? effects[type] : NULL;
+    channelSetEffect(channel, effect, (effect != NULL) ? effect->getFadeTime() : 0);
+#ifdef PIXEL_STRIP
+    if (channel == 0) {
+      pixelsSetEffect(effect);
     }
+#endif
 
-    logCurrentEffect();
+    TRACE1(TRACE_EFFECT, ((uint32_t)channel << 8) | type);
+    CAPTURE_EFFECT(channel, type);
+  }
+}
+
+// Sets the ambient (or triggered) effect of every channel.
+void setEffects(const uint8_t *types) {
+  for (uint8_t channel = 0; channel < OUTPUT_CHANNELS; channel++) {
+    setEffect(channel, types[channel]);
   }
 }
 
 uint8_t nextEffect() {
-  uint8_t nextEffect = currentEffect + 1;
+  uint8_t nextEffect = currentEffect[0] + 1;
   
   if (nextEffect >= EFFECTS_COUNT) {
     nextEffect =  DEFAULT_EFFECT;
   }
 
-  setEffect(nextEffect);
+  setEffect(0, nextEffect);
 
   return nextEffect;
 }
@@ -562,48 +660,107 @@ State prepareRecordingState(&prepareRecordingEnter, &prepareRecordingUpdate, &pr
 State recordTriggerState(&recordTriggerEnter, &recordTriggerUpdate, &recordTriggerExit);
 State peripheralState(&peripheralStateEnter, &peripheralStateUpdate, &peripheralStateExit);
 
+#ifdef CAPTURE
+// The states by their number in the capture (host/sim/Firmware.cpp has the
+// same order).
+State *const capturedStates[] = {
+  &startupState,
+  &ambientState,
+  &triggeredState,
+  &prepareRecordingState,
+  &recordTriggerState,
+  &peripheralState,
+};
+
+uint8_t capturedState() {
+  for (uint8_t state = 0; state < sizeof(capturedStates) / sizeof(capturedStates[0]); state++) {
+    if (stateMachine.isCurrentState(capturedStates[state])) {
+      return state;
+    }
+  }
+  return 0;
+}
+#endif
+
 void startupStateEnter()
 {
-  DPRINTLN("Startup enter");
+  TRACE(TRACE_STARTUP_ENTER);
 
   // add start up processes here
-  leds.setPixelColor(0, COLOR_BLACK); // off
-  leds.show();
+  statusLedSet(COLOR_BLACK); // off
 
   stateMachine.goToState(&ambientState);
 }
 
 void startupStateExit()
 {
-  DPRINTLN("Startup exit");
+  TRACE(TRACE_STARTUP_EXIT);
 }
 
 void ambientStateEnter()
 {
-  DPRINTLN("Ambient enter");
+  TRACE(TRACE_AMBIENT_ENTER);
   clearButtons();
 
   previousMillis = currentMillis;
 
-  leds.setPixelColor(0, COLOR_GREEN_75); // green
-  leds.show();
+  statusLedSet(COLOR_GREEN_75); // green
+
+  setEffects(ambientEffect);
+}
+
+// Saves the ambient effects that changed to EEPROM.
+void saveAmbientEffects() {
+  for (uint8_t channel = 0; channel < OUTPUT_CHANNELS; channel++) {
+    int channelAddr = channelEffectsAddress(channel);
+    if (EEPROM.read(channelAddr) != ambientEffect[channel]) {
+      telemetryEEPROMPut(channelAddr, ambientEffect[channel]);
+      TRACE1(TRACE_SAVE_AMBIENT_EFFECT, ((uint32_t)channel << 8) | ambientEffect[channel]);
+    }
+  }
+  ambientEffectSaved = true;
+}
 
-  setEffect(ambientEffect);
+// Switches to the ambient effects written over seesaw or selected by a
+// broadcast. Starting the crossfade here keeps it out of the I2C ISR. A
+// written effect is in EEPROM already; a broadcast one is saved once it
+// settles, like the button's, so the ISR doesn't write EEPROM for it.
+void takeSelectedEffects() {
+  for (uint8_t channel = 0; channel < OUTPUT_CHANNELS; channel++) {
+    uint8_t sreg = SREG;
+    cli();
+    uint8_t type = selectedEffect[channel];
+    selectedEffect[channel] = EFFECTS_COUNT;
+    SREG = sreg;
+    if (type == EFFECTS_COUNT) {
+      continue;
+    }
+    bool ambient = stateMachine.isCurrentState(&ambientState);
+    if (ambientEffect[channel] != type) {
+      ambientEffect[channel] = type;
+      ambientEffectSaved = false;
+      if (ambient) {
+        previousMillis = currentMillis;
+      }
+    }
+    if (ambient) {
+      setEffect(channel, type);
+    }
+  }
 }
 
 void ambientStateUpdate()
 {
   if (!ambientEffectSaved) {
     if (ambientEffectSettleTime < (currentMillis - previousMillis)) {
-      // save the ambient effect
-      EEPROM.put(ADDR_AMBIENT_EFFECT, ambientEffect);
-      DPRINTLN("Saved ambient effect to EEPROM in update.");
-      ambientEffectSaved = true;
+      saveAmbientEffects();
+    } else {
+      powerWakeAt(previousMillis + ambientEffectSettleTime + 1);
     }
   }
 
   // state transition
-  if (peripheralMode) {
+  if (channelPeripheral != 0) {
     clearButtons();
     stateMachine.goToState(&peripheralState);
     return;
@@ -611,8 +768,8 @@ void ambientStateUpdate()
     clearButtons();
 
     previousMillis = currentMillis;
-    DPRINTLN("Ambient going to next effect.");
-    ambientEffect = nextEffect();
+    TRACE(TRACE_AMBIENT_NEXT_EFFECT);
+    ambientEffect[0] = nextEffect();
     // wait for selected ambient effect to "settle"
     ambientEffectSaved = false;
   } else if (BUTTON_FLAG(FLAG_BUTTON_DOUBLE_CLICKED) || BUTTON_FLAG(FLAG_TRIGGER_PRESSED)) {
@@ -621,7 +778,6 @@ void ambientStateUpdate()
   } else if (BUTTON_FLAG(FLAG_BUTTON_LONG_PRESS_STARTED)) {
     clearButtons();
 
-    DPRINTLN("Ambient going to prepareRecording");
     stateMachine.goToState(&prepareRecordingState);
     return;
   }
@@ -631,166 +787,209 @@ void ambientStateExit()
 {
   if (!ambientEffectSaved) {
     // save the ambient effect before exiting the ambient state
-    EEPROM.put(ADDR_AMBIENT_EFFECT, ambientEffect);
-    DPRINTLN("Saved ambient effect to EEPROM in exit.");
-    ambientEffectSaved = true;
+    saveAmbientEffects();
   }
-  DPRINTLN("Ambient exit");
+  TRACE(TRACE_AMBIENT_EXIT);
 }
 
 void triggeredStateEnter()
 {
-  DPRINTLN("Triggered enter");
+  TRACE(TRACE_TRIGGERED_ENTER);
   clearButtons();
 
   previousMillis = currentMillis;
 
-  leds.setPixelColor(0, COLOR_BLUE); // blue
-  leds.show();
+  statusLedSet(COLOR_BLUE); // blue
 
-  setEffect(triggeredEffect);
+  telemetryIncrement(TELEMETRY_TRIGGERS);
+
+  setEffects(triggeredEffect);
+
+  // play back what was done during the recording
+  replayPeripheral = false;
+  replayStart(currentMillis);
 }
 
 void triggeredStateUpdate()
 {
+  uint8_t kind;
+  uint8_t value;
+
+  while (replayNext(currentMillis, kind, value)) {
+    if (kind == RECORDING_EFFECT) {
+      if (value < EFFECTS_COUNT) {
+        setEffect(0, value);
+      }
+    } else if (kind == RECORDING_LEVEL) {
+      channelLevel[0] = value;
+      channelSetPeripheral(0, true);
+      replayPeripheral = true;
+    } else if (kind == RECORDING_RELEASE) {
+      channelSetPeripheral(0, false);
+      replayPeripheral = false;
+    }
+  }
+
   if (currentMillis - previousMillis >= triggeredLengthMillis) {
     stateMachine.goToState(&ambientState);
     return;
   }
+  powerWakeAt(previousMillis + triggeredLengthMillis);
+  if (!replayDone()) {
+    powerWakeAt(replayNextTime());
+  }
 }
 
 void triggeredStateExit()
 {
-  DPRINTLN("Triggered exit");
+  if (replayPeripheral) {
+    // the replay gives channel 0 back to its effect
+    channelSetPeripheral(0, false);
+  }
+  TRACE(TRACE_TRIGGERED_EXIT);
 }
 
 void prepareRecordingEnter() {
-  DPRINTLN("prepareRecording enter");
-  previousMillis = 0;
-  recordingPrepCount = 0;
-  recordingPrepState = false; // so that it will immediately turn on
+  TRACE(TRACE_PREPARE_RECORDING_ENTER);
+  previousMillis = currentMillis;
+  statusLedBlink(COLOR_YELLOW, recordingPrepOn, recordingPrepOff, currentMillis); // yellow
 }
 
 void prepareRecordingUpdate() {
-  if (recordingPrepState) {
-    // on
-    if (currentMillis - previousMillis >= recordingPrepOn) {
-      // go to off
-      leds.setPixelColor(0, COLOR_BLACK); // off
-      leds.show();
-
-      recordingPrepState = !recordingPrepState;
-      previousMillis = currentMillis;
-    }
-  } else {
-    // off
-    if (currentMillis - previousMillis >= recordingPrepOff) {
-      if (recordingPrepCount >= recordingPrepLength) {
-        // done with recording prep. state transition
-        stateMachine.goToState(&recordTriggerState);
-        return;
-      }
-
-      // go to on
-      leds.setPixelColor(0, COLOR_YELLOW); // yellow
-      leds.show();
-
-      recordingPrepState = !recordingPrepState;
-      previousMillis = currentMillis;
+  unsigned long prepLength = (unsigned long)recordingPrepLength * (recordingPrepOn + recordingPrepOff);
 
-      recordingPrepCount += 1;
-    }
+  if (currentMillis - previousMillis >= prepLength) {
+    // done with recording prep. state transition
+    stateMachine.goToState(&recordTriggerState);
+    return;
   }
+  powerWakeAt(previousMillis + prepLength);
 }
 
 void prepareRecordingExit() {
-  DPRINTLN("prepareRecording exit");
+  TRACE(TRACE_PREPARE_RECORDING_EXIT);
+  statusLedSet(COLOR_BLACK); // off
 }
 
 void recordTriggerEnter() {
-  DPRINTLN("recordTrigger enter");
+  TRACE(TRACE_RECORD_TRIGGER_ENTER);
   clearButtons();
   previousMillis = 0;
   triggeredLengthMillis = 0;
 }
 
+// Adds the changes of the seesaw controller's level on channel 0 since the
+// last pass to the recording. Returns false when the recording is full.
+bool recordChannelLevel() {
+  bool peripheral = channelPeripheral & 1;
+  uint8_t level = channelLevel[0];
+
+  if (peripheral && (!recordedPeripheral || level != recordedLevel)) {
+    if (!recordingAdd(currentMillis, RECORDING_LEVEL, level)) {
+      return false;
+    }
+    recordedLevel = level;
+  } else if (!peripheral && recordedPeripheral) {
+    if (!recordingAdd(currentMillis, RECORDING_RELEASE, 0)) {
+      return false;
+    }
+  }
+  recordedPeripheral = peripheral;
+  return true;
+}
+
+// Records the effect changes (button clicks) and the levels set by the
+// seesaw controller on channel 0 until a long press, the recording is full
+// or MILLIS_30_MINUTES.
 void recordTriggerUpdate() {
+  bool full = false;
+
   if (previousMillis == 0) {
-    // start record
+    // start record from the current effect
     previousMillis = currentMillis;
-    leds.setPixelColor(0, COLOR_RED); // red
-    leds.show();
-  } else {
-    if (BUTTON_FLAG(FLAG_BUTTON_CLICKED) || ((currentMillis - previousMillis) >= MILLIS_30_MINUTES)) {
-      // stop recording trigger
-      triggeredLengthMillis = currentMillis - previousMillis;
-      triggeredEffect = currentEffect;
-      EEPROM.put(ADDR_TRIGGERED_EFFECT, triggeredEffect);
-      DPRINT("Wrote triggered effect to eeprom: ");
-      DPRINTLN(triggeredEffect);
-      EEPROM.put(ADDR_TRIGGERED_LENGTH, triggeredLengthMillis);
-      DPRINT("Wrote triggered length millis to eeprom: ");
-      DPRINTLN(triggeredLengthMillis);
-
-      stateMachine.goToState(&ambientState);
-      return;
-    }
+    triggeredEffect[0] = currentEffect[0];
+    recordingStart(currentMillis);
+    recordedPeripheral = false;
+    statusLedSet(COLOR_RED); // red
+  } else if (BUTTON_FLAG(FLAG_BUTTON_CLICKED)) {
+    clearButtons();
+    nextEffect();
+    full = !recordingAdd(currentMillis, RECORDING_EFFECT, currentEffect[0]);
+  }
+
+  if (!full) {
+    full = !recordChannelLevel();
   }
+
+  if (full || BUTTON_FLAG(FLAG_BUTTON_LONG_PRESS_STARTED) ||
+      ((currentMillis - previousMillis) >= MILLIS_30_MINUTES)) {
+    // stop recording trigger
+    triggeredLengthMillis = currentMillis - previousMillis;
+    recordingStop();
+    TRACE1(TRACE_SAVE_RECORDING, ((uint32_t)recordingEvents << 8) | recordingLength);
+    telemetryEEPROMPut(ADDR_TRIGGERED_EFFECT, triggeredEffect[0]);
+    TRACE1(TRACE_SAVE_TRIGGERED_EFFECT, triggeredEffect[0]);
+    telemetryEEPROMPut(ADDR_TRIGGERED_LENGTH, triggeredLengthMillis);
+    TRACE1(TRACE_SAVE_TRIGGERED_LENGTH, triggeredLengthMillis);
+
+    stateMachine.goToState(&ambientState);
+    return;
+  }
+  powerWakeAt(previousMillis + MILLIS_30_MINUTES);
 }
 
 void recordTriggerExit() {
-  DPRINTLN("recordTrigger exit");
+  TRACE(TRACE_RECORD_TRIGGER_EXIT);
 }
 
 void peripheralStateEnter() {
-  DPRINTLN("Peripheral enter");
+  TRACE(TRACE_PERIPHERAL_ENTER);
   clearButtons();
 
-  leds.setPixelColor(0, COLOR_PURPLE); // purple
-  leds.show();
+  statusLedSet(COLOR_PURPLE); // purple
 }
 
 void peripheralStateUpdate() {
-  if (!peripheralMode) {
+  if (channelPeripheral == 0) {
     stateMachine.goToState(&ambientState);
   }
 }
 
 void peripheralStateExit() {
-  DPRINTLN("Peripheral exit");
+  TRACE(TRACE_PERIPHERAL_EXIT);
 }
 
 // Called by seesaw to "overide" the built in controller logic.
 // Transition to peripheral state when an external controller is setting the
-// output value until soft reset.
+// output value of a channel (the pin is the channel number) until soft
+// reset. The other channels keep running their effects.
 void PWMCallback(uint8_t pin, uint16_t value) {
-  DPRINT("PWMCallback Pin: ");
-  DPRINT(pin);
-  DPRINT(", Value: ");
-  DPRINT(value);
-  DPRINT(", 8 bit value: ");
-  DPRINTLN(value & 0xFF);
+  TRACE1(TRACE_PWM, ((uint32_t)pin << 16) | value);
 
-  if (pin == 0) {
-    peripheralMode = true;
-    peripheralDimmer.setBrightness(value & 0xFF); // convert from 16 bit to 8 bit
+  if (pin < OUTPUT_CHANNELS) {
+    channelLevel[pin] = value & 0xFF; // convert from 16 bit to 8 bit
+    channelPeripheral |= 1 << pin;
   }
 }
 
 // Called by seesaw when reset. Return to controller logic.
 void SeesawReset() {
-  DPRINTLN("Seesaw reset called.");
-  peripheralMode = false;
+  TRACE(TRACE_SEESAW_RESET);
+  channelPeripheral = 0;
 }
 
 // Called by seesaw to read the peripheral EEPROM. Convert to values that
 // Incipit11 uses to store ambient and trigger data.
 uint8_t EEPROMReadCallback(uint8_t addr) {
-  if (addr == ADDR_AMBIENT_EFFECT) {
-    return currentEffect;
-  } else if (addr == ADDR_TRIGGERED_EFFECT) {
-    return triggeredEffect;
-  }  else if (addr == ADDR_TRIGGERED_LENGTH) {
+  for (uint8_t channel = 0; channel < OUTPUT_CHANNELS; channel++) {
+    if (addr == channelEffectsAddress(channel)) {
+      return currentEffect[channel];
+    } else if (addr == channelEffectsAddress(channel) + 1) {
+      return triggeredEffect[channel];
+    }
+  }
+
+  if (addr == ADDR_TRIGGERED_LENGTH) {
     uint8_t value = (triggeredLengthMillis >> 24) & 0x000000FF;
     return value;
   }  else if (addr == ADDR_TRIGGERED_LENGTH + 1) {
@@ -808,32 +1007,41 @@ uint8_t EEPROMReadCallback(uint8_t addr) {
 
 // Called by seesaw to write the peripheral EEPROM. Convert to values that
 // Incipit11 uses to store ambient and trigger data.
-void EEPROMWriteCallback(uint8_t addr, uint8_t *buf, uint8_t size) {
-  if (addr == ADDR_AMBIENT_EFFECT) {
-    if (size >= 1) {
-      uint8_t value = buf[0];
-      if (value < EFFECTS_COUNT) {
-        ambientEffect = value;
-        EEPROM.put(ADDR_AMBIENT_EFFECT, ambientEffect);
-        DPRINT("Saved ambient effect to EEPROM in update: ");
-        DPRINTLN(ambientEffect);
-        ambientEffectSaved = true;
-        if (stateMachine.isCurrentState(&ambientState)) {
-          setEffect(ambientEffect);
+void EEPROMWriteCallback(uint8_t addr, const uint8_t *buf, uint8_t size) {
+  for (uint8_t channel = 0; channel < OUTPUT_CHANNELS; channel++) {
+    int channelAddr = channelEffectsAddress(channel);
+    if (addr == channelAddr) {
+      if (size >= 1) {
+        uint8_t value = buf[0];
+        if (value < EFFECTS_COUNT) {
+          ambientEffect[channel] = value;
+          telemetryEEPROMPut(channelAddr, value);
+          TRACE1(TRACE_SAVE_AMBIENT_EFFECT, ((uint32_t)channel << 8) | value);
+          if (channel == 0) {
+            ambientEffectSaved = true;
+          }
+          selectedEffect[channel] = value;
         }
       }
-    }
-  } else if (addr == ADDR_TRIGGERED_EFFECT) {
-    if (size >= 1) {
-      uint8_t value = buf[0];
-      if (value < EFFECTS_COUNT) {
-        triggeredEffect = value;
-        EEPROM.put(ADDR_TRIGGERED_EFFECT, triggeredEffect);
-        DPRINT("Saved triggered effect to EEPROM in update: ");
-        DPRINTLN(triggeredEffect);
+      return;
+    } else if (addr == channelAddr + 1) {
+      if (size >= 1) {
+        uint8_t value = buf[0];
+        if (value < EFFECTS_COUNT) {
+          triggeredEffect[channel] = value;
+          telemetryEEPROMPut(channelAddr + 1, value);
+          if (channel == 0) {
+            // the recording was made from another effect
+            recordingClearRequested = true;
+          }
+          TRACE1(TRACE_SAVE_TRIGGERED_EFFECT, ((uint32_t)channel << 8) | value);
+        }
       }
+      return;
     }
-  } else if (addr == ADDR_TRIGGERED_LENGTH) {
+  }
+
+  if (addr == ADDR_TRIGGERED_LENGTH) {
     if (size >= 4) {
       triggeredLengthMillis = ((uint32_t)buf[0] << 24) |
                               ((uint32_t)buf[1] << 16) |
@@ -842,28 +1050,64 @@ void EEPROMWriteCallback(uint8_t addr, uint8_t *buf, uint8_t size) {
       if (triggeredLengthMillis > MILLIS_30_MINUTES) {
         triggeredLengthMillis = MILLIS_10_SECONDS;
       }
-      EEPROM.put(ADDR_TRIGGERED_LENGTH, triggeredLengthMillis);
-      DPRINT("Saved triggered length (millseconds) to EEPROM in update: ");
-      DPRINTLN(triggeredLengthMillis);
+      telemetryEEPROMPut(ADDR_TRIGGERED_LENGTH, triggeredLengthMillis);
+      TRACE1(TRACE_SAVE_TRIGGERED_LENGTH, triggeredLengthMillis);
+      recordingClearRequested = true;
     }
   }
 }
 
+// Called by seesaw for the broadcast commands to a group this unit is in.
+// The levels and syncs are taken by seesaw itself.
+void BroadcastCallback(uint8_t command, const uint8_t *buf, uint8_t size) {
+  if (command == DOA_SEESAW_BROADCAST_EFFECT) {
+    if (size >= 2 && buf[0] < OUTPUT_CHANNELS && buf[1] < EFFECTS_COUNT) {
+      selectedEffect[buf[0]] = buf[1];
+    }
+  } else if (command == DOA_SEESAW_BROADCAST_TRIGGER) {
+    g_bufferedBulkGPIORead |= FLAG_TRIGGER_PRESSED;
+  }
+}
+
 // End DOA_seesawCompatibility callbacks
 
 void setup() {
   // put your setup code here, to run once:
-  // put your setup code here, to run once:
+
+  // Fast boot: restore the saved ambient effect's output before anything
+  // slow is initialized. The time from init() to the first output level is
+  // reported as telemetryBootToLight. The startup time fuse (SUT, "Startup
+  // Time" in the tools menu) adds to this before any code runs.
   pinMode(PWM_OUTPUT, OUTPUT);
+#ifdef OUTPUT_MAX_SLEW
+  PwmOutputs::setMaxSlew(OUTPUT_MAX_SLEW);
+#endif
+
+  intializeEffects();
+
+  currentMillis = millis();
+  for (uint8_t channel = 0; channel < OUTPUT_CHANNELS; channel++) {
+    currentEffect[channel] = EFFECTS_COUNT;
+    selectedEffect[channel] = EFFECTS_COUNT;
+    ambientEffect[channel] = EEPROM.read(channelEffectsAddress(channel));
+    if (ambientEffect[channel] >= EFFECTS_COUNT) {
+      ambientEffect[channel] = DEFAULT_EFFECT;
+    }
+    setEffect(channel, ambientEffect[channel]);
+  }
+  channelsUpdate<PwmOutputs>(currentMillis);
+  telemetryBootToLight = micros();
+
+  // Everything else
   pinModeFast(NEOPIXEL, OUTPUT);
+  statusLedBegin(leds);
 
   // Seesaw setup
   DOA_seesawCompatibility_setPWMCallback(&PWMCallback);
   DOA_seesawCompatibility_setSeesawReset(&SeesawReset);
   DOA_seesawCompatibility_setEEPROMReadCallback(&EEPROMReadCallback);
   DOA_seesawCompatibility_setEEPROMWriteCallback(&EEPROMWriteCallback);
-
-  intializeEffects();
+  DOA_seesawCompatibility_setBroadcastCallback(&BroadcastCallback);
 
   button.setup(PIN_BUTTON);
   button.attachClick(fClicked);
@@ -874,46 +1118,52 @@ void setup() {
   trigger.setup(PIN_TRIGGER);
   trigger.attachPress(fTriggerPressed);
 
-  SERIALPINS(TX, RX);
-  SERIALBEGIN(115200);
-  DELAY(1000); // wait a second for serial
-  DPRINTLN("Incipit11 started up.");
-
   // load data from EEPROM
-  DPRINT("ADDR_AMBIENT_EFFECT: ");
-  DPRINTLN(ADDR_AMBIENT_EFFECT);
-  DPRINT("ADDR_TRIGGERED_EFFECT: ");
-  DPRINTLN(ADDR_TRIGGERED_EFFECT);
-  DPRINT("ADDR_TRIGGERED_LENGTH: ");
-  DPRINTLN(ADDR_TRIGGERED_LENGTH);
-  DPRINTLN("Getting ambient effect from eeprom");
-  EEPROM.get(ADDR_AMBIENT_EFFECT, ambientEffect);
-  DPRINT("Got ambient effect from eeprom: ");
-  DPRINTLN(ambientEffect);
-  if (ambientEffect >= EFFECTS_COUNT) {
-    ambientEffect = DEFAULT_EFFECT;
-  }
-  DPRINTLN("Getting triggered effect from eeprom");
-  EEPROM.get(ADDR_TRIGGERED_EFFECT, triggeredEffect);
-  DPRINT("Got triggered effect from eeprom: ");
-  DPRINTLN(triggeredEffect);
-  if (triggeredEffect >= EFFECTS_COUNT) {
-    triggeredEffect = DEFAULT_EFFECT;
-  }
-  DPRINTLN("Getting triggered length millis from eeprom: ");
-  DPRINTLN(EEPROM.get(ADDR_TRIGGERED_LENGTH, triggeredLengthMillis));
-  DPRINT("Got triggered length millis from eeprom: ");
-  DPRINTLN(triggeredLengthMillis);
+  for (uint8_t channel = 0; channel < OUTPUT_CHANNELS; channel++) {
+    triggeredEffect[channel] = EEPROM.read(channelEffectsAddress(channel) + 1);
+    if (triggeredEffect[channel] >= EFFECTS_COUNT) {
+      triggeredEffect[channel] = DEFAULT_EFFECT;
+    }
+  }
+  EEPROM.get(ADDR_TRIGGERED_LENGTH, triggeredLengthMillis);
   if (triggeredLengthMillis > MILLIS_30_MINUTES) {
     triggeredLengthMillis = MILLIS_10_SECONDS;
   }
 
   // Adafruit seesaw peripheral compatibility support
-  DPRINTLN(F("Begin seesaw compatibility."));
   DOA_seesawCompatibility_begin();
 
-  setEffect(DEFAULT_EFFECT);
+  telemetryBegin();
+
+  PROFILER_BEGIN();
+
+  powerBegin();
+
+  // No delay waiting for serial. The output is not needed to get going and
+  // the trace records are buffered until loop() drains them.
+  SERIALPINS(TX, RX);
+#if defined(CONFIG_INTERRUPT_PIN) && CONFIG_INTERRUPT_PIN == RX
+  SERIALBEGIN(115200, SERIAL_TX_ONLY); // RX is the keypad interrupt
+#else
+  SERIALBEGIN(115200);
+#endif
+  clockBegin();
+  DPRINTLN(F("Incipit11 started up."));
+  DPRINT(F("Boot to light (microseconds): "));
+  DPRINTLN(telemetryBootToLight);
+  DPRINT(F("Ambient effect: "));
+  DPRINT(ambientEffect[0]);
+  DPRINT(F(", triggered effect: "));
+  DPRINT(triggeredEffect[0]);
+  DPRINT(F(", triggered length millis: "));
+  DPRINTLN(triggeredLengthMillis);
+  TRACE1(TRACE_BOOT_TO_LIGHT, telemetryBootToLight);
+
+  // the ambient effect is already running so the startup state won't
+  // switch effects
   stateMachine.goToState(&startupState);
+
+  telemetrySaveResets();
 }
 
 uint8_t brightness = 0;
@@ -924,10 +1174,24 @@ int16_t nextStemp = step;
 
 void loop() {
   // put your main code here, to run repeatedly:
+  PROFILE_START();
   currentMillis = millis();
+  powerStartLoop(currentMillis);
+  syncUpdate();
+  if (syncWasSet()) {
+    // the effects' times are on the old clock
+    channelsRestart();
+#ifdef PIXEL_STRIP
+    pixelsRestart();
+#endif
+  }
 
+  CAPTURE_INPUT(0, digitalReadFast(PIN_BUTTON));
+  CAPTURE_INPUT(1, digitalReadFast(PIN_TRIGGER));
   button.tick();
+  PROFILE_LAP(PROFILE_BUTTON_TICK);
   trigger.tick();
+  PROFILE_LAP(PROFILE_TRIGGER_TICK);
   if (g_bufferedBulkGPIORead) {
     // Seesaw GPIO button/trigger setting
     if (g_bufferedBulkGPIORead & FLAG_BUTTON_PRESSED) {
@@ -944,14 +1208,35 @@ void loop() {
 
     g_bufferedBulkGPIORead = 0; // clear the buffer
   }
+  PROFILE_LAP(PROFILE_GPIO_FLAGS);
+  takeSelectedEffects();
+  recordingUpdate();
   stateMachine.update();
-  if (stateMachine.isCurrentState(&peripheralState)) {
-    // special peripheral mode effect
-    peripheralDimmer.update(currentMillis);
-  } else {
-    // standard controller effects
-    effects[currentEffect]->update(currentMillis);
-  }
+  CAPTURE_STATE(capturedState());
+  PROFILE_LAP(PROFILE_STATE_MACHINE);
+  channelsUpdate<PwmOutputs>(currentMillis);
+#ifdef PIXEL_STRIP
+  pixelsUpdate(currentMillis);
+#endif
+  PROFILE_LAP(PROFILE_EFFECT_UPDATE);
 
   DOA_seesawCompatibility_run();
+  PROFILE_LAP(PROFILE_SEESAW_RUN);
+  statusLedUpdate(currentMillis);
+  PROFILE_LAP(PROFILE_STATUS_LED);
+  PROFILE_LOOP_END();
+
+  telemetryUpdate(currentMillis);
+
+  PROFILER_POLL(currentMillis);
+  TRACE_DRAIN();
+
+  if (!button.isIdle() || !trigger.isIdle() ||
+      (digitalReadFast(PIN_BUTTON) == LOW) || (digitalReadFast(PIN_TRIGGER) == LOW)) {
+    // debouncing or waiting for a click to finish; keep ticking every millisecond
+    powerWakeIn(1);
+    clockBusy();
+  }
+  clockUpdate(currentMillis);
+  powerSleep();
 }
@@ -0,0 +1,224 @@
+//***************************************************************
+// Keyframes effect.
+//
+// An effect uploaded by a seesaw controller without reflashing. The program
+// is a list of keyframes in EEPROM that the effect reads as it plays, so it
+// takes the same RAM whatever its length:
+//
+//   byte 0   number of keyframes (up to KEYFRAMES_MAX)
+//   byte 1   keyframe to loop back to after the last one, or KEYFRAMES_NO_LOOP
+//            to hold the last one
+//   then for each keyframe:
+//     level      brightness to ramp to
+//     jitter     a random amount below jitter is taken off the level
+//     ramp       milliseconds to get there (uint16, big endian)
+//     hold       milliseconds to stay there (uint16, big endian)
+//
+// The program is written and read back through DOA_SEESAW_KEYFRAMES_BASE
+// with the byte offset as the register. Each update() does at most one
+// ramp step or one move to the next keyframe, so a program of keyframes
+// that take no time still can't hold up loop().
+//
+// A write comes in from the I2C receive ISR, where an EEPROM byte (about
+// 3.3 ms each) would keep interrupts off for the whole program. The bytes
+// are kept in RAM until keyframesCommit() writes them from loop(), and
+// read from there until then.
+//
+// Define CONFIG_KEYFRAMES_EEPROM_ADDR before including this file to move the
+// program in EEPROM.
+//***************************************************************
+
+#ifndef Keyframes_h
+#define Keyframes_h
+
+#include "Arduino.h"
+#include "Effect.h"
+#include "Sync.h"
+#include "Telemetry.h"
+#include "Trace.h"
+#include <EEPROM.h>
+
+#ifndef CONFIG_KEYFRAMES_EEPROM_ADDR
+  #define CONFIG_KEYFRAMES_EEPROM_ADDR 0xA0
+#endif
+
+#define KEYFRAMES_PROGRAM_SIZE 64 // bytes of EEPROM
+#define KEYFRAMES_HEADER_SIZE 2
+#define KEYFRAME_SIZE 6
+#define KEYFRAMES_MAX ((KEYFRAMES_PROGRAM_SIZE - KEYFRAMES_HEADER_SIZE) / KEYFRAME_SIZE)
+#define KEYFRAMES_NO_LOOP 0xFF
+
+volatile uint8_t keyframesBuffer[KEYFRAMES_PROGRAM_SIZE];     // bytes not written yet
+volatile uint8_t keyframesDirty[KEYFRAMES_PROGRAM_SIZE / 8]; // bit per byte in keyframesBuffer
+volatile bool keyframesPending = false;
+
+bool keyframesIsDirty(uint8_t offset) {
+  return keyframesDirty[offset >> 3] & (1 << (offset & 7));
+}
+
+// Keeps bytes of the program from offset for keyframesCommit(). Called from
+// the I2C receive ISR.
+void keyframesWrite(uint8_t offset, const uint8_t *data, uint8_t size) {
+  TRACE1(TRACE_KEYFRAMES_WRITE, ((uint32_t)offset << 8) | size);
+
+  for (uint8_t i = 0; i < size && offset < KEYFRAMES_PROGRAM_SIZE; i++, offset++) {
+    keyframesBuffer[offset] = data[i];
+    keyframesDirty[offset >> 3] |= 1 << (offset & 7);
+  }
+  keyframesPending = true;
+}
+
+// Called from loop(). Writes the bytes of the program that came in to
+// EEPROM; only the ones that changed are written.
+void keyframesCommit() {
+  if (!keyframesPending) {
+    return;
+  }
+  keyframesPending = false;
+
+  for (uint8_t offset = 0; offset < KEYFRAMES_PROGRAM_SIZE; offset++) {
+    if (!keyframesIsDirty(offset)) {
+      continue;
+    }
+    uint8_t value = keyframesBuffer[offset];
+    telemetryEEPROMPut(CONFIG_KEYFRAMES_EEPROM_ADDR + offset, value);
+
+    uint8_t sreg = SREG;
+    cli();
+    if (keyframesBuffer[offset] == value) {
+      keyframesDirty[offset >> 3] &= ~(1 << (offset & 7));
+    }
+    // otherwise written again meanwhile, and keyframesPending is set
+    SREG = sreg;
+  }
+}
+
+uint8_t keyframesRead(uint8_t offset) {
+  if (offset >= KEYFRAMES_PROGRAM_SIZE) {
+    return 0;
+  }
+  if (keyframesIsDirty(offset)) {
+    return keyframesBuffer[offset];
+  }
+  return EEPROM.read(CONFIG_KEYFRAMES_EEPROM_ADDR + offset);
+}
+
+template <class Output>
+class Keyframes : public Effect {
+public:
+  Keyframes() {
+    _brightness = 0;
+  }
+
+  void enter(uint8_t slot) override {
+    // start the first keyframe on the next update(), ramping up from off
+    effectSlots.lastTransitionTime[slot] = syncMillis();
+    effectSlots.period[slot] = 0;
+    effectSlots.index[slot] = KEYFRAMES_NO_LOOP;
+    effectSlots.phase[slot] = KEYFRAME_HOLD;
+    effectSlots.to[slot] = 0;
+  }
+
+  void update(uint8_t slot, unsigned long now = 0) override {
+    unsigned long &lastTransitionTime = effectSlots.lastTransitionTime[slot];
+    uint16_t &period = effectSlots.period[slot];
+    uint8_t &phase = effectSlots.phase[slot];
+    uint8_t from = effectSlots.from[slot];
+    uint8_t to = effectSlots.to[slot];
+
+    if (phase == KEYFRAME_END) {
+      return;
+    }
+
+    if (now == 0) {
+      now = syncMillis();
+    }
+
+    unsigned long elapsed = now - lastTransitionTime;
+    if (elapsed < period) {
+      if (phase == KEYFRAME_RAMP) {
+        int16_t change = ((int32_t)(to - from) * (uint16_t)elapsed) / period;
+        Output::write(slot, from + change);
+      }
+      return;
+    }
+
+    lastTransitionTime = now;
+    if (phase == KEYFRAME_RAMP) {
+      phase = KEYFRAME_HOLD;
+      period = keyframe16(effectSlots.index[slot], 4);
+    } else {
+      next(slot);
+    }
+    Output::write(slot, effectSlots.to[slot]);
+  }
+
+  unsigned long getIdleTime(uint8_t slot, unsigned long now) override {
+    uint8_t phase = effectSlots.phase[slot];
+
+    if (phase == KEYFRAME_END) {
+      return EFFECT_IDLE_FOREVER;
+    }
+    unsigned long idle = timeLeft(now, effectSlots.lastTransitionTime[slot] + effectSlots.period[slot]);
+    if (phase == KEYFRAME_RAMP && idle > 1) {
+      // next ramp step
+      idle = 1;
+    }
+    return idle;
+  }
+
+  ~Keyframes() override {}
+
+protected:
+  enum : uint8_t {
+    KEYFRAME_RAMP = 0,
+    KEYFRAME_HOLD,
+    KEYFRAME_END
+  };
+
+  static uint8_t keyframe8(uint8_t index, uint8_t field) {
+    return keyframesRead(KEYFRAMES_HEADER_SIZE + index * KEYFRAME_SIZE + field);
+  }
+
+  static uint16_t keyframe16(uint8_t index, uint8_t field) {
+    return ((uint16_t)keyframe8(index, field) << 8) | keyframe8(index, field + 1);
+  }
+
+  // Starts ramping to the next keyframe.
+  static void next(uint8_t slot) {
+    uint8_t &index = effectSlots.index[slot];
+    uint8_t count = keyframesRead(0);
+    uint8_t loop = keyframesRead(1);
+
+    if (count > KEYFRAMES_MAX) {
+      // not a program (erased EEPROM)
+      count = 0;
+    }
+
+    index++; // from KEYFRAMES_NO_LOOP to 0 on the first one
+    if (index >= count) {
+      if (loop >= count) {
+        // hold the last keyframe (or off without any)
+        effectSlots.phase[slot] = KEYFRAME_END;
+        if (count == 0) {
+          effectSlots.to[slot] = 0;
+        }
+        return;
+      }
+      index = loop;
+    }
+
+    uint8_t level = keyframe8(index, 0);
+    uint8_t jitter = keyframe8(index, 1);
+    if (jitter > 0) {
+      uint8_t offset = random(jitter);
+      level = (offset < level) ? level - offset : 0;
+    }
+
+    effectSlots.from[slot] = effectSlots.to[slot];
+    effectSlots.to[slot] = level;
+    effectSlots.phase[slot] = KEYFRAME_RAMP;
+    effectSlots.period[slot] = keyframe16(index, 2);
+  }
+};
+#endif
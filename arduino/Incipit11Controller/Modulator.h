@@ -0,0 +1,303 @@
+//***************************************************************
+// Modulator effect.
+//
+// An effect described by data instead of code: a program of stages that
+// runs from the top on every step of the effect. The stages work out the
+// level of the step in 8 bits and how long the step lasts, then the level
+// is written and the effect waits for the next step. A step that sets no
+// time is the last one: the level holds until the effect changes.
+//
+//   MOD_LEVEL a         level a
+//   MOD_NOISE a         random level below a
+//   MOD_WAVE a b        next level of sineLookupTable, read from position b
+//                       and wrapping after a steps (LFO)
+//   MOD_ADD a           add a
+//   MOD_SCALE a         multiply by (a + 1) / 256
+//   MOD_MIN a           at least a
+//   MOD_MAX a           at most a
+//   MOD_BELOW a b       below a: level b and skip the next stage
+//   MOD_GATE a          every other step is off: level 0 and skip a stages
+//   MOD_BURST a b time  every a steps ends a cycle of the wave and every b
+//                       cycles rests at level 0 for time milliseconds
+//                       longer (envelope)
+//   MOD_HOLD time       step lasts time milliseconds longer
+//   MOD_JITTER time     step lasts up to time milliseconds longer, at random
+//   MOD_END             end of the step
+//
+// A program is a const array of ModStage ending with MOD_END (and one more
+// MOD_END after the stages a MOD_GATE skips to). The arrays stay in flash,
+// which the tinyAVR 1-series maps into the data space, so the stages are
+// read with plain loads. The run state is the effect slot (Effect.h):
+// lastTransitionTime and period time the steps, index is the wave step and
+// phase the gate or the burst cycle.
+//
+// The steps are timed on syncMillis() (Sync.h). Once a seesaw controller
+// shares the clock, an effect is entered as if it had been running since
+// the clock started, and each step is timed from the one before rather
+// than from when update() got to it, so units running the same effect stay
+// in step. A program that repeats (its index and phase come back to 0
+// after a fixed time, worked out once) is entered at the start of its
+// current cycle and runs the steps since then. Any other one is entered on
+// the last SYNC_PHASE_GRID boundary. Either way it runs at most
+// SYNC_ENTER_STEPS steps to catch up.
+//***************************************************************
+
+#ifndef Modulator_h
+#define Modulator_h
+
+#include "Arduino.h"
+#include "Effect.h"
+#include "Sync.h"
+
+const uint8_t sineLookupTable[] = {
+   128, 136, 143, 151, 159, 167, 174, 182,
+   189, 196, 202, 209, 215, 220, 226, 231,
+   235, 239, 243, 246, 249, 251, 253, 254,
+   255, 255, 255, 254, 253, 251, 249, 246,
+   243, 239, 235, 231, 226, 220, 215, 209,
+   202, 196, 189, 182, 174, 167, 159, 151,
+   143, 136, 128, 119, 112, 104,  96,  88,
+    81,  73,  66,  59,  53,  46,  40,  35,
+    29,  24,  20,  16,  12,   9,   6,   4,
+     2,   1,   0,   0,   0,   1,   2,   4,
+     6,   9,  12,  16,  20,  24,  29,  35,
+    40,  46,  53,  59,  66,  73,  81,  88,
+    96, 104, 112, 119,
+  };
+
+const uint8_t sineLookupTableLength = 100;
+
+enum ModOp : uint8_t {
+  MOD_END = 0,
+  MOD_LEVEL,
+  MOD_NOISE,
+  MOD_WAVE,
+  MOD_ADD,
+  MOD_SCALE,
+  MOD_MIN,
+  MOD_MAX,
+  MOD_BELOW,
+  MOD_GATE,
+  MOD_BURST,
+  MOD_HOLD,
+  MOD_JITTER
+};
+
+struct ModStage {
+  uint8_t op;
+  uint8_t a;
+  uint8_t b;
+  uint16_t time; // milliseconds
+};
+
+// period of a step that holds until the effect changes
+const uint16_t MOD_FOREVER = 0xFFFF;
+
+// cycle of a program that wasn't worked out yet
+const uint16_t MOD_CYCLE_UNKNOWN = 0xFFFF;
+
+template <class Output>
+class Modulator : public Effect {
+public:
+  Modulator() {
+    _program = NULL;
+    _cycle = MOD_CYCLE_UNKNOWN;
+  }
+
+  const ModStage *getProgram() {
+    return _program;
+  }
+
+  void setProgram(const ModStage *program) {
+    _program = program;
+    _cycle = MOD_CYCLE_UNKNOWN;
+  }
+
+  void enter(uint8_t slot) override {
+    unsigned long now = syncMillis();
+    unsigned long &lastTransitionTime = effectSlots.lastTransitionTime[slot];
+    uint16_t &period = effectSlots.period[slot];
+
+    // step on the next update() (even right after boot)
+    lastTransitionTime = now;
+    period = 0;
+    effectSlots.index[slot] = 0;
+    effectSlots.phase[slot] = 0;
+
+    if (syncLocked) {
+      // catch up from the start of the cycle, or the grid boundary
+      uint16_t repeat = cycle(slot);
+      lastTransitionTime = now - now % ((repeat != 0) ? repeat : SYNC_PHASE_GRID);
+      uint8_t level = step(slot, period);
+      for (uint16_t steps = 1; steps < SYNC_ENTER_STEPS && period != MOD_FOREVER &&
+                               now - lastTransitionTime >= period; steps++) {
+        lastTransitionTime += period;
+        level = step(slot, period);
+      }
+      Output::write(slot, level);
+    }
+  }
+
+  void update(uint8_t slot, unsigned long now = 0) override {
+    unsigned long &lastTransitionTime = effectSlots.lastTransitionTime[slot];
+    uint16_t &period = effectSlots.period[slot];
+
+    if (period == MOD_FOREVER) {
+      return;
+    }
+
+    if (now == 0) {
+      now = syncMillis();
+    }
+
+    if (now >= (lastTransitionTime + period)) {
+      if (syncLocked && now - lastTransitionTime < 2UL * period) {
+        // on time from the previous step
+        lastTransitionTime += period;
+      } else {
+        lastTransitionTime = now;
+      }
+      Output::write(slot, step(slot, period));
+    }
+  }
+
+  unsigned long getIdleTime(uint8_t slot, unsigned long now) override {
+    uint16_t period = effectSlots.period[slot];
+
+    if (period == MOD_FOREVER) {
+      return EFFECT_IDLE_FOREVER;
+    }
+    return timeLeft(now, effectSlots.lastTransitionTime[slot] + period);
+  }
+
+  ~Modulator() override {}
+
+protected:
+  // Milliseconds after which the program is back at its first step, or 0
+  // if it holds, times its steps at random or takes more than
+  // SYNC_ENTER_STEPS steps to get back. Worked out on the first call, in
+  // the slot's run state, which is left at the first step.
+  uint16_t cycle(uint8_t slot) {
+    if (_cycle == MOD_CYCLE_UNKNOWN) {
+      uint8_t &index = effectSlots.index[slot];
+      uint8_t &phase = effectSlots.phase[slot];
+      uint32_t time = 0;
+      uint16_t period;
+
+      _cycle = 0;
+      for (uint16_t steps = 0; steps < SYNC_ENTER_STEPS; steps++) {
+        step(slot, period, false);
+        time += period;
+        if (period == 0 || period == MOD_FOREVER || time >= MOD_CYCLE_UNKNOWN) {
+          break;
+        }
+        if (index == 0 && phase == 0) {
+          _cycle = time;
+          break;
+        }
+      }
+      index = 0;
+      phase = 0;
+    }
+    return _cycle;
+  }
+
+  // Runs the program once. Returns the level and sets the period of the
+  // step. Without draw no random numbers are drawn: the level of a
+  // MOD_NOISE is 0 and a MOD_JITTER ends the step with a period of 0.
+  uint8_t step(uint8_t slot, uint16_t &period, bool draw = true) {
+    uint8_t &index = effectSlots.index[slot];
+    uint8_t &phase = effectSlots.phase[slot];
+    uint8_t level = 0;
+    uint16_t time = 0;
+    const ModStage *stage = _program;
+
+    if (stage == NULL) {
+      period = MOD_FOREVER;
+      return 0;
+    }
+
+    for (; stage->op != MOD_END; stage++) {
+      uint8_t a = stage->a;
+
+      switch (stage->op) {
+        case MOD_LEVEL:
+          level = a;
+          break;
+        case MOD_NOISE:
+          level = draw ? random(a) : 0;
+          break;
+        case MOD_WAVE: {
+          uint8_t position = index + stage->b;
+          if (position >= a) {
+            position -= a;
+          }
+          level = sineLookupTable[position];
+
+          index++;
+          if (index >= a) {
+            index = 0;
+          }
+          break;
+        }
+        case MOD_ADD:
+          level += a;
+          break;
+        case MOD_SCALE:
+          level = ((uint16_t)level * (a + 1)) >> 8;
+          break;
+        case MOD_MIN:
+          if (level < a) {
+            level = a;
+          }
+          break;
+        case MOD_MAX:
+          if (level > a) {
+            level = a;
+          }
+          break;
+        case MOD_BELOW:
+          if (level < a) {
+            level = stage->b;
+            stage++;
+          }
+          break;
+        case MOD_GATE:
+          phase = !phase;
+          if (!phase) {
+            level = 0;
+            stage += a;
+          }
+          break;
+        case MOD_BURST:
+          if (index >= a) {
+            index = 0;
+            phase++;
+            if (phase >= stage->b) {
+              phase = 0;
+              level = 0;
+              time += stage->time;
+            }
+          }
+          break;
+        case MOD_HOLD:
+          time += stage->time;
+          break;
+        case MOD_JITTER:
+          if (!draw) {
+            period = 0;
+            return 0;
+          }
+          time += random(stage->time);
+          break;
+      }
+    }
+
+    period = (time == 0) ? MOD_FOREVER : time;
+    return level;
+  }
+
+  const ModStage *_program;
+  uint16_t _cycle; // milliseconds, see cycle()
+};
+#endif
@@ -0,0 +1,248 @@
+//***************************************************************
+// The PWM outputs of the effects.
+//
+// Effects write linear brightness levels (0-255) to an OutputStage. The
+// stage applies the gamma correction, skips writes that don't change the
+// output and writes the TCA0 compare register of the pin directly instead of
+// going through analogWrite(), which looks up the timer of the pin on every
+// call.
+//
+// OutputStage is a template on the pin, so the compare register and enable
+// bit (PwmChannel) are resolved at compile time, and each pin has one set of
+// static state no matter how many effects write to it. The effect classes
+// take the OutputStage type as a template parameter:
+//   typedef OutputStage<PIN_PA5> PwmOutput;
+//   Modulator<PwmOutput> modulator;
+// Pins without a TCA0 split mode channel fall back to analogWrite().
+//
+// Several outputs, each running its own effect, are an OutputBank of pins
+// addressed by channel number (0 is the first pin):
+//   typedef OutputBank<PIN_PA5, PIN_PB0> PwmOutputs;
+//   PwmOutputs::write(channel, level);
+// A bank of one pin ignores the channel, so a single output build still
+// writes the compare register without a lookup.
+//
+// Like analogWrite(), fully off and fully on are digital outputs with the
+// timer channel disabled, so the PWM timer is only used for levels in
+// between (Power.h relies on this to stop TCA0 in standby).
+//
+// An optional slew limit (setMaxSlew()) moves the output towards the level
+// written by at most that many brightness steps per millisecond. update()
+// then has to be called every loop() pass until settled() returns true.
+//***************************************************************
+
+#ifndef OutputStage_h
+#define OutputStage_h
+
+#include "Arduino.h"
+
+// Gamma brightness lookup table <https://victornpb.github.io/gamma-table-generator>
+// gamma = 2.20 steps = 256 range = 0-255
+const uint8_t gamma_lut[256] = {
+     0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   1,
+     1,   1,   1,   1,   1,   1,   1,   1,   1,   2,   2,   2,   2,   2,   2,   2,
+     3,   3,   3,   3,   3,   4,   4,   4,   4,   5,   5,   5,   5,   6,   6,   6,
+     6,   7,   7,   7,   8,   8,   8,   9,   9,   9,  10,  10,  11,  11,  11,  12,
+    12,  13,  13,  13,  14,  14,  15,  15,  16,  16,  17,  17,  18,  18,  19,  19,
+    20,  20,  21,  22,  22,  23,  23,  24,  25,  25,  26,  26,  27,  28,  28,  29,
+    30,  30,  31,  32,  33,  33,  34,  35,  35,  36,  37,  38,  39,  39,  40,  41,
+    42,  43,  43,  44,  45,  46,  47,  48,  49,  49,  50,  51,  52,  53,  54,  55,
+    56,  57,  58,  59,  60,  61,  62,  63,  64,  65,  66,  67,  68,  69,  70,  71,
+    73,  74,  75,  76,  77,  78,  79,  81,  82,  83,  84,  85,  87,  88,  89,  90,
+    91,  93,  94,  95,  97,  98,  99, 100, 102, 103, 105, 106, 107, 109, 110, 111,
+   113, 114, 116, 117, 119, 120, 121, 123, 124, 126, 127, 129, 130, 132, 133, 135,
+   137, 138, 140, 141, 143, 145, 146, 148, 149, 151, 153, 154, 156, 158, 159, 161,
+   163, 165, 166, 168, 170, 172, 173, 175, 177, 179, 181, 182, 184, 186, 188, 190,
+   192, 194, 196, 197, 199, 201, 203, 205, 207, 209, 211, 213, 215, 217, 219, 221,
+   223, 225, 227, 229, 231, 234, 236, 238, 240, 242, 244, 246, 248, 251, 253, 255,
+  };
+
+// Writes an output value (after gamma correction) to a pin. Pins without a
+// TCA0 split mode channel use analogWrite().
+template <uint8_t PIN>
+struct PwmChannel {
+  static void write(uint8_t value) {
+    analogWrite(PIN, value);
+  }
+};
+
+// TCA0 split mode channels of the 20 pin parts (default PORTMUX). Split mode
+// has no buffered compare registers; a new value is used from the next
+// compare match.
+#define PWM_CHANNEL(PIN, COMPARE, ENABLE)                      \
+  template <>                                                  \
+  struct PwmChannel<PIN> {                                     \
+    static void write(uint8_t value) {                         \
+      if (value == 0 || value == 255) {                        \
+        TCA0.SPLIT.CTRLB &= ~(ENABLE);                         \
+        digitalWriteFast(PIN, value ? HIGH : LOW);             \
+      } else {                                                 \
+        TCA0.SPLIT.COMPARE = value;                            \
+        TCA0.SPLIT.CTRLB |= (ENABLE);                          \
+      }                                                        \
+    }                                                          \
+  };
+
+PWM_CHANNEL(PIN_PB0, LCMP0, TCA_SPLIT_LCMP0EN_bm)
+PWM_CHANNEL(PIN_PB1, LCMP1, TCA_SPLIT_LCMP1EN_bm)
+PWM_CHANNEL(PIN_PB2, LCMP2, TCA_SPLIT_LCMP2EN_bm)
+PWM_CHANNEL(PIN_PA3, HCMP0, TCA_SPLIT_HCMP0EN_bm)
+PWM_CHANNEL(PIN_PA4, HCMP1, TCA_SPLIT_HCMP1EN_bm)
+PWM_CHANNEL(PIN_PA5, HCMP2, TCA_SPLIT_HCMP2EN_bm)
+
+#undef PWM_CHANNEL
+
+template <uint8_t PIN>
+class OutputStage {
+public:
+  static uint8_t getPin() {
+    return PIN;
+  }
+
+  // Brightness level (before gamma correction) currently output.
+  static uint8_t getLevel() {
+    return _level;
+  }
+
+  // Brightness level last written, which the output is slewing to.
+  static uint8_t getTarget() {
+    return _target;
+  }
+
+  // Brightness steps per millisecond, 0 for no limit.
+  static uint8_t getMaxSlew() {
+    return _maxSlew;
+  }
+
+  static void setMaxSlew(uint8_t maxSlew) {
+    _maxSlew = maxSlew;
+  }
+
+  static void write(uint8_t level) {
+    if (_maxSlew == 0 || !_written) {
+      _target = level;
+      output(level);
+      return;
+    }
+
+    if (_level == _target) {
+      // start slewing from now, not from the last change
+      _lastSlewTime = millis();
+    }
+    _target = level;
+  }
+
+  // Moves the output towards the last level written under the slew limit.
+  static void update(unsigned long now) {
+    if (_level == _target) {
+      return;
+    }
+
+    unsigned long elapsed = now - _lastSlewTime;
+    if (elapsed == 0) {
+      return;
+    }
+    _lastSlewTime = now;
+
+    uint16_t step = (elapsed >= 255) ? 255 : (uint16_t)elapsed * _maxSlew;
+    if (_maxSlew == 0 || step >= 255) {
+      output(_target);
+    } else if (_target > _level) {
+      output((_target - _level > step) ? _level + step : _target);
+    } else {
+      output((_level - _target > step) ? _level - step : _target);
+    }
+  }
+
+  // True if the output is at the last level written.
+  static bool settled() {
+    return _level == _target;
+  }
+
+protected:
+  static void output(uint8_t level) {
+    if (_written && level == _level) {
+      return;
+    }
+    _level = level;
+    _written = true;
+
+    PwmChannel<PIN>::write(gamma_lut[level]);
+  }
+
+  static uint8_t _level;
+  static uint8_t _target;
+  static uint8_t _maxSlew;
+  static bool _written;
+  static unsigned long _lastSlewTime;
+};
+
+template <uint8_t PIN> uint8_t OutputStage<PIN>::_level = 0;
+template <uint8_t PIN> uint8_t OutputStage<PIN>::_target = 0;
+template <uint8_t PIN> uint8_t OutputStage<PIN>::_maxSlew = 0;
+template <uint8_t PIN> bool OutputStage<PIN>::_written = false;
+template <uint8_t PIN> unsigned long OutputStage<PIN>::_lastSlewTime = 0;
+
+// OutputStages addressed by channel number.
+template <uint8_t... PINS>
+struct OutputBank;
+
+template <uint8_t PIN>
+struct OutputBank<PIN> {
+  static const uint8_t CHANNELS = 1;
+
+  static void write(uint8_t channel, uint8_t level) {
+    OutputStage<PIN>::write(level);
+  }
+
+  static uint8_t getTarget(uint8_t channel) {
+    return OutputStage<PIN>::getTarget();
+  }
+
+  static void setMaxSlew(uint8_t maxSlew) {
+    OutputStage<PIN>::setMaxSlew(maxSlew);
+  }
+
+  static void update(unsigned long now) {
+    OutputStage<PIN>::update(now);
+  }
+
+  static bool settled() {
+    return OutputStage<PIN>::settled();
+  }
+};
+
+template <uint8_t PIN, uint8_t... MORE>
+struct OutputBank<PIN, MORE...> {
+  static const uint8_t CHANNELS = 1 + sizeof...(MORE);
+
+  static void write(uint8_t channel, uint8_t level) {
+    if (channel == 0) {
+      OutputStage<PIN>::write(level);
+    } else {
+      OutputBank<MORE...>::write(channel - 1, level);
+    }
+  }
+
+  static uint8_t getTarget(uint8_t channel) {
+    if (channel == 0) {
+      return OutputStage<PIN>::getTarget();
+    }
+    return OutputBank<MORE...>::getTarget(channel - 1);
+  }
+
+  static void setMaxSlew(uint8_t maxSlew) {
+    OutputStage<PIN>::setMaxSlew(maxSlew);
+    OutputBank<MORE...>::setMaxSlew(maxSlew);
+  }
+
+  static void update(unsigned long now) {
+    OutputStage<PIN>::update(now);
+    OutputBank<MORE...>::update(now);
+  }
+
+  static bool settled() {
+    return OutputStage<PIN>::settled() && OutputBank<MORE...>::settled();
+  }
+};
+#endif
@@ -0,0 +1,213 @@
+//***************************************************************
+// Pixel strip.
+//
+// Define PIXEL_STRIP to the number of NeoPixels chained after the status
+// pixel on NEOPIXEL to also show channel 0's effect on them:
+//   #define PIXEL_STRIP 8
+//
+// Every pixel runs the effect in its own effect slot (after the channel
+// slots, see Effect.h), so the random effects draw their own numbers for
+// each pixel and flicker independently. Pixel i starts an effect
+// i * PIXEL_PHASE_STEP milliseconds after the change, which offsets the
+// waves along the strip and wipes a new effect in from the first pixel. The
+// level is gamma corrected and scales PIXEL_STRIP_COLOR. While the seesaw
+// controller drives channel 0 the whole strip shows its level.
+//
+// Frames are rendered at most PIXEL_FRAME_RATE times a second, and only
+// when a pixel's effect is due to change. The steps an effect was due to
+// take since the last frame are run at their own times (up to
+// PIXEL_MAX_STEPS), so effects faster than the frame rate keep their speed.
+// A frame is worked out a few
+// pixels at a time (PIXEL_UPDATES_PER_PASS per loop() pass) straight into
+// the pixels buffer, and then sent by statusLedUpdate() (StatusLed.h). So
+// show() does nothing but send the bytes, and it is still put off around
+// I2C reads.
+//
+// The effects run on the shared clock (Sync.h) like the channels'.
+//
+// show() keeps interrupts off for 30 us per pixel. PIXEL_STRIP is limited
+// to 32 so that, with the status pixel, the whole chain is sent within one
+// millis() tick.
+//***************************************************************
+
+#ifndef PixelStrip_h
+#define PixelStrip_h
+
+#include "Arduino.h"
+#include "Channels.h"
+#include "Clock.h"
+#include "Effect.h"
+#include "Power.h"
+#include "StatusLed.h"
+#include "Sync.h"
+
+#if PIXEL_STRIP > 32
+  #error "show() would keep interrupts off for longer than a millis() tick"
+#endif
+
+#ifndef PIXEL_FRAME_RATE
+  #define PIXEL_FRAME_RATE 50 // frames per second at most
+#endif
+
+#ifndef PIXEL_UPDATES_PER_PASS
+  #define PIXEL_UPDATES_PER_PASS 4
+#endif
+
+#ifndef PIXEL_PHASE_STEP
+  #define PIXEL_PHASE_STEP 40 // milliseconds between the pixels' effect starts
+#endif
+
+#ifndef PIXEL_STRIP_COLOR
+  #define PIXEL_STRIP_COLOR 0xFF9329 // warm white at full level
+#endif
+
+#define PIXEL_MAX_STEPS 8 // effect steps per pixel and frame
+
+#define PIXEL_FRAME_TIME (MILLISECONDS_PER_SECOND / PIXEL_FRAME_RATE)
+#define PIXEL_STRIP_SLOT (2 * OUTPUT_CHANNELS) // slot of the first pixel
+
+Effect *pixelStripEffect = NULL;     // channel 0's effect
+unsigned long pixelChangeTime = 0;   // frame that started pixelStripEffect
+Effect *pixelEffect[PIXEL_STRIP];    // effect each pixel is running
+
+unsigned long pixelFrameTime = 0;    // of the frame being (or last) rendered
+unsigned long pixelLastFrameTime = 0;
+unsigned long pixelFrameWait = 0;    // milliseconds from pixelFrameTime to the next frame
+bool pixelFrameDue = true;           // pixelStripEffect changed
+bool pixelFrameChanged = false;
+uint8_t pixelNext = PIXEL_STRIP;     // next pixel of the frame, PIXEL_STRIP when done
+
+// Called when channel 0 changes effects. The next frame starts it.
+void pixelsSetEffect(Effect *effect) {
+  pixelStripEffect = effect;
+  pixelFrameDue = true;
+}
+
+// Starts the effects of the pixels again. Called when the shared clock
+// was set (Sync.h).
+void pixelsRestart() {
+  for (uint8_t pixel = 0; pixel < PIXEL_STRIP; pixel++) {
+    if (pixelEffect[pixel] != NULL) {
+      pixelEffect[pixel]->exit(PIXEL_STRIP_SLOT + pixel);
+      pixelEffect[pixel] = NULL;
+    }
+  }
+  pixelFrameTime = syncMillis();
+  pixelFrameDue = true;
+  pixelNext = PIXEL_STRIP;
+}
+
+// Wakes loop() up for the next frame.
+void pixelsWake(unsigned long now) {
+  unsigned long remaining = pixelFrameTime + pixelFrameWait - now;
+  if ((long)remaining < 0) {
+    remaining = 0;
+  }
+  powerWakeIn(remaining);
+}
+
+// Renders a pixel of the frame. Returns the milliseconds until it changes.
+unsigned long pixelRender(uint8_t pixel) {
+  uint8_t slot = PIXEL_STRIP_SLOT + pixel;
+  unsigned long start = (unsigned long)pixel * PIXEL_PHASE_STEP;
+  unsigned long elapsed = pixelFrameTime - pixelChangeTime;
+  unsigned long idle = EFFECT_IDLE_FOREVER;
+  uint8_t level = 0;
+
+  Effect *effect = pixelEffect[pixel];
+  if (elapsed >= start) {
+    effect = pixelStripEffect;
+  } else {
+    idle = start - elapsed;
+  }
+  if (effect != pixelEffect[pixel]) {
+    if (pixelEffect[pixel] != NULL) {
+      pixelEffect[pixel]->exit(slot);
+    }
+    pixelEffect[pixel] = effect;
+    if (effect != NULL) {
+      effect->enter(slot);
+    }
+  }
+
+  if (channelPeripheral & 1) {
+    level = channelLevel[0];
+    idle = PIXEL_FRAME_TIME;
+  } else if (effect != NULL) {
+    unsigned long time = pixelLastFrameTime;
+    for (uint8_t steps = 0; steps < PIXEL_MAX_STEPS; steps++) {
+      unsigned long due = effect->getIdleTime(slot, time);
+      if (due == EFFECT_IDLE_FOREVER || due > pixelFrameTime - time) {
+        break;
+      }
+      time += due;
+      effect->update(slot, time);
+    }
+    effect->update(slot, pixelFrameTime);
+    level = slotLevel[slot];
+    unsigned long effectIdle = effect->getIdleTime(slot, pixelFrameTime);
+    if (effectIdle < idle) {
+      idle = effectIdle;
+    }
+  }
+
+  uint32_t color = statusLedScale(PIXEL_STRIP_COLOR, gamma_lut[level]);
+  if (color != statusLeds->getPixelColor(1 + pixel)) {
+    statusLeds->setPixelColor(1 + pixel, color);
+    pixelFrameChanged = true;
+  }
+  return idle;
+}
+
+// Called from loop() after channelsUpdate() with millis().
+void pixelsUpdate(unsigned long now) {
+  if (statusLeds == NULL) {
+    return;
+  }
+
+  now = syncMillisAt(now);
+
+  if (pixelNext >= PIXEL_STRIP) {
+    if (!pixelFrameDue && now - pixelFrameTime < pixelFrameWait) {
+      if (pixelFrameWait != EFFECT_IDLE_FOREVER) {
+        pixelsWake(now);
+      }
+      return;
+    }
+    // start a frame
+    clockBusy();
+    pixelLastFrameTime = pixelFrameTime;
+    pixelFrameTime = now;
+    pixelFrameWait = EFFECT_IDLE_FOREVER;
+    if (pixelFrameDue) {
+      pixelChangeTime = now;
+      pixelFrameDue = false;
+    }
+    pixelNext = 0;
+  }
+
+  for (uint8_t n = 0; n < PIXEL_UPDATES_PER_PASS && pixelNext < PIXEL_STRIP; n++, pixelNext++) {
+    unsigned long idle = pixelRender(pixelNext);
+    if (idle < pixelFrameWait) {
+      pixelFrameWait = idle;
+    }
+  }
+
+  if (pixelNext < PIXEL_STRIP) {
+    // the rest of the frame on the next pass
+    powerWakeIn(0);
+    return;
+  }
+
+  if (pixelFrameChanged) {
+    statusLedShowFrame();
+    pixelFrameChanged = false;
+  }
+  if (pixelFrameWait < PIXEL_FRAME_TIME) {
+    pixelFrameWait = PIXEL_FRAME_TIME;
+  }
+  if (pixelFrameWait != EFFECT_IDLE_FOREVER) {
+    pixelsWake(now);
+  }
+}
+#endif
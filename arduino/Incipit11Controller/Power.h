@@ -0,0 +1,311 @@
+//***************************************************************
+// Sleep between loop() passes.
+//
+// Define POWER_SAVE before including this file (it is included by
+// DOA_seesawCompatibility.h) to let loop() sleep:
+//   #define POWER_SAVE
+//
+// loop() calls powerStartLoop() first. Everything that has to run again at a
+// certain time asks for it with powerWakeAt() or powerWakeIn(), and
+// powerSleep() at the end of loop() sleeps until the earliest of them:
+//
+//   - Standby ("off" mode) when the wait is at least POWER_MIN_STANDBY and the
+//     PWM timer isn't driving any output (every output is fully off or fully
+//     on). The CPU, TCA0 and the millis timer are stopped and only the RTC
+//     runs from the 32 kHz oscillator. millis() is moved forward by the RTC
+//     count when waking up so timers that span the sleep still expire.
+//   - Idle otherwise. The CPU stops until the next interrupt, at the latest
+//     the next millis tick.
+//
+// Standby wakes up on the RTC compare at the deadline, a button or trigger
+// pin change and an I2C address match. An interrupt between
+// powerStartLoop() and powerSleep() cancels the sleep so its work is done
+// by the next loop() pass.
+//
+// The time spent in each mode is readable through the DOA_SEESAW_POWER_BASE
+// seesaw registers and traced every POWER_REPORT_INTERVAL.
+//
+// If POWER_SAVE is not defined the functions do nothing.
+//***************************************************************
+
+#ifndef Power_h
+#define Power_h
+
+#include "Arduino.h"
+#include "Capture.h"
+#include "Trace.h"
+#include <avr/sleep.h>
+
+#ifndef POWER_MAX_SLEEP
+  #define POWER_MAX_SLEEP 60000 // milliseconds; RTC ticks * 1000 have to fit in 32 bits
+#endif
+
+#ifndef POWER_MIN_STANDBY
+  #define POWER_MIN_STANDBY 20 // milliseconds; shorter waits use idle
+#endif
+
+#ifndef POWER_REPORT_INTERVAL
+  #define POWER_REPORT_INTERVAL 60000 // milliseconds
+#endif
+
+// Pins that wake up from standby on a change.
+#ifndef POWER_WAKE_PORT
+  #define POWER_WAKE_PORT      PORTA
+  #define POWER_WAKE_PORT_vect PORTA_PORT_vect
+  #define POWER_WAKE_PIN_A     PIN4CTRL // PIN_BUTTON
+  #define POWER_WAKE_PIN_B     PIN6CTRL // PIN_TRIGGER
+#endif
+
+enum PowerMode : uint8_t {
+  POWER_RUN = 0,
+  POWER_IDLE,
+  POWER_STANDBY,
+  POWER_MODE_COUNT // keep this at the end
+};
+
+// milliseconds spent in each mode since reset (POWER_RUN is worked out from
+// millis() when it is read)
+volatile uint32_t powerModeMillis[POWER_MODE_COUNT];
+volatile uint32_t powerStandbyCount = 0;
+volatile bool powerInterrupted = false;
+volatile bool powerMillisStopped = false; // in standby, so an ISR can't tell the time
+
+unsigned long powerLoopMillis = 0;
+unsigned long powerSleepMillis = 0;
+unsigned long powerLastReport = 0;
+
+void powerWakeIn(unsigned long ms) {
+  if (ms < powerSleepMillis) {
+    powerSleepMillis = ms;
+  }
+}
+
+void powerWakeAt(unsigned long time) {
+  unsigned long remaining = time - powerLoopMillis;
+  if ((long)remaining < 0) {
+    remaining = 0;
+  }
+  powerWakeIn(remaining);
+}
+
+// Called from ISRs that change what loop() has to do.
+inline void powerInterrupt() {
+  powerInterrupted = true;
+}
+
+// Milliseconds spent in mode since reset.
+uint32_t powerGetMillis(uint8_t mode) {
+  uint8_t sreg = SREG;
+  cli();
+  uint32_t value = powerModeMillis[mode];
+  if (mode == POWER_RUN) {
+    value = millis() - powerModeMillis[POWER_IDLE] - powerModeMillis[POWER_STANDBY];
+  }
+  SREG = sreg;
+  return value;
+}
+
+#ifdef POWER_SAVE
+
+uint32_t powerIdleMicros = 0;
+uint16_t powerTickRemainder = 0;
+volatile uint8_t powerRtcOverflows = 0; // in this standby
+uint8_t powerRtcWraps = 0;              // overflows before the compare match that ends it
+
+ISR(RTC_CNT_vect) {
+  uint8_t flags = RTC.INTFLAGS;
+  RTC.INTFLAGS = flags;
+  if (flags & RTC_OVF_bm) {
+    powerRtcOverflows++;
+  }
+  if ((flags & RTC_CMP_bm) && powerRtcOverflows >= powerRtcWraps) {
+    powerInterrupted = true;
+  }
+}
+
+ISR(POWER_WAKE_PORT_vect) {
+  POWER_WAKE_PORT.INTFLAGS = POWER_WAKE_PORT.INTFLAGS;
+  powerInterrupted = true;
+}
+
+// The RTC counts the internal 32 kHz oscillator and keeps running in
+// standby. A standby of more than the 2 seconds of the 16 bit count sleeps on
+// through the overflows in between. Counting every tick rather than 1024 a
+// second keeps millis() (and the shared clock of Sync.h) within 31 us over a
+// standby that a pin or I2C ends between two ticks.
+void powerBegin() {
+  while (RTC.STATUS != 0) {
+    // wait for the RTC registers to synchronize
+  }
+  RTC.CLKSEL = RTC_CLKSEL_INT32K_gc;
+  RTC.PER = 0xFFFF;
+  RTC.INTCTRL = 0;
+  RTC.CTRLA = RTC_PRESCALER_DIV1_gc | RTC_RTCEN_bm | RTC_RUNSTDBY_bm;
+}
+
+void powerStartLoop(unsigned long now) {
+  powerLoopMillis = now;
+  powerSleepMillis = POWER_MAX_SLEEP;
+  powerInterrupted = false;
+
+  if (now - powerLastReport >= POWER_REPORT_INTERVAL) {
+    powerLastReport = now;
+    // share of the time the CPU was running, in 1/1000
+    TRACE1(TRACE_POWER_DUTY, (uint32_t)((uint64_t)powerGetMillis(POWER_RUN) * 1000 / (now + 1)));
+  }
+}
+
+bool powerPWMActive() {
+  return TCA0.SPLIT.CTRLB != 0;
+}
+
+void powerStandby(unsigned long ms) {
+  // the USART stops in standby
+  TRACE_FLUSH();
+
+  cli();
+  if (powerInterrupted) {
+    sei();
+    return;
+  }
+
+  // Sleep until millis() gets to the deadline rather than for ms from now,
+  // which would add the part of the loop() pass after a millis() tick.
+  unsigned long before = millis();
+  unsigned long left = powerLoopMillis + ms - before;
+  if ((long)left <= 0) {
+    sei();
+    return;
+  }
+  uint32_t ticks = (((uint32_t)left << 15) - powerTickRemainder + 999) / 1000;
+  stop_millis();
+  powerMillisStopped = true;
+  CAPTURE_STANDBY();
+  uint8_t tcaCtrlA = TCA0.SPLIT.CTRLA;
+  TCA0.SPLIT.CTRLA = tcaCtrlA & ~TCA_SPLIT_ENABLE_bm;
+
+  while (RTC.STATUS & (RTC_CNTBUSY_bm | RTC_CMPBUSY_bm)) {
+    // wait for the RTC registers to synchronize
+  }
+  RTC.CNT = 0;
+  RTC.CMP = (uint16_t)ticks;
+  RTC.INTFLAGS = RTC_CMP_bm | RTC_OVF_bm;
+  RTC.INTCTRL = RTC_CMP_bm | RTC_OVF_bm;
+  powerRtcOverflows = 0;
+  powerRtcWraps = ticks >> 16;
+
+  POWER_WAKE_PORT.POWER_WAKE_PIN_A = (POWER_WAKE_PORT.POWER_WAKE_PIN_A & ~PORT_ISC_gm) | PORT_ISC_BOTHEDGES_gc;
+  POWER_WAKE_PORT.POWER_WAKE_PIN_B = (POWER_WAKE_PORT.POWER_WAKE_PIN_B & ~PORT_ISC_gm) | PORT_ISC_BOTHEDGES_gc;
+
+  set_sleep_mode(SLEEP_MODE_STANDBY);
+  sleep_enable();
+  uint8_t overflows;
+  do {
+    overflows = powerRtcOverflows;
+    sei(); // the next instruction runs before any interrupt
+    sleep_cpu();
+    cli();
+    // back to sleep after an overflow
+  } while (!powerInterrupted && powerRtcOverflows != overflows);
+  sleep_disable();
+  sei();
+
+  while (RTC.STATUS & RTC_CNTBUSY_bm) {
+    // wait for the RTC count to synchronize
+  }
+  uint16_t count;
+  do {
+    // again if it overflowed in between
+    overflows = powerRtcOverflows;
+    count = RTC.CNT;
+  } while (overflows != powerRtcOverflows);
+  RTC.INTCTRL = 0;
+  uint32_t elapsed = ((uint32_t)overflows << 16) | count;
+  POWER_WAKE_PORT.POWER_WAKE_PIN_A &= ~PORT_ISC_gm;
+  POWER_WAKE_PORT.POWER_WAKE_PIN_B &= ~PORT_ISC_gm;
+
+  TCA0.SPLIT.CTRLA = tcaCtrlA;
+
+  // ticks to milliseconds, keeping the remainder so no time is lost
+  uint32_t scaled = elapsed * 1000 + powerTickRemainder;
+  uint32_t slept = scaled >> 15;
+  powerTickRemainder = scaled & 0x7FFF;
+
+  restart_millis();
+  set_millis(before + slept);
+  powerMillisStopped = false;
+  CAPTURE_WAKE();
+
+  cli();
+  powerModeMillis[POWER_STANDBY] += slept;
+  powerStandbyCount++;
+  sei();
+}
+
+void powerIdle() {
+  unsigned long before = micros();
+
+  set_sleep_mode(SLEEP_MODE_IDLE);
+  cli();
+  if (powerInterrupted) {
+    sei();
+    return;
+  }
+  sleep_enable();
+  sei(); // the next instruction runs before any interrupt
+  sleep_cpu();
+  sleep_disable();
+
+  powerIdleMicros += micros() - before;
+  if (powerIdleMicros >= 1000) {
+    cli();
+    powerModeMillis[POWER_IDLE] += powerIdleMicros / 1000;
+    sei();
+    powerIdleMicros %= 1000;
+  }
+}
+
+// micros() with the part of a millisecond that standby slept and millis()
+// doesn't show yet (it is carried over to the next standby).
+unsigned long powerMicros() {
+  return micros() + (((uint32_t)powerTickRemainder * 1000) >> 15);
+}
+
+// True when powerSleep() is going to use standby.
+bool powerWillStandby() {
+  return (powerSleepMillis >= POWER_MIN_STANDBY) && !powerPWMActive();
+}
+
+// Called at the end of loop().
+void powerSleep() {
+  if (powerSleepMillis == 0) {
+    return;
+  }
+
+  if (powerWillStandby()) {
+    powerStandby(powerSleepMillis);
+  } else {
+    powerIdle();
+  }
+}
+
+//***************************************************************
+#else
+
+void powerBegin() {}
+void powerStartLoop(unsigned long now) {
+  powerLoopMillis = now;
+  powerSleepMillis = POWER_MAX_SLEEP;
+}
+bool powerWillStandby() {
+  return false;
+}
+void powerSleep() {}
+unsigned long powerMicros() {
+  return micros();
+}
+
+#endif
+//***************************************************************
+
+#endif
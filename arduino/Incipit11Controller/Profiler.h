@@ -0,0 +1,260 @@
+//***************************************************************
+// Loop phase and I2C ISR cycle profiler.
+//
+// Define PROFILER before including this file (it is included by
+// DOA_seesawCompatibility.h) to turn on the instrumentation:
+//   #define PROFILER
+//
+// A free running TCB counts CPU cycles. Each phase of loop() and each I2C
+// callback records its duration into a min/max/mean summary and a log2
+// histogram. The interrupt latency is sampled by the TCB's own overflow
+// interrupt, which reads how far the count got before it was taken. The results are readable through the DOA_SEESAW_PROFILER_BASE
+// seesaw registers and are dumped to the debug serial every
+// PROFILER_DUMP_INTERVAL milliseconds when DEBUG is also defined.
+//
+// If PROFILER is not defined the macros are blank and no timer or RAM is used.
+//***************************************************************
+
+#ifndef Profiler_h
+#define Profiler_h
+
+#include "Arduino.h"
+#include "DebugMacros.h"
+
+// The phases that are measured. Keep the I2C ISR phases at the end.
+enum ProfilerPhase : uint8_t {
+  PROFILE_BUTTON_TICK = 0, // button.tick()
+  PROFILE_TRIGGER_TICK,    // trigger.tick()
+  PROFILE_GPIO_FLAGS,      // seesaw GPIO button/trigger flag handling
+  PROFILE_STATE_MACHINE,   // stateMachine.update()
+  PROFILE_EFFECT_UPDATE,   // channelsUpdate() (and pixelsUpdate())
+  PROFILE_SEESAW_RUN,      // DOA_seesawCompatibility_run()
+  PROFILE_STATUS_LED,      // statusLedUpdate()
+  PROFILE_PIXEL_SHOW,      // tinyNeoPixel show(), part of PROFILE_STATUS_LED
+  PROFILE_LOOP,            // whole loop()
+  PROFILE_I2C_RECEIVE,     // receiveData() (Wire onReceive ISR)
+  PROFILE_I2C_REQUEST,     // requestData() (Wire onRequest ISR)
+  PROFILE_ISR_LATENCY,     // overflow to PROFILER_TIMER_vect, see below
+  PROFILER_PHASE_COUNT     // keep this at the end
+};
+
+// Histogram bin i counts durations of 2^(i + PROFILER_HISTOGRAM_SHIFT) up to
+// 2^(i + PROFILER_HISTOGRAM_SHIFT + 1) - 1 cycles. The first bin also holds
+// the shorter durations and the last bin holds all of the longer durations.
+#define PROFILER_HISTOGRAM_BINS  16
+#define PROFILER_HISTOGRAM_SHIFT 4
+
+#ifdef PROFILER
+
+// Timer used for counting cycles. TCB1 is not used by megaTinyCore unless it
+// was selected as the millis timer.
+#ifndef PROFILER_TIMER
+  #define PROFILER_TIMER      TCB1
+  #define PROFILER_TIMER_vect TCB1_INT_vect
+#endif
+
+#ifndef PROFILER_DUMP_INTERVAL
+  #define PROFILER_DUMP_INTERVAL 10000 // milliseconds
+#endif
+
+struct ProfilerStats {
+  uint32_t min;   // cycles
+  uint32_t max;   // cycles
+  uint32_t total; // cycles, halved together with count to avoid overflow
+  uint16_t count;
+  uint16_t histogram[PROFILER_HISTOGRAM_BINS];
+};
+
+// Names for the serial dump, kept in flash.
+const char profilerPhaseNames[PROFILER_PHASE_COUNT][12] PROGMEM = {
+  "button",
+  "trigger",
+  "gpio",
+  "state",
+  "effect",
+  "seesaw",
+  "status",
+  "show",
+  "loop",
+  "i2c rx",
+  "i2c tx",
+  "isr latency",
+};
+
+ProfilerStats profilerStats[PROFILER_PHASE_COUNT];
+volatile uint16_t profilerOverflows = 0;
+unsigned long profilerLastDump = 0;
+
+void profilerReset() {
+  uint8_t sreg = SREG;
+  cli();
+  for (uint8_t i = 0; i < PROFILER_PHASE_COUNT; i++) {
+    memset(&profilerStats[i], 0, sizeof(ProfilerStats));
+    profilerStats[i].min = 0xFFFFFFFF;
+  }
+  SREG = sreg;
+}
+
+// Start the free running cycle counter. 0xFFFF is the top value so an
+// overflow interrupt is taken every 65536 cycles to extend it to 32 bits.
+void profilerBegin() {
+  profilerReset();
+
+  PROFILER_TIMER.CTRLA = 0;
+  PROFILER_TIMER.CTRLB = TCB_CNTMODE_INT_gc;
+  PROFILER_TIMER.CCMP = 0xFFFF;
+  PROFILER_TIMER.CNT = 0;
+  PROFILER_TIMER.INTFLAGS = TCB_CAPT_bm;
+  PROFILER_TIMER.INTCTRL = TCB_CAPT_bm;
+  PROFILER_TIMER.CTRLA = TCB_CLKSEL_CLKDIV1_gc | TCB_ENABLE_bm;
+}
+
+// Current cycle count.
+inline uint32_t profilerNow() {
+  uint8_t sreg = SREG;
+  cli();
+  uint16_t count = PROFILER_TIMER.CNT;
+  uint16_t overflows = profilerOverflows;
+  // overflow happened but the interrupt has not been serviced yet
+  if ((PROFILER_TIMER.INTFLAGS & TCB_CAPT_bm) && (count < 0x8000)) {
+    overflows++;
+  }
+  SREG = sreg;
+  return ((uint32_t)overflows << 16) | count;
+}
+
+void profilerRecord(uint8_t phase, uint32_t cycles) {
+  uint8_t bin = 0;
+  uint32_t scaled = cycles >> (PROFILER_HISTOGRAM_SHIFT + 1);
+  while (scaled != 0 && bin < (PROFILER_HISTOGRAM_BINS - 1)) {
+    scaled >>= 1;
+    bin++;
+  }
+
+  // The stats are read from the I2C ISR so don't let it see a partial update.
+  uint8_t sreg = SREG;
+  cli();
+  ProfilerStats *stats = &profilerStats[phase];
+  if (cycles < stats->min) {
+    stats->min = cycles;
+  }
+  if (cycles > stats->max) {
+    stats->max = cycles;
+  }
+  if ((stats->count == 0xFFFF) || ((uint32_t)(stats->total + cycles) < stats->total)) {
+    // keep the mean but make room
+    stats->count >>= 1;
+    stats->total >>= 1;
+  }
+  stats->count++;
+  stats->total += cycles;
+  if (stats->histogram[bin] == 0xFFFF) {
+    // keep the shape of the histogram but make room
+    for (uint8_t i = 0; i < PROFILER_HISTOGRAM_BINS; i++) {
+      stats->histogram[i] >>= 1;
+    }
+  }
+  stats->histogram[bin]++;
+  SREG = sreg;
+}
+
+// The count was 0 at the overflow, so reading it first thing gives the
+// cycles it took to get here: the time interrupts were off (show(), the other
+// ISRs, cli() sections), the response and this ISR's prologue. The overflows
+// come at no particular point of the code, so the max of the samples gets
+// close to the worst case over a long enough run.
+ISR(PROFILER_TIMER_vect) {
+  uint16_t latency = PROFILER_TIMER.CNT;
+  PROFILER_TIMER.INTFLAGS = TCB_CAPT_bm;
+  profilerOverflows++;
+  profilerRecord(PROFILE_ISR_LATENCY, latency);
+}
+
+// Copy of the stats of a phase that is safe to read outside of the ISRs.
+// The mean is returned in total.
+void profilerGetStats(uint8_t phase, ProfilerStats *stats) {
+  uint8_t sreg = SREG;
+  cli();
+  *stats = profilerStats[phase];
+  SREG = sreg;
+
+  if (stats->count == 0) {
+    stats->min = 0;
+  } else {
+    stats->total /= stats->count;
+  }
+}
+
+// Records the time from construction to destruction. Used for functions with
+// more than one return, such as the I2C callbacks.
+class ProfilerScope {
+public:
+  ProfilerScope(uint8_t phase) : _phase(phase) {
+    _start = profilerNow();
+  }
+
+  ~ProfilerScope() {
+    profilerRecord(_phase, profilerNow() - _start);
+  }
+
+private:
+  uint8_t _phase;
+  uint32_t _start;
+};
+
+void profilerDump() {
+  ProfilerStats stats;
+
+  DPRINT(F("Profile (cycles at "));
+  DPRINT(F_CPU);
+  DPRINTLN(F(" Hz): phase count min mean max | log2 histogram"));
+  for (uint8_t phase = 0; phase < PROFILER_PHASE_COUNT; phase++) {
+    profilerGetStats(phase, &stats);
+    DPRINT((const __FlashStringHelper *)profilerPhaseNames[phase]);
+    DPRINT(F(" "));
+    DPRINT(stats.count);
+    DPRINT(F(" "));
+    DPRINT(stats.min);
+    DPRINT(F(" "));
+    DPRINT(stats.total);
+    DPRINT(F(" "));
+    DPRINT(stats.max);
+    DPRINT(F(" |"));
+    for (uint8_t bin = 0; bin < PROFILER_HISTOGRAM_BINS; bin++) {
+      DPRINT(F(" "));
+      DPRINT(stats.histogram[bin]);
+    }
+    DPRINTLN();
+  }
+}
+
+// Dump the profile every PROFILER_DUMP_INTERVAL. The dump itself happens
+// outside of the measured phases.
+void profilerPoll(unsigned long now) {
+  if (now - profilerLastDump >= PROFILER_DUMP_INTERVAL) {
+    profilerLastDump = now;
+    profilerDump();
+  }
+}
+
+#define PROFILER_BEGIN()         profilerBegin()
+#define PROFILE_START()          uint32_t _profileLoopStart = profilerNow(); uint32_t _profileStart = _profileLoopStart
+#define PROFILE_LAP(phase)       do { profilerRecord(phase, profilerNow() - _profileStart); _profileStart = profilerNow(); } while (0)
+#define PROFILE_LOOP_END()       profilerRecord(PROFILE_LOOP, profilerNow() - _profileLoopStart)
+#define PROFILE_SCOPE(phase)     ProfilerScope _profilerScope(phase)
+#define PROFILER_POLL(now)       profilerPoll(now)
+
+//***************************************************************
+#else
+
+#define PROFILER_BEGIN()
+#define PROFILE_START()
+#define PROFILE_LAP(phase)
+#define PROFILE_LOOP_END()
+#define PROFILE_SCOPE(phase)
+#define PROFILER_POLL(now)
+
+#endif
+//***************************************************************
+
+#endif
@@ -0,0 +1,259 @@
+//***************************************************************
+// Recorded performance.
+//
+// While a trigger is recorded, what the operator does to channel 0 is saved
+// as a stream of timed events in EEPROM: effect changes, levels set by the
+// seesaw controller and the controller letting go of the channel. The
+// triggered state replays the stream from the start of the trigger.
+//
+// The stream is compressed for the little EEPROM there is:
+//   - Times are the milliseconds since the previous event, as 7 bit groups
+//     (least significant first, top bit set on all but the last).
+//   - A level is sent as the change from the previous one when it fits in
+//     a signed byte.
+//   - A run of identical events (same kind, value and time since the
+//     previous one, like a controller ramping a level) is stored once with
+//     a repeat count.
+// So a run takes 3 bytes (4 if it is 128 ms or more after the previous
+// event, 5 from 16.4 s) for up to RECORDING_REPEAT_MAX events:
+//   byte 0   kind << 6 | (repeats - 1)
+//   time     1-3 bytes
+//   value    effect, level or level change
+//
+// The run being recorded is kept in RAM and only written to EEPROM when a
+// different event comes in, so a run costs its bytes of EEPROM wear once.
+// The first byte at CONFIG_RECORDING_EEPROM_ADDR is the length of the
+// stream. recordingAdd() returns false when the stream is full and the
+// recording has to stop there to be replayed as it was done.
+//
+// Define CONFIG_RECORDING_EEPROM_ADDR before including this file to move the
+// stream in EEPROM.
+//***************************************************************
+
+#ifndef Recording_h
+#define Recording_h
+
+#include "Arduino.h"
+#include "Telemetry.h"
+#include <EEPROM.h>
+
+#ifndef CONFIG_RECORDING_EEPROM_ADDR
+  #define CONFIG_RECORDING_EEPROM_ADDR 0x20
+#endif
+
+#define RECORDING_SIZE 96 // bytes of EEPROM, including the length
+#define RECORDING_REPEAT_MAX 64
+
+enum RecordingEvent : uint8_t {
+  RECORDING_EFFECT = 0,  // value: effect
+  RECORDING_LEVEL,       // value: level set by the seesaw controller
+  RECORDING_LEVEL_CHANGE, // value: int8_t change of the level (stream only)
+  RECORDING_RELEASE      // the seesaw controller let go of the channel
+};
+
+struct RecordingRun {
+  uint32_t time;   // milliseconds since the previous event
+  uint8_t kind;
+  uint8_t value;
+  uint8_t repeats; // 0 when there is no run
+};
+
+// writing
+RecordingRun recordingRun;
+uint8_t recordingLength = 0;     // bytes of the stream in EEPROM
+uint16_t recordingEvents = 0;
+unsigned long recordingTime = 0; // of the previous event
+uint8_t recordingLevel = 0;      // previous level
+bool recordingLevelSet = false;
+
+// replay
+RecordingRun replayRun;
+uint8_t replayPosition = 0;      // next byte of the stream
+uint8_t replayLength = 0;
+unsigned long replayTime = 0;    // of the next event
+uint8_t replayLevel = 0;
+
+volatile bool recordingClearRequested = false;
+
+uint8_t recordingTimeSize(uint32_t time) {
+  uint8_t size = 1;
+  while (time >= 0x80) {
+    time >>= 7;
+    size++;
+  }
+  return size;
+}
+
+uint8_t recordingRunSize(const RecordingRun &run) {
+  return 2 + recordingTimeSize(run.time);
+}
+
+void recordingWriteRun() {
+  uint32_t time = recordingRun.time;
+  uint8_t address = CONFIG_RECORDING_EEPROM_ADDR + 1 + recordingLength;
+
+  telemetryEEPROMPut(address++, (uint8_t)((recordingRun.kind << 6) | (recordingRun.repeats - 1)));
+  while (time >= 0x80) {
+    telemetryEEPROMPut(address++, (uint8_t)(time | 0x80));
+    time >>= 7;
+  }
+  telemetryEEPROMPut(address++, (uint8_t)time);
+  telemetryEEPROMPut(address++, recordingRun.value);
+
+  recordingLength = address - (CONFIG_RECORDING_EEPROM_ADDR + 1);
+  recordingRun.repeats = 0;
+}
+
+// Empties the stream, for a trigger set without a recording.
+void recordingClear() {
+  telemetryEEPROMPut(CONFIG_RECORDING_EEPROM_ADDR, (uint8_t)0);
+}
+
+// Called from loop(). Empties the stream when the I2C ISR asked for it with
+// recordingClearRequested, so the EEPROM is written here.
+void recordingUpdate() {
+  if (recordingClearRequested) {
+    recordingClearRequested = false;
+    recordingClear();
+  }
+}
+
+void recordingStart(unsigned long now) {
+  recordingRun.repeats = 0;
+  recordingLength = 0;
+  recordingEvents = 0;
+  recordingTime = now;
+  recordingLevelSet = false;
+  recordingClear();
+}
+
+// Adds an event at now. Returns false (and drops the event) when the
+// stream is full.
+bool recordingAdd(unsigned long now, uint8_t kind, uint8_t value) {
+  RecordingRun run;
+
+  run.time = now - recordingTime;
+  run.kind = kind;
+  run.value = value;
+  run.repeats = 1;
+
+  if (kind == RECORDING_LEVEL) {
+    int16_t change = (int16_t)value - recordingLevel;
+    if (recordingLevelSet && change >= -128 && change <= 127) {
+      run.kind = RECORDING_LEVEL_CHANGE;
+      run.value = (uint8_t)change;
+    }
+  }
+
+  if (recordingRun.repeats > 0 && recordingRun.repeats < RECORDING_REPEAT_MAX &&
+      recordingRun.kind == run.kind && recordingRun.value == run.value &&
+      recordingRun.time == run.time) {
+    recordingRun.repeats++;
+  } else {
+    uint8_t size = recordingRunSize(run);
+    if (recordingRun.repeats > 0) {
+      size += recordingRunSize(recordingRun);
+    }
+    if (recordingLength + size > RECORDING_SIZE - 1) {
+      return false;
+    }
+    if (recordingRun.repeats > 0) {
+      recordingWriteRun();
+    }
+    recordingRun = run;
+  }
+
+  if (kind == RECORDING_LEVEL) {
+    recordingLevel = value;
+    recordingLevelSet = true;
+  }
+  recordingTime = now;
+  recordingEvents++;
+  return true;
+}
+
+// Writes the last run and the length of the stream.
+void recordingStop() {
+  if (recordingRun.repeats > 0) {
+    recordingWriteRun();
+  }
+  telemetryEEPROMPut(CONFIG_RECORDING_EEPROM_ADDR, recordingLength);
+}
+
+// Reads the next run of the stream. repeats is 0 at the end.
+void replayRead() {
+  uint8_t address = CONFIG_RECORDING_EEPROM_ADDR + 1 + replayPosition;
+  uint8_t end = CONFIG_RECORDING_EEPROM_ADDR + 1 + replayLength;
+  uint8_t shift = 0;
+  uint8_t byte;
+
+  replayRun.repeats = 0;
+  if (address >= end) {
+    return;
+  }
+
+  byte = EEPROM.read(address++);
+  replayRun.kind = byte >> 6;
+  replayRun.repeats = (byte & 0x3F) + 1;
+  replayRun.time = 0;
+  do {
+    byte = EEPROM.read(address++);
+    replayRun.time |= (uint32_t)(byte & 0x7F) << shift;
+    shift += 7;
+  } while ((byte & 0x80) && shift < 28);
+  replayRun.value = EEPROM.read(address++);
+
+  if (address > end) {
+    // cut short
+    replayRun.repeats = 0;
+  }
+  replayPosition = address - (CONFIG_RECORDING_EEPROM_ADDR + 1);
+}
+
+// Starts replaying the stream from now.
+void replayStart(unsigned long now) {
+  replayLength = EEPROM.read(CONFIG_RECORDING_EEPROM_ADDR);
+  if (replayLength > RECORDING_SIZE - 1) {
+    // not a stream (erased EEPROM)
+    replayLength = 0;
+  }
+  replayPosition = 0;
+  replayLevel = 0;
+  replayRead();
+  replayTime = now + replayRun.time;
+}
+
+bool replayDone() {
+  return replayRun.repeats == 0;
+}
+
+// Time of the next event. Only valid when !replayDone().
+unsigned long replayNextTime() {
+  return replayTime;
+}
+
+// Gets the next event if it is due at now. Returns false if there is none.
+// A level change comes out as the RECORDING_LEVEL it leads to.
+bool replayNext(unsigned long now, uint8_t &kind, uint8_t &value) {
+  if (replayDone() || (long)(now - replayTime) < 0) {
+    return false;
+  }
+
+  kind = replayRun.kind;
+  value = replayRun.value;
+  if (kind == RECORDING_LEVEL_CHANGE) {
+    replayLevel += value;
+    kind = RECORDING_LEVEL;
+    value = replayLevel;
+  } else if (kind == RECORDING_LEVEL) {
+    replayLevel = value;
+  }
+
+  replayRun.repeats--;
+  if (replayRun.repeats == 0) {
+    replayRead();
+  }
+  replayTime += replayRun.time;
+  return true;
+}
+#endif
@@ -0,0 +1,161 @@
+//***************************************************************
+// Status LED.
+//
+// The NeoPixel that shows the state, the first one of the chain on NEOPIXEL.
+// tinyNeoPixel's show() sends the colours with interrupts off, so the states
+// only say what to show and statusLedUpdate(), called from loop() after the
+// outputs are updated, decides when to send it:
+//   - Only when the colour on the pixel has to change, or the rest of the
+//     chain has a new frame (statusLedShowFrame(), PixelStrip.h).
+//   - Not while the seesaw controller is about to read a register
+//     (DOA_seesawCompatibility_busy()) or an output step is due right away,
+//     for up to STATUS_LED_MAX_DEFER milliseconds.
+//
+// Patterns:
+//   statusLedSet(color)                   steady
+//   statusLedBlink(color, on, off, now)   on for on ms, off for off ms,
+//                                         starting on
+//   statusLedBreathe(color, period, now)  fades in and out along the
+//                                         sineLookupTable once a period
+// The patterns are worked out from the time in statusLedUpdate() and wake
+// loop() with powerWakeIn() for their next change, so they cost nothing in
+// between.
+//***************************************************************
+
+#ifndef StatusLed_h
+#define StatusLed_h
+
+#include "Arduino.h"
+#include "Clock.h"
+#include "DOA_seesawCompatibility.h"
+#include "Modulator.h"
+#include "Power.h"
+#include <tinyNeoPixel_Static.h>
+
+#ifndef STATUS_LED_MAX_DEFER
+  #define STATUS_LED_MAX_DEFER 20 // milliseconds
+#endif
+
+#define STATUS_LED_BREATHE_STEPS 50 // colour changes per breathe period
+
+enum StatusLedPattern : uint8_t {
+  STATUS_LED_SOLID = 0,
+  STATUS_LED_BLINK,
+  STATUS_LED_BREATHE
+};
+
+tinyNeoPixel *statusLeds = NULL;
+uint32_t statusLedColor = 0;
+uint8_t statusLedPattern = STATUS_LED_SOLID;
+uint16_t statusLedOn = 0;      // milliseconds; the breathe period
+uint16_t statusLedOff = 0;     // milliseconds
+unsigned long statusLedStart = 0;
+
+uint32_t statusLedShown = 0;   // colour on the pixel
+bool statusLedValid = false;   // false until the first show()
+bool statusLedFrame = false;   // the rest of the chain changed
+bool statusLedDeferred = false;
+unsigned long statusLedDeferredSince = 0;
+
+void statusLedBegin(tinyNeoPixel &leds) {
+  statusLeds = &leds;
+  statusLedValid = false;
+}
+
+void statusLedSet(uint32_t color) {
+  statusLedPattern = STATUS_LED_SOLID;
+  statusLedColor = color;
+}
+
+void statusLedBlink(uint32_t color, uint16_t on, uint16_t off, unsigned long now) {
+  statusLedPattern = STATUS_LED_BLINK;
+  statusLedColor = color;
+  statusLedOn = on;
+  statusLedOff = off;
+  statusLedStart = now;
+}
+
+void statusLedBreathe(uint32_t color, uint16_t period, unsigned long now) {
+  statusLedPattern = STATUS_LED_BREATHE;
+  statusLedColor = color;
+  statusLedOn = period;
+  statusLedStart = now;
+}
+
+// The pixels after the status pixel changed.
+void statusLedShowFrame() {
+  statusLedFrame = true;
+}
+
+// color with every component multiplied by (level + 1) / 256
+uint32_t statusLedScale(uint32_t color, uint8_t level) {
+  uint32_t scaled = 0;
+  for (uint8_t shift = 0; shift < 24; shift += 8) {
+    uint8_t component = color >> shift;
+    scaled |= (uint32_t)(((uint16_t)component * (level + 1)) >> 8) << shift;
+  }
+  return scaled;
+}
+
+// Colour of the pattern at now. Asks to be woken for the next change.
+uint32_t statusLedPatternColor(unsigned long now) {
+  if (statusLedPattern == STATUS_LED_BLINK) {
+    uint16_t period = statusLedOn + statusLedOff;
+    uint16_t elapsed = (now - statusLedStart) % period;
+    if (elapsed < statusLedOn) {
+      powerWakeIn(statusLedOn - elapsed);
+      return statusLedColor;
+    }
+    powerWakeIn(period - elapsed);
+    return 0;
+  } else if (statusLedPattern == STATUS_LED_BREATHE) {
+    uint16_t period = statusLedOn;
+    uint16_t step = period / STATUS_LED_BREATHE_STEPS;
+    uint16_t elapsed = (now - statusLedStart) % period;
+    // start dark, three quarters into the table
+    uint8_t position = (uint32_t)elapsed * sineLookupTableLength / period + 3 * sineLookupTableLength / 4;
+    if (position >= sineLookupTableLength) {
+      position -= sineLookupTableLength;
+    }
+    powerWakeIn((step > 0) ? step - elapsed % step : 1);
+    return statusLedScale(statusLedColor, sineLookupTable[position]);
+  }
+  return statusLedColor;
+}
+
+void statusLedUpdate(unsigned long now) {
+  if (statusLeds == NULL) {
+    return;
+  }
+
+  uint32_t color = statusLedPatternColor(now);
+  if (statusLedValid && color == statusLedShown && !statusLedFrame) {
+    statusLedDeferred = false;
+    return;
+  }
+
+  if (DOA_seesawCompatibility_busy(now) || powerSleepMillis == 0) {
+    if (!statusLedDeferred) {
+      statusLedDeferred = true;
+      statusLedDeferredSince = now;
+    }
+    if (now - statusLedDeferredSince < STATUS_LED_MAX_DEFER) {
+      powerWakeIn(1);
+      clockBusy();
+      return;
+    }
+  }
+
+  statusLeds->setPixelColor(0, color);
+  {
+    // the bits are timed in cycles of F_CPU
+    clockFull();
+    PROFILE_SCOPE(PROFILE_PIXEL_SHOW);
+    statusLeds->show();
+  }
+  statusLedShown = color;
+  statusLedValid = true;
+  statusLedFrame = false;
+  statusLedDeferred = false;
+}
+#endif
@@ -0,0 +1,195 @@
+//***************************************************************
+// Shared effect clock.
+//
+// The effects run on syncMillis() instead of millis(), so several units can
+// be kept in phase by a seesaw controller. It is millis() until the
+// controller writes its own time (milliseconds) to DOA_SEESAW_SYNC_EPOCH,
+// the same to every unit (or to all of them at once with
+// DOA_SEESAW_BROADCAST_SYNC), every few seconds:
+//   - The first sync, or one that is more than SYNC_STEP_LIMIT off, sets the
+//     clock.
+//   - After that each sync measures how far the clock is off and how fast
+//     the local oscillator runs (the internal oscillator can be a percent
+//     or two off). The clock is then slewed: its rate is corrected to run
+//     at the controller's speed and to catch up with the error by the time
+//     the next sync is due. The clock never goes back.
+// The clock counts the microseconds between loop() passes (powerMicros(),
+// which has the RTC's 31 us resolution over a standby), so it keeps well
+// within a millisecond of the controller with a sync every few seconds.
+// There is one rate for the whole time: when the RTC (which times the
+// standby) is off by much more than the main oscillator, the effects that
+// spend a changing part of their time in standby (the heartbeat) get
+// further off.
+//
+// Once the clock is shared, the modulator effects (Modulator.h) start as if
+// they had been running on the clock all along (or, if they don't repeat,
+// since the last SYNC_PHASE_GRID boundary of the clock), and step on from
+// the time of the previous step rather than from the time loop() got to
+// them. Units running the same effect then step together, and the effects
+// that repeat (the sine waves, strobes and heartbeats) line up whenever
+// they were started.
+//
+// syncUpdate() is called at the start of every loop() pass and
+// syncMillis() is the clock at that time. When syncWasSet() the effects are
+// started again on the new clock.
+//***************************************************************
+
+#ifndef Sync_h
+#define Sync_h
+
+#include "Arduino.h"
+#include "Power.h"
+#include "Trace.h"
+
+#ifndef SYNC_STEP_LIMIT
+  #define SYNC_STEP_LIMIT 100000L // microseconds; sets the clock when further off
+#endif
+
+#ifndef SYNC_PHASE_GRID
+  #define SYNC_PHASE_GRID 4000 // milliseconds
+#endif
+
+#ifndef SYNC_ENTER_STEPS
+  #define SYNC_ENTER_STEPS 200 // most steps a modulator effect runs to catch up on entering
+#endif
+
+#define SYNC_RATE_SHIFT 24 // syncRate is in 1/2^24
+#define SYNC_RATE_MAX ((1L << SYNC_RATE_SHIFT) / 16) // +-6.25%
+#define SYNC_SHORT_ELAPSED 1024 // microseconds; elapsed * syncRate fits in 32 bits below this
+
+bool syncLocked = false;         // a controller set the clock
+bool syncSet = false;            // the last sync set the clock
+bool syncStepped = false;        // set since syncWasSet() last asked
+uint32_t syncLocal = 0;          // powerMicros() the clock was last counted at
+uint32_t syncClockMillis = 0;    // clock at syncLocal
+uint16_t syncClockMicros = 0;    // and the microseconds of it (below 1000)
+int32_t syncFrequency = 0;       // local oscillator correction
+int32_t syncRate = 0;            // syncFrequency and the slew
+int32_t syncFraction = 0;        // of a microsecond, in 1/2^24
+int32_t syncError = 0;           // microseconds the clock was behind at the last sync
+
+// Set by the I2C receive ISR, taken by syncUpdate().
+volatile bool syncPending = false;
+volatile uint32_t syncEpoch = 0;       // controller time (milliseconds)
+volatile uint32_t syncEpochLocal = 0;  // powerMicros() it was received at
+volatile bool syncEpochWoke = false;   // received in standby: at the next syncUpdate()
+uint32_t syncLastLocal = 0;            // powerMicros() of the previous sync
+
+// Called from the I2C receive ISR with the controller's time.
+void syncReceive(uint32_t epoch) {
+  syncEpoch = epoch;
+  syncEpochLocal = powerMicros();
+  syncEpochWoke = powerMillisStopped;
+  syncPending = true;
+}
+
+void syncAdvance(uint32_t micros) {
+  micros += syncClockMicros;
+  syncClockMillis += micros / 1000;
+  syncClockMicros = micros % 1000;
+}
+
+// Takes a sync from the controller.
+void syncAdjust(uint32_t local) {
+  uint8_t sreg = SREG;
+  cli();
+  uint32_t epoch = syncEpoch;
+  uint32_t epochLocal = syncEpochLocal;
+  if (syncEpochWoke) {
+    // millis() was stopped; loop() runs right after waking up
+    epochLocal = local;
+  }
+  syncPending = false;
+  SREG = sreg;
+
+  // how far the clock was behind when the sync was received (the time
+  // since then is the same on both sides)
+  uint32_t since = local - epochLocal;
+  int32_t offset = epoch - syncClockMillis;
+  int32_t error = 0;
+  bool step = !syncLocked || offset <= -SYNC_STEP_LIMIT / 1000 || offset >= SYNC_STEP_LIMIT / 1000;
+  if (!step) {
+    error = offset * 1000 - syncClockMicros + (int32_t)since;
+  }
+
+  if (step) {
+    // set
+    syncClockMillis = epoch;
+    syncClockMicros = 0;
+    syncAdvance(since);
+    syncRate = syncFrequency;
+    syncSet = true;
+    syncStepped = true;
+    syncLocked = true;
+  } else {
+    // slew: the error is what the frequency was off over the interval, as
+    // the previous error was caught up with. Correct the frequency by it
+    // (all of it after the clock was set, half later on to settle the
+    // noise) and catch up with the error over the next interval.
+    int32_t interval = epochLocal - syncLastLocal;
+    if (interval > 0) {
+      int32_t change = ((int64_t)error << SYNC_RATE_SHIFT) / interval;
+      syncFrequency = constrain(syncFrequency + (syncSet ? change : change / 2), -SYNC_RATE_MAX, SYNC_RATE_MAX);
+      syncRate = constrain(syncFrequency + change, -SYNC_RATE_MAX, SYNC_RATE_MAX);
+    }
+    syncSet = false;
+  }
+
+  syncError = error;
+  syncLastLocal = epochLocal;
+  TRACE1(TRACE_SYNC, (uint32_t)error & 0x0FFFFFFF);
+}
+
+// Counts the clock up to now. Called at the start of loop().
+void syncUpdate() {
+  if (!syncLocked && !syncPending) {
+    return;
+  }
+
+  uint32_t local = powerMicros();
+  uint32_t elapsed = local - syncLocal;
+  syncLocal = local;
+  if (syncLocked) {
+    // elapsed * syncRate, keeping the fraction of a microsecond for the next
+    // time so that it doesn't add up to a drift
+    int32_t correction;
+    if (elapsed < SYNC_SHORT_ELAPSED) {
+      int32_t scaled = (int32_t)elapsed * syncRate + syncFraction;
+      correction = scaled >> SYNC_RATE_SHIFT;
+      syncFraction = scaled & ((1L << SYNC_RATE_SHIFT) - 1);
+    } else {
+      int64_t scaled = (int64_t)elapsed * syncRate + syncFraction;
+      correction = scaled >> SYNC_RATE_SHIFT;
+      syncFraction = scaled & ((1L << SYNC_RATE_SHIFT) - 1);
+    }
+    syncAdvance(elapsed + correction);
+  }
+
+  if (syncPending) {
+    syncAdjust(local);
+  }
+}
+
+// Returns true once after the clock was set. The effects' times are then
+// on the old clock and they have to be started again.
+bool syncWasSet() {
+  bool stepped = syncStepped;
+  syncStepped = false;
+  return stepped;
+}
+
+// The effect clock (milliseconds) at the last syncUpdate(), or now (the
+// millis() the loop() pass started at) before the first sync.
+unsigned long syncMillisAt(unsigned long now) {
+  return syncLocked ? syncClockMillis : now;
+}
+
+// The effect clock (milliseconds) at the last syncUpdate(), or millis()
+// before the first sync.
+unsigned long syncMillis() {
+  if (!syncLocked) {
+    return millis();
+  }
+  return syncClockMillis;
+}
+#endif
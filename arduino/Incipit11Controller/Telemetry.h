@@ -0,0 +1,168 @@
+//***************************************************************
+// Health telemetry counters.
+//
+// The counters are kept in RAM and the lifetime totals are saved to EEPROM
+// every TELEMETRY_SAVE_INTERVAL. Only the bytes that changed are written so
+// the hourly save costs one or two bytes of EEPROM wear. The reset count is
+// saved on its own at the end of setup(), so a unit caught in a brown-out or
+// watchdog reset loop still counts every reset; that is one byte per boot.
+//
+// The counters are laid out as a contiguous block of big endian uint32
+// registers under DOA_SEESAW_TELEMETRY_BASE so a controller can read all of
+// them in one 32 byte transaction.
+//
+// Define CONFIG_TELEMETRY_EEPROM_ADDR before including this file to move the
+// saved counters in EEPROM.
+//***************************************************************
+
+#ifndef Telemetry_h
+#define Telemetry_h
+
+#include "Arduino.h"
+#include "Capture.h"
+#include <EEPROM.h>
+
+#ifndef CONFIG_TELEMETRY_EEPROM_ADDR
+  #define CONFIG_TELEMETRY_EEPROM_ADDR 0x80
+#endif
+
+#ifndef TELEMETRY_SAVE_INTERVAL
+  #define TELEMETRY_SAVE_INTERVAL 3600000UL // milliseconds; 1 hour
+#endif
+
+// Written in front of the saved counters. Change it if the layout changes.
+#define TELEMETRY_MAGIC 0xA1
+
+// Register order. Everything after TELEMETRY_UPTIME is a lifetime total that
+// is saved to EEPROM.
+enum TelemetryCounter : uint8_t {
+  TELEMETRY_UPTIME = 0,           // seconds since reset
+  TELEMETRY_LIFETIME_UPTIME,      // seconds
+  TELEMETRY_RESETS,
+  TELEMETRY_EFFECT_CHANGES,
+  TELEMETRY_TRIGGERS,
+  TELEMETRY_KEY_EVENTS_DROPPED,   // enqueueKeyEvent() with a full queue
+  TELEMETRY_I2C_OVERRUNS,         // more bytes received than fit in the buffer
+  TELEMETRY_EEPROM_BYTES_WRITTEN,
+  TELEMETRY_COUNTER_COUNT         // keep this at the end
+};
+
+#define TELEMETRY_SAVED_COUNT (TELEMETRY_COUNTER_COUNT - TELEMETRY_LIFETIME_UPTIME)
+
+volatile uint32_t telemetryCounters[TELEMETRY_COUNTER_COUNT];
+uint8_t telemetryResetFlags = 0;
+uint32_t telemetryBootToLight = 0; // microseconds from init() to the first output level
+unsigned long telemetryLastSecond = 0;
+unsigned long telemetryLastSave = 0;
+volatile bool telemetryClearRequested = false;
+
+// Increment a counter. Safe to call from an ISR and safe against the I2C ISR
+// reading a half updated counter.
+void telemetryIncrement(uint8_t counter, uint32_t amount = 1) {
+  uint8_t sreg = SREG;
+  cli();
+  telemetryCounters[counter] += amount;
+  SREG = sreg;
+}
+
+uint32_t telemetryGet(uint8_t counter) {
+  uint8_t sreg = SREG;
+  cli();
+  uint32_t value = telemetryCounters[counter];
+  SREG = sreg;
+  return value;
+}
+
+// Same as EEPROM.put() but only writes the bytes that changed and counts them.
+template <typename T> void telemetryEEPROMPut(int addr, const T &value) {
+  const uint8_t *bytes = (const uint8_t *)&value;
+  uint8_t written = 0;
+
+  for (uint8_t i = 0; i < sizeof(T); i++) {
+    if (EEPROM.read(addr + i) != bytes[i]) {
+      CAPTURE_EEPROM(addr + i, bytes[i]);
+      EEPROM.write(addr + i, bytes[i]);
+      written++;
+    }
+  }
+
+  if (written != 0) {
+    telemetryIncrement(TELEMETRY_EEPROM_BYTES_WRITTEN, written);
+  }
+}
+
+void telemetrySave() {
+  uint32_t saved[TELEMETRY_SAVED_COUNT];
+
+  CAPTURE_EEPROM(CONFIG_TELEMETRY_EEPROM_ADDR, TELEMETRY_MAGIC);
+  EEPROM.update(CONFIG_TELEMETRY_EEPROM_ADDR, TELEMETRY_MAGIC);
+  for (uint8_t i = 0; i < TELEMETRY_SAVED_COUNT; i++) {
+    saved[i] = telemetryGet(TELEMETRY_LIFETIME_UPTIME + i);
+  }
+  telemetryEEPROMPut(CONFIG_TELEMETRY_EEPROM_ADDR + 1, saved);
+}
+
+// Load the lifetime totals and count this reset.
+void telemetryBegin() {
+  uint32_t saved[TELEMETRY_SAVED_COUNT];
+
+  // megaTinyCore moves the reset flags to GPIOR0 when it clears them
+  telemetryResetFlags = RSTCTRL.RSTFR;
+  if (telemetryResetFlags == 0) {
+    telemetryResetFlags = GPIOR0;
+  }
+  RSTCTRL.RSTFR = telemetryResetFlags;
+
+  if (EEPROM.read(CONFIG_TELEMETRY_EEPROM_ADDR) == TELEMETRY_MAGIC) {
+    EEPROM.get(CONFIG_TELEMETRY_EEPROM_ADDR + 1, saved);
+  } else {
+    memset(saved, 0, sizeof(saved));
+  }
+  for (uint8_t i = 0; i < TELEMETRY_SAVED_COUNT; i++) {
+    telemetryCounters[TELEMETRY_LIFETIME_UPTIME + i] = saved[i];
+  }
+  telemetryCounters[TELEMETRY_UPTIME] = 0;
+
+  // saved by telemetrySaveResets()
+  telemetryCounters[TELEMETRY_RESETS]++;
+}
+
+// Saves the reset count. Called at the end of setup() so the write doesn't
+// hold up the output. The first boot lays out the whole block.
+void telemetrySaveResets() {
+  if (EEPROM.read(CONFIG_TELEMETRY_EEPROM_ADDR) != TELEMETRY_MAGIC) {
+    telemetrySave();
+    return;
+  }
+  uint32_t resets = telemetryGet(TELEMETRY_RESETS);
+  telemetryEEPROMPut(CONFIG_TELEMETRY_EEPROM_ADDR + 1 + (TELEMETRY_RESETS - TELEMETRY_LIFETIME_UPTIME) * sizeof(uint32_t),
+                     resets);
+}
+
+// Called from loop(). Keeps the uptime counters and saves the totals.
+void telemetryUpdate(unsigned long now) {
+  if (telemetryClearRequested) {
+    // requested from the I2C ISR, but the EEPROM is written here
+    for (uint8_t i = TELEMETRY_LIFETIME_UPTIME; i < TELEMETRY_COUNTER_COUNT; i++) {
+      uint8_t sreg = SREG;
+      cli();
+      telemetryCounters[i] = 0;
+      SREG = sreg;
+    }
+    telemetryClearRequested = false;
+    telemetrySave();
+  }
+
+  while (now - telemetryLastSecond >= 1000) {
+    telemetryLastSecond += 1000;
+    telemetryIncrement(TELEMETRY_UPTIME);
+    telemetryIncrement(TELEMETRY_LIFETIME_UPTIME);
+  }
+
+  if (now - telemetryLastSave >= TELEMETRY_SAVE_INTERVAL) {
+    telemetryLastSave = now;
+    telemetrySave();
+  }
+}
+
+#endif
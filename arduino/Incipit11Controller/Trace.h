@@ -0,0 +1,175 @@
+//***************************************************************
+// Binary trace logger for debug builds.
+//
+// With DEBUG defined (see DebugMacros.h) TRACE(event) and TRACE1(event, arg)
+// store an event id, the time in milliseconds and an argument into a RAM
+// ring buffer. That only takes a few cycles and is safe in the I2C ISRs.
+// TRACE_DRAIN() is called from loop() and copies whole records to the serial
+// port as long as there is room in the serial transmit buffer, so the UART
+// TX interrupt sends them in the background and loop() never blocks on
+// Serial. TRACE_FLUSH() blocks until the ring buffer is empty.
+//
+// Each record is sent as 9 bytes:
+//   0x80 | event id, 4 x 7 bits of time (msb first), 4 x 7 bits of argument
+// Only the first byte has the top bit set so plain text that is printed with
+// DPRINT can be mixed in. host/trace_decode.py turns the records into text.
+// It reads the event names and argument types from the enum below, so keep
+// the "// arg: <type>" comments up to date.
+//
+// Without DEBUG the macros are blank.
+//***************************************************************
+
+#ifndef Trace_h
+#define Trace_h
+
+#include "Arduino.h"
+#include "DebugMacros.h"
+
+enum TraceEvent : uint8_t {
+  TRACE_OVERFLOW = 0,              // arg: count (records dropped)
+  TRACE_BUTTON_CLICK,
+  TRACE_BUTTON_PRESS,
+  TRACE_BUTTON_DOUBLE_CLICK,
+  TRACE_BUTTON_LONG_PRESS_START,
+  TRACE_TRIGGER_PRESS,
+  TRACE_EFFECT,                    // arg: effect (channel << 8 | effect)
+  TRACE_STARTUP_ENTER,
+  TRACE_STARTUP_EXIT,
+  TRACE_AMBIENT_ENTER,
+  TRACE_AMBIENT_NEXT_EFFECT,
+  TRACE_AMBIENT_EXIT,
+  TRACE_TRIGGERED_ENTER,
+  TRACE_TRIGGERED_EXIT,
+  TRACE_PREPARE_RECORDING_ENTER,
+  TRACE_PREPARE_RECORDING_EXIT,
+  TRACE_RECORD_TRIGGER_ENTER,
+  TRACE_RECORD_TRIGGER_EXIT,
+  TRACE_PERIPHERAL_ENTER,
+  TRACE_PERIPHERAL_EXIT,
+  TRACE_SAVE_AMBIENT_EFFECT,       // arg: effect (channel << 8 | effect)
+  TRACE_SAVE_TRIGGERED_EFFECT,     // arg: effect (channel << 8 | effect)
+  TRACE_SAVE_TRIGGERED_LENGTH,     // arg: milliseconds
+  TRACE_SAVE_RECORDING,            // arg: recording (events << 8 | bytes)
+  TRACE_PWM,                       // arg: pwm (pin << 16 | value)
+  TRACE_SEESAW_RESET,
+  TRACE_I2C_BEGIN,                 // arg: hex (enumeration address << 8 | address)
+  TRACE_I2C_OVERRUN,               // arg: count (bytes received)
+  TRACE_KEY_QUEUE_FULL,
+  TRACE_KEY_QUEUE_EMPTY,
+  TRACE_EEPROM_READ,               // arg: hex (address)
+  TRACE_EEPROM_READ_NO_CALLBACK,   // arg: hex (address)
+  TRACE_BOOT_TO_LIGHT,             // arg: microseconds
+  TRACE_POWER_DUTY,                // arg: permille (time awake)
+  TRACE_KEYFRAMES_WRITE,           // arg: hex (offset << 8 | bytes)
+  TRACE_SYNC,                      // arg: sync (microseconds the clock was behind, 28 bit signed)
+  TRACE_BROADCAST,                 // arg: broadcast (command << 8 | groups)
+  TRACE_ADDRESS,                   // arg: hex (address given by the controller)
+  TRACE_EVENT_COUNT                // keep this at the end
+};
+
+#ifdef DEBUG
+
+// Must be a power of 2 that divides 256.
+#ifndef TRACE_BUFFER_CAPACITY
+  #define TRACE_BUFFER_CAPACITY 16
+#endif
+
+#define TRACE_RECORD_SIZE 9 // bytes on the serial port
+
+struct TraceRecord {
+  uint8_t event;
+  uint32_t time;
+  uint32_t arg;
+};
+
+TraceRecord traceBuffer[TRACE_BUFFER_CAPACITY];
+volatile uint8_t traceHead = 0; // only changed by traceDrain()
+volatile uint8_t traceTail = 0; // only changed by trace()
+volatile uint16_t traceDropped = 0;
+
+// Add a record to the ring buffer. Safe to call from an ISR.
+void trace(uint8_t event, uint32_t arg) {
+  uint32_t now = millis();
+
+  uint8_t sreg = SREG;
+  cli();
+  uint8_t tail = traceTail;
+  if ((uint8_t)(tail - traceHead) >= TRACE_BUFFER_CAPACITY) {
+    if (traceDropped != 0xFFFF) {
+      traceDropped++;
+    }
+  } else {
+    TraceRecord *record = &traceBuffer[tail & (TRACE_BUFFER_CAPACITY - 1)];
+    record->event = event;
+    record->time = now;
+    record->arg = arg;
+    traceTail = tail + 1;
+  }
+  SREG = sreg;
+}
+
+void traceWrite28(uint32_t value) {
+  Serial.write((uint8_t)((value >> 21) & 0x7F));
+  Serial.write((uint8_t)((value >> 14) & 0x7F));
+  Serial.write((uint8_t)((value >> 7) & 0x7F));
+  Serial.write((uint8_t)(value & 0x7F));
+}
+
+void traceWriteRecord(uint8_t event, uint32_t time, uint32_t arg) {
+  Serial.write((uint8_t)(0x80 | event));
+  traceWrite28(time);
+  traceWrite28(arg);
+}
+
+// Send as many whole records as fit in the serial transmit buffer.
+void traceDrain() {
+  while (Serial.availableForWrite() >= TRACE_RECORD_SIZE) {
+    if (traceDropped != 0) {
+      uint8_t sreg = SREG;
+      cli();
+      uint16_t dropped = traceDropped;
+      traceDropped = 0;
+      SREG = sreg;
+
+      traceWriteRecord(TRACE_OVERFLOW, millis(), dropped);
+      continue;
+    }
+
+    uint8_t head = traceHead;
+    if (head == traceTail) {
+      // empty
+      return;
+    }
+
+    // the producer never writes to a record that has not been drained
+    TraceRecord *record = &traceBuffer[head & (TRACE_BUFFER_CAPACITY - 1)];
+    traceWriteRecord(record->event, record->time, record->arg);
+    traceHead = head + 1;
+  }
+}
+
+// Block until every record has been sent.
+void traceFlush() {
+  while ((traceHead != traceTail) || (traceDropped != 0)) {
+    traceDrain();
+  }
+  Serial.flush();
+}
+
+#define TRACE(event)        trace(event, 0)
+#define TRACE1(event, arg)  trace(event, arg)
+#define TRACE_DRAIN()       traceDrain()
+#define TRACE_FLUSH()       traceFlush()
+
+//***************************************************************
+#else
+
+#define TRACE(event)
+#define TRACE1(event, arg)
+#define TRACE_DRAIN()
+#define TRACE_FLUSH()
+
+#endif
+//***************************************************************
+
+#endif
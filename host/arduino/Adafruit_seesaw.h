@@ -0,0 +1,91 @@
+// Host stand-in for the parts of the Adafruit seesaw library header that the
+// peripheral side uses: the register bases, the register numbers and the
+// keypad event layout. The values match Adafruit_seesaw.h.
+
+#ifndef HOST_ADAFRUIT_SEESAW_H
+#define HOST_ADAFRUIT_SEESAW_H
+
+#include "Arduino.h"
+
+enum {
+  SEESAW_STATUS_BASE = 0x00,
+  SEESAW_GPIO_BASE = 0x01,
+  SEESAW_SERCOM0_BASE = 0x02,
+  SEESAW_TIMER_BASE = 0x08,
+  SEESAW_ADC_BASE = 0x09,
+  SEESAW_DAC_BASE = 0x0A,
+  SEESAW_INTERRUPT_BASE = 0x0B,
+  SEESAW_DAP_BASE = 0x0C,
+  SEESAW_EEPROM_BASE = 0x0D,
+  SEESAW_NEOPIXEL_BASE = 0x0E,
+  SEESAW_TOUCH_BASE = 0x0F,
+  SEESAW_KEYPAD_BASE = 0x10,
+  SEESAW_ENCODER_BASE = 0x11,
+  SEESAW_SPECTRUM_BASE = 0x12,
+  SEESAW_SOIL_BASE = 0x13,
+};
+
+enum {
+  SEESAW_GPIO_DIRSET_BULK = 0x02,
+  SEESAW_GPIO_DIRCLR_BULK = 0x03,
+  SEESAW_GPIO_BULK = 0x04,
+  SEESAW_GPIO_BULK_SET = 0x05,
+  SEESAW_GPIO_BULK_CLR = 0x06,
+  SEESAW_GPIO_BULK_TOGGLE = 0x07,
+  SEESAW_GPIO_INTENSET = 0x08,
+  SEESAW_GPIO_INTENCLR = 0x09,
+  SEESAW_GPIO_INTFLAG = 0x0A,
+  SEESAW_GPIO_PULLENSET = 0x0B,
+  SEESAW_GPIO_PULLENCLR = 0x0C,
+};
+
+enum {
+  SEESAW_STATUS_HW_ID = 0x01,
+  SEESAW_STATUS_VERSION = 0x02,
+  SEESAW_STATUS_OPTIONS = 0x03,
+  SEESAW_STATUS_TEMP = 0x04,
+  SEESAW_STATUS_SWRST = 0x7F,
+};
+
+enum {
+  SEESAW_TIMER_STATUS = 0x00,
+  SEESAW_TIMER_PWM = 0x01,
+  SEESAW_TIMER_FREQ = 0x02,
+};
+
+enum {
+  SEESAW_NEOPIXEL_STATUS = 0x00,
+  SEESAW_NEOPIXEL_PIN = 0x01,
+  SEESAW_NEOPIXEL_SPEED = 0x02,
+  SEESAW_NEOPIXEL_BUF_LENGTH = 0x03,
+  SEESAW_NEOPIXEL_BUF = 0x04,
+  SEESAW_NEOPIXEL_SHOW = 0x05,
+};
+
+enum {
+  SEESAW_KEYPAD_STATUS = 0x00,
+  SEESAW_KEYPAD_EVENT = 0x01,
+  SEESAW_KEYPAD_INTENSET = 0x02,
+  SEESAW_KEYPAD_INTENCLR = 0x03,
+  SEESAW_KEYPAD_COUNT = 0x04,
+  SEESAW_KEYPAD_FIFO = 0x10,
+};
+
+enum {
+  SEESAW_KEYPAD_EDGE_HIGH = 0,
+  SEESAW_KEYPAD_EDGE_LOW,
+  SEESAW_KEYPAD_EDGE_FALLING,
+  SEESAW_KEYPAD_EDGE_RISING,
+};
+
+#define SEESAW_EEPROM_I2C_ADDR 0x3F
+
+union keyEventRaw {
+  struct {
+    uint8_t EDGE : 2;
+    uint8_t NUM : 6;
+  } bit;
+  uint8_t reg;
+};
+
+#endif
@@ -0,0 +1,215 @@
+#include "Arduino.h"
+
+#include "Sim.h"
+
+// ---- registers
+
+volatile uint8_t SREG;
+volatile uint8_t GPIOR0, GPIOR1, GPIOR2, GPIOR3;
+volatile uint8_t CCP;
+CLKCTRL_t CLKCTRL;
+RSTCTRL_t RSTCTRL;
+SLPCTRL_t SLPCTRL;
+RTC_t RTC;
+PORT_t PORTA, PORTB, PORTC;
+TCA_t TCA0;
+TCB_t TCB0, TCB1;
+USART_t USART0;
+SIGROW_t SIGROW;
+
+// Empty defaults for the vectors the simulator calls. A firmware ISR()
+// replaces them.
+extern "C" {
+__attribute__((weak)) void RTC_CNT_vect() {}
+__attribute__((weak)) void RTC_PIT_vect() {}
+__attribute__((weak)) void PORTA_PORT_vect() {}
+__attribute__((weak)) void PORTB_PORT_vect() {}
+__attribute__((weak)) void PORTC_PORT_vect() {}
+__attribute__((weak)) void TCB0_INT_vect() {}
+__attribute__((weak)) void TCB1_INT_vect() {}
+}
+
+// ---- time
+
+unsigned long millis() {
+  return sim::millisNow();
+}
+
+unsigned long micros() {
+  return sim::microsNow();
+}
+
+void delay(unsigned long ms) {
+  sim::chargeNs(ms * sim::NS_PER_MS);
+}
+
+void delayMicroseconds(unsigned int us) {
+  sim::chargeNs(us * sim::NS_PER_US);
+}
+
+void stop_millis() {
+  sim::millisStop();
+}
+
+void restart_millis() {
+  sim::millisRestart();
+}
+
+void set_millis(uint32_t newmillis) {
+  sim::millisSet(newmillis);
+}
+
+void nudge_millis(uint16_t ms) {
+  sim::millisNudge(ms);
+}
+
+// ---- digital and analog IO
+
+void pinMode(uint8_t pin, uint8_t mode) {
+  sim::setPinMode(pin, mode);
+}
+
+void digitalWrite(uint8_t pin, uint8_t value) {
+  sim::writePin(pin, value);
+}
+
+int8_t digitalRead(uint8_t pin) {
+  return sim::readPin(pin);
+}
+
+void analogWrite(uint8_t pin, int value) {
+  sim::charge(sim::costs.analogWriteCycles);
+
+  const sim::PwmChannel *channel = sim::pwmChannel(pin);
+  if (channel == nullptr || value <= 0 || value >= 255) {
+    // fully off or on is a digital output without the timer
+    if (channel != nullptr) {
+      TCA0.SPLIT.CTRLB &= ~channel->enable;
+    }
+    sim::writePin(pin, value >= 128 ? HIGH : LOW);
+    if (channel != nullptr) {
+      sim::writeOutput(pin, value <= 0 ? 0 : 255, false);
+    }
+    return;
+  }
+
+  *channel->compare = (uint8_t)value;
+  TCA0.SPLIT.CTRLB |= channel->enable;
+  sim::writeOutput(pin, (uint8_t)value, true);
+}
+
+void attachInterrupt(uint8_t interrupt, void (*callback)(), uint8_t mode) {
+  sim::attachPinInterrupt(interrupt, callback, mode);
+}
+
+void detachInterrupt(uint8_t interrupt) {
+  sim::attachPinInterrupt(interrupt, nullptr, 0);
+}
+
+// ---- random, the avr-libc generator
+
+namespace {
+
+uint32_t randomNext = 1;
+
+int32_t doRandom(uint32_t *context) {
+  int32_t hi, lo, x;
+
+  x = (int32_t)*context;
+  if (x == 0) {
+    x = 123459876L;
+  }
+  hi = x / 127773L;
+  lo = x % 127773L;
+  x = 16807L * lo - 2836L * hi;
+  if (x < 0) {
+    x += 0x7fffffffL;
+  }
+  *context = (uint32_t)x;
+  return x % ((uint32_t)0x7fffffffL + 1);
+}
+
+} // namespace
+
+long random(long howbig) {
+  if (howbig == 0) {
+    return 0;
+  }
+  return doRandom(&randomNext) % (int32_t)howbig;
+}
+
+long random(long howsmall, long howbig) {
+  if (howsmall >= howbig) {
+    return howsmall;
+  }
+  return random(howbig - howsmall) + howsmall;
+}
+
+void randomSeed(unsigned long seed) {
+  if (seed != 0) {
+    randomNext = (uint32_t)seed;
+  }
+}
+
+// ---- serial
+
+HardwareSerial Serial;
+
+size_t Print::write(const uint8_t *buffer, size_t size) {
+  for (size_t i = 0; i < size; i++) {
+    write(buffer[i]);
+  }
+  return size;
+}
+
+size_t Print::printNumber(unsigned long n, int base) {
+  char buffer[8 * sizeof(long) + 1];
+  char *str = &buffer[sizeof(buffer) - 1];
+
+  if (base < 2) {
+    base = 10;
+  }
+  *str = '\0';
+  do {
+    char c = n % base;
+    n /= base;
+    *--str = c < 10 ? c + '0' : c + 'A' - 10;
+  } while (n);
+  return write(str);
+}
+
+size_t Print::printSigned(long n, int base) {
+  if (base == 10 && n < 0) {
+    return print('-') + printNumber(-n, 10);
+  }
+  // AVR long is 32 bits
+  return printNumber(base == 10 ? (unsigned long)n : (uint32_t)n, base);
+}
+
+size_t Print::print(double number, int digits) {
+  char buffer[32];
+  snprintf(buffer, sizeof(buffer), "%.*f", digits, number);
+  return write(buffer);
+}
+
+int HardwareSerial::availableForWrite() {
+  // callers poll this while the transmitter drains the buffer
+  sim::charge(10);
+  return sim::serialAvailableForWrite();
+}
+
+// The baud register as megaTinyCore sets it for F_CPU (normal speed mode).
+void HardwareSerial::begin(unsigned long baud, uint16_t options) {
+  _baud = baud;
+  USART0.BAUD = (uint16_t)(4 * F_CPU / baud);
+  USART0.CTRLB = (options & SERIAL_TX_ONLY) ? USART_TXEN_bm : (USART_TXEN_bm | USART_RXEN_bm);
+}
+
+void HardwareSerial::flush() {
+  sim::serialFlush();
+}
+
+size_t HardwareSerial::write(uint8_t c) {
+  sim::serialWrite(c);
+  return 1;
+}
@@ -0,0 +1,170 @@
+// Host stand-in for the megaTinyCore Arduino core (ATtiny1616, 20 pin
+// package). Only what the Incipit11 firmware uses is provided. Time, pins,
+// PWM and the serial port are backed by the simulator in sim/Sim.cpp.
+
+#ifndef HOST_ARDUINO_H
+#define HOST_ARDUINO_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+
+#include "avr/io.h"
+#include "avr/interrupt.h"
+
+#ifndef F_CPU
+  #define F_CPU 20000000UL
+#endif
+
+// megaTinyCore's default millis timer on the 1-series, clocked from the
+// unprescaled oscillator
+#define MILLIS_USE_TIMERD0
+
+#define HIGH 0x1
+#define LOW  0x0
+
+#define INPUT        0x0
+#define OUTPUT       0x1
+#define INPUT_PULLUP 0x2
+
+#define CHANGE  4
+#define FALLING 2
+#define RISING  3
+
+#define DEC 10
+#define HEX 16
+#define OCT 8
+#define BIN 2
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+using std::min;
+using std::max;
+
+// megaTinyCore pin numbers for the 20 pin parts
+#define PIN_PA4 0
+#define PIN_PA5 1
+#define PIN_PA6 2
+#define PIN_PA7 3
+#define PIN_PB5 4
+#define PIN_PB4 5
+#define PIN_PB3 6
+#define PIN_PB2 7
+#define PIN_PB1 8
+#define PIN_PB0 9
+#define PIN_PC0 10
+#define PIN_PC1 11
+#define PIN_PC2 12
+#define PIN_PC3 13
+#define PIN_PA1 14
+#define PIN_PA2 15
+#define PIN_PA3 16
+#define PIN_PA0 17
+#define NUM_DIGITAL_PINS 18
+#define NOT_A_PIN 255
+
+// ---- program memory (flash is in the data space on the tinyAVR parts)
+#define PROGMEM
+#define PGM_P const char *
+#define PSTR(s) (s)
+#define pgm_read_byte(addr)  (*(const uint8_t *)(addr))
+#define pgm_read_word(addr)  (*(const uint16_t *)(addr))
+#define pgm_read_dword(addr) (*(const uint32_t *)(addr))
+#define pgm_read_ptr(addr)   (*(void *const *)(addr))
+#define memcpy_P memcpy
+#define strlen_P strlen
+
+class __FlashStringHelper;
+#define F(s) (reinterpret_cast<const __FlashStringHelper *>(s))
+
+#define _BV(bit) (1U << (bit))
+#define bitRead(value, bit) (((value) >> (bit)) & 0x01)
+#define _NOP() do { } while (0)
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+
+// ---- time
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+
+// megaTinyCore millis control
+void stop_millis();
+void restart_millis();
+void set_millis(uint32_t newmillis);
+void nudge_millis(uint16_t ms);
+
+// ---- digital and analog IO
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+int8_t digitalRead(uint8_t pin);
+void analogWrite(uint8_t pin, int value);
+#define pinModeFast(pin, mode)       pinMode(pin, mode)
+#define digitalWriteFast(pin, value) digitalWrite(pin, value)
+#define digitalReadFast(pin)         digitalRead(pin)
+
+void attachInterrupt(uint8_t interrupt, void (*callback)(), uint8_t mode);
+void detachInterrupt(uint8_t interrupt);
+#define digitalPinToInterrupt(pin) (pin)
+
+// ---- random (same generator as avr-libc, so a seed gives the same sequence)
+long random(long howbig);
+long random(long howsmall, long howbig);
+void randomSeed(unsigned long seed);
+
+// ---- serial
+class Print {
+public:
+  virtual ~Print() {}
+  virtual size_t write(uint8_t c) = 0;
+  size_t write(const uint8_t *buffer, size_t size);
+  size_t write(const char *str) { return write((const uint8_t *)str, strlen(str)); }
+
+  size_t print(const __FlashStringHelper *s) { return write((const char *)s); }
+  size_t print(const char *s) { return write(s); }
+  size_t print(char c) { return write((uint8_t)c); }
+  size_t print(unsigned char n, int base = DEC) { return printNumber(n, base); }
+  size_t print(int n, int base = DEC) { return printSigned(n, base); }
+  size_t print(unsigned int n, int base = DEC) { return printNumber(n, base); }
+  size_t print(long n, int base = DEC) { return printSigned(n, base); }
+  size_t print(unsigned long n, int base = DEC) { return printNumber(n, base); }
+  size_t print(double n, int digits = 2);
+
+  size_t println() { return write("\r\n"); }
+  template <typename T> size_t println(T value) { size_t n = print(value); return n + println(); }
+  template <typename T> size_t println(T value, int format) { size_t n = print(value, format); return n + println(); }
+
+private:
+  size_t printNumber(unsigned long n, int base);
+  size_t printSigned(long n, int base);
+};
+
+// HardwareSerial::begin() options
+#define SERIAL_TX_ONLY 0x8000
+
+class HardwareSerial : public Print {
+public:
+  void begin(unsigned long baud, uint16_t options = 0);
+  void end() {}
+  void pins(uint8_t tx, uint8_t rx) {}
+  void swap(uint8_t state = 1) {}
+  int available() { return 0; }
+  int read() { return -1; }
+  int peek() { return -1; }
+  int availableForWrite();
+  void flush();
+  size_t write(uint8_t c) override;
+  using Print::write;
+  operator bool() { return true; }
+
+private:
+  unsigned long _baud = 0;
+};
+
+extern HardwareSerial Serial;
+
+#endif
@@ -0,0 +1,34 @@
+#include "EEPROM.h"
+
+#include "Sim.h"
+
+EEPROMClass EEPROM;
+
+namespace {
+
+struct EEPROMErased {
+  EEPROMErased() { EEPROM.hostErase(); }
+} eepromErased;
+
+} // namespace
+
+void EEPROMClass::write(int address, uint8_t value) {
+  address &= EEPROM_SIZE - 1;
+  if (sim::onEEPROMWrite) {
+    sim::onEEPROMWrite(sim::now(), address, value);
+  }
+  sim::eepromWriteCost();
+  _data[address] = value;
+  _writes[address]++;
+}
+
+void EEPROMClass::hostErase() {
+  memset(_data, 0xFF, sizeof(_data));
+  memset(_writes, 0, sizeof(_writes));
+}
+
+void EEPROMClass::hostLoad(int address, const uint8_t *data, size_t length) {
+  for (size_t i = 0; i < length; i++) {
+    _data[(address + i) & (EEPROM_SIZE - 1)] = data[i];
+  }
+}
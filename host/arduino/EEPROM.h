@@ -0,0 +1,53 @@
+// Host stand-in for the megaTinyCore EEPROM library. The 256 bytes start
+// erased (0xFF) like a new part and every write is counted per byte so
+// scenarios can report wear. Each write that changes a byte costs the CPU the
+// NVM write time.
+
+#ifndef HOST_EEPROM_H
+#define HOST_EEPROM_H
+
+#include "Arduino.h"
+
+#define EEPROM_SIZE 256
+
+class EEPROMClass {
+public:
+  uint8_t read(int address) const { return _data[address & (EEPROM_SIZE - 1)]; }
+  void write(int address, uint8_t value);
+  void update(int address, uint8_t value) {
+    if (read(address) != value) {
+      write(address, value);
+    }
+  }
+  uint16_t length() const { return EEPROM_SIZE; }
+
+  template <typename T> T &get(int address, T &value) const {
+    uint8_t *bytes = (uint8_t *)&value;
+    for (size_t i = 0; i < sizeof(T); i++) {
+      bytes[i] = read(address + i);
+    }
+    return value;
+  }
+
+  template <typename T> const T &put(int address, const T &value) {
+    const uint8_t *bytes = (const uint8_t *)&value;
+    for (size_t i = 0; i < sizeof(T); i++) {
+      update(address + i, bytes[i]);
+    }
+    return value;
+  }
+
+  // ---- simulator side
+  void hostErase();
+  void hostLoad(int address, const uint8_t *data, size_t length);
+  uint8_t *hostData() { return _data; }
+  uint32_t hostWrites(int address) const { return _writes[address & (EEPROM_SIZE - 1)]; }
+
+private:
+  uint8_t _data[EEPROM_SIZE];
+  uint32_t _writes[EEPROM_SIZE];
+};
+
+extern EEPROMClass EEPROM;
+
+#endif
@@ -0,0 +1,103 @@
+#include "OneButton.h"
+
+void OneButton::setup(uint8_t pin, uint8_t mode, bool activeLow) {
+  _pin = pin;
+  _buttonPressed = activeLow ? LOW : HIGH;
+  pinMode(pin, mode);
+}
+
+void OneButton::reset() {
+  _state = OCS_INIT;
+  _nClicks = 0;
+  _startTime = millis();
+}
+
+bool OneButton::debounce(bool value) {
+  _now = millis();
+  if (_lastDebounceValue == value) {
+    if (_now - _lastDebounceTime >= _debounceMs) {
+      _debouncedValue = value;
+    }
+  } else {
+    _lastDebounceTime = _now;
+    _lastDebounceValue = value;
+  }
+  return _debouncedValue;
+}
+
+void OneButton::tick() {
+  if (_pin >= 0) {
+    tick(debounce(digitalRead(_pin) == _buttonPressed));
+  }
+}
+
+void OneButton::tick(bool active) {
+  unsigned long waitTime = _now - _startTime;
+
+  if (_doubleClickFunc != nullptr && _maxClicks < 2) {
+    _maxClicks = 2;
+  }
+  if (_multiClickFunc != nullptr) {
+    _maxClicks = 100;
+  }
+
+  switch (_state) {
+    case OCS_INIT:
+      if (active) {
+        newState(OCS_DOWN);
+        _startTime = _now;
+        _nClicks = 0;
+        if (_pressFunc) _pressFunc();
+      }
+      break;
+
+    case OCS_DOWN:
+      if (!active) {
+        newState(OCS_UP);
+        _startTime = _now;
+      } else if (waitTime > _pressMs) {
+        if (_longPressStartFunc) _longPressStartFunc();
+        newState(OCS_PRESS);
+      }
+      break;
+
+    case OCS_UP:
+      _nClicks++;
+      newState(OCS_COUNT);
+      break;
+
+    case OCS_COUNT:
+      if (active) {
+        newState(OCS_DOWN);
+        _startTime = _now;
+      } else if ((waitTime >= _clickMs) || (_nClicks == _maxClicks)) {
+        if (_nClicks == 1) {
+          if (_clickFunc) _clickFunc();
+        } else if (_nClicks == 2) {
+          if (_doubleClickFunc) _doubleClickFunc();
+        } else {
+          if (_multiClickFunc) _multiClickFunc();
+        }
+        reset();
+      }
+      break;
+
+    case OCS_PRESS:
+      if (!active) {
+        newState(OCS_PRESSEND);
+        _startTime = _now;
+      } else if (_duringLongPressFunc) {
+        _duringLongPressFunc();
+      }
+      break;
+
+    case OCS_PRESSEND:
+      if (_longPressStopFunc) _longPressStopFunc();
+      reset();
+      break;
+
+    default:
+      newState(OCS_INIT);
+      break;
+  }
+}
@@ -0,0 +1,77 @@
+// Host stand-in for the OneButton library (2.x). The state machine and the
+// default timings follow OneButton.cpp so the firmware sees clicks, double
+// clicks and long presses at the same times it would on the hardware.
+
+#ifndef HOST_ONEBUTTON_H
+#define HOST_ONEBUTTON_H
+
+#include "Arduino.h"
+
+class OneButton {
+public:
+  OneButton() {}
+  OneButton(uint8_t pin, bool activeLow = true, bool pullupActive = true) {
+    setup(pin, pullupActive ? INPUT_PULLUP : INPUT, activeLow);
+  }
+
+  void setup(uint8_t pin, uint8_t mode = INPUT_PULLUP, bool activeLow = true);
+
+  void setDebounceMs(int ms) { _debounceMs = ms; }
+  void setClickMs(unsigned int ms) { _clickMs = ms; }
+  void setPressMs(unsigned int ms) { _pressMs = ms; }
+
+  void attachClick(void (*callback)()) { _clickFunc = callback; }
+  void attachDoubleClick(void (*callback)()) { _doubleClickFunc = callback; }
+  void attachMultiClick(void (*callback)()) { _multiClickFunc = callback; }
+  void attachPress(void (*callback)()) { _pressFunc = callback; }
+  void attachLongPressStart(void (*callback)()) { _longPressStartFunc = callback; }
+  void attachLongPressStop(void (*callback)()) { _longPressStopFunc = callback; }
+  void attachDuringLongPress(void (*callback)()) { _duringLongPressFunc = callback; }
+
+  void tick();
+  void tick(bool active);
+  void reset();
+
+  int getNumberClicks() const { return _nClicks; }
+  bool isIdle() const { return _state == OCS_INIT; }
+  bool isLongPressed() const { return _state == OCS_PRESS; }
+
+private:
+  enum State : int {
+    OCS_INIT = 0,
+    OCS_DOWN = 1,
+    OCS_UP = 2,
+    OCS_COUNT = 3,
+    OCS_PRESS = 6,
+    OCS_PRESSEND = 7,
+  };
+
+  bool debounce(bool value);
+  void newState(State state) { _lastState = _state; _state = state; }
+
+  int _pin = -1;
+  int _buttonPressed = LOW;
+  unsigned int _debounceMs = 50;
+  unsigned int _clickMs = 400;
+  unsigned int _pressMs = 800;
+  int _maxClicks = 1;
+
+  void (*_clickFunc)() = nullptr;
+  void (*_doubleClickFunc)() = nullptr;
+  void (*_multiClickFunc)() = nullptr;
+  void (*_pressFunc)() = nullptr;
+  void (*_longPressStartFunc)() = nullptr;
+  void (*_longPressStopFunc)() = nullptr;
+  void (*_duringLongPressFunc)() = nullptr;
+
+  State _state = OCS_INIT;
+  State _lastState = OCS_INIT;
+  bool _lastDebounceValue = false;
+  unsigned long _lastDebounceTime = 0;
+  bool _debouncedValue = false;
+  unsigned long _now = 0;
+  unsigned long _startTime = 0;
+  int _nClicks = 0;
+};
+
+#endif
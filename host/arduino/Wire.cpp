@@ -0,0 +1,77 @@
+#include "Wire.h"
+
+TwoWire Wire;
+
+void TwoWire::begin(uint8_t address, bool receiveBroadcast, uint8_t secondAddress) {
+  _enabled = true;
+  _address = address;
+  _receiveBroadcast = receiveBroadcast;
+  _secondAddress = secondAddress;
+}
+
+size_t TwoWire::write(uint8_t data) {
+  if (_txLength >= BUFFER_LENGTH) {
+    return 0;
+  }
+  _txBuffer[_txLength++] = data;
+  return 1;
+}
+
+size_t TwoWire::write(const uint8_t *data, size_t length) {
+  size_t written = 0;
+  while (written < length && write(data[written])) {
+    written++;
+  }
+  return written;
+}
+
+bool TwoWire::hostMatches(uint8_t address) const {
+  if (!_enabled || _address == 0) {
+    return false;
+  }
+  if (address == _address) {
+    return true;
+  }
+  if (address == 0 && _receiveBroadcast) {
+    return true;
+  }
+  // megaTinyCore passes the second address to TWI0.SADDRMASK: with ADDREN
+  // (bit 0) set bits 7:1 are a second address, otherwise they mask the bits
+  // of the address that are not compared
+  if (_secondAddress & 0x01) {
+    return address == (_secondAddress >> 1);
+  }
+  uint8_t mask = _secondAddress >> 1;
+  return (address & ~mask) == (_address & ~mask);
+}
+
+bool TwoWire::hostWrite(uint8_t address, const uint8_t *data, uint8_t length) {
+  if (!hostMatches(address)) {
+    return false;
+  }
+  _incomingAddress = address;
+  // bytes past the buffer are NACKed by the core and dropped
+  _rxLength = (length > BUFFER_LENGTH) ? BUFFER_LENGTH : length;
+  memcpy(_rxBuffer, data, _rxLength);
+  _rxIndex = 0;
+  if (_onReceive != nullptr) {
+    _onReceive(_rxLength);
+  }
+  return true;
+}
+
+int TwoWire::hostRead(uint8_t address, uint8_t *data, uint8_t length) {
+  if (!hostMatches(address)) {
+    return -1;
+  }
+  _incomingAddress = address;
+  _txLength = 0;
+  if (_onRequest != nullptr) {
+    _onRequest();
+  }
+  // the controller clocks out length bytes whatever the peripheral wrote
+  for (uint8_t i = 0; i < length; i++) {
+    data[i] = (i < _txLength) ? _txBuffer[i] : 0xFF;
+  }
+  return length;
+}
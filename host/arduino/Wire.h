@@ -0,0 +1,59 @@
+// Host stand-in for the megaTinyCore Wire library in client (slave) mode.
+// The simulator plays the bus controller: hostWrite() and hostRead() run the
+// onReceive and onRequest callbacks the way the TWI ISR does.
+
+#ifndef HOST_WIRE_H
+#define HOST_WIRE_H
+
+#include "Arduino.h"
+
+#ifndef BUFFER_LENGTH
+  #define BUFFER_LENGTH 32
+#endif
+
+class TwoWire {
+public:
+  // controller mode is not used by the firmware
+  void begin() { _enabled = true; _address = 0; }
+  void begin(uint8_t address, bool receiveBroadcast = false, uint8_t secondAddress = 0);
+  void end() { _enabled = false; }
+  void setClock(uint32_t clock) {}
+
+  void onReceive(void (*callback)(int)) { _onReceive = callback; }
+  void onRequest(void (*callback)()) { _onRequest = callback; }
+
+  int available() { return _rxLength - _rxIndex; }
+  int read() { return (_rxIndex < _rxLength) ? _rxBuffer[_rxIndex++] : -1; }
+  int peek() { return (_rxIndex < _rxLength) ? _rxBuffer[_rxIndex] : -1; }
+  size_t write(uint8_t data);
+  size_t write(const uint8_t *data, size_t length);
+  uint8_t getIncomingAddress() { return _incomingAddress << 1; }
+
+  // ---- simulator side
+  // True if a transaction to address would be acknowledged.
+  bool hostMatches(uint8_t address) const;
+  // Controller write of length bytes. Returns false on NACK.
+  bool hostWrite(uint8_t address, const uint8_t *data, uint8_t length);
+  // Controller read of up to length bytes. Returns the number of bytes the
+  // client wrote, the rest of data is filled with 0xFF like a released bus.
+  int hostRead(uint8_t address, uint8_t *data, uint8_t length);
+  uint8_t hostAddress() const { return _address; }
+
+private:
+  bool _enabled = false;
+  uint8_t _address = 0;
+  bool _receiveBroadcast = false;
+  uint8_t _secondAddress = 0;
+  uint8_t _incomingAddress = 0;
+  void (*_onReceive)(int) = nullptr;
+  void (*_onRequest)() = nullptr;
+  uint8_t _rxBuffer[BUFFER_LENGTH];
+  uint8_t _rxLength = 0;
+  uint8_t _rxIndex = 0;
+  uint8_t _txBuffer[BUFFER_LENGTH];
+  uint8_t _txLength = 0;
+};
+
+extern TwoWire Wire;
+
+#endif
@@ -0,0 +1,25 @@
+// Host stand-in for <avr/interrupt.h>. The simulator calls the vectors by
+// name when the matching event happens (sim/Sim.cpp). Every vector has an
+// empty weak default so a firmware build that doesn't define it still links.
+
+#ifndef HOST_AVR_INTERRUPT_H
+#define HOST_AVR_INTERRUPT_H
+
+#include "avr/io.h"
+
+#define ISR(vector) extern "C" void vector()
+
+#define cli() (SREG &= (uint8_t)~CPU_I_bm)
+#define sei() (SREG |= CPU_I_bm)
+
+extern "C" {
+void RTC_CNT_vect();
+void RTC_PIT_vect();
+void PORTA_PORT_vect();
+void PORTB_PORT_vect();
+void PORTC_PORT_vect();
+void TCB0_INT_vect();
+void TCB1_INT_vect();
+}
+
+#endif
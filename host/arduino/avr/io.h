@@ -0,0 +1,245 @@
+// Host stand-ins for the ATtiny1616 peripheral registers used by the
+// firmware. They are plain memory. The simulator (sim/Sim.cpp) reads and
+// writes them where the hardware would, e.g. RTC.CNT after waking up.
+
+#ifndef HOST_AVR_IO_H
+#define HOST_AVR_IO_H
+
+#include <stdint.h>
+
+typedef volatile uint8_t register8_t;
+typedef volatile uint16_t register16_t;
+
+extern volatile uint8_t SREG;
+#define CPU_I_bm 0x80
+
+extern volatile uint8_t GPIOR0, GPIOR1, GPIOR2, GPIOR3;
+
+// ---- CLKCTRL
+struct CLKCTRL_t {
+  register8_t MCLKCTRLA;
+  register8_t MCLKCTRLB;
+  register8_t MCLKLOCK;
+  register8_t MCLKSTATUS;
+  register8_t OSC20MCTRLA;
+  register8_t OSC20MCALIBA;
+  register8_t OSC20MCALIBB;
+  register8_t OSC32KCTRLA;
+  register8_t XOSC32KCTRLA;
+};
+extern CLKCTRL_t CLKCTRL;
+#define CLKCTRL_PEN_bm     0x01
+#define CLKCTRL_PDIV_gm    0x1E
+#define CLKCTRL_PDIV_2X_gc  (0x00 << 1)
+#define CLKCTRL_PDIV_4X_gc  (0x01 << 1)
+#define CLKCTRL_PDIV_8X_gc  (0x02 << 1)
+#define CLKCTRL_PDIV_16X_gc (0x03 << 1)
+#define CLKCTRL_PDIV_32X_gc (0x04 << 1)
+#define CLKCTRL_PDIV_64X_gc (0x05 << 1)
+#define CLKCTRL_PDIV_6X_gc  (0x08 << 1)
+#define CLKCTRL_PDIV_10X_gc (0x09 << 1)
+#define CLKCTRL_PDIV_12X_gc (0x0A << 1)
+#define CLKCTRL_PDIV_24X_gc (0x0B << 1)
+#define CLKCTRL_PDIV_48X_gc (0x0C << 1)
+#define CLKCTRL_SOSC_bm    0x01
+
+// ---- CCP
+extern volatile uint8_t CCP;
+#define CCP_IOREG_gc 0xD8
+#define _PROTECTED_WRITE(reg, value) do { CCP = CCP_IOREG_gc; (reg) = (value); } while (0)
+
+// ---- RSTCTRL
+struct RSTCTRL_t {
+  register8_t RSTFR;
+  register8_t SWRR;
+};
+extern RSTCTRL_t RSTCTRL;
+#define RSTCTRL_PORF_bm  0x01
+#define RSTCTRL_BORF_bm  0x02
+#define RSTCTRL_EXTRF_bm 0x04
+#define RSTCTRL_WDRF_bm  0x08
+#define RSTCTRL_SWRF_bm  0x10
+#define RSTCTRL_UPDIRF_bm 0x20
+#define RSTCTRL_SWRE_bm  0x01
+
+// ---- SLPCTRL
+struct SLPCTRL_t {
+  register8_t CTRLA;
+};
+extern SLPCTRL_t SLPCTRL;
+#define SLPCTRL_SEN_bm   0x01
+#define SLPCTRL_SMODE_gm 0x06
+#define SLPCTRL_SMODE_IDLE_gc    (0x00 << 1)
+#define SLPCTRL_SMODE_STDBY_gc   (0x01 << 1)
+#define SLPCTRL_SMODE_PDOWN_gc   (0x02 << 1)
+
+// ---- RTC
+struct RTC_t {
+  register8_t CTRLA;
+  register8_t STATUS;
+  register8_t INTCTRL;
+  register8_t INTFLAGS;
+  register8_t TEMP;
+  register8_t DBGCTRL;
+  register8_t CLKSEL;
+  register16_t CNT;
+  register16_t PER;
+  register16_t CMP;
+  register8_t PITCTRLA;
+  register8_t PITSTATUS;
+  register8_t PITINTCTRL;
+  register8_t PITINTFLAGS;
+};
+extern RTC_t RTC;
+#define RTC_RTCEN_bm    0x01
+#define RTC_RUNSTDBY_bm 0x80
+#define RTC_PRESCALER_gm 0x78
+#define RTC_PRESCALER_DIV1_gc  (0x00 << 3)
+#define RTC_PRESCALER_DIV32_gc (0x05 << 3)
+#define RTC_OVF_bm      0x01
+#define RTC_CMP_bm      0x02
+#define RTC_CTRLABUSY_bm 0x01
+#define RTC_CNTBUSY_bm  0x02
+#define RTC_PERBUSY_bm  0x04
+#define RTC_CMPBUSY_bm  0x08
+#define RTC_CLKSEL_INT32K_gc 0x00
+#define RTC_CLKSEL_INT1K_gc  0x01
+#define RTC_PI_bm       0x01
+#define RTC_PITEN_bm    0x01
+
+// ---- PORT
+struct PORT_t {
+  register8_t DIR;
+  register8_t DIRSET;
+  register8_t DIRCLR;
+  register8_t DIRTGL;
+  register8_t OUT;
+  register8_t OUTSET;
+  register8_t OUTCLR;
+  register8_t OUTTGL;
+  register8_t IN;
+  register8_t INTFLAGS;
+  register8_t PORTCTRL;
+  register8_t PIN0CTRL;
+  register8_t PIN1CTRL;
+  register8_t PIN2CTRL;
+  register8_t PIN3CTRL;
+  register8_t PIN4CTRL;
+  register8_t PIN5CTRL;
+  register8_t PIN6CTRL;
+  register8_t PIN7CTRL;
+};
+extern PORT_t PORTA, PORTB, PORTC;
+#define PORT_ISC_gm              0x07
+#define PORT_ISC_INTDISABLE_gc   0x00
+#define PORT_ISC_BOTHEDGES_gc    0x01
+#define PORT_ISC_RISING_gc       0x02
+#define PORT_ISC_FALLING_gc      0x03
+#define PORT_ISC_INPUT_DISABLE_gc 0x04
+#define PORT_ISC_LEVEL_gc        0x05
+#define PORT_PULLUPEN_bm         0x08
+#define PORT_INVEN_bm            0x80
+
+// ---- TCA0 (split mode, which megaTinyCore uses for analogWrite())
+struct TCA_SPLIT_t {
+  register8_t CTRLA;
+  register8_t CTRLB;
+  register8_t CTRLC;
+  register8_t CTRLD;
+  register8_t CTRLECLR;
+  register8_t CTRLESET;
+  register8_t INTCTRL;
+  register8_t INTFLAGS;
+  register8_t DBGCTRL;
+  register8_t LCNT;
+  register8_t HCNT;
+  register8_t LPER;
+  register8_t HPER;
+  register8_t LCMP0;
+  register8_t HCMP0;
+  register8_t LCMP1;
+  register8_t HCMP1;
+  register8_t LCMP2;
+  register8_t HCMP2;
+};
+union TCA_t {
+  TCA_SPLIT_t SPLIT;
+};
+extern TCA_t TCA0;
+#define TCA_SPLIT_ENABLE_bm  0x01
+#define TCA_SPLIT_CLKSEL_gm  0x0E
+#define TCA_SPLIT_CLKSEL_DIV1_gc  (0x00 << 1)
+#define TCA_SPLIT_CLKSEL_DIV2_gc  (0x01 << 1)
+#define TCA_SPLIT_CLKSEL_DIV4_gc  (0x02 << 1)
+#define TCA_SPLIT_CLKSEL_DIV8_gc  (0x03 << 1)
+#define TCA_SPLIT_CLKSEL_DIV16_gc (0x04 << 1)
+#define TCA_SPLIT_CLKSEL_DIV64_gc (0x05 << 1)
+#define TCA_SPLIT_LCMP0EN_bm 0x01
+#define TCA_SPLIT_LCMP1EN_bm 0x02
+#define TCA_SPLIT_LCMP2EN_bm 0x04
+#define TCA_SPLIT_HCMP0EN_bm 0x10
+#define TCA_SPLIT_HCMP1EN_bm 0x20
+#define TCA_SPLIT_HCMP2EN_bm 0x40
+#define TCA_SPLIT_LUNF_bm    0x01
+#define TCA_SPLIT_HUNF_bm    0x02
+
+// ---- TCB
+struct TCB_t {
+  register8_t CTRLA;
+  register8_t CTRLB;
+  register8_t EVCTRL;
+  register8_t INTCTRL;
+  register8_t INTFLAGS;
+  register8_t STATUS;
+  register8_t DBGCTRL;
+  register8_t TEMP;
+  register16_t CNT;
+  register16_t CCMP;
+};
+extern TCB_t TCB0, TCB1;
+#define TCB_ENABLE_bm 0x01
+#define TCB_CAPT_bm   0x01
+#define TCB_CNTMODE_INT_gc 0x00
+#define TCB_CLKSEL_CLKDIV1_gc 0x00
+#define TCB_CLKSEL_CLKDIV2_gc 0x02
+#define TCB_CLKSEL_CLKTCA_gc  0x04
+
+// ---- TWI0 (the Wire stand-in takes the place of the registers)
+#define TWI_ADDREN_bm 0x01 // SADDRMASK: bits 7:1 are a second address
+
+// ---- USART0
+struct USART_t {
+  register8_t RXDATAL;
+  register8_t RXDATAH;
+  register8_t TXDATAL;
+  register8_t TXDATAH;
+  register8_t STATUS;
+  register8_t CTRLA;
+  register8_t CTRLB;
+  register8_t CTRLC;
+  register16_t BAUD;
+};
+extern USART_t USART0;
+#define USART_DREIE_bm 0x20
+#define USART_RXEN_bm  0x80
+#define USART_TXEN_bm  0x40
+
+// ---- SIGROW
+struct SIGROW_t {
+  register8_t DEVICEID0;
+  register8_t DEVICEID1;
+  register8_t DEVICEID2;
+  register8_t SERNUM0;
+  register8_t SERNUM1;
+  register8_t SERNUM2;
+  register8_t SERNUM3;
+  register8_t SERNUM4;
+  register8_t SERNUM5;
+  register8_t SERNUM6;
+  register8_t SERNUM7;
+  register8_t SERNUM8;
+  register8_t SERNUM9;
+};
+extern SIGROW_t SIGROW;
+
+#endif
@@ -0,0 +1,24 @@
+// Host stand-in for <avr/sleep.h>. sleep_cpu() hands over to the simulator,
+// which advances virtual time to the next wake up source of the selected
+// sleep mode.
+
+#ifndef HOST_AVR_SLEEP_H
+#define HOST_AVR_SLEEP_H
+
+#include "avr/io.h"
+
+#define SLEEP_MODE_IDLE       SLPCTRL_SMODE_IDLE_gc
+#define SLEEP_MODE_STANDBY    SLPCTRL_SMODE_STDBY_gc
+#define SLEEP_MODE_PWR_DOWN   SLPCTRL_SMODE_PDOWN_gc
+
+#define set_sleep_mode(mode) (SLPCTRL.CTRLA = (SLPCTRL.CTRLA & ~SLPCTRL_SMODE_gm) | (mode))
+#define sleep_enable()       (SLPCTRL.CTRLA |= SLPCTRL_SEN_bm)
+#define sleep_disable()      (SLPCTRL.CTRLA &= (uint8_t)~SLPCTRL_SEN_bm)
+
+namespace sim {
+void sleepCpu();
+}
+
+#define sleep_cpu() sim::sleepCpu()
+
+#endif
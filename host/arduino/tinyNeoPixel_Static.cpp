@@ -0,0 +1,61 @@
+#include "tinyNeoPixel_Static.h"
+
+#include <stdio.h>
+
+#include "Sim.h"
+
+tinyNeoPixel::tinyNeoPixel(uint16_t n, uint8_t pin, neoPixelType type, uint8_t *pixels)
+    : _numLEDs(n), _numBytes(n * 3), _pin(pin), _pixels(pixels) {
+  _rOffset = (type >> 4) & 0x03;
+  _gOffset = (type >> 2) & 0x03;
+  _bOffset = type & 0x03;
+}
+
+void tinyNeoPixel::show() {
+  // the bits are timed in cycles of F_CPU
+  static bool warned = false;
+  if (sim::cpuHz() != F_CPU && !warned) {
+    warned = true;
+    fprintf(stderr, "tinyNeoPixel::show() at %lu Hz, the pixels get garbage\n", (unsigned long)sim::cpuHz());
+  }
+  // 1.25 us per bit at 800 kHz with interrupts off, then the latch time
+  sim::chargeNs(_numBytes * 8 * 1250ULL);
+  sim::chargeNs(50 * sim::NS_PER_US);
+  if (sim::onShow) {
+    sim::onShow(sim::now(), _pin, _pixels, _numBytes);
+  }
+}
+
+void tinyNeoPixel::setPixelColor(uint16_t n, uint8_t r, uint8_t g, uint8_t b) {
+  if (n >= _numLEDs) {
+    return;
+  }
+  if (_brightness) {
+    r = (r * _brightness) >> 8;
+    g = (g * _brightness) >> 8;
+    b = (b * _brightness) >> 8;
+  }
+  uint8_t *p = &_pixels[n * 3];
+  p[_rOffset] = r;
+  p[_gOffset] = g;
+  p[_bOffset] = b;
+}
+
+void tinyNeoPixel::setPixelColor(uint16_t n, uint32_t c) {
+  setPixelColor(n, (uint8_t)(c >> 16), (uint8_t)(c >> 8), (uint8_t)c);
+}
+
+void tinyNeoPixel::fill(uint32_t c, uint16_t first, uint16_t count) {
+  uint16_t end = (count == 0) ? _numLEDs : first + count;
+  for (uint16_t i = first; i < end && i < _numLEDs; i++) {
+    setPixelColor(i, c);
+  }
+}
+
+uint32_t tinyNeoPixel::getPixelColor(uint16_t n) const {
+  if (n >= _numLEDs) {
+    return 0;
+  }
+  const uint8_t *p = &_pixels[n * 3];
+  return ((uint32_t)p[_rOffset] << 16) | ((uint32_t)p[_gOffset] << 8) | p[_bOffset];
+}
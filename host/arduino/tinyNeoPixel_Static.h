@@ -0,0 +1,50 @@
+// Host stand-in for the megaTinyCore tinyNeoPixel_Static library. The pixel
+// buffer belongs to the sketch like on the hardware. show() costs the time
+// the data takes on the wire and is reported to the simulator.
+
+#ifndef HOST_TINYNEOPIXEL_STATIC_H
+#define HOST_TINYNEOPIXEL_STATIC_H
+
+#include "Arduino.h"
+
+#define NEO_RGB ((0 << 6) | (0 << 4) | (1 << 2) | (2))
+#define NEO_GRB ((1 << 6) | (1 << 4) | (0 << 2) | (2))
+#define NEO_KHZ800 0x0000
+
+typedef uint8_t neoPixelType;
+
+class tinyNeoPixel {
+public:
+  tinyNeoPixel(uint16_t n, uint8_t pin, neoPixelType type, uint8_t *pixels);
+
+  void show();
+  void setPin(uint8_t pin) { _pin = pin; }
+  void setPixelColor(uint16_t n, uint8_t r, uint8_t g, uint8_t b);
+  void setPixelColor(uint16_t n, uint32_t c);
+  void fill(uint32_t c = 0, uint16_t first = 0, uint16_t count = 0);
+  void setBrightness(uint8_t brightness) { _brightness = brightness; }
+  void clear() { memset(_pixels, 0, _numBytes); }
+
+  uint8_t *getPixels() const { return _pixels; }
+  uint8_t getBrightness() const { return _brightness; }
+  uint8_t getPin() const { return _pin; }
+  uint16_t numPixels() const { return _numLEDs; }
+  uint32_t getPixelColor(uint16_t n) const;
+  bool canShow() const { return true; }
+
+  static uint32_t Color(uint8_t r, uint8_t g, uint8_t b) {
+    return ((uint32_t)r << 16) | ((uint32_t)g << 8) | b;
+  }
+
+private:
+  uint16_t _numLEDs;
+  uint16_t _numBytes;
+  uint8_t _pin;
+  uint8_t _brightness = 0;
+  uint8_t *_pixels;
+  uint8_t _rOffset;
+  uint8_t _gOffset;
+  uint8_t _bOffset;
+};
+
+#endif
@@ -0,0 +1,369 @@
+#include "Controller.h"
+
+#include <string.h>
+
+#include <algorithm>
+
+namespace incipit11 {
+
+namespace {
+
+// Adafruit_seesaw.h
+const uint8_t SEESAW_EEPROM_BASE = 0x0D;
+const uint8_t SEESAW_KEYPAD_BASE = 0x10;
+const uint8_t SEESAW_KEYPAD_INTENSET = 0x02;
+const uint8_t SEESAW_KEYPAD_INTENCLR = 0x03;
+const uint8_t SEESAW_KEYPAD_COUNT = 0x04;
+const uint8_t SEESAW_KEYPAD_FIFO = 0x10;
+// DOA_seesawCompatibility.h
+const uint8_t CONFIG_I2C_ENUMERATION_ADDR = 0x61;
+const uint8_t DOA_SEESAW_ADDRESS_BASE = 0x85;
+const uint8_t DOA_SEESAW_ADDRESS_ID = 0x01;
+const uint8_t DOA_SEESAW_ADDRESS_ASSIGN = 0x02;
+const uint8_t DOA_SEESAW_BROADCAST_BASE = 0x86;
+const uint8_t DOA_SEESAW_BROADCAST_EFFECT = 0x00;
+const uint8_t DOA_SEESAW_BROADCAST_SYNC = 0x02;
+const uint8_t DOA_SEESAW_PROFILER_BASE = 0x80;
+const uint8_t DOA_SEESAW_PROFILER_INFO = 0x00;
+const uint8_t DOA_SEESAW_PROFILER_SUMMARY = 0x10;
+const uint8_t DOA_SEESAW_PROFILER_RESET = 0x7F;
+const uint8_t DOA_SEESAW_CAPTURE_BASE = 0x87;
+const uint8_t DOA_SEESAW_CAPTURE_INFO = 0x00;
+const uint8_t DOA_SEESAW_CAPTURE_EEPROM = 0x20;
+const uint8_t DOA_SEESAW_CAPTURE_DATA = 0x40;
+const uint8_t KEY_BUFFER_CAPACITY = 5;
+const uint8_t ALL_GROUPS = 0xFF;
+// Profiler.h
+const uint8_t PROFILER_MAX_PHASES = 16; // the phase is the low nibble of the register
+const uint8_t PROFILER_HISTOGRAM_BINS = 16;
+// Capture.h, and the EEPROM it reads
+const uint16_t CAPTURE_MAX_SIZE = 64 * 32;
+const uint8_t CAPTURE_CHUNK = 32;
+const uint16_t EEPROM_SIZE = 256;
+// Address.h
+const uint8_t ADDRESS_ID_SIZE = 11;
+const uint8_t ADDRESS_LAST = 0x77;
+// Incipit11Controller.ino
+const uint8_t ADDR_AMBIENT_EFFECT = 0;
+const uint8_t ADDR_TRIGGERED_LENGTH = 2;
+const uint8_t ADDR_CHANNEL_EFFECTS = 0x10;
+
+uint32_t bigEndian32(const uint8_t *bytes) {
+  return ((uint32_t)bytes[0] << 24) | ((uint32_t)bytes[1] << 16) | ((uint32_t)bytes[2] << 8) | bytes[3];
+}
+
+uint16_t bigEndian16(const uint8_t *bytes) {
+  return (uint16_t)((bytes[0] << 8) | bytes[1]);
+}
+
+uint8_t channelEffectsAddress(uint8_t channel) {
+  if (channel == 0) {
+    return ADDR_AMBIENT_EFFECT;
+  }
+  return ADDR_CHANNEL_EFFECTS + 2 * (channel - 1);
+}
+
+} // namespace
+
+Controller::Access Controller::access(uint8_t address, const uint8_t *write, uint8_t writeLength,
+                                      uint8_t readLength) {
+  Access access;
+  access.address = address;
+  memcpy(access.write, write, writeLength);
+  access.writeLength = writeLength;
+  access.readLength = readLength;
+  access.ok = false;
+  return access;
+}
+
+// Sends the accesses in one transfer.
+bool Controller::send(Access *accesses, size_t count) {
+  std::vector<I2CMessage> messages;
+  for (size_t i = 0; i < count; i++) {
+    Access &access = accesses[i];
+    messages.push_back({access.address, false, access.write, access.writeLength});
+    if (access.readLength > 0) {
+      messages.push_back({access.address, true, access.read, access.readLength});
+    }
+  }
+  _transfers++;
+  _messages += messages.size();
+  return _transport.transfer(messages.data(), messages.size());
+}
+
+// Sends the accesses, as many in a transfer as the transport takes. When a
+// transfer fails its accesses are sent one at a time to find the units that
+// didn't answer.
+void Controller::run(std::vector<Access> &accesses) {
+  size_t count;
+  for (size_t first = 0; first < accesses.size(); first += count) {
+    // as many accesses as there is room for their messages
+    size_t messages = 0;
+    for (count = 0; first + count < accesses.size(); count++) {
+      messages += (accesses[first + count].readLength > 0) ? 2 : 1;
+      if (count > 0 && (!_batching || messages > _transport.maxMessages())) {
+        break;
+      }
+    }
+    bool ok = send(&accesses[first], count);
+    if (!ok && count > 1) {
+      _retries++;
+      for (size_t i = first; i < first + count; i++) {
+        accesses[i].ok = send(&accesses[i], 1);
+      }
+      continue;
+    }
+    for (size_t i = first; i < first + count; i++) {
+      accesses[i].ok = ok;
+    }
+  }
+}
+
+bool Controller::write(uint8_t address, const uint8_t *data, uint8_t length) {
+  std::vector<Access> accesses(1, access(address, data, length, 0));
+  run(accesses);
+  return accesses[0].ok;
+}
+
+size_t Controller::readKeyEvents(const std::vector<uint8_t> &units, std::vector<KeyEvent> &events) {
+  static const uint8_t count[] = {SEESAW_KEYPAD_BASE, SEESAW_KEYPAD_COUNT};
+  static const uint8_t fifo[] = {SEESAW_KEYPAD_BASE, SEESAW_KEYPAD_FIFO};
+
+  std::vector<Access> counts;
+  for (uint8_t address : units) {
+    counts.push_back(access(address, count, sizeof(count), 1));
+  }
+  run(counts);
+
+  // the events of the units that have any
+  std::vector<Access> reads;
+  size_t answered = 0;
+  for (const Access &access : counts) {
+    if (!access.ok) {
+      continue;
+    }
+    answered++;
+    uint8_t queued = std::min(access.read[0], KEY_BUFFER_CAPACITY);
+    if (queued > 0) {
+      reads.push_back(Controller::access(access.address, fifo, sizeof(fifo), queued));
+    }
+  }
+  run(reads);
+
+  for (const Access &access : reads) {
+    if (!access.ok) {
+      continue;
+    }
+    for (uint8_t i = 0; i < access.readLength; i++) {
+      // past the queued events (taken by another read since the count) the
+      // unit sends 0xFF
+      if (access.read[i] == 0xFF) {
+        break;
+      }
+      // keyEventRaw: the edge in the low 2 bits, the key above
+      events.push_back({access.address, (uint8_t)(access.read[i] >> 2), (uint8_t)(access.read[i] & 0x03)});
+    }
+  }
+  return answered;
+}
+
+void Controller::readSettings(const std::vector<uint8_t> &units, uint8_t channel,
+                              std::vector<Settings> &settings) {
+  // one byte per EEPROM register read: the effects, then the length (big
+  // endian)
+  const uint8_t ADDRESSES = 6;
+  uint8_t registers[ADDRESSES] = {
+    channelEffectsAddress(channel), (uint8_t)(channelEffectsAddress(channel) + 1),
+    ADDR_TRIGGERED_LENGTH, ADDR_TRIGGERED_LENGTH + 1, ADDR_TRIGGERED_LENGTH + 2, ADDR_TRIGGERED_LENGTH + 3,
+  };
+
+  std::vector<Access> accesses;
+  for (uint8_t address : units) {
+    for (uint8_t i = 0; i < ADDRESSES; i++) {
+      uint8_t select[] = {SEESAW_EEPROM_BASE, registers[i]};
+      accesses.push_back(access(address, select, sizeof(select), 1));
+    }
+  }
+  run(accesses);
+
+  settings.assign(units.size(), Settings());
+  for (size_t unit = 0; unit < units.size(); unit++) {
+    const Access *reads = &accesses[unit * ADDRESSES];
+    Settings &unitSettings = settings[unit];
+    unitSettings.ok = true;
+    for (uint8_t i = 0; i < ADDRESSES; i++) {
+      unitSettings.ok = unitSettings.ok && reads[i].ok;
+    }
+    unitSettings.ambientEffect = reads[0].read[0];
+    unitSettings.triggeredEffect = reads[1].read[0];
+    uint8_t length[] = {reads[2].read[0], reads[3].read[0], reads[4].read[0], reads[5].read[0]};
+    unitSettings.triggeredLength = bigEndian32(length);
+  }
+}
+
+size_t Controller::setEffect(const std::vector<uint8_t> &units, uint8_t channel, uint8_t effect) {
+  // a broadcast command written to the unit's own address
+  uint8_t command[] = {DOA_SEESAW_BROADCAST_BASE, DOA_SEESAW_BROADCAST_EFFECT, ALL_GROUPS, channel, effect};
+  std::vector<Access> accesses;
+  for (uint8_t address : units) {
+    accesses.push_back(access(address, command, sizeof(command), 0));
+  }
+  run(accesses);
+  return std::count_if(accesses.begin(), accesses.end(), [](const Access &access) { return access.ok; });
+}
+
+size_t Controller::saveEffect(const std::vector<uint8_t> &units, uint8_t channel, uint8_t effect) {
+  uint8_t command[] = {SEESAW_EEPROM_BASE, channelEffectsAddress(channel), effect};
+  std::vector<Access> accesses;
+  for (uint8_t address : units) {
+    accesses.push_back(access(address, command, sizeof(command), 0));
+  }
+  run(accesses);
+  return std::count_if(accesses.begin(), accesses.end(), [](const Access &access) { return access.ok; });
+}
+
+size_t Controller::setKeyInterrupt(const std::vector<uint8_t> &units, bool on) {
+  uint8_t command[] = {SEESAW_KEYPAD_BASE, on ? SEESAW_KEYPAD_INTENSET : SEESAW_KEYPAD_INTENCLR, 0x01};
+  std::vector<Access> accesses;
+  for (uint8_t address : units) {
+    accesses.push_back(access(address, command, sizeof(command), 0));
+  }
+  run(accesses);
+  return std::count_if(accesses.begin(), accesses.end(), [](const Access &access) { return access.ok; });
+}
+
+size_t Controller::enumerate(uint8_t first, std::vector<uint8_t> &addresses) {
+  static const uint8_t readId[] = {DOA_SEESAW_ADDRESS_BASE, DOA_SEESAW_ADDRESS_ID};
+  size_t given = 0;
+  uint8_t address = first;
+  for (;;) {
+    while (address == CONFIG_I2C_ENUMERATION_ADDR ||
+           std::find(addresses.begin(), addresses.end(), address) != addresses.end()) {
+      address++;
+    }
+    if (address > ADDRESS_LAST) {
+      break;
+    }
+    // every enumerating unit sends its id and the lowest one comes through;
+    // a NACK means there are none left
+    std::vector<Access> id(1, access(CONFIG_I2C_ENUMERATION_ADDR, readId, sizeof(readId), ADDRESS_ID_SIZE));
+    run(id);
+    if (!id[0].ok) {
+      break;
+    }
+    uint8_t assign[2 + ADDRESS_ID_SIZE + 1] = {DOA_SEESAW_ADDRESS_BASE, DOA_SEESAW_ADDRESS_ASSIGN};
+    memcpy(assign + 2, id[0].read, ADDRESS_ID_SIZE);
+    assign[2 + ADDRESS_ID_SIZE] = address;
+    if (!write(CONFIG_I2C_ENUMERATION_ADDR, assign, sizeof(assign))) {
+      break;
+    }
+    addresses.push_back(address);
+    given++;
+  }
+  return given;
+}
+
+void Controller::readProfiles(const std::vector<uint8_t> &units, std::vector<Profile> &profiles) {
+  static const uint8_t info[] = {DOA_SEESAW_PROFILER_BASE, DOA_SEESAW_PROFILER_INFO};
+  const uint8_t INFO_SIZE = 7;    // phase count, bins, shift, F_CPU
+  const uint8_t SUMMARY_SIZE = 16; // count, min, mean, max
+
+  std::vector<Access> infos;
+  for (uint8_t address : units) {
+    infos.push_back(access(address, info, sizeof(info), INFO_SIZE));
+  }
+  run(infos);
+
+  // the summaries of the units that have a profiler; one without answers
+  // the info with 0xFF
+  std::vector<Access> summaries;
+  profiles.assign(units.size(), Profile());
+  for (size_t unit = 0; unit < units.size(); unit++) {
+    const Access &access = infos[unit];
+    uint8_t phases = access.read[0];
+    if (!access.ok || phases > PROFILER_MAX_PHASES || access.read[1] != PROFILER_HISTOGRAM_BINS) {
+      continue;
+    }
+    profiles[unit].hz = bigEndian32(&access.read[3]);
+    profiles[unit].phases.resize(phases);
+    for (uint8_t phase = 0; phase < phases; phase++) {
+      uint8_t select[] = {DOA_SEESAW_PROFILER_BASE, (uint8_t)(DOA_SEESAW_PROFILER_SUMMARY + phase)};
+      summaries.push_back(Controller::access(access.address, select, sizeof(select), SUMMARY_SIZE));
+    }
+  }
+  run(summaries);
+
+  const Access *summary = summaries.data();
+  for (Profile &profile : profiles) {
+    profile.ok = !profile.phases.empty();
+    for (PhaseProfile &phase : profile.phases) {
+      profile.ok = profile.ok && summary->ok;
+      phase.count = bigEndian32(&summary->read[0]);
+      phase.min = bigEndian32(&summary->read[4]);
+      phase.mean = bigEndian32(&summary->read[8]);
+      phase.max = bigEndian32(&summary->read[12]);
+      summary++;
+    }
+  }
+}
+
+size_t Controller::resetProfiles(const std::vector<uint8_t> &units) {
+  static const uint8_t command[] = {DOA_SEESAW_PROFILER_BASE, DOA_SEESAW_PROFILER_RESET};
+  std::vector<Access> accesses;
+  for (uint8_t address : units) {
+    accesses.push_back(access(address, command, sizeof(command), 0));
+  }
+  run(accesses);
+  return std::count_if(accesses.begin(), accesses.end(), [](const Access &access) { return access.ok; });
+}
+
+void Controller::readCapture(uint8_t unit, Capture &capture) {
+  static const uint8_t info[] = {DOA_SEESAW_CAPTURE_BASE, DOA_SEESAW_CAPTURE_INFO};
+  const uint8_t INFO_SIZE = 7; // used, size, dropped, flags
+
+  capture = Capture();
+  std::vector<Access> infos(1, access(unit, info, sizeof(info), INFO_SIZE));
+  run(infos);
+  // a unit without answers the info with 0xFF
+  uint16_t used = bigEndian16(&infos[0].read[0]);
+  uint16_t size = bigEndian16(&infos[0].read[2]);
+  if (!infos[0].ok || size == 0 || size > CAPTURE_MAX_SIZE || used > size) {
+    return;
+  }
+
+  // the records, then the EEPROM
+  std::vector<Access> chunks;
+  for (uint16_t offset = 0; offset < used; offset += CAPTURE_CHUNK) {
+    uint8_t select[] = {DOA_SEESAW_CAPTURE_BASE, (uint8_t)(DOA_SEESAW_CAPTURE_DATA + offset / CAPTURE_CHUNK)};
+    chunks.push_back(access(unit, select, sizeof(select), CAPTURE_CHUNK));
+  }
+  for (uint16_t offset = 0; offset < EEPROM_SIZE; offset += CAPTURE_CHUNK) {
+    uint8_t select[] = {DOA_SEESAW_CAPTURE_BASE, (uint8_t)(DOA_SEESAW_CAPTURE_EEPROM + offset / CAPTURE_CHUNK)};
+    chunks.push_back(access(unit, select, sizeof(select), CAPTURE_CHUNK));
+  }
+  run(chunks);
+
+  capture.ok = std::all_of(chunks.begin(), chunks.end(), [](const Access &access) { return access.ok; });
+  capture.size = size;
+  capture.dropped = bigEndian16(&infos[0].read[4]);
+  capture.flags = infos[0].read[6];
+  size_t records = (used + CAPTURE_CHUNK - 1) / CAPTURE_CHUNK;
+  for (size_t i = 0; i < chunks.size(); i++) {
+    std::vector<uint8_t> &bytes = (i < records) ? capture.records : capture.eeprom;
+    bytes.insert(bytes.end(), chunks[i].read, chunks[i].read + CAPTURE_CHUNK);
+  }
+  capture.records.resize(used);
+}
+
+bool Controller::broadcastEffect(uint8_t groups, uint8_t channel, uint8_t effect) {
+  uint8_t command[] = {DOA_SEESAW_BROADCAST_BASE, DOA_SEESAW_BROADCAST_EFFECT, groups, channel, effect};
+  return write(0, command, sizeof(command));
+}
+
+bool Controller::broadcastSync(uint8_t groups, uint32_t millis) {
+  uint8_t command[] = {DOA_SEESAW_BROADCAST_BASE, DOA_SEESAW_BROADCAST_SYNC, groups,
+                       (uint8_t)(millis >> 24), (uint8_t)(millis >> 16), (uint8_t)(millis >> 8), (uint8_t)millis};
+  return write(0, command, sizeof(command));
+}
+
+} // namespace incipit11
@@ -0,0 +1,150 @@
+// Host controller library for a bus of Incipit11 units.
+//
+// The units are seesaw peripherals (DOA_seesawCompatibility.h). Where the
+// Adafruit seesaw library talks to one unit at a time, writing the register,
+// waiting and then reading it, this sends the register accesses of many
+// units together:
+//   - A register is selected and read in one go (write, repeated START,
+//     read). The firmware answers from the TWI interrupt, so no wait is
+//     needed in between.
+//   - The accesses of all the units are packed into as few transfers as the
+//     transport takes (Transport.h), 21 write and read pairs per I2C_RDWR
+//     ioctl on Linux.
+//   - Reads that depend on an earlier read (the key events after their
+//     count) are sent as a second batch to the units that need them.
+// A unit that doesn't answer fails the whole transfer, so the accesses of a
+// failed transfer are sent again one unit at a time to find it. Its results
+// are then marked as not ok and the other units' are kept.
+
+#ifndef INCIPIT11_CONTROLLER_H
+#define INCIPIT11_CONTROLLER_H
+
+#include <stdint.h>
+#include <vector>
+
+#include "Transport.h"
+
+namespace incipit11 {
+
+// A key event of a unit (SEESAW_KEYPAD_FIFO).
+struct KeyEvent {
+  uint8_t address;
+  uint8_t key;  // KEY_NUM_* of Incipit11Controller.ino
+  uint8_t edge; // SEESAW_KEYPAD_EDGE_*
+};
+
+// Settings of a unit saved in its EEPROM.
+struct Settings {
+  bool ok = false;
+  uint8_t ambientEffect = 0;
+  uint8_t triggeredEffect = 0;
+  uint32_t triggeredLength = 0; // milliseconds
+};
+
+// Summary of a phase of the profiler (Profiler.h), in CPU cycles.
+struct PhaseProfile {
+  uint32_t count = 0;
+  uint32_t min = 0;
+  uint32_t mean = 0;
+  uint32_t max = 0;
+};
+
+// Profile of a unit built with PROFILER. ok is false for a unit that didn't
+// answer or was built without it.
+struct Profile {
+  bool ok = false;
+  uint32_t hz = 0; // F_CPU
+  std::vector<PhaseProfile> phases; // ProfilerPhase order
+};
+
+// Capture of a unit built with CAPTURE (Capture.h). ok is false for a unit
+// that didn't answer or was built without it.
+struct Capture {
+  bool ok = false;
+  uint16_t size = 0;    // CAPTURE_BUFFER_SIZE
+  uint16_t dropped = 0; // records that didn't fit
+  uint8_t flags = 0;    // CAPTURE_*_bm
+  std::vector<uint8_t> records;
+  std::vector<uint8_t> eeprom; // as it is now
+};
+
+class Controller {
+public:
+  explicit Controller(Transport &transport) : _transport(transport) {}
+
+  // Reads and removes the queued key events of the units. Returns the
+  // number of units that answered.
+  size_t readKeyEvents(const std::vector<uint8_t> &units, std::vector<KeyEvent> &events);
+
+  // Reads the saved effects and triggered length of a channel (the
+  // triggered length is the same for every channel).
+  void readSettings(const std::vector<uint8_t> &units, uint8_t channel, std::vector<Settings> &settings);
+
+  // Runs an ambient effect on a channel of each unit. Like an effect picked
+  // with the button it is saved when the unit leaves the ambient state.
+  // Returns the number of units that took it.
+  size_t setEffect(const std::vector<uint8_t> &units, uint8_t channel, uint8_t effect);
+
+  // Sets and saves the ambient effect of a channel of each unit.
+  size_t saveEffect(const std::vector<uint8_t> &units, uint8_t channel, uint8_t effect);
+
+  // Turns the keypad interrupt (SEESAW_KEYPAD_INTENSET) of the units on or
+  // off. With it on a unit holds CONFIG_INTERRUPT_PIN low while it has key
+  // events, and the controller only needs to read them when the line is low.
+  size_t setKeyInterrupt(const std::vector<uint8_t> &units, bool on);
+
+  // Gives each unit answering on the enumeration address (Address.h) an
+  // address of its own: the lowest free one from first up, skipping the
+  // ones in addresses. Appends the addresses given to addresses and returns
+  // how many there were.
+  size_t enumerate(uint8_t first, std::vector<uint8_t> &addresses);
+
+  // Reads the profiles of units built with PROFILER (Profiler.h), and clears
+  // them to measure from then on.
+  void readProfiles(const std::vector<uint8_t> &units, std::vector<Profile> &profiles);
+  size_t resetProfiles(const std::vector<uint8_t> &units);
+
+  // Reads the capture of a unit built with CAPTURE and its EEPROM.
+  void readCapture(uint8_t unit, Capture &capture);
+
+  // Broadcast commands, one write to the general call address for every
+  // unit in groups.
+  bool broadcastEffect(uint8_t groups, uint8_t channel, uint8_t effect);
+  bool broadcastSync(uint8_t groups, uint32_t millis);
+
+  // With batching off every register access is a transfer of its own, as
+  // with the Adafruit seesaw library.
+  void setBatching(bool batching) { _batching = batching; }
+
+  // Totals since the controller was made.
+  uint32_t transfers() const { return _transfers; }
+  uint32_t messages() const { return _messages; }
+  uint32_t retries() const { return _retries; } // transfers sent again unit by unit
+
+private:
+  // A register access of one unit: a write, and the read of the register
+  // when readLength isn't 0.
+  struct Access {
+    uint8_t address;
+    uint8_t write[16];
+    uint8_t writeLength;
+    uint8_t read[32];
+    uint8_t readLength;
+    bool ok;
+  };
+
+  static Access access(uint8_t address, const uint8_t *write, uint8_t writeLength, uint8_t readLength);
+  void run(std::vector<Access> &accesses);
+  bool send(Access *accesses, size_t count);
+  bool write(uint8_t address, const uint8_t *data, uint8_t length);
+
+  Transport &_transport;
+  bool _batching = true;
+  uint32_t _transfers = 0;
+  uint32_t _messages = 0;
+  uint32_t _retries = 0;
+};
+
+} // namespace incipit11
+
+#endif
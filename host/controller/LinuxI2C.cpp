@@ -0,0 +1,59 @@
+#include "LinuxI2C.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/i2c-dev.h>
+#include <linux/i2c.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+namespace incipit11 {
+
+LinuxI2CTransport::~LinuxI2CTransport() {
+  close();
+}
+
+bool LinuxI2CTransport::open(const char *device) {
+  close();
+  _fd = ::open(device, O_RDWR);
+  if (_fd < 0) {
+    return false;
+  }
+  unsigned long functions = 0;
+  if (ioctl(_fd, I2C_FUNCS, &functions) < 0 || !(functions & I2C_FUNC_I2C)) {
+    close();
+    errno = EOPNOTSUPP;
+    return false;
+  }
+  return true;
+}
+
+void LinuxI2CTransport::close() {
+  if (_fd >= 0) {
+    ::close(_fd);
+    _fd = -1;
+  }
+}
+
+bool LinuxI2CTransport::transfer(I2CMessage *messages, size_t count) {
+  if (_fd < 0 || count > maxMessages()) {
+    return false;
+  }
+  struct i2c_msg msgs[I2C_RDWR_IOCTL_MAX_MSGS];
+  for (size_t i = 0; i < count; i++) {
+    msgs[i].addr = messages[i].address;
+    msgs[i].flags = messages[i].read ? I2C_M_RD : 0;
+    msgs[i].len = messages[i].length;
+    msgs[i].buf = messages[i].data;
+  }
+  struct i2c_rdwr_ioctl_data data;
+  data.msgs = msgs;
+  data.nmsgs = count;
+  return ioctl(_fd, I2C_RDWR, &data) == (int)count;
+}
+
+size_t LinuxI2CTransport::maxMessages() const {
+  return I2C_RDWR_IOCTL_MAX_MSGS;
+}
+
+} // namespace incipit11
@@ -0,0 +1,34 @@
+// Transport over a Linux I2C adapter (/dev/i2c-N, the i2c-dev module).
+//
+// Each transfer is one I2C_RDWR ioctl, so the adapter sends the messages
+// back to back with repeated STARTs. The kernel takes up to
+// I2C_RDWR_IOCTL_MAX_MSGS (42) messages per ioctl. Adapters that can't do
+// repeated STARTs (I2C_FUNC_I2C missing, some SMBus-only controllers) are
+// refused by open().
+
+#ifndef INCIPIT11_LINUX_I2C_H
+#define INCIPIT11_LINUX_I2C_H
+
+#include "Transport.h"
+
+namespace incipit11 {
+
+class LinuxI2CTransport : public Transport {
+public:
+  LinuxI2CTransport() {}
+  ~LinuxI2CTransport() override;
+
+  // Opens the adapter, e.g. "/dev/i2c-1". Returns false with errno set.
+  bool open(const char *device);
+  void close();
+
+  bool transfer(I2CMessage *messages, size_t count) override;
+  size_t maxMessages() const override;
+
+private:
+  int _fd = -1;
+};
+
+} // namespace incipit11
+
+#endif
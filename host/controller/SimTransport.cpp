@@ -0,0 +1,82 @@
+#include "SimTransport.h"
+
+#include <string.h>
+
+#include <memory>
+
+#include "Sim.h"
+
+namespace incipit11 {
+
+uint64_t SimTransport::messageNs(const I2CMessage &message) const {
+  // START (or repeated START), address and data bytes with their ACK bits
+  return (1 + (uint64_t)(1 + message.length) * 9) * sim::NS_PER_S / _busHz;
+}
+
+bool SimTransport::transfer(I2CMessage *messages, size_t count) {
+  if (!_started) {
+    _clock = sim::now();
+    _started = true;
+  }
+  uint64_t time = _clock + _overheadNs;
+
+  // Each message is an event at its end, which has the controller send it
+  // unless an earlier one was NACKed.
+  struct State {
+    bool failed = false;
+    size_t done = 0;
+  };
+  auto state = std::make_shared<State>();
+  for (size_t i = 0; i < count; i++) {
+    I2CMessage &message = messages[i];
+    uint8_t address = _aliases.count(message.address) ? _unitAddress : message.address;
+    uint64_t length = messageNs(message);
+    time += length;
+    _busNs += length;
+
+    if (message.read) {
+      uint8_t *data = message.data;
+      uint8_t size = message.length;
+      sim::schedule(time, [state, address, data, size]() {
+        if (state->failed) {
+          state->done++;
+          return false;
+        }
+        sim::scheduleI2CRead(sim::now(), address, size, [state, data, size](int read, const uint8_t *bytes) {
+          state->done++;
+          if (read < 0) {
+            state->failed = true;
+          } else {
+            memcpy(data, bytes, size);
+          }
+        });
+        return false;
+      });
+    } else {
+      const uint8_t *data = message.data;
+      uint8_t size = message.length;
+      sim::schedule(time, [state, address, data, size]() {
+        if (state->failed) {
+          state->done++;
+          return false;
+        }
+        sim::scheduleI2CWrite(sim::now(), address, data, size, [state](bool ack) {
+          state->done++;
+          if (!ack) {
+            state->failed = true;
+          }
+        });
+        return false;
+      });
+    }
+  }
+
+  _clock = time;
+  sim::runUntil(time);
+  while (state->done < count) {
+    sim::runUntil(sim::now() + sim::NS_PER_US);
+  }
+  return !state->failed;
+}
+
+} // namespace incipit11
@@ -0,0 +1,58 @@
+// Transport to the firmware running in the simulator (sim/), for testing
+// controller software without a bus.
+//
+// The messages are sent at the bus speed: START, then 9 clocks for the
+// address and for each byte, with the firmware's Wire callbacks run as the
+// message ends. transfer() runs the firmware (sim::runUntil()) until the
+// transfer is done, after the transfer overhead of the controller (the
+// ioctl and the adapter driver, nothing by default).
+//
+// The simulator only delivers the messages between loop() passes, where
+// the hardware takes them in the TWI interrupt right away. So the
+// controller keeps its own clock (controllerNs()) of the bus and transfer
+// times, which a long loop() pass doesn't hold up.
+//
+// The simulator runs a single unit. addAlias() has it answer on more
+// addresses, each taken to the unit's own, to see what the bus traffic of
+// more units costs.
+
+#ifndef INCIPIT11_SIM_TRANSPORT_H
+#define INCIPIT11_SIM_TRANSPORT_H
+
+#include <set>
+
+#include "Transport.h"
+
+namespace incipit11 {
+
+class SimTransport : public Transport {
+public:
+  SimTransport(uint8_t unitAddress, uint32_t busHz = 400000) : _unitAddress(unitAddress), _busHz(busHz) {}
+
+  // The unit answers on address as well.
+  void addAlias(uint8_t address) { _aliases.insert(address); }
+  void setTransferOverhead(uint64_t ns) { _overheadNs = ns; }
+
+  bool transfer(I2CMessage *messages, size_t count) override;
+  size_t maxMessages() const override { return 42; } // as the Linux I2C_RDWR ioctl
+
+  // Virtual time the bus was busy, ns.
+  uint64_t busNs() const { return _busNs; }
+  // Virtual time of the controller, ns: the end of the last transfer.
+  uint64_t controllerNs() const { return _clock; }
+
+private:
+  uint64_t messageNs(const I2CMessage &message) const;
+
+  uint8_t _unitAddress;
+  uint32_t _busHz;
+  std::set<uint8_t> _aliases;
+  uint64_t _overheadNs = 0;
+  uint64_t _busNs = 0;
+  uint64_t _clock = 0;
+  bool _started = false;
+};
+
+} // namespace incipit11
+
+#endif
@@ -0,0 +1,38 @@
+// I2C transports of the Incipit11 host controller library (Controller.h).
+//
+// A transfer is a list of messages sent as one combined transaction: START,
+// the messages separated by repeated STARTs, then STOP, as the Linux
+// I2C_RDWR ioctl sends them. The messages can be for different units. A
+// message that isn't ACKed ends the transfer and the messages after it are
+// not sent.
+
+#ifndef INCIPIT11_TRANSPORT_H
+#define INCIPIT11_TRANSPORT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace incipit11 {
+
+struct I2CMessage {
+  uint8_t address; // 7 bit, 0 for the general call
+  bool read;
+  uint8_t *data;
+  uint8_t length;
+};
+
+class Transport {
+public:
+  virtual ~Transport() {}
+
+  // Sends count messages (up to maxMessages()). Returns false if one of them
+  // wasn't ACKed or the bus failed.
+  virtual bool transfer(I2CMessage *messages, size_t count) = 0;
+
+  // Messages one transfer takes.
+  virtual size_t maxMessages() const = 0;
+};
+
+} // namespace incipit11
+
+#endif
@@ -0,0 +1,204 @@
+// incipit11_bench: commands per second of the host controller library
+// (Controller.h) against the number of units, batched and one by one.
+//
+// usage: incipit11_bench [--device DEV --address ADDR...] [--units N]
+//                        [--rounds N] [--hz N] [--transfer-us N]
+//
+//   --device DEV      Linux I2C adapter (/dev/i2c-N) with Incipit11 units on
+//                     it; each --address is one. Without it the firmware
+//                     runs in the simulator and answers on every address.
+//   --units N         units to go up to in the simulator (default 64)
+//   --rounds N        of each command per unit count (default 20)
+//   --hz N            simulated bus clock (default 400000)
+//   --transfer-us N   simulated controller time per transfer: the ioctl and
+//                     the adapter driver (default 100)
+//
+// A command is one unit's part of an operation: its key events (count and,
+// when there are any, the events), its settings (6 EEPROM registers) or a
+// new ambient effect (the effect it already runs, so the units don't change
+// and nothing is written to EEPROM). Batched, the commands of all the units
+// share transfers; one by one, every register access is a transfer as with
+// the Adafruit seesaw library (without its delays).
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+#include <functional>
+#include <vector>
+
+#include "Controller.h"
+#include "SimTransport.h"
+#include "Sim.h"
+#ifdef INCIPIT11_I2C_DEV
+#include "LinuxI2C.h"
+#endif
+
+using incipit11::Controller;
+
+namespace {
+
+// CONFIG_I2C_PERIPH_ADDR with the strap pins open
+const uint8_t SIM_UNIT_ADDRESS = 0x49;
+const uint8_t CONFIG_I2C_ENUMERATION_ADDR = 0x61;
+
+void usage() {
+  fprintf(stderr, "usage: incipit11_bench [--device DEV --address ADDR...] [--units N] [--rounds N] [--hz N] "
+                  "[--transfer-us N]\n");
+  exit(2);
+}
+
+long number(const char *word) {
+  char *end;
+  long value = strtol(word, &end, 0);
+  if (*word == '\0' || *end != '\0' || value < 0) {
+    usage();
+  }
+  return value;
+}
+
+// Time of the benchmark: the controller's virtual time in the simulator,
+// the wall clock on a real bus.
+struct Clock {
+  const incipit11::SimTransport *simulated;
+
+  double seconds() const {
+    if (simulated != nullptr) {
+      return (double)simulated->controllerNs() / sim::NS_PER_S;
+    }
+    auto now = std::chrono::steady_clock::now().time_since_epoch();
+    return std::chrono::duration<double>(now).count();
+  }
+};
+
+// Commands per second of rounds of operation on units.
+double rate(Controller &controller, const Clock &clock, int rounds, const std::vector<uint8_t> &units,
+            const std::function<void()> &operation) {
+  double start = clock.seconds();
+  for (int round = 0; round < rounds; round++) {
+    operation();
+  }
+  double seconds = clock.seconds() - start;
+  return (seconds > 0) ? rounds * units.size() / seconds : 0;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  const char *device = nullptr;
+  std::vector<uint8_t> addresses;
+  int maxUnits = 64;
+  int rounds = 20;
+  uint32_t hz = 400000;
+  uint64_t transferUs = 100;
+
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--device") == 0 && i + 1 < argc) {
+      device = argv[++i];
+    } else if (strcmp(argv[i], "--address") == 0 && i + 1 < argc) {
+      addresses.push_back((uint8_t)number(argv[++i]));
+    } else if (strcmp(argv[i], "--units") == 0 && i + 1 < argc) {
+      maxUnits = (int)number(argv[++i]);
+    } else if (strcmp(argv[i], "--rounds") == 0 && i + 1 < argc) {
+      rounds = (int)number(argv[++i]);
+    } else if (strcmp(argv[i], "--hz") == 0 && i + 1 < argc) {
+      hz = (uint32_t)number(argv[++i]);
+    } else if (strcmp(argv[i], "--transfer-us") == 0 && i + 1 < argc) {
+      transferUs = (uint64_t)number(argv[++i]);
+    } else {
+      usage();
+    }
+  }
+  if ((device != nullptr) == addresses.empty() || rounds < 1 || hz == 0) {
+    usage();
+  }
+
+  incipit11::Transport *transport;
+  incipit11::SimTransport simTransport(SIM_UNIT_ADDRESS, hz);
+  Clock clock = {(device == nullptr) ? &simTransport : nullptr};
+  if (device != nullptr) {
+#ifdef INCIPIT11_I2C_DEV
+    static incipit11::LinuxI2CTransport i2c;
+    if (!i2c.open(device)) {
+      perror(device);
+      return 1;
+    }
+    transport = &i2c;
+    printf("Commands per second on %s\n", device);
+#else
+    fprintf(stderr, "built without i2c-dev\n");
+    return 1;
+#endif
+  } else {
+    // the simulated unit first, then the addresses it answers on for the
+    // other units
+    addresses.push_back(SIM_UNIT_ADDRESS);
+    for (int address = 0x08; address <= 0x77 && (int)addresses.size() < maxUnits; address++) {
+      if (address != SIM_UNIT_ADDRESS && address != CONFIG_I2C_ENUMERATION_ADDR) {
+        simTransport.addAlias((uint8_t)address);
+        addresses.push_back((uint8_t)address);
+      }
+    }
+    simTransport.setTransferOverhead(transferUs * sim::NS_PER_US);
+    transport = &simTransport;
+    sim::boot();
+    sim::runUntil(sim::NS_PER_S);
+    printf("Commands per second against the simulator (%u kHz bus, %lu us per transfer)\n", hz / 1000,
+           (unsigned long)transferUs);
+  }
+
+  Controller controller(*transport);
+  printf("                key events          settings            effect\n");
+  printf("units     batched  one by one  batched  one by one  batched  one by one\n");
+  std::vector<size_t> counts;
+  for (size_t count = 1; count < addresses.size(); count *= 2) {
+    counts.push_back(count);
+  }
+  counts.push_back(addresses.size());
+
+  for (size_t count : counts) {
+    std::vector<uint8_t> units(addresses.begin(), addresses.begin() + count);
+    std::vector<incipit11::Settings> settings;
+    controller.readSettings(units, 0, settings);
+
+    printf("%5zu", count);
+    double rates[3][2]; // operation, batched
+    for (int batched = 1; batched >= 0; batched--) {
+      controller.setBatching(batched);
+      rates[0][batched] = rate(controller, clock, rounds, units, [&]() {
+        std::vector<incipit11::KeyEvent> events;
+        controller.readKeyEvents(units, events);
+      });
+      rates[1][batched] = rate(controller, clock, rounds, units, [&]() {
+        std::vector<incipit11::Settings> read;
+        controller.readSettings(units, 0, read);
+      });
+      rates[2][batched] = rate(controller, clock, rounds, units, [&]() {
+        // each unit's own effect: one setEffect() per effect in use
+        std::vector<bool> done(units.size());
+        for (size_t i = 0; i < units.size(); i++) {
+          if (done[i]) {
+            continue;
+          }
+          std::vector<uint8_t> same;
+          for (size_t j = i; j < units.size(); j++) {
+            if (!done[j] && settings[j].ambientEffect == settings[i].ambientEffect) {
+              same.push_back(units[j]);
+              done[j] = true;
+            }
+          }
+          controller.setEffect(same, 0, settings[i].ambientEffect);
+        }
+      });
+    }
+    for (int operation = 0; operation < 3; operation++) {
+      printf("  %9.0f  %9.0f", rates[operation][1], rates[operation][0]);
+    }
+    printf("\n");
+  }
+  printf("%lu transfers, %lu messages, %lu retried unit by unit\n", (unsigned long)controller.transfers(),
+         (unsigned long)controller.messages(), (unsigned long)controller.retries());
+  return 0;
+}
@@ -0,0 +1,317 @@
+// incipit11_profile: the cycle profile of a unit built with PROFILER
+// (Profiler.h) against a file of budgets.
+//
+// usage: incipit11_profile --device DEV --address ADDR [--seconds N]
+//                          [--budgets FILE]
+//        incipit11_profile --log FILE [--budgets FILE]
+//
+//   --device DEV      Linux I2C adapter (/dev/i2c-N) with the unit on it
+//   --address ADDR    the unit
+//   --seconds N       clear the profile, then read it after N seconds;
+//                     without it the profile since boot (or the last clear)
+//                     is read
+//   --log FILE        the last profile the unit dumped to its debug serial
+//                     (PROFILER and DEBUG) instead
+//   --budgets FILE    budgets to check, see profile_budgets.txt
+//
+// The counts come from the part itself: the simulator only has estimates of
+// the cycles. Prints the summary of every phase, the worst-case interrupt
+// latency and loop() time, then the budgets that were exceeded. Exits with 1
+// when one was, or the profile couldn't be read.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Controller.h"
+#ifdef INCIPIT11_I2C_DEV
+#include "LinuxI2C.h"
+#endif
+
+namespace {
+
+// profilerPhaseNames of Profiler.h
+const char *const PHASE_NAMES[] = {
+  "button", "trigger", "gpio", "state", "effect", "seesaw", "status", "show", "loop", "i2c rx", "i2c tx",
+  "isr latency",
+};
+const size_t KNOWN_PHASES = sizeof(PHASE_NAMES) / sizeof(PHASE_NAMES[0]);
+
+struct Phase {
+  std::string name;
+  incipit11::PhaseProfile profile;
+};
+
+// A budget: the max or mean of a phase may not go over cycles.
+struct Budget {
+  std::string phase;
+  bool mean;
+  uint32_t cycles;
+  bool microseconds; // cycles is in us and turned into cycles at F_CPU
+};
+
+void usage() {
+  fprintf(stderr, "usage: incipit11_profile --device DEV --address ADDR [--seconds N] [--budgets FILE]\n"
+                  "       incipit11_profile --log FILE [--budgets FILE]\n");
+  exit(2);
+}
+
+long number(const char *word) {
+  char *end;
+  long value = strtol(word, &end, 0);
+  if (*word == '\0' || *end != '\0' || value < 0) {
+    usage();
+  }
+  return value;
+}
+
+// Splits a line into its words.
+std::vector<std::string> words(const char *line) {
+  std::vector<std::string> result;
+  const char *separators = " \t\r\n";
+  for (const char *p = line + strspn(line, separators); *p != '\0'; p += strspn(p, separators)) {
+    size_t length = strcspn(p, separators);
+    result.emplace_back(p, length);
+    p += length;
+  }
+  return result;
+}
+
+// The words from first up to last, joined with spaces.
+std::string join(const std::vector<std::string> &words, size_t first, size_t last) {
+  std::string result;
+  for (size_t i = first; i < last; i++) {
+    result += (i > first) ? " " + words[i] : words[i];
+  }
+  return result;
+}
+
+bool isNumber(const std::string &word) {
+  return !word.empty() && word.find_first_not_of("0123456789") == std::string::npos;
+}
+
+// Lines of "<phase> max|mean <cycles>" or "<phase> max|mean <n>us"; the
+// phase is the name in the profile and can have spaces. # starts a comment.
+bool readBudgets(const char *path, std::vector<Budget> &budgets) {
+  FILE *file = fopen(path, "r");
+  if (file == nullptr) {
+    perror(path);
+    return false;
+  }
+  char line[256];
+  int lineNumber = 0;
+  bool ok = true;
+  while (fgets(line, sizeof(line), file) != nullptr) {
+    lineNumber++;
+    line[strcspn(line, "#")] = '\0';
+    std::vector<std::string> tokens = words(line);
+    if (tokens.empty()) {
+      continue;
+    }
+    size_t n = tokens.size();
+    std::string value = (n >= 3) ? tokens[n - 1] : "";
+    bool microseconds = value.size() > 2 && value.compare(value.size() - 2, 2, "us") == 0;
+    if (microseconds) {
+      value.resize(value.size() - 2);
+    }
+    if (n < 3 || (tokens[n - 2] != "max" && tokens[n - 2] != "mean") || !isNumber(value)) {
+      fprintf(stderr, "%s:%d: expected <phase> max|mean <cycles>[us]\n", path, lineNumber);
+      ok = false;
+      continue;
+    }
+    budgets.push_back({join(tokens, 0, n - 2), tokens[n - 2] == "mean", (uint32_t)strtoul(value.c_str(), nullptr, 10),
+                       microseconds});
+  }
+  fclose(file);
+  return ok;
+}
+
+// The last profilerDump() in a debug serial log: a "Profile (cycles at <hz>
+// Hz)" line, the column names, then "<phase> count min mean max | bins".
+bool readLog(const char *path, uint32_t &hz, std::vector<Phase> &phases) {
+  FILE *file = fopen(path, "r");
+  if (file == nullptr) {
+    perror(path);
+    return false;
+  }
+  char line[512];
+  bool found = false;
+  bool inDump = false;
+  while (fgets(line, sizeof(line), file) != nullptr) {
+    unsigned long dumpHz;
+    if (sscanf(line, "Profile (cycles at %lu Hz)", &dumpHz) == 1) {
+      hz = (uint32_t)dumpHz;
+      phases.clear();
+      found = inDump = true;
+      continue;
+    }
+    if (!inDump) {
+      continue;
+    }
+    char *bar = strchr(line, '|');
+    std::vector<std::string> tokens;
+    if (bar != nullptr) {
+      *bar = '\0';
+      tokens = words(line);
+    }
+    size_t n = tokens.size();
+    if (n < 5 || !isNumber(tokens[n - 4]) || !isNumber(tokens[n - 3]) || !isNumber(tokens[n - 2]) ||
+        !isNumber(tokens[n - 1])) {
+      inDump = false;
+      continue;
+    }
+    Phase phase;
+    phase.name = join(tokens, 0, n - 4);
+    phase.profile.count = (uint32_t)strtoul(tokens[n - 4].c_str(), nullptr, 10);
+    phase.profile.min = (uint32_t)strtoul(tokens[n - 3].c_str(), nullptr, 10);
+    phase.profile.mean = (uint32_t)strtoul(tokens[n - 2].c_str(), nullptr, 10);
+    phase.profile.max = (uint32_t)strtoul(tokens[n - 1].c_str(), nullptr, 10);
+    phases.push_back(phase);
+  }
+  fclose(file);
+  if (!found || phases.empty()) {
+    fprintf(stderr, "%s: no profile\n", path);
+    return false;
+  }
+  return true;
+}
+
+double microseconds(uint32_t cycles, uint32_t hz) {
+  return (hz > 0) ? cycles * 1e6 / hz : 0;
+}
+
+const Phase *find(const std::vector<Phase> &phases, const std::string &name) {
+  for (const Phase &phase : phases) {
+    if (phase.name == name) {
+      return &phase;
+    }
+  }
+  return nullptr;
+}
+
+void report(uint32_t hz, const std::vector<Phase> &phases) {
+  printf("Cycles at %lu Hz\n", (unsigned long)hz);
+  printf("phase            count       min      mean       max    max us\n");
+  for (const Phase &phase : phases) {
+    const incipit11::PhaseProfile &p = phase.profile;
+    printf("%-12s %9lu %9lu %9lu %9lu %9.1f\n", phase.name.c_str(), (unsigned long)p.count, (unsigned long)p.min,
+           (unsigned long)p.mean, (unsigned long)p.max, microseconds(p.max, hz));
+  }
+  const Phase *latency = find(phases, "isr latency");
+  if (latency != nullptr && latency->profile.count > 0) {
+    printf("worst-case interrupt latency %lu cycles (%.1f us)\n", (unsigned long)latency->profile.max,
+           microseconds(latency->profile.max, hz));
+  }
+  const Phase *loop = find(phases, "loop");
+  if (loop != nullptr && loop->profile.count > 0) {
+    printf("loop() mean %lu, max %lu cycles (%.1f us, %.1f us)\n", (unsigned long)loop->profile.mean,
+           (unsigned long)loop->profile.max, microseconds(loop->profile.mean, hz), microseconds(loop->profile.max, hz));
+  }
+}
+
+// Prints the budgets that were exceeded and returns how many.
+int check(uint32_t hz, const std::vector<Phase> &phases, const std::vector<Budget> &budgets) {
+  int over = 0;
+  for (const Budget &budget : budgets) {
+    const Phase *phase = find(phases, budget.phase);
+    if (phase == nullptr) {
+      printf("no phase \"%s\" in the profile\n", budget.phase.c_str());
+      over++;
+      continue;
+    }
+    uint32_t limit = budget.microseconds ? (uint32_t)((uint64_t)budget.cycles * hz / 1000000) : budget.cycles;
+    uint32_t cycles = budget.mean ? phase->profile.mean : phase->profile.max;
+    if (cycles > limit) {
+      printf("over budget: %s %s %lu cycles, budget %lu\n", budget.phase.c_str(), budget.mean ? "mean" : "max",
+             (unsigned long)cycles, (unsigned long)limit);
+      over++;
+    }
+  }
+  if (!budgets.empty()) {
+    printf("%d of %zu budgets exceeded\n", over, budgets.size());
+  }
+  return over;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  const char *device = nullptr;
+  long address = -1;
+  long seconds = -1;
+  const char *logPath = nullptr;
+  const char *budgetsPath = nullptr;
+
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--device") == 0 && i + 1 < argc) {
+      device = argv[++i];
+    } else if (strcmp(argv[i], "--address") == 0 && i + 1 < argc) {
+      address = number(argv[++i]);
+    } else if (strcmp(argv[i], "--seconds") == 0 && i + 1 < argc) {
+      seconds = number(argv[++i]);
+    } else if (strcmp(argv[i], "--log") == 0 && i + 1 < argc) {
+      logPath = argv[++i];
+    } else if (strcmp(argv[i], "--budgets") == 0 && i + 1 < argc) {
+      budgetsPath = argv[++i];
+    } else {
+      usage();
+    }
+  }
+  if ((device != nullptr) == (logPath != nullptr) || (device != nullptr && (address < 0 || address > 0x7F)) ||
+      (logPath != nullptr && seconds >= 0)) {
+    usage();
+  }
+
+  std::vector<Budget> budgets;
+  if (budgetsPath != nullptr && !readBudgets(budgetsPath, budgets)) {
+    return 1;
+  }
+
+  uint32_t hz = 0;
+  std::vector<Phase> phases;
+  if (logPath != nullptr) {
+    if (!readLog(logPath, hz, phases)) {
+      return 1;
+    }
+  } else {
+#ifdef INCIPIT11_I2C_DEV
+    incipit11::LinuxI2CTransport i2c;
+    if (!i2c.open(device)) {
+      perror(device);
+      return 1;
+    }
+    incipit11::Controller controller(i2c);
+    std::vector<uint8_t> units(1, (uint8_t)address);
+    if (seconds >= 0) {
+      if (controller.resetProfiles(units) == 0) {
+        fprintf(stderr, "0x%02lx didn't answer\n", address);
+        return 1;
+      }
+      std::this_thread::sleep_for(std::chrono::seconds(seconds));
+    }
+    std::vector<incipit11::Profile> profiles;
+    controller.readProfiles(units, profiles);
+    if (!profiles[0].ok) {
+      fprintf(stderr, "no profile from 0x%02lx: not there, or built without PROFILER\n", address);
+      return 1;
+    }
+    hz = profiles[0].hz;
+    for (size_t i = 0; i < profiles[0].phases.size(); i++) {
+      std::string name = (i < KNOWN_PHASES) ? PHASE_NAMES[i] : "phase " + std::to_string(i);
+      phases.push_back({name, profiles[0].phases[i]});
+    }
+#else
+    fprintf(stderr, "built without i2c-dev\n");
+    return 1;
+#endif
+  }
+
+  report(hz, phases);
+  return (check(hz, phases, budgets) > 0) ? 1 : 0;
+}
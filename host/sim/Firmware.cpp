@@ -0,0 +1,98 @@
+// Hooks into the Incipit11 controller firmware globals for the simulator.
+
+#include "Firmware.h"
+
+#include "StateMachine.h"
+
+extern StateMachine stateMachine;
+extern State startupState;
+extern State ambientState;
+extern State triggeredState;
+extern State prepareRecordingState;
+extern State recordTriggerState;
+extern State peripheralState;
+
+extern uint8_t currentEffect[];
+
+uint32_t powerGetMillis(uint8_t mode);
+extern volatile uint32_t powerStandbyCount;
+
+extern bool syncLocked;
+extern uint32_t syncClockMillis;
+extern uint16_t syncClockMicros;
+
+extern uint8_t keyCount;
+
+// only there with CLOCK_SCALING (Clock.h)
+extern bool clockEnabled __attribute__((weak));
+
+namespace firmware {
+
+namespace {
+
+State *const states[STATE_COUNT] = {
+  &startupState,
+  &ambientState,
+  &triggeredState,
+  &prepareRecordingState,
+  &recordTriggerState,
+  &peripheralState,
+};
+
+const char *const names[STATE_COUNT] = {
+  "startup",
+  "ambient",
+  "triggered",
+  "prepareRecording",
+  "recordTrigger",
+  "peripheral",
+};
+
+} // namespace
+
+int state() {
+  for (int i = 0; i < STATE_COUNT; i++) {
+    if (stateMachine.isCurrentState(states[i])) {
+      return i;
+    }
+  }
+  return STATE_STARTUP;
+}
+
+const char *const *stateNames() {
+  return names;
+}
+
+uint8_t effect(uint8_t channel) {
+  return currentEffect[channel];
+}
+
+uint32_t reportedMillis(uint8_t mode) {
+  return powerGetMillis(mode);
+}
+
+uint32_t reportedStandbyCount() {
+  return powerStandbyCount;
+}
+
+bool synced() {
+  return syncLocked;
+}
+
+uint64_t syncClock() {
+  return (uint64_t)syncClockMillis * 1000 + syncClockMicros;
+}
+
+uint8_t keyEvents() {
+  return keyCount;
+}
+
+bool setClockScaling(bool on) {
+  if (&clockEnabled == nullptr) {
+    return false;
+  }
+  clockEnabled = on;
+  return true;
+}
+
+} // namespace firmware
@@ -0,0 +1,44 @@
+// Hooks into the Incipit11 controller firmware globals for the simulator.
+
+#ifndef HOST_FIRMWARE_H
+#define HOST_FIRMWARE_H
+
+#include <stdint.h>
+
+namespace firmware {
+
+// Firmware states, in the order used for the simulator state probe.
+enum {
+  STATE_STARTUP = 0,
+  STATE_AMBIENT,
+  STATE_TRIGGERED,
+  STATE_PREPARE_RECORDING,
+  STATE_RECORD_TRIGGER,
+  STATE_PERIPHERAL,
+  STATE_COUNT
+};
+
+int state();
+const char *const *stateNames();
+uint8_t effect(uint8_t channel = 0);
+
+// Time in each power mode as the firmware counts it (Power.h).
+uint32_t reportedMillis(uint8_t mode);
+uint32_t reportedStandbyCount();
+
+// Shared effect clock (Sync.h): true once a controller set it, and the
+// clock in microseconds at the start of the last loop() pass.
+bool synced();
+uint64_t syncClock();
+
+// Key events queued for the seesaw controller (SEESAW_KEYPAD_COUNT).
+uint8_t keyEvents();
+
+// Turns the CPU clock governor (Clock.h) on or off. Call it after boot(),
+// before the governor lowered the clock. False if the firmware was built
+// without CLOCK_SCALING.
+bool setClockScaling(bool on);
+
+} // namespace firmware
+
+#endif
@@ -0,0 +1,138 @@
+// The incipit11_node module: a unit of the fleet simulator (see Node.h).
+
+#include "Node.h"
+
+#include <Arduino.h>
+#include <EEPROM.h>
+#include <Wire.h>
+
+#include <algorithm>
+#include <deque>
+#include <functional>
+#include <vector>
+
+#include "Firmware.h"
+#include "Sim.h"
+
+#define NODE_PIN_BUTTON    PIN_PA4
+#define NODE_PIN_TRIGGER   PIN_PA6
+#define NODE_PIN_INTERRUPT PIN_PB3 // CONFIG_INTERRUPT_PIN
+
+namespace {
+
+// Queue times of the key events still queued, oldest first, and the events
+// read since the last takeKeyEvents().
+std::deque<uint64_t> keyQueued;
+std::vector<NodeKeyEvent> keyRead;
+
+// Notes the key events queued since the last call.
+void keyNotice(uint64_t time) {
+  while (keyQueued.size() < firmware::keyEvents()) {
+    keyQueued.push_back(time);
+  }
+}
+
+// Runs the unit until done() after a transfer scheduled at time.
+void finish(uint64_t time, const std::function<bool()> &done) {
+  sim::runUntil(time);
+  while (!done()) {
+    sim::runUntil(sim::now() + sim::NS_PER_US);
+  }
+}
+
+void boot(const uint8_t *serial, int32_t skewPpm, int32_t rtcSkewPpm) {
+  for (uint8_t i = 0; i < 10; i++) {
+    (&SIGROW.SERNUM0)[i] = serial[i];
+  }
+  sim::setClockSkew(skewPpm, rtcSkewPpm);
+  // the interrupt line has its pull-up at the controller
+  sim::pullUpPin(NODE_PIN_INTERRUPT);
+  sim::onLoop = [](uint64_t start) { keyNotice(start); };
+  sim::boot();
+}
+
+void press(uint64_t time, uint8_t input, uint64_t length) {
+  uint8_t pin = (input == 0) ? NODE_PIN_BUTTON : NODE_PIN_TRIGGER;
+  sim::schedulePin(time, pin, LOW);
+  sim::schedulePin(time + length, pin, -1);
+}
+
+void addresses(uint64_t *mask) {
+  mask[0] = mask[1] = 0;
+  for (uint8_t address = 0; address < 128; address++) {
+    if (Wire.hostMatches(address)) {
+      mask[address / 64] |= 1ULL << (address % 64);
+    }
+  }
+}
+
+bool write(uint64_t time, uint8_t address, const uint8_t *data, uint8_t length) {
+  int ack = -1;
+  sim::scheduleI2CWrite(time, address, data, length, [&ack](bool acked) { ack = acked; });
+  finish(time, [&ack]() { return ack >= 0; });
+  return ack > 0;
+}
+
+int read(uint64_t time, uint8_t address, uint8_t *data, uint8_t length) {
+  const int PENDING = -2;
+  int result = PENDING;
+  uint8_t queued = 0;
+  // right before the read: the events it can take
+  sim::schedule(time, [&queued]() {
+    keyNotice(sim::now());
+    queued = firmware::keyEvents();
+    return false;
+  });
+  sim::scheduleI2CRead(time, address, length, [&](int count, const uint8_t *bytes) {
+    if (count >= 0) {
+      memcpy(data, bytes, count);
+    }
+    result = count;
+    for (uint8_t left = firmware::keyEvents(); queued > left && !keyQueued.empty(); queued--) {
+      keyRead.push_back({keyQueued.front(), time});
+      keyQueued.pop_front();
+    }
+  });
+  finish(time, [&result]() { return result != PENDING; });
+  return result;
+}
+
+bool interrupt() {
+  return sim::readPin(NODE_PIN_INTERRUPT) == LOW;
+}
+
+size_t takeKeyEvents(NodeKeyEvent *events, size_t max) {
+  size_t count = std::min(max, keyRead.size());
+  std::copy(keyRead.begin(), keyRead.begin() + count, events);
+  keyRead.erase(keyRead.begin(), keyRead.begin() + count);
+  return count;
+}
+
+uint32_t eepromWrites(int address) {
+  return EEPROM.hostWrites(address);
+}
+
+double averageMilliamps() {
+  return sim::averageMilliamps(-1);
+}
+
+const NodeApi api = {
+  &boot,
+  &sim::runUntil,
+  &sim::now,
+  &press,
+  &addresses,
+  &write,
+  &read,
+  &interrupt,
+  &takeKeyEvents,
+  &eepromWrites,
+  &averageMilliamps,
+  &sim::loopCount,
+};
+
+} // namespace
+
+extern "C" const NodeApi *incipit11_node() {
+  return &api;
+}
@@ -0,0 +1,53 @@
+// One unit of the fleet simulator (fleet.cpp).
+//
+// The firmware keeps its state in globals and so does the simulator, so a
+// process can only run one unit. The incipit11_node module is the firmware
+// and the simulator built as a shared object with this interface on top,
+// and the fleet loads a private copy of it for every unit. The copies share
+// nothing, so units can run on different threads at the same time.
+
+#ifndef HOST_NODE_H
+#define HOST_NODE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// A key event the controller read: when it was queued (the start of the
+// loop() pass that queued it) and when it was read, virtual ns.
+struct NodeKeyEvent {
+  uint64_t queued;
+  uint64_t read;
+};
+
+struct NodeApi {
+  // Sets the SIGROW serial number and the clock skew, then boots.
+  void (*boot)(const uint8_t *serial, int32_t skewPpm, int32_t rtcSkewPpm);
+  void (*runUntil)(uint64_t time);
+  uint64_t (*now)();
+
+  // Holds the button (0) or the trigger (1) down from time for length.
+  void (*press)(uint64_t time, uint8_t input, uint64_t length);
+
+  // Bus side. addresses() sets the bit (mask[address / 64] >> address % 64)
+  // of each address the unit's Wire takes. The transfers are delivered at
+  // time, or as soon after as the unit takes them, and return as the
+  // controller would see them: the ACK, or the bytes read (-1 on NACK).
+  void (*addresses)(uint64_t *mask);
+  bool (*write)(uint64_t time, uint8_t address, const uint8_t *data, uint8_t length);
+  int (*read)(uint64_t time, uint8_t address, uint8_t *data, uint8_t length);
+  // CONFIG_INTERRUPT_PIN held low.
+  bool (*interrupt)();
+  // Moves up to max key events read since the last call to events.
+  size_t (*takeKeyEvents)(NodeKeyEvent *events, size_t max);
+
+  // Totals.
+  uint32_t (*eepromWrites)(int address);
+  double (*averageMilliamps)();
+  uint64_t (*loops)();
+};
+
+// The symbol the fleet looks up in each copy.
+#define NODE_API_SYMBOL "incipit11_node"
+extern "C" const NodeApi *incipit11_node();
+
+#endif
@@ -0,0 +1,727 @@
+#include "Sim.h"
+
+#include <Arduino.h>
+#include <EEPROM.h>
+#include <Wire.h>
+#include <avr/sleep.h>
+
+#include <algorithm>
+#include <queue>
+#include <vector>
+
+void setup();
+void loop();
+
+namespace sim {
+
+Costs costs;
+PowerModel powerModel;
+
+std::function<void(uint64_t, uint8_t, uint8_t)> onOutput;
+std::function<void(uint64_t, uint8_t, const uint8_t *, uint16_t)> onShow;
+std::function<void(uint8_t)> onSerial;
+std::function<void(uint64_t, int)> onState;
+std::function<void(uint64_t)> onLoop;
+std::function<void(uint64_t, uint8_t, uint8_t)> onEEPROMWrite;
+
+namespace {
+
+const int MAX_STATES = 16;
+
+struct Event {
+  uint64_t time;
+  uint64_t sequence;
+  std::function<bool()> action;
+};
+
+struct EventLater {
+  bool operator()(const Event &a, const Event &b) const {
+    if (a.time != b.time) {
+      return a.time > b.time;
+    }
+    return a.sequence > b.sequence;
+  }
+};
+
+struct PinInfo {
+  PORT_t *port;
+  uint8_t bit;
+};
+
+// megaTinyCore pin numbers of the 20 pin parts
+const PinInfo pinInfo[NUM_DIGITAL_PINS] = {
+  {&PORTA, 4}, {&PORTA, 5}, {&PORTA, 6}, {&PORTA, 7},
+  {&PORTB, 5}, {&PORTB, 4}, {&PORTB, 3}, {&PORTB, 2}, {&PORTB, 1}, {&PORTB, 0},
+  {&PORTC, 0}, {&PORTC, 1}, {&PORTC, 2}, {&PORTC, 3},
+  {&PORTA, 1}, {&PORTA, 2}, {&PORTA, 3}, {&PORTA, 0},
+};
+
+const PwmChannel pwmChannels[] = {
+  {PIN_PB0, &TCA0.SPLIT.LCMP0, TCA_SPLIT_LCMP0EN_bm},
+  {PIN_PB1, &TCA0.SPLIT.LCMP1, TCA_SPLIT_LCMP1EN_bm},
+  {PIN_PB2, &TCA0.SPLIT.LCMP2, TCA_SPLIT_LCMP2EN_bm},
+  {PIN_PA3, &TCA0.SPLIT.HCMP0, TCA_SPLIT_HCMP0EN_bm},
+  {PIN_PA4, &TCA0.SPLIT.HCMP1, TCA_SPLIT_HCMP1EN_bm},
+  {PIN_PA5, &TCA0.SPLIT.HCMP2, TCA_SPLIT_HCMP2EN_bm},
+};
+
+struct PinState {
+  uint8_t mode = INPUT;
+  uint8_t out = LOW;
+  int drive = -1;
+  bool pullUp = false; // external
+  uint8_t level = 0; // output level 0-255
+  void (*callback)() = nullptr;
+  uint8_t callbackMode = 0;
+};
+
+uint64_t timeNs = 0;
+uint64_t sequence = 0;
+std::priority_queue<Event, std::vector<Event>, EventLater> events;
+
+uint64_t millisNs = 0;
+bool millisRunning = true;
+int32_t skewPpm = 0;
+int32_t rtcSkewPpm = 0;
+int64_t skewRemainder = 0; // ns * ppm not yet added to millisNs
+
+uint64_t runEnd = TIME_NEVER;
+uint64_t loops = 0;
+uint64_t standbys = 0;
+
+PinState pins[NUM_DIGITAL_PINS];
+
+uint64_t serialQueueEnd = 0; // time the serial transmitter is done
+uint64_t eepromBusyUntil = 0;
+
+int (*stateProbe)() = nullptr;
+const char *const *stateNames = nullptr;
+int states = 1;
+int lastState = -1;
+const char *const defaultStateNames[] = {"firmware"};
+
+uint64_t timeByState[MAX_STATES][CPU_MODE_COUNT];
+uint64_t prescaledNs = 0; // awake with the CPU clock below F_CPU
+double chargeByState[MAX_STATES][CPU_MODE_COUNT]; // mA * ns
+
+int currentState() {
+  if (stateProbe == nullptr) {
+    return 0;
+  }
+  int state = stateProbe();
+  return (state >= 0 && state < states) ? state : 0;
+}
+
+double milliamps(uint8_t mode) {
+  double mhz = cpuHz() / 1e6;
+  switch (mode) {
+    case CPU_RUN:
+      return powerModel.runMilliampsPerMHz * mhz;
+    case CPU_IDLE:
+      return powerModel.idleMilliampsPerMHz * mhz;
+    default:
+      return powerModel.standbyMilliamps;
+  }
+}
+
+// Time of a byte at the rate the baud register gives at the current CPU
+// clock (normal speed mode), or costs.serialBaud before Serial.begin().
+uint64_t serialByteNs() {
+  uint32_t baud = (USART0.BAUD != 0) ? (uint32_t)(4ULL * cpuHz() / USART0.BAUD) : costs.serialBaud;
+  return 10 * NS_PER_S / baud;
+}
+
+// megaTinyCore keeps the data register empty interrupt on while bytes wait
+// in the buffer, behind the one being sent.
+void syncSerialStatus() {
+  if (serialQueueEnd > timeNs + serialByteNs()) {
+    USART0.CTRLA |= USART_DREIE_bm;
+  } else {
+    USART0.CTRLA &= ~USART_DREIE_bm;
+  }
+}
+
+// Move virtual time forward. Doesn't deliver events.
+void advance(uint64_t ns, uint8_t mode) {
+  if (ns == 0) {
+    return;
+  }
+  // the outputs written since virtual time last moved
+  syncPwmOutputs();
+  int state = currentState();
+  if (state != lastState) {
+    lastState = state;
+    if (onState) {
+      onState(timeNs, state);
+    }
+  }
+  timeByState[state][mode] += ns;
+  chargeByState[state][mode] += milliamps(mode) * (double)ns;
+  if (mode != CPU_STANDBY && cpuHz() < F_CPU) {
+    prescaledNs += ns;
+  }
+  if (millisRunning) {
+    skewRemainder += (int64_t)ns * skewPpm;
+    int64_t skew = skewRemainder / 1000000;
+    skewRemainder -= skew * 1000000;
+    millisNs += ns + skew;
+  }
+  timeNs += ns;
+  syncSerialStatus();
+}
+
+uint64_t cyclesToNs(uint64_t cycles) {
+  return (cycles * NS_PER_S + cpuHz() - 1) / cpuHz();
+}
+
+// Deliver the events that are due. Returns true if one raised an interrupt.
+bool deliverDue() {
+  bool interrupted = false;
+  while (!events.empty() && events.top().time <= timeNs) {
+    Event event = events.top();
+    events.pop();
+    // the CPU takes interrupts one at a time
+    uint8_t sreg = SREG;
+    SREG &= ~CPU_I_bm;
+    bool raised = event.action();
+    SREG = sreg;
+    if (raised) {
+      interrupted = true;
+      advance(cyclesToNs(costs.isrCycles), CPU_RUN);
+    }
+  }
+  return interrupted;
+}
+
+// RTC counting rate with the current clock and prescaler settings.
+uint32_t rtcHz() {
+  uint32_t source = ((RTC.CLKSEL & 0x03) == RTC_CLKSEL_INT1K_gc) ? 1024 : 32768;
+  return source >> ((RTC.CTRLA & RTC_PRESCALER_gm) >> 3);
+}
+
+// RTC counts at time since reset. The prescaler runs freely, so a sleep
+// starts anywhere between two counts.
+uint64_t rtcTicks(uint64_t time) {
+  return (uint64_t)((unsigned __int128)time * rtcHz() * (1000000 + rtcSkewPpm) /
+                    ((unsigned __int128)NS_PER_S * 1000000));
+}
+
+// Time the RTC reaches ticks counts since reset.
+uint64_t rtcTickTime(uint64_t ticks) {
+  unsigned __int128 rate = (unsigned __int128)rtcHz() * (1000000 + rtcSkewPpm);
+  return (uint64_t)(((unsigned __int128)ticks * NS_PER_S * 1000000 + rate - 1) / rate);
+}
+
+bool rtcRunsInStandby() {
+  return (RTC.CTRLA & RTC_RTCEN_bm) && (RTC.CTRLA & RTC_RUNSTDBY_bm);
+}
+
+// Pin change interrupt according to PINnCTRL.ISC and attachInterrupt().
+bool pinInterrupt(uint8_t pin, int before, int after) {
+  const PinInfo &info = pinInfo[pin];
+  register8_t *pinCtrl = &info.port->PIN0CTRL + info.bit;
+  uint8_t isc = *pinCtrl & PORT_ISC_gm;
+  bool fire = false;
+
+  switch (isc) {
+    case PORT_ISC_BOTHEDGES_gc:
+      fire = before != after;
+      break;
+    case PORT_ISC_RISING_gc:
+      fire = !before && after;
+      break;
+    case PORT_ISC_FALLING_gc:
+      fire = before && !after;
+      break;
+    case PORT_ISC_LEVEL_gc:
+      fire = !after;
+      break;
+  }
+
+  bool interrupted = false;
+  if (fire) {
+    info.port->INTFLAGS |= (1 << info.bit);
+    if (info.port == &PORTA) {
+      PORTA_PORT_vect();
+    } else if (info.port == &PORTB) {
+      PORTB_PORT_vect();
+    } else {
+      PORTC_PORT_vect();
+    }
+    // the ISR clears the flag by writing a one, which plain memory can't do
+    info.port->INTFLAGS &= ~(1 << info.bit);
+    interrupted = true;
+  }
+
+  PinState &state = pins[pin];
+  if (state.callback != nullptr && before != after) {
+    if (state.callbackMode == CHANGE || (state.callbackMode == RISING && after) ||
+        (state.callbackMode == FALLING && !after)) {
+      state.callback();
+      interrupted = true;
+    }
+  }
+  return interrupted;
+}
+
+void updateInputRegister(uint8_t pin) {
+  const PinInfo &info = pinInfo[pin];
+  if (readPin(pin)) {
+    info.port->IN |= (1 << info.bit);
+  } else {
+    info.port->IN &= ~(1 << info.bit);
+  }
+}
+
+} // namespace
+
+const char *cpuModeName(uint8_t mode) {
+  static const char *const names[CPU_MODE_COUNT] = {"run", "idle", "standby"};
+  return (mode < CPU_MODE_COUNT) ? names[mode] : "?";
+}
+
+// ---- time
+
+uint64_t now() {
+  return timeNs;
+}
+
+uint32_t cpuHz() {
+  uint8_t b = CLKCTRL.MCLKCTRLB;
+  if (!(b & CLKCTRL_PEN_bm)) {
+    return F_CPU;
+  }
+  static const uint8_t divisors[16] = {2, 4, 8, 16, 32, 64, 0, 0, 6, 10, 12, 24, 48, 0, 0, 0};
+  uint8_t divisor = divisors[(b & CLKCTRL_PDIV_gm) >> 1];
+  return divisor ? F_CPU / divisor : F_CPU;
+}
+
+uint32_t pwmHz() {
+  static const uint16_t divisors[8] = {1, 2, 4, 8, 16, 64, 256, 1024};
+  uint16_t divisor = divisors[(TCA0.SPLIT.CTRLA & TCA_SPLIT_CLKSEL_gm) >> 1];
+  return cpuHz() / divisor / (TCA0.SPLIT.HPER + 1);
+}
+
+void charge(uint64_t cycles) {
+  advance(cyclesToNs(cycles), CPU_RUN);
+}
+
+void chargeNs(uint64_t ns) {
+  advance(ns, CPU_RUN);
+}
+
+uint32_t millisNow() {
+  return (uint32_t)(millisNs / NS_PER_MS);
+}
+
+uint32_t microsNow() {
+  return (uint32_t)(millisNs / NS_PER_US);
+}
+
+void millisStop() {
+  millisRunning = false;
+}
+
+void millisRestart() {
+  millisRunning = true;
+}
+
+void millisSet(uint32_t ms) {
+  millisNs = (uint64_t)ms * NS_PER_MS + (millisNs % NS_PER_MS);
+}
+
+void millisNudge(uint16_t ms) {
+  millisNs += (uint64_t)ms * NS_PER_MS;
+}
+
+void setClockSkew(int32_t ppm, int32_t rtcPpm) {
+  skewPpm = ppm;
+  rtcSkewPpm = rtcPpm;
+}
+
+// ---- pins
+
+void drivePin(uint8_t pin, int level) {
+  if (pin >= NUM_DIGITAL_PINS) {
+    return;
+  }
+  pins[pin].drive = level;
+  updateInputRegister(pin);
+}
+
+int readPin(uint8_t pin) {
+  if (pin >= NUM_DIGITAL_PINS) {
+    return 0;
+  }
+  const PinState &state = pins[pin];
+  if (state.drive >= 0) {
+    return state.drive;
+  }
+  if (state.mode == OUTPUT) {
+    return state.out;
+  }
+  return (state.mode == INPUT_PULLUP || state.pullUp) ? HIGH : LOW;
+}
+
+void pullUpPin(uint8_t pin) {
+  if (pin >= NUM_DIGITAL_PINS) {
+    return;
+  }
+  pins[pin].pullUp = true;
+  updateInputRegister(pin);
+}
+
+void setPinMode(uint8_t pin, uint8_t mode) {
+  if (pin >= NUM_DIGITAL_PINS) {
+    return;
+  }
+  pins[pin].mode = mode;
+  const PinInfo &info = pinInfo[pin];
+  if (mode == OUTPUT) {
+    info.port->DIR |= (1 << info.bit);
+  } else {
+    info.port->DIR &= ~(1 << info.bit);
+  }
+  updateInputRegister(pin);
+}
+
+void writePin(uint8_t pin, uint8_t level) {
+  if (pin >= NUM_DIGITAL_PINS) {
+    return;
+  }
+  pins[pin].out = level ? HIGH : LOW;
+  writeOutput(pin, level ? 255 : 0, false);
+  updateInputRegister(pin);
+}
+
+void writeOutput(uint8_t pin, uint8_t level, bool pwm) {
+  if (pin >= NUM_DIGITAL_PINS) {
+    return;
+  }
+  if (pins[pin].level != level) {
+    pins[pin].level = level;
+    if (onOutput) {
+      onOutput(timeNs, pin, level);
+    }
+  }
+}
+
+uint8_t outputLevel(uint8_t pin) {
+  return (pin < NUM_DIGITAL_PINS) ? pins[pin].level : 0;
+}
+
+const PwmChannel *pwmChannel(uint8_t pin) {
+  for (const PwmChannel &channel : pwmChannels) {
+    if (channel.pin == pin) {
+      return &channel;
+    }
+  }
+  return nullptr;
+}
+
+void syncPwmOutputs() {
+  for (const PwmChannel &channel : pwmChannels) {
+    if ((TCA0.SPLIT.CTRLB & channel.enable) && pins[channel.pin].level != *channel.compare) {
+      writeOutput(channel.pin, *channel.compare, true);
+      charge(costs.compareWriteCycles);
+    }
+  }
+}
+
+void attachPinInterrupt(uint8_t pin, void (*callback)(), uint8_t mode) {
+  if (pin < NUM_DIGITAL_PINS) {
+    pins[pin].callback = callback;
+    pins[pin].callbackMode = mode;
+  }
+}
+
+// ---- serial
+
+int serialAvailableForWrite() {
+  uint64_t byteNs = serialByteNs();
+  uint64_t queued = (serialQueueEnd > timeNs) ? (serialQueueEnd - timeNs + byteNs - 1) / byteNs : 0;
+  return (queued >= costs.serialTxBuffer) ? 0 : costs.serialTxBuffer - (int)queued;
+}
+
+void serialWrite(uint8_t c) {
+  uint64_t byteNs = serialByteNs();
+  // a full buffer blocks until a byte has been sent
+  while (serialAvailableForWrite() == 0) {
+    advance(byteNs, CPU_RUN);
+  }
+  serialQueueEnd = std::max(serialQueueEnd, timeNs) + byteNs;
+  syncSerialStatus();
+  if (onSerial) {
+    onSerial(c);
+  }
+}
+
+void serialFlush() {
+  if (serialQueueEnd > timeNs) {
+    advance(serialQueueEnd - timeNs, CPU_RUN);
+  }
+}
+
+// ---- EEPROM
+
+void eepromWriteCost() {
+  // the core waits for the previous write to finish before starting one,
+  // taking interrupts meanwhile unless they are off
+  while (eepromBusyUntil > timeNs) {
+    uint64_t until = eepromBusyUntil;
+    if (SREG & CPU_I_bm) {
+      until = std::min(until, std::max(nextEventTime(), timeNs));
+    }
+    advance(until - timeNs, CPU_RUN);
+    if (SREG & CPU_I_bm) {
+      deliverDue();
+    }
+  }
+  eepromBusyUntil = timeNs + costs.eepromWriteNs;
+}
+
+// ---- events
+
+void schedule(uint64_t time, std::function<bool()> action) {
+  events.push(Event{time, sequence++, action});
+}
+
+uint64_t nextEventTime() {
+  return events.empty() ? TIME_NEVER : events.top().time;
+}
+
+void schedulePin(uint64_t time, uint8_t pin, int level) {
+  schedule(time, [pin, level]() {
+    int before = readPin(pin);
+    drivePin(pin, level);
+    return pinInterrupt(pin, before, readPin(pin));
+  });
+}
+
+void scheduleI2CWrite(uint64_t time, uint8_t address, const uint8_t *data, uint8_t length,
+                      std::function<void(bool)> done) {
+  std::vector<uint8_t> bytes(data, data + length);
+  schedule(time, [address, bytes, done]() {
+    bool ack = Wire.hostWrite(address, bytes.data(), (uint8_t)bytes.size());
+    if (ack) {
+      advance(cyclesToNs((uint64_t)costs.i2cByteCycles * bytes.size()), CPU_RUN);
+    }
+    if (done) {
+      done(ack);
+    }
+    return ack;
+  });
+}
+
+void scheduleI2CRead(uint64_t time, uint8_t address, uint8_t length,
+                     std::function<void(int, const uint8_t *)> done) {
+  schedule(time, [address, length, done]() {
+    uint8_t data[BUFFER_LENGTH];
+    int count = Wire.hostRead(address, data, std::min<uint8_t>(length, BUFFER_LENGTH));
+    if (count >= 0) {
+      advance(cyclesToNs((uint64_t)costs.i2cByteCycles * length), CPU_RUN);
+    }
+    if (done) {
+      done(count, data);
+    }
+    return count >= 0;
+  });
+}
+
+// ---- CPU
+
+void sleepCpu() {
+  if (!(SLPCTRL.CTRLA & SLPCTRL_SEN_bm) || !(SREG & CPU_I_bm)) {
+    return;
+  }
+  uint8_t mode = ((SLPCTRL.CTRLA & SLPCTRL_SMODE_gm) == SLPCTRL_SMODE_IDLE_gc) ? CPU_IDLE : CPU_STANDBY;
+
+  uint64_t start = timeNs;
+  // the firmware clears the RTC flags by writing ones, which plain memory
+  // can't do, and the flags are only raised below
+  RTC.INTFLAGS = 0;
+  uint16_t rtcStart = RTC.CNT;
+  uint64_t rtcStartTicks = rtcTicks(start);
+  bool rtcCompare = (mode == CPU_STANDBY) && rtcRunsInStandby() && (RTC.INTCTRL & RTC_CMP_bm);
+  bool rtcOverflow = (mode == CPU_STANDBY) && rtcRunsInStandby() && (RTC.INTCTRL & RTC_OVF_bm);
+  if (mode == CPU_STANDBY) {
+    standbys++;
+  }
+
+  for (;;) {
+    // an interrupt that is already pending wakes up right away
+    if (deliverDue()) {
+      break;
+    }
+
+    uint64_t wake = std::min(nextEventTime(), runEnd);
+    uint64_t tick = TIME_NEVER;
+    uint64_t compare = TIME_NEVER;
+    uint64_t overflow = TIME_NEVER;
+    if (mode == CPU_IDLE && millisRunning) {
+      tick = timeNs + (NS_PER_MS - millisNs % NS_PER_MS) * 1000000 / (1000000 + skewPpm);
+      wake = std::min(wake, tick);
+    }
+    if (rtcCompare) {
+      // the count has to come round to RTC.CMP when it is there already
+      uint32_t ticks = (uint16_t)(RTC.CMP - rtcStart);
+      compare = rtcTickTime(rtcStartTicks + (ticks ? ticks : 0x10000));
+      wake = std::min(wake, compare);
+    }
+    if (rtcOverflow) {
+      // RTC.PER is 0xFFFF
+      overflow = rtcTickTime(rtcStartTicks + (0x10000 - rtcStart));
+      wake = std::min(wake, overflow);
+    }
+    if (wake == TIME_NEVER) {
+      // nothing can wake the CPU up
+      break;
+    }
+    if (wake <= timeNs) {
+      // loop() went past the end of runUntil() before sleeping
+      break;
+    }
+
+    advance(wake - timeNs, mode);
+
+    if (wake == tick) {
+      advance(cyclesToNs(costs.millisIsrCycles), CPU_RUN);
+      break;
+    }
+    if (wake == compare || wake == overflow) {
+      if (wake == compare) {
+        RTC.INTFLAGS |= RTC_CMP_bm;
+      }
+      if (wake == overflow) {
+        RTC.INTFLAGS |= RTC_OVF_bm;
+      }
+      RTC_CNT_vect();
+      RTC.INTFLAGS &= ~(RTC_CMP_bm | RTC_OVF_bm);
+      advance(cyclesToNs(costs.isrCycles), CPU_RUN);
+      break;
+    }
+    if (wake == runEnd && wake < nextEventTime()) {
+      // the caller of runUntil() takes over from here
+      break;
+    }
+  }
+
+  if (RTC.CTRLA & RTC_RTCEN_bm) {
+    RTC.CNT = rtcStart + (uint16_t)(rtcTicks(timeNs) - rtcStartTicks);
+  }
+}
+
+void boot() {
+  SREG = 0;
+  RSTCTRL.RSTFR = RSTCTRL_PORF_bm;
+  GPIOR0 = 0;
+  CLKCTRL.MCLKCTRLB = 0; // megaTinyCore runs at F_CPU
+  TCA0.SPLIT.CTRLA = TCA_SPLIT_CLKSEL_DIV16_gc | TCA_SPLIT_ENABLE_bm;
+  TCA0.SPLIT.LPER = 254;
+  TCA0.SPLIT.HPER = 254;
+  SIGROW.DEVICEID0 = 0x1E;
+  SIGROW.DEVICEID1 = 0x94;
+  SIGROW.DEVICEID2 = 0x21;
+  sei();
+
+  charge(costs.setupCycles);
+  setup();
+  deliverDue();
+}
+
+void runUntil(uint64_t time) {
+  runEnd = time;
+  while (timeNs < time) {
+    uint64_t start = timeNs;
+    loop();
+    if (onLoop) {
+      onLoop(start);
+    }
+    loops++;
+    charge(costs.loopCycles);
+    deliverDue();
+  }
+  runEnd = TIME_NEVER;
+}
+
+uint64_t loopCount() {
+  return loops;
+}
+
+// ---- accounting
+
+void setStateProbe(int (*probe)(), const char *const *names, int count) {
+  stateProbe = probe;
+  stateNames = names;
+  states = std::min(count, MAX_STATES);
+}
+
+int stateCount() {
+  return states;
+}
+
+const char *stateName(int state) {
+  const char *const *names = (stateNames != nullptr) ? stateNames : defaultStateNames;
+  return (state >= 0 && state < states) ? names[state] : "total";
+}
+
+uint64_t modeTime(int state, uint8_t mode) {
+  if (state >= 0) {
+    return timeByState[state][mode];
+  }
+  uint64_t total = 0;
+  for (int i = 0; i < states; i++) {
+    total += timeByState[i][mode];
+  }
+  return total;
+}
+
+uint64_t standbyCount() {
+  return standbys;
+}
+
+uint64_t prescaledTime() {
+  return prescaledNs;
+}
+
+double averageMilliamps(int state) {
+  double charge = 0;
+  uint64_t time = 0;
+  for (int i = 0; i < states; i++) {
+    if (state >= 0 && state != i) {
+      continue;
+    }
+    for (uint8_t mode = 0; mode < CPU_MODE_COUNT; mode++) {
+      charge += chargeByState[i][mode];
+      time += timeByState[i][mode];
+    }
+  }
+  return (time != 0) ? charge / (double)time : 0;
+}
+
+void printPowerReport(FILE *out) {
+  fprintf(out, "%-20s %12s %12s %12s %7s %12s\n", "state", "run ms", "idle ms", "standby ms",
+          "awake", "avg current");
+  for (int state = 0; state < states; state++) {
+    uint64_t total = 0;
+    for (uint8_t mode = 0; mode < CPU_MODE_COUNT; mode++) {
+      total += modeTime(state, mode);
+    }
+    if (total == 0) {
+      continue;
+    }
+    fprintf(out, "%-20s %12.1f %12.1f %12.1f %6.2f%% %9.4f mA\n", stateName(state),
+            modeTime(state, CPU_RUN) / 1e6, modeTime(state, CPU_IDLE) / 1e6,
+            modeTime(state, CPU_STANDBY) / 1e6, 100.0 * modeTime(state, CPU_RUN) / total,
+            averageMilliamps(state));
+  }
+  uint64_t total = 0;
+  for (uint8_t mode = 0; mode < CPU_MODE_COUNT; mode++) {
+    total += modeTime(-1, mode);
+  }
+  fprintf(out, "%-20s %12.1f %12.1f %12.1f %6.2f%% %9.4f mA\n", "total", modeTime(-1, CPU_RUN) / 1e6,
+          modeTime(-1, CPU_IDLE) / 1e6, modeTime(-1, CPU_STANDBY) / 1e6,
+          total ? 100.0 * modeTime(-1, CPU_RUN) / total : 0.0, averageMilliamps(-1));
+}
+
+} // namespace sim
@@ -0,0 +1,173 @@
+// Host simulator for the Incipit11 controller firmware.
+//
+// The firmware (Incipit11Controller.ino and its headers) is compiled for the
+// host against the stand-in Arduino core in host/arduino. This file keeps the
+// virtual time and everything the core needs from "the hardware":
+//
+//   - Virtual time in nanoseconds. It only moves when the CPU is charged for
+//     work (a loop() pass, a PWM write, an EEPROM write, ...) or sleeps.
+//   - The millis() clock, which stops in standby like the TCD0 millis timer.
+//     It can run fast or slow against virtual time (clock skew), like the
+//     internal oscillator against the seesaw controller's clock.
+//   - The RTC, which keeps counting in standby and wakes the CPU up on compare
+//     and overflow.
+//   - Pin levels driven from outside (buttons) and the pin change interrupts.
+//   - The I2C controller, which runs the Wire callbacks at a given time.
+//   - Time spent in each CPU mode, split by firmware state, and the estimated
+//     supply current from it.
+//
+// Inputs are scheduled as events. They are delivered when virtual time
+// passes them: at the end of a loop() pass or while sleeping, which is where
+// the interrupt would have been taken on the hardware.
+
+#ifndef HOST_SIM_H
+#define HOST_SIM_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <functional>
+
+namespace sim {
+
+const uint64_t NS_PER_US = 1000ULL;
+const uint64_t NS_PER_MS = 1000000ULL;
+const uint64_t NS_PER_S = 1000000000ULL;
+const uint64_t TIME_NEVER = ~0ULL;
+
+enum CpuMode : uint8_t {
+  CPU_RUN = 0,
+  CPU_IDLE,
+  CPU_STANDBY,
+  CPU_MODE_COUNT
+};
+
+const char *cpuModeName(uint8_t mode);
+
+// Costs of the work the firmware does, in CPU cycles unless noted.
+struct Costs {
+  uint32_t loopCycles = 1500;         // one loop() pass
+  uint32_t setupCycles = 20000;       // setup()
+  uint32_t isrCycles = 100;           // entering and leaving an ISR
+  uint32_t millisIsrCycles = 80;      // millis timer tick
+  uint32_t analogWriteCycles = 60;
+  uint32_t compareWriteCycles = 20;  // compare register write without analogWrite()
+  uint32_t i2cByteCycles = 40;        // per byte, on top of isrCycles
+  uint64_t eepromWriteNs = 4000000;   // NVM erase + write of one byte
+  uint32_t serialBaud = 115200;       // until Serial.begin() sets the baud register
+  uint8_t serialTxBuffer = 64;
+};
+
+// Estimated supply current of the MCU alone (not the LEDs). Typical values
+// for the tinyAVR 1-series at 5 V from the datasheet. Active and idle scale
+// with the CPU clock.
+struct PowerModel {
+  double runMilliampsPerMHz = 0.43;
+  double idleMilliampsPerMHz = 0.14;
+  double standbyMilliamps = 0.0007;   // RTC on the 32 kHz ULP oscillator
+};
+
+extern Costs costs;
+extern PowerModel powerModel;
+
+// ---- time
+uint64_t now();
+uint32_t cpuHz();            // F_CPU divided by the CLKCTRL prescaler
+uint32_t pwmHz();            // TCA0 split mode PWM frequency at cpuHz()
+void charge(uint64_t cycles); // CPU busy for cycles
+void chargeNs(uint64_t ns);   // CPU busy for ns
+
+// millis() clock (megaTinyCore's TCD0 millis timer)
+uint32_t millisNow();
+uint32_t microsNow();
+void millisStop();
+void millisRestart();
+void millisSet(uint32_t ms);
+void millisNudge(uint16_t ms);
+// The main clock (millis(), micros()) and the RTC run ppm parts per million
+// fast against virtual time, slow when negative.
+void setClockSkew(int32_t ppm, int32_t rtcPpm);
+
+// ---- pins
+// Drive a pin from outside: 0 or 1, or -1 to release it.
+void drivePin(uint8_t pin, int level);
+int readPin(uint8_t pin);
+// External pull-up resistor: the pin reads high when nothing drives it.
+void pullUpPin(uint8_t pin);
+void setPinMode(uint8_t pin, uint8_t mode);
+void writePin(uint8_t pin, uint8_t level);
+// PWM level 0-255 of an output pin (0/255 when written digitally).
+void writeOutput(uint8_t pin, uint8_t level, bool pwm);
+uint8_t outputLevel(uint8_t pin);
+void attachPinInterrupt(uint8_t pin, void (*callback)(), uint8_t mode);
+
+// TCA0 split mode compare channel of a pin, like the megaTinyCore
+// analogWrite() on the 20 pin parts. nullptr if the pin has none.
+struct PwmChannel {
+  uint8_t pin;
+  volatile uint8_t *compare;
+  uint8_t enable;
+};
+const PwmChannel *pwmChannel(uint8_t pin);
+// Picks up compare register writes made without analogWrite() (the firmware's
+// OutputStage). Called whenever virtual time moves.
+void syncPwmOutputs();
+
+// Called for every output change: time, pin, level 0-255.
+extern std::function<void(uint64_t, uint8_t, uint8_t)> onOutput;
+// Called for every NeoPixel show(): time, pin, pixel bytes, length.
+extern std::function<void(uint64_t, uint8_t, const uint8_t *, uint16_t)> onShow;
+// Called for every byte written to the serial port.
+extern std::function<void(uint8_t)> onSerial;
+// Called when the state probe returns a new state: time, state.
+extern std::function<void(uint64_t, int)> onState;
+// Called after every loop() pass with the time it started.
+extern std::function<void(uint64_t)> onLoop;
+// Called for every EEPROM byte written, as the write starts: time, address,
+// value.
+extern std::function<void(uint64_t, uint8_t, uint8_t)> onEEPROMWrite;
+
+// ---- serial transmit model
+int serialAvailableForWrite();
+void serialWrite(uint8_t c);
+void serialFlush();
+
+// ---- EEPROM
+void eepromWriteCost();
+
+// ---- events
+// action returns true if it raised an interrupt, which wakes up the CPU.
+void schedule(uint64_t time, std::function<bool()> action);
+uint64_t nextEventTime();
+
+// Inputs as events.
+void schedulePin(uint64_t time, uint8_t pin, int level);
+// Controller write. done gets the ACK.
+void scheduleI2CWrite(uint64_t time, uint8_t address, const uint8_t *data, uint8_t length,
+                      std::function<void(bool)> done = nullptr);
+// Controller read of length bytes. done gets the bytes read (-1 on NACK).
+void scheduleI2CRead(uint64_t time, uint8_t address, uint8_t length,
+                     std::function<void(int, const uint8_t *)> done);
+
+// ---- CPU
+void sleepCpu();
+void boot();                     // reset the peripherals and run setup()
+void runUntil(uint64_t time);    // run loop() until virtual time reaches time
+uint64_t loopCount();
+
+// ---- accounting
+// The firmware state is sampled with this probe so the time in each mode can
+// be split by state. It returns an index below stateCount.
+void setStateProbe(int (*probe)(), const char *const *names, int count);
+int stateCount();
+const char *stateName(int state);
+uint64_t modeTime(int state, uint8_t mode); // ns; state -1 for the total
+uint64_t standbyCount();
+uint64_t prescaledTime();                   // ns awake with cpuHz() below F_CPU
+double averageMilliamps(int state);         // state -1 for the total
+
+// Print the current per state table.
+void printPowerReport(FILE *out);
+
+} // namespace sim
+
+#endif
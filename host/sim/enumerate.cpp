@@ -0,0 +1,267 @@
+// incipit11_enumerate: run the address enumeration (Address.h) over a bus
+// of many Incipit11 units and count the bus transactions it takes.
+//
+// usage: incipit11_enumerate [-v] [--units N] [--seed N] [--same-serial N]
+//                            [--assigned N]
+//
+//   --units N        units on the bus (default 96)
+//   --seed N         seed of the serial numbers and tie-break bytes
+//   --same-serial N  give N pairs of units the same serial number, to see
+//                    the tie-break byte at work
+//   --assigned N     the first N units already have an address and are left
+//                    alone, as after adding units to an enumerated bus
+//
+// The units are modelled at the bus level only: the firmware side is a few
+// lines of Address.h and the single unit simulator (incipit11_sim, see
+// scenarios/address_assign.txt) runs the real thing. A read from the
+// enumeration address is wired-AND: every enumerating unit sends its id and
+// a unit drops out (TWI SSTATUS.COLL) at the first bit it sends as 1 while
+// another sends 0, so the controller reads the lowest id. Units from one
+// production lot share the first bytes of their serial number, as
+// SIGROW.SERNUM starts with the lot number.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <random>
+#include <vector>
+
+namespace {
+
+// DOA_seesawCompatibility.h
+const uint8_t ENUMERATION_ADDR = 0x61;
+const uint8_t ADDRESS_BASE = 0x85;
+const uint8_t ADDRESS_ID = 0x01;
+const uint8_t ADDRESS_ASSIGN = 0x02;
+// Address.h
+const int SERIAL_SIZE = 10;
+const int ID_SIZE = SERIAL_SIZE + 1;
+const uint8_t ADDRESS_FIRST = 0x08;
+const uint8_t ADDRESS_LAST = 0x77;
+const int LOT_BYTES = 6; // serial number bytes the units of a lot share
+
+bool verbose = false;
+
+struct Unit {
+  uint8_t serial[SERIAL_SIZE];
+  uint8_t tieBreak;
+  bool enumerating;
+  uint8_t address;
+};
+
+// Bus totals
+struct Bus {
+  uint32_t transactions = 0;
+  uint32_t nacks = 0;
+  uint32_t bytes = 0; // including the address bytes
+
+  void transaction(int length, bool ack) {
+    transactions++;
+    bytes += 1 + (ack ? length : 0);
+    if (!ack) {
+      nacks++;
+    }
+  }
+
+  // START, 9 clocks per byte, STOP
+  double seconds(uint32_t hz) const {
+    return (double)(bytes * 9 + transactions * 2) / hz;
+  }
+};
+
+void usage() {
+  fprintf(stderr, "usage: incipit11_enumerate [-v] [--units N] [--seed N] [--same-serial N] [--assigned N]\n");
+  exit(2);
+}
+
+long number(const char *word) {
+  char *end;
+  long value = strtol(word, &end, 0);
+  if (*word == '\0' || *end != '\0' || value < 0) {
+    usage();
+  }
+  return value;
+}
+
+bool enumerating(const std::vector<Unit> &units) {
+  for (const Unit &unit : units) {
+    if (unit.enumerating) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Read of the id from the enumeration address. Every enumerating unit draws
+// a tie-break byte and sends; the bus carries the AND of the units still
+// sending.
+void readId(std::vector<Unit> &units, std::mt19937 &random, uint8_t *id) {
+  std::vector<bool> sending(units.size());
+  for (size_t i = 0; i < units.size(); i++) {
+    sending[i] = units[i].enumerating;
+    if (sending[i]) {
+      units[i].tieBreak = (uint8_t)random();
+    }
+  }
+  for (int byte = 0; byte < ID_SIZE; byte++) {
+    id[byte] = 0;
+    for (int bit = 7; bit >= 0; bit--) {
+      bool level = true;
+      for (size_t i = 0; i < units.size(); i++) {
+        if (sending[i]) {
+          uint8_t value = (byte < SERIAL_SIZE) ? units[i].serial[byte] : units[i].tieBreak;
+          level = level && ((value >> bit) & 1);
+        }
+      }
+      for (size_t i = 0; i < units.size(); i++) {
+        if (sending[i]) {
+          uint8_t value = (byte < SERIAL_SIZE) ? units[i].serial[byte] : units[i].tieBreak;
+          if (((value >> bit) & 1) && !level) {
+            sending[i] = false; // SSTATUS.COLL
+          }
+        }
+      }
+      id[byte] |= level << bit;
+    }
+  }
+}
+
+// DOA_SEESAW_ADDRESS_ASSIGN on the enumeration address. Returns the units
+// that took the address.
+int assign(std::vector<Unit> &units, const uint8_t *id, uint8_t address) {
+  int taken = 0;
+  for (Unit &unit : units) {
+    if (unit.enumerating && memcmp(unit.serial, id, SERIAL_SIZE) == 0 && unit.tieBreak == id[SERIAL_SIZE]) {
+      unit.enumerating = false;
+      unit.address = address;
+      taken++;
+    }
+  }
+  return taken;
+}
+
+void printId(const uint8_t *id) {
+  for (int i = 0; i < ID_SIZE; i++) {
+    printf("%s%02X", (i == SERIAL_SIZE) ? " / " : "", id[i]);
+  }
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  int unitCount = 96;
+  uint32_t seed = 1;
+  int sameSerial = 0;
+  int assigned = 0;
+
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "-v") == 0) {
+      verbose = true;
+    } else if (strcmp(argv[i], "--units") == 0 && i + 1 < argc) {
+      unitCount = (int)number(argv[++i]);
+    } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+      seed = (uint32_t)number(argv[++i]);
+    } else if (strcmp(argv[i], "--same-serial") == 0 && i + 1 < argc) {
+      sameSerial = (int)number(argv[++i]);
+    } else if (strcmp(argv[i], "--assigned") == 0 && i + 1 < argc) {
+      assigned = (int)number(argv[++i]);
+    } else {
+      usage();
+    }
+  }
+
+  // the addresses the controller gives out: not the enumeration address
+  std::vector<uint8_t> free;
+  for (int address = ADDRESS_FIRST; address <= ADDRESS_LAST; address++) {
+    if (address != ENUMERATION_ADDR) {
+      free.push_back((uint8_t)address);
+    }
+  }
+  if (unitCount < 1 || (size_t)unitCount > free.size() || assigned > unitCount ||
+      2 * sameSerial > unitCount) {
+    fprintf(stderr, "--units has to be 1 to %zu, with at most that many --assigned and half of them --same-serial\n",
+            free.size());
+    return 2;
+  }
+
+  std::mt19937 random(seed);
+  uint8_t lot[LOT_BYTES];
+  for (int i = 0; i < LOT_BYTES; i++) {
+    lot[i] = (uint8_t)random();
+  }
+  std::vector<Unit> units(unitCount);
+  for (int i = 0; i < unitCount; i++) {
+    Unit &unit = units[i];
+    memcpy(unit.serial, lot, LOT_BYTES);
+    for (int j = LOT_BYTES; j < SERIAL_SIZE; j++) {
+      unit.serial[j] = (uint8_t)random();
+    }
+    if (i < 2 * sameSerial && (i & 1)) {
+      memcpy(unit.serial, units[i - 1].serial, SERIAL_SIZE);
+    }
+    unit.enumerating = (i >= assigned);
+    unit.address = 0;
+    if (!unit.enumerating) {
+      unit.address = free.front();
+      free.erase(free.begin());
+    }
+  }
+
+  // The controller: select the ID register on the enumeration address (NACKed
+  // when no unit is left), read the lowest id, give it the next address.
+  Bus bus;
+  int rounds = 0;
+  int collisions = 0;
+  size_t next = 0;
+  for (;;) {
+    bool ack = enumerating(units);
+    bus.transaction(2, ack);
+    if (!ack) {
+      break;
+    }
+    uint8_t id[ID_SIZE];
+    readId(units, random, id);
+    bus.transaction(ID_SIZE, true);
+
+    uint8_t address = free[next++];
+    bus.transaction(2 + ID_SIZE + 1, true);
+    int taken = assign(units, id, address);
+    rounds++;
+    if (taken > 1) {
+      collisions++;
+    }
+    if (verbose) {
+      printf("0x%02X  ", address);
+      printId(id);
+      printf("%s\n", (taken > 1) ? "  taken by more than one unit" : "");
+    }
+  }
+
+  int enumerated = unitCount - assigned;
+  printf("Enumeration of %d units (%d already assigned), seed %u\n", enumerated, assigned, seed);
+  printf("  rounds               %8d\n", rounds);
+  printf("  transactions         %8u   (%u NACKed)\n", bus.transactions, bus.nacks);
+  printf("  per unit             %8.2f\n", enumerated ? (double)bus.transactions / enumerated : 0.0);
+  printf("  bytes on the bus     %8u\n", bus.bytes);
+  printf("  bus time at 100 kHz  %8.1f ms\n", bus.seconds(100000) * 1000);
+  printf("  bus time at 400 kHz  %8.1f ms\n", bus.seconds(400000) * 1000);
+  if (sameSerial > 0) {
+    printf("  same serial number   %8d pairs\n", sameSerial);
+  }
+  printf("  address collisions   %8d\n", collisions);
+
+  // every unit has an address of its own
+  std::vector<int> holders(128);
+  for (const Unit &unit : units) {
+    holders[unit.address]++;
+  }
+  int shared = 0;
+  for (int address = 0; address < 128; address++) {
+    if (holders[address] > 1) {
+      shared++;
+    }
+  }
+  return (shared == 0 && rounds == enumerated) ? 0 : 1;
+}
@@ -0,0 +1,770 @@
+// incipit11_fleet: a fleet of Incipit11 units on a number of buses, each bus
+// with a controller (controller/Controller.h) running a scripted scenario.
+//
+// usage: incipit11_fleet [-v] [--threads N] [--seed N] [--buses N] [--units N]
+//                        [--node FILE] SCENARIO
+//
+//   -v           a line per bus
+//   --threads N  worker threads (default: one per CPU)
+//   --seed, --buses, --units
+//                override the scenario
+//   --node FILE  the incipit11_node module
+//
+// Every unit is a copy of the firmware and the simulator (Node.h) with its
+// own virtual clock, EEPROM and Wire, a serial number, clock skew and button
+// presses drawn from the seed. The units only meet on their bus, so they
+// run on the worker threads up to the next controller action, then the
+// buses carry out their actions in parallel. The results only depend on the
+// scenario and the seed, not on the number of threads.
+//
+// A bus delivers each message to the units whose Wire takes the address. A read that more than one unit answers (the enumeration
+// address) is wired-AND, so the controller gets the lowest bytes (see
+// enumerate.cpp). The controllers keep their own clocks of the bus and
+// transfer times, as with SimTransport.
+//
+// Scenario commands, one per line, # starts a comment, times in ms:
+//   buses <n>                    buses, each with a controller (default 1)
+//   units <n>                    units on each bus (default 32, at most 111)
+//   seed <n>                     (default 1)
+//   skew <ppm>                   each unit's main clock and RTC are off by up
+//                                to ppm, either way (default 10000)
+//   hz <n>                       bus clock (default 400000)
+//   transfer-us <n>              controller time per transfer (default 100)
+//   presses <button> <trigger>   presses per unit and minute, at random times
+//   poll <ms> [int]              read the key events of the units every ms;
+//                                with int, turn the keypad interrupt on and
+//                                only read while the bus's line is low
+//   sync <ms>                    broadcast the controller's clock every ms
+//   at <ms> enumerate            give the units addresses of their own
+//   at <ms> effect <n>           broadcast ambient effect n
+//   at <ms> save <n>             set and save ambient effect n on every unit
+//   wear <ms>                    estimate the EEPROM endurance from the writes
+//                                from ms on, leaving out the ones of setting
+//                                the units up (default 0)
+//   end <ms>
+// The controllers only know the units they enumerated, so a scenario
+// enumerates before the units are polled or saved to.
+
+#include <dlfcn.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Controller.h"
+#include "Node.h"
+#include "Transport.h"
+
+namespace {
+
+const uint64_t NS_PER_US = 1000ULL;
+const uint64_t NS_PER_MS = 1000000ULL;
+const uint64_t NS_PER_S = 1000000000ULL;
+const uint64_t TIME_NEVER = ~0ULL;
+
+// DOA_seesawCompatibility.h
+const uint8_t CONFIG_I2C_ENUMERATION_ADDR = 0x61;
+const uint8_t DOA_SEESAW_ADDRESS_BASE = 0x85;
+const uint8_t SEESAW_STATUS_BASE = 0x00;
+// Address.h
+const int SERIAL_SIZE = 10;
+const int LOT_BYTES = 6; // serial number bytes the units of a lot share
+const uint8_t ADDRESS_FIRST = 0x08;
+const int ADDRESSES = 111; // 0x08 to 0x77 but the enumeration address
+// tinyAVR 1-series data sheet: EEPROM write endurance
+const uint32_t EEPROM_ENDURANCE = 100000;
+
+bool verbose = false;
+
+struct Scenario {
+  int buses = 1;
+  int units = 32;
+  uint32_t seed = 1;
+  int32_t skewPpm = 10000;
+  uint32_t hz = 400000;
+  uint64_t transferNs = 100 * NS_PER_US;
+  double buttonPerMinute = 0;
+  double triggerPerMinute = 0;
+  uint64_t pollPeriod = 0;
+  bool pollInterrupt = false;
+  uint64_t syncPeriod = 0;
+  uint64_t wearFrom = 0;
+  uint64_t end = 0;
+
+  enum Kind { ENUMERATE, EFFECT, SAVE };
+  struct Action {
+    uint64_t time;
+    Kind kind;
+    uint8_t value;
+  };
+  std::vector<Action> actions;
+};
+
+struct Unit {
+  const NodeApi *api;
+  uint32_t wornBefore[256]; // EEPROM writes before Scenario::wearFrom
+};
+
+// Runs work(0) to work(count - 1) on the worker threads and the calling
+// thread, and returns when they are all done.
+class Pool {
+public:
+  explicit Pool(int threads) {
+    for (int i = 1; i < threads; i++) {
+      _threads.emplace_back([this]() { worker(); });
+    }
+  }
+
+  ~Pool() {
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      _stop = true;
+    }
+    _start.notify_all();
+    for (std::thread &thread : _threads) {
+      thread.join();
+    }
+  }
+
+  void run(size_t count, const std::function<void(size_t)> &work) {
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      _work = &work;
+      _count = count;
+      _next = 0;
+      _busy = _threads.size();
+      _generation++;
+    }
+    _start.notify_all();
+    take();
+    std::unique_lock<std::mutex> lock(_mutex);
+    _done.wait(lock, [this]() { return _busy == 0; });
+  }
+
+private:
+  void take() {
+    for (size_t i = _next++; i < _count; i = _next++) {
+      (*_work)(i);
+    }
+  }
+
+  void worker() {
+    uint64_t generation = 0;
+    for (;;) {
+      {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _start.wait(lock, [&]() { return _stop || _generation != generation; });
+        if (_stop) {
+          return;
+        }
+        generation = _generation;
+      }
+      take();
+      std::lock_guard<std::mutex> lock(_mutex);
+      if (--_busy == 0) {
+        _done.notify_one();
+      }
+    }
+  }
+
+  std::vector<std::thread> _threads;
+  std::mutex _mutex;
+  std::condition_variable _start;
+  std::condition_variable _done;
+  const std::function<void(size_t)> *_work = nullptr;
+  size_t _count = 0;
+  std::atomic<size_t> _next{0};
+  size_t _busy = 0;
+  uint64_t _generation = 0;
+  bool _stop = false;
+};
+
+// A bus and its units, as the transport of the bus's controller.
+class BusTransport : public incipit11::Transport {
+public:
+  BusTransport(std::vector<Unit> units, uint32_t hz, uint64_t transferNs)
+      : _units(std::move(units)), _hz(hz), _transferNs(transferNs) {}
+
+  bool transfer(incipit11::I2CMessage *messages, size_t count) override {
+    uint64_t time = _clock + _transferNs;
+    bool ok = true;
+    for (size_t i = 0; i < count && ok; i++) {
+      incipit11::I2CMessage &message = messages[i];
+      // START (or repeated START), address and data bytes with their ACK bits
+      uint64_t length = (1 + (uint64_t)(1 + message.length) * 9) * NS_PER_S / _hz;
+      time += length;
+      _busNs += length;
+      ok = message.read ? read(time, message) : write(time, message);
+    }
+    _clock = time;
+    return ok;
+  }
+  size_t maxMessages() const override { return 42; } // as the Linux I2C_RDWR ioctl
+
+  // The controller starts its next action at time, or when it is done with
+  // the last one.
+  void start(uint64_t time) {
+    _clock = std::max(_clock, time);
+    _indexed = false;
+  }
+
+  const std::vector<Unit> &units() const { return _units; }
+  bool interrupt() const {
+    for (const Unit &unit : _units) {
+      if (unit.api->interrupt()) {
+        return true;
+      }
+    }
+    return false;
+  }
+  uint64_t busNs() const { return _busNs; }
+
+private:
+  // The units by the addresses they take. Asking each unit for every message
+  // would touch every copy of the module, so they are asked at the start of
+  // an action and after the writes that can move a unit: to the general call
+  // and enumeration addresses, and to DOA_SEESAW_ADDRESS_BASE and
+  // SEESAW_STATUS_BASE (a software reset).
+  const std::vector<size_t> &takers(uint8_t address) {
+    if (!_indexed) {
+      for (std::vector<size_t> &takers : _takers) {
+        takers.clear();
+      }
+      for (size_t i = 0; i < _units.size(); i++) {
+        uint64_t mask[2];
+        _units[i].api->addresses(mask);
+        for (uint8_t taken = 0; taken < 128; taken++) {
+          if ((mask[taken / 64] >> (taken % 64)) & 1) {
+            _takers[taken].push_back(i);
+          }
+        }
+      }
+      _indexed = true;
+    }
+    return _takers[address & 0x7F];
+  }
+
+  bool write(uint64_t time, const incipit11::I2CMessage &message) {
+    bool ack = false;
+    for (size_t i : takers(message.address)) {
+      ack = _units[i].api->write(time, message.address, message.data, message.length) || ack;
+    }
+    if (ack && (message.address == 0 || message.address == CONFIG_I2C_ENUMERATION_ADDR ||
+                (message.length > 0 && (message.data[0] == DOA_SEESAW_ADDRESS_BASE ||
+                                        message.data[0] == SEESAW_STATUS_BASE)))) {
+      _indexed = false;
+    }
+    return ack;
+  }
+
+  bool read(uint64_t time, incipit11::I2CMessage &message) {
+    bool ack = false;
+    uint8_t data[256];
+    for (size_t i : takers(message.address)) {
+      if (_units[i].api->read(time, message.address, data, message.length) < 0) {
+        continue;
+      }
+      // wired-AND: the lowest bytes win the arbitration
+      if (!ack || memcmp(data, message.data, message.length) < 0) {
+        memcpy(message.data, data, message.length);
+      }
+      ack = true;
+    }
+    return ack;
+  }
+
+  std::vector<Unit> _units;
+  uint32_t _hz;
+  uint64_t _transferNs;
+  uint64_t _clock = 0;
+  uint64_t _busNs = 0;
+  std::vector<size_t> _takers[128];
+  bool _indexed = false;
+};
+
+struct Bus {
+  std::unique_ptr<BusTransport> transport;
+  std::unique_ptr<incipit11::Controller> controller;
+  std::vector<uint8_t> addresses; // enumerated units
+  std::vector<uint64_t> latencies;
+  size_t keyInterrupts = 0; // units with the key interrupt on
+  uint32_t keyEvents = 0;
+};
+
+void usage() {
+  fprintf(stderr, "usage: incipit11_fleet [-v] [--threads N] [--seed N] [--buses N] [--units N] [--node FILE] "
+                  "SCENARIO\n");
+  exit(2);
+}
+
+void fail(const char *path, int line, const char *message) {
+  fprintf(stderr, "%s:%d: %s\n", path, line, message);
+  exit(1);
+}
+
+long number(const char *word) {
+  char *end;
+  long value = strtol(word, &end, 0);
+  if (*word == '\0' || *end != '\0' || value < 0) {
+    usage();
+  }
+  return value;
+}
+
+long number(const std::string &word, const char *path, int line) {
+  char *end;
+  long value = strtol(word.c_str(), &end, 0);
+  if (word.empty() || *end != '\0' || value < 0) {
+    fail(path, line, "expected a number");
+  }
+  return value;
+}
+
+void loadScenario(const char *path, Scenario &scenario) {
+  FILE *file = fopen(path, "r");
+  if (file == nullptr) {
+    perror(path);
+    exit(1);
+  }
+
+  char text[512];
+  int line = 0;
+  while (fgets(text, sizeof(text), file) != nullptr) {
+    line++;
+    char *comment = strchr(text, '#');
+    if (comment != nullptr) {
+      *comment = '\0';
+    }
+
+    std::istringstream in(text);
+    std::vector<std::string> words;
+    std::string word;
+    while (in >> word) {
+      words.push_back(word);
+    }
+    if (words.empty()) {
+      continue;
+    }
+
+    const std::string &command = words[0];
+    if (command == "buses" && words.size() == 2) {
+      scenario.buses = (int)number(words[1], path, line);
+    } else if (command == "units" && words.size() == 2) {
+      scenario.units = (int)number(words[1], path, line);
+    } else if (command == "seed" && words.size() == 2) {
+      scenario.seed = (uint32_t)number(words[1], path, line);
+    } else if (command == "skew" && words.size() == 2) {
+      scenario.skewPpm = (int32_t)number(words[1], path, line);
+    } else if (command == "hz" && words.size() == 2) {
+      scenario.hz = (uint32_t)number(words[1], path, line);
+    } else if (command == "transfer-us" && words.size() == 2) {
+      scenario.transferNs = (uint64_t)number(words[1], path, line) * NS_PER_US;
+    } else if (command == "presses" && words.size() == 3) {
+      scenario.buttonPerMinute = strtod(words[1].c_str(), nullptr);
+      scenario.triggerPerMinute = strtod(words[2].c_str(), nullptr);
+    } else if (command == "poll" && (words.size() == 2 || (words.size() == 3 && words[2] == "int"))) {
+      scenario.pollPeriod = (uint64_t)number(words[1], path, line) * NS_PER_MS;
+      scenario.pollInterrupt = (words.size() == 3);
+    } else if (command == "sync" && words.size() == 2) {
+      scenario.syncPeriod = (uint64_t)number(words[1], path, line) * NS_PER_MS;
+    } else if (command == "wear" && words.size() == 2) {
+      scenario.wearFrom = (uint64_t)number(words[1], path, line) * NS_PER_MS;
+    } else if (command == "end" && words.size() == 2) {
+      scenario.end = (uint64_t)number(words[1], path, line) * NS_PER_MS;
+    } else if (command == "at" && words.size() >= 3) {
+      Scenario::Action action = {(uint64_t)number(words[1], path, line) * NS_PER_MS, Scenario::ENUMERATE, 0};
+      if (words[2] == "enumerate" && words.size() == 3) {
+        action.kind = Scenario::ENUMERATE;
+      } else if (words[2] == "effect" && words.size() == 4) {
+        action.kind = Scenario::EFFECT;
+        action.value = (uint8_t)number(words[3], path, line);
+      } else if (words[2] == "save" && words.size() == 4) {
+        action.kind = Scenario::SAVE;
+        action.value = (uint8_t)number(words[3], path, line);
+      } else {
+        fail(path, line, "at <ms> enumerate | effect <n> | save <n>");
+      }
+      scenario.actions.push_back(action);
+    } else {
+      fail(path, line, "unknown command");
+    }
+  }
+  fclose(file);
+
+  if (scenario.end == 0) {
+    fail(path, line, "missing end <ms>");
+  }
+  if (scenario.wearFrom >= scenario.end) {
+    fail(path, line, "wear has to start before the end");
+  }
+  std::stable_sort(scenario.actions.begin(), scenario.actions.end(),
+                   [](const Scenario::Action &a, const Scenario::Action &b) { return a.time < b.time; });
+}
+
+// Loads a private copy of the module: a library is only loaded once per
+// file, so every unit gets a file of its own, removed again once loaded.
+const NodeApi *loadNode(const std::string &directory, const std::vector<char> &module, size_t index) {
+  std::string path = directory + "/node" + std::to_string(index) + ".so";
+  std::ofstream(path, std::ios::binary).write(module.data(), module.size());
+  void *handle = dlopen(path.c_str(), RTLD_NOW | RTLD_LOCAL);
+  unlink(path.c_str());
+  if (handle == nullptr) {
+    fprintf(stderr, "%s\n", dlerror());
+    exit(1);
+  }
+  auto entry = (const NodeApi *(*)())dlsym(handle, NODE_API_SYMBOL);
+  if (entry == nullptr) {
+    fprintf(stderr, "%s\n", dlerror());
+    exit(1);
+  }
+  return entry();
+}
+
+// Presses of one input at random, rate per minute, from the first second
+// to the end.
+void schedulePresses(const Unit &unit, std::mt19937_64 &random, uint8_t input, double perMinute, uint64_t end) {
+  if (perMinute <= 0) {
+    return;
+  }
+  std::exponential_distribution<double> gap(perMinute / 60.0);
+  std::uniform_int_distribution<uint64_t> hold(60 * NS_PER_MS, 250 * NS_PER_MS);
+  uint64_t time = NS_PER_S;
+  for (;;) {
+    time += (uint64_t)(gap(random) * NS_PER_S);
+    uint64_t length = hold(random);
+    if (time + length >= end) {
+      break;
+    }
+    unit.api->press(time, input, length);
+    time += length;
+  }
+}
+
+// Carries out an action on a bus at time.
+void perform(Bus &bus, const Scenario::Action &action, uint64_t time) {
+  bus.transport->start(time);
+  incipit11::Controller &controller = *bus.controller;
+  switch (action.kind) {
+    case Scenario::ENUMERATE:
+      controller.enumerate(ADDRESS_FIRST, bus.addresses);
+      break;
+    case Scenario::EFFECT:
+      controller.broadcastEffect(0xFF, 0, action.value);
+      break;
+    case Scenario::SAVE:
+      controller.saveEffect(bus.addresses, 0, action.value);
+      break;
+  }
+}
+
+void poll(Bus &bus, const Scenario &scenario, uint64_t time) {
+  bus.transport->start(time);
+  // a unit moves to the address it was given on its next pass of loop(),
+  // so the interrupt is turned on from the polls after the enumeration
+  if (scenario.pollInterrupt && bus.keyInterrupts < bus.addresses.size()) {
+    bus.keyInterrupts = bus.controller->setKeyInterrupt(bus.addresses, true);
+  }
+  if (scenario.pollInterrupt && !bus.transport->interrupt()) {
+    return;
+  }
+  std::vector<incipit11::KeyEvent> events;
+  bus.controller->readKeyEvents(bus.addresses, events);
+  bus.keyEvents += events.size();
+  NodeKeyEvent read[8];
+  for (const Unit &unit : bus.transport->units()) {
+    size_t count;
+    while ((count = unit.api->takeKeyEvents(read, 8)) > 0) {
+      for (size_t i = 0; i < count; i++) {
+        bus.latencies.push_back((read[i].read > read[i].queued) ? read[i].read - read[i].queued : 0);
+      }
+    }
+  }
+}
+
+void sync(Bus &bus, uint64_t time) {
+  bus.transport->start(time);
+  bus.controller->broadcastSync(0xFF, (uint32_t)(time / NS_PER_MS));
+}
+
+void printReport(const Scenario &scenario, const std::vector<Unit> &units, const std::vector<Bus> &buses,
+                 int threads, double wallSeconds) {
+  double seconds = (double)scenario.end / NS_PER_S;
+  printf("Fleet of %d bus%s with %d units each, seed %u\n", scenario.buses, (scenario.buses == 1) ? "" : "es",
+         scenario.units, scenario.seed);
+  printf("  simulated          %8.1f s in %.2f s on %d thread%s (%.1f times real time)\n", seconds, wallSeconds,
+         threads, (threads == 1) ? "" : "s", wallSeconds > 0 ? seconds / wallSeconds : 0.0);
+
+  uint32_t transfers = 0;
+  uint32_t messages = 0;
+  uint32_t retries = 0;
+  size_t enumerated = 0;
+  double meanUse = 0;
+  double maxUse = 0;
+  int maxBus = 0;
+  uint32_t keyEvents = 0;
+  std::vector<uint64_t> latencies;
+  for (size_t b = 0; b < buses.size(); b++) {
+    const Bus &bus = buses[b];
+    transfers += bus.controller->transfers();
+    messages += bus.controller->messages();
+    retries += bus.controller->retries();
+    enumerated += bus.addresses.size();
+    double use = (double)bus.transport->busNs() / scenario.end;
+    meanUse += use / buses.size();
+    if (use > maxUse) {
+      maxUse = use;
+      maxBus = (int)b;
+    }
+    keyEvents += bus.keyEvents;
+    latencies.insert(latencies.end(), bus.latencies.begin(), bus.latencies.end());
+  }
+
+  printf("\nBuses (%u kHz, %.0f us per transfer)\n", scenario.hz / 1000, (double)scenario.transferNs / NS_PER_US);
+  printf("  utilisation        %8.2f%% mean, %.2f%% max (bus %d)\n", 100 * meanUse, 100 * maxUse, maxBus);
+  printf("  transfers          %8lu   (%lu messages, %lu retried unit by unit)\n", (unsigned long)transfers,
+         (unsigned long)messages, (unsigned long)retries);
+  printf("  units enumerated   %8zu of %zu\n", enumerated, units.size());
+
+  if (scenario.pollPeriod != 0) {
+    printf("\nKey events read by the controllers (%s every %.0f ms)\n",
+           scenario.pollInterrupt ? "interrupt line checked" : "SEESAW_KEYPAD_COUNT polled",
+           (double)scenario.pollPeriod / NS_PER_MS);
+    printf("  events read        %8lu\n", (unsigned long)keyEvents);
+    if (!latencies.empty()) {
+      std::sort(latencies.begin(), latencies.end());
+      double mean = 0;
+      for (uint64_t latency : latencies) {
+        mean += (double)latency / latencies.size();
+      }
+      printf("  latency            %8.1f ms mean, %.1f ms 99th percentile, %.1f ms max\n", mean / NS_PER_MS,
+             (double)latencies[latencies.size() * 99 / 100] / NS_PER_MS, (double)latencies.back() / NS_PER_MS);
+    }
+  }
+
+  // the byte written most often from wearFrom on decides how long the
+  // EEPROM lasts
+  uint64_t written = 0;
+  uint32_t most = 0;
+  size_t mostUnit = 0;
+  int mostAddress = 0;
+  for (size_t u = 0; u < units.size(); u++) {
+    for (int address = 0; address < 256; address++) {
+      uint32_t writes = units[u].api->eepromWrites(address);
+      written += writes;
+      writes -= units[u].wornBefore[address];
+      if (writes > most) {
+        most = writes;
+        mostUnit = u;
+        mostAddress = address;
+      }
+    }
+  }
+  double wearSeconds = (double)(scenario.end - scenario.wearFrom) / NS_PER_S;
+  printf("\nEEPROM wear\n");
+  printf("  bytes written      %8lu   (%.1f per unit)\n", (unsigned long)written, (double)written / units.size());
+  printf("  most written       %8lu   from %.1f s on (bus %zu unit %zu, address 0x%02X)\n", (unsigned long)most,
+         (double)scenario.wearFrom / NS_PER_S, mostUnit / scenario.units, mostUnit % scenario.units, mostAddress);
+  if (most > 0) {
+    printf("  endurance lasts    %8.1f days at this rate\n",
+           (double)EEPROM_ENDURANCE / most * wearSeconds / (24 * 3600));
+  }
+
+  double milliamps = 0;
+  uint64_t loops = 0;
+  for (const Unit &unit : units) {
+    milliamps += unit.api->averageMilliamps() / units.size();
+    loops += unit.api->loops();
+  }
+  printf("\nUnits\n");
+  printf("  mean MCU current   %8.4f mA\n", milliamps);
+  printf("  loop() passes      %8.0f per unit\n", (double)loops / units.size());
+
+  if (verbose) {
+    printf("\n%4s %6s %12s %8s %12s\n", "bus", "units", "utilisation", "events", "latency ms");
+    for (size_t b = 0; b < buses.size(); b++) {
+      const Bus &bus = buses[b];
+      double mean = 0;
+      for (uint64_t latency : bus.latencies) {
+        mean += (double)latency / bus.latencies.size() / NS_PER_MS;
+      }
+      printf("%4zu %6zu %11.2f%% %8lu %12.1f\n", b, bus.addresses.size(),
+             100.0 * bus.transport->busNs() / scenario.end, (unsigned long)bus.keyEvents, mean);
+    }
+  }
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  const char *path = nullptr;
+  const char *nodePath = INCIPIT11_NODE_MODULE;
+  int threads = (int)std::max(1u, std::thread::hardware_concurrency());
+  long seed = -1;
+  long busCount = -1;
+  long unitCount = -1;
+
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "-v") == 0) {
+      verbose = true;
+    } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+      threads = (int)number(argv[++i]);
+    } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+      seed = number(argv[++i]);
+    } else if (strcmp(argv[i], "--buses") == 0 && i + 1 < argc) {
+      busCount = number(argv[++i]);
+    } else if (strcmp(argv[i], "--units") == 0 && i + 1 < argc) {
+      unitCount = number(argv[++i]);
+    } else if (strcmp(argv[i], "--node") == 0 && i + 1 < argc) {
+      nodePath = argv[++i];
+    } else if (argv[i][0] == '-' || path != nullptr) {
+      usage();
+    } else {
+      path = argv[i];
+    }
+  }
+  if (path == nullptr || threads < 1) {
+    usage();
+  }
+
+  Scenario scenario;
+  loadScenario(path, scenario);
+  if (seed >= 0) {
+    scenario.seed = (uint32_t)seed;
+  }
+  if (busCount >= 0) {
+    scenario.buses = (int)busCount;
+  }
+  if (unitCount >= 0) {
+    scenario.units = (int)unitCount;
+  }
+  if (scenario.buses < 1 || scenario.units < 1 || scenario.units > ADDRESSES || scenario.hz == 0) {
+    fprintf(stderr, "%s: need at least one bus and 1 to %d units on each\n", path, ADDRESSES);
+    return 2;
+  }
+
+  std::ifstream file(nodePath, std::ios::binary);
+  std::vector<char> module((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+  if (module.empty()) {
+    perror(nodePath);
+    return 1;
+  }
+  const char *tmp = getenv("TMPDIR");
+  std::string directory = std::string((tmp != nullptr) ? tmp : "/tmp") + "/incipit11_fleet.XXXXXX";
+  if (mkdtemp(&directory[0]) == nullptr) {
+    perror("mkdtemp");
+    return 1;
+  }
+
+  // The serial numbers share the lot bytes; everything else of a unit
+  // comes from a generator of its own.
+  std::mt19937_64 fleetRandom(scenario.seed);
+  uint8_t lot[LOT_BYTES];
+  for (int i = 0; i < LOT_BYTES; i++) {
+    lot[i] = (uint8_t)fleetRandom();
+  }
+  size_t total = (size_t)scenario.buses * scenario.units;
+  std::vector<Unit> units(total);
+  for (size_t i = 0; i < total; i++) {
+    units[i].api = loadNode(directory, module, i);
+  }
+  rmdir(directory.c_str());
+
+  Pool pool(threads);
+  pool.run(total, [&](size_t i) {
+    std::seed_seq seeds = {(uint64_t)scenario.seed, (uint64_t)i};
+    std::mt19937_64 random(seeds);
+    std::uniform_int_distribution<int32_t> skew(-scenario.skewPpm, scenario.skewPpm);
+    uint8_t serial[SERIAL_SIZE];
+    memcpy(serial, lot, LOT_BYTES);
+    for (int j = LOT_BYTES; j < SERIAL_SIZE; j++) {
+      serial[j] = (uint8_t)random();
+    }
+    int32_t skewPpm = skew(random);
+    units[i].api->boot(serial, skewPpm, skew(random));
+    schedulePresses(units[i], random, 0, scenario.buttonPerMinute, scenario.end);
+    schedulePresses(units[i], random, 1, scenario.triggerPerMinute, scenario.end);
+  });
+
+  std::vector<Bus> buses(scenario.buses);
+  for (int b = 0; b < scenario.buses; b++) {
+    std::vector<Unit> busUnits(units.begin() + (size_t)b * scenario.units,
+                               units.begin() + (size_t)(b + 1) * scenario.units);
+    buses[b].transport.reset(new BusTransport(busUnits, scenario.hz, scenario.transferNs));
+    buses[b].controller.reset(new incipit11::Controller(*buses[b].transport));
+  }
+
+  // Run the units to the next controller action, then the buses carry
+  // out the actions due.
+  auto wallStart = std::chrono::steady_clock::now();
+  size_t nextAction = 0;
+  uint64_t nextPoll = scenario.pollPeriod ? scenario.pollPeriod : TIME_NEVER;
+  uint64_t nextSync = scenario.syncPeriod ? scenario.syncPeriod : TIME_NEVER;
+  bool worn = false;
+  for (;;) {
+    uint64_t time = std::min(nextPoll, nextSync);
+    if (nextAction < scenario.actions.size()) {
+      time = std::min(time, scenario.actions[nextAction].time);
+    }
+    bool wearing = !worn && scenario.wearFrom <= time;
+    if (wearing) {
+      time = scenario.wearFrom;
+    }
+    if (time > scenario.end) {
+      break;
+    }
+    pool.run(total, [&](size_t i) {
+      units[i].api->runUntil(time);
+      if (wearing) {
+        for (int address = 0; address < 256; address++) {
+          units[i].wornBefore[address] = units[i].api->eepromWrites(address);
+        }
+      }
+    });
+    worn = worn || wearing;
+
+    size_t firstAction = nextAction;
+    while (nextAction < scenario.actions.size() && scenario.actions[nextAction].time == time) {
+      nextAction++;
+    }
+    bool polling = (time == nextPoll);
+    bool syncing = (time == nextSync);
+    pool.run(buses.size(), [&](size_t b) {
+      for (size_t a = firstAction; a < nextAction; a++) {
+        perform(buses[b], scenario.actions[a], time);
+      }
+      if (syncing) {
+        sync(buses[b], time);
+      }
+      if (polling) {
+        poll(buses[b], scenario, time);
+      }
+    });
+    if (polling) {
+      nextPoll += scenario.pollPeriod;
+    }
+    if (syncing) {
+      nextSync += scenario.syncPeriod;
+    }
+  }
+  pool.run(total, [&](size_t i) { units[i].api->runUntil(scenario.end); });
+  double wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - wallStart).count();
+
+  printReport(scenario, units, buses, threads, wallSeconds);
+  return 0;
+}
@@ -0,0 +1,486 @@
+// incipit11_golden: renders the built-in effect presets in the simulator and
+// records them as golden traces, or checks a build against the traces.
+//
+// usage: incipit11_golden --record DIR [--seed N] [--ms N] [EFFECT...]
+//        incipit11_golden --check DIR [EFFECT...]
+//        incipit11_golden --current [--ms N] [EFFECT...]
+//
+//   --record DIR  write DIR/<nn>_<NAME>.txt for each effect (default all)
+//   --check DIR   render each effect with the seed and length of its trace
+//                 in DIR and compare; exits with 1 when one is off by more
+//                 than the tolerances below
+//   --seed N      randomSeed() before boot (default 1, the avr-libc start
+//                 value, as the firmware doesn't seed)
+//   --current     render each effect with the CPU clock governor (Clock.h)
+//                 off and on and report the estimated MCU current
+//   --ms N        virtual time to render (default 10000)
+//
+// Each effect runs as the saved ambient effect of channel 0 from reset, in a
+// process of its own. A trace has a header line and then the changes of the
+// PWM output as "<us> <level>" lines; the output is 0 at time 0.
+//
+// The comparison, per effect:
+//   writes/s   output changes per second, golden and new: the analogWrite()
+//              (compare register) rate
+//   freq       rising crossings of the golden midpoint level per second,
+//              error in percent of the golden
+//   duty       time above the midpoint, difference in percentage points
+//   mean       mean level, difference in percent of full scale
+//   jitter     for each golden change, the nearest new change to the same
+//              level; the largest time between them in ms (missing when
+//              the new trace never goes to that level)
+//
+// The current report, per effect: the average MCU current (sim::PowerModel)
+// at F_CPU and with the governor, the saving, the share of the awake time
+// the CPU ran at the low clock, the PWM frequency with the governor (its
+// lowest and highest, sampled every loop() pass) and whether the output came
+// out the same as at F_CPU (within the jitter tolerance).
+
+#include <Arduino.h>
+#include <EEPROM.h>
+
+#include "Firmware.h"
+#include "Sim.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace {
+
+// the effect constants of Incipit11Controller.ino, by index
+const char *const EFFECT_NAMES[] = {
+  "HEARTBEAT_1",
+  "HEARTBEAT_2",
+  "HEARTBEAT_3",
+  "CONSTANT_40",
+  "CONSTANT_60",
+  "CONSTANT_80",
+  "CONSTANT_100",
+  "STROBE_1",
+  "STROBE_3",
+  "STROBE_7",
+  "STROBE_12",
+  "STROBE_20",
+  "SPARKLE_1",
+  "SPARKLE_2",
+  "SPARKLE_3",
+  "FLICKER_OFF_1",
+  "FLICKER_OFF_2",
+  "FLICKER_OFF_3",
+  "FLICKER_ON_FAST_1",
+  "FLICKER_ON_FAST_2",
+  "FLICKER_ON_FAST_3",
+  "FLICKER_ON_SLOW_1",
+  "FLICKER_ON_SLOW_2",
+  "FLICKER_ON_SLOW_3",
+  "SINE_WAVE_1",
+  "SINE_WAVE_2",
+  "SINE_WAVE_3",
+  "SINE_WAVE_MIN_20_1",
+  "SINE_WAVE_MIN_20_2",
+  "SINE_WAVE_MIN_20_3",
+  "SINE_WAVE_MIN_40_1",
+  "SINE_WAVE_MIN_40_2",
+  "SINE_WAVE_MIN_40_3",
+  "CONSTANT_0",
+  "CONSTANT_20",
+};
+const int EFFECT_COUNT = sizeof(EFFECT_NAMES) / sizeof(EFFECT_NAMES[0]);
+
+#define GOLDEN_PIN_PWM_OUTPUT PIN_PA5
+const int ADDR_AMBIENT_EFFECT = 0;
+
+// tolerances of --check
+const double MAX_FREQUENCY_ERROR = 1.0; // percent
+const double MAX_DUTY_ERROR = 1.0;      // percentage points
+const double MAX_MEAN_ERROR = 1.0;      // percent of full scale
+// steps are timed from the millisecond loop() sees them in, so a boot a bit
+// shorter or longer than the golden one moves them by a millisecond or two
+const double MAX_JITTER_MS = 3.0;
+
+struct Step {
+  uint64_t us;
+  uint8_t level;
+};
+
+struct Trace {
+  unsigned long seed = 1;
+  unsigned long ms = 10000;
+  std::vector<Step> steps;
+};
+
+// A rendering for the current report. After the steps the child sends a
+// step with END_OF_STEPS and then this.
+struct Current {
+  bool scaling;       // governor on
+  double milliamps;   // average over the rendering
+  double lowClock;    // percent of the awake time below F_CPU
+  uint32_t pwmMin;    // Hz
+  uint32_t pwmMax;
+};
+const uint64_t END_OF_STEPS = UINT64_MAX;
+
+void usage() {
+  fprintf(stderr, "usage: incipit11_golden --record DIR [--seed N] [--ms N] [EFFECT...]\n"
+                  "       incipit11_golden --check DIR [EFFECT...]\n"
+                  "       incipit11_golden --current [--ms N] [EFFECT...]\n");
+  exit(2);
+}
+
+long number(const char *word) {
+  char *end;
+  long value = strtol(word, &end, 0);
+  if (*word == '\0' || *end != '\0' || value < 0) {
+    usage();
+  }
+  return value;
+}
+
+std::string tracePath(const char *dir, int effect) {
+  char name[64];
+  snprintf(name, sizeof(name), "/%02d_%s.txt", effect, EFFECT_NAMES[effect]);
+  return dir + std::string(name);
+}
+
+// Runs the effect in a child process, as the firmware and the simulator can
+// only boot once in a process, and collects the output changes. With
+// current, the governor is set as asked and the current is measured.
+bool render(int effect, Trace &trace, Current *current = nullptr) {
+  int pipes[2];
+  if (pipe(pipes) != 0) {
+    perror("pipe");
+    return false;
+  }
+  fflush(stdout);
+  pid_t pid = fork();
+  if (pid < 0) {
+    perror("fork");
+    return false;
+  }
+  if (pid == 0) {
+    close(pipes[0]);
+    FILE *out = fdopen(pipes[1], "wb");
+    uint8_t saved = (uint8_t)effect;
+    EEPROM.hostLoad(ADDR_AMBIENT_EFFECT, &saved, 1);
+    randomSeed(trace.seed);
+    sim::onOutput = [out](uint64_t time, uint8_t pin, uint8_t level) {
+      if (pin == GOLDEN_PIN_PWM_OUTPUT) {
+        Step step = {time / sim::NS_PER_US, level};
+        fwrite(&step, sizeof(step), 1, out);
+      }
+    };
+    sim::boot();
+    Current measured = {};
+    if (current != nullptr) {
+      measured.scaling = current->scaling;
+      if (!firmware::setClockScaling(current->scaling) && current->scaling) {
+        fprintf(stderr, "the firmware was built without CLOCK_SCALING\n");
+        _exit(1);
+      }
+      measured.pwmMin = UINT32_MAX;
+      sim::onLoop = [&measured](uint64_t) {
+        measured.pwmMin = std::min(measured.pwmMin, sim::pwmHz());
+        measured.pwmMax = std::max(measured.pwmMax, sim::pwmHz());
+      };
+    }
+    sim::runUntil(trace.ms * sim::NS_PER_MS);
+    if (current != nullptr) {
+      uint64_t awake = sim::modeTime(-1, sim::CPU_RUN) + sim::modeTime(-1, sim::CPU_IDLE);
+      measured.milliamps = sim::averageMilliamps(-1);
+      measured.lowClock = (awake > 0) ? 100.0 * sim::prescaledTime() / awake : 0;
+      Step end = {END_OF_STEPS, 0};
+      fwrite(&end, sizeof(end), 1, out);
+      fwrite(&measured, sizeof(measured), 1, out);
+    }
+    fclose(out);
+    _exit(0);
+  }
+
+  close(pipes[1]);
+  FILE *in = fdopen(pipes[0], "rb");
+  trace.steps.clear();
+  Step step;
+  bool measured = false;
+  while (fread(&step, sizeof(step), 1, in) == 1) {
+    if (step.us == END_OF_STEPS) {
+      measured = current != nullptr && fread(current, sizeof(*current), 1, in) == 1;
+      break;
+    }
+    trace.steps.push_back(step);
+  }
+  fclose(in);
+  int status;
+  waitpid(pid, &status, 0);
+  if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+    fprintf(stderr, "effect %d: the simulator failed\n", effect);
+    return false;
+  }
+  if (current != nullptr && !measured) {
+    fprintf(stderr, "effect %d: no current from the simulator\n", effect);
+    return false;
+  }
+  return true;
+}
+
+bool writeTrace(const std::string &path, int effect, const Trace &trace) {
+  FILE *file = fopen(path.c_str(), "w");
+  if (file == nullptr) {
+    perror(path.c_str());
+    return false;
+  }
+  fprintf(file, "# incipit11_golden effect %d %s seed %lu ms %lu\n", effect, EFFECT_NAMES[effect], trace.seed,
+          trace.ms);
+  for (const Step &step : trace.steps) {
+    fprintf(file, "%llu %u\n", (unsigned long long)step.us, step.level);
+  }
+  return fclose(file) == 0;
+}
+
+bool readTrace(const std::string &path, Trace &trace) {
+  FILE *file = fopen(path.c_str(), "r");
+  if (file == nullptr) {
+    perror(path.c_str());
+    return false;
+  }
+  char line[128];
+  bool ok = fgets(line, sizeof(line), file) != nullptr &&
+            sscanf(line, "# incipit11_golden effect %*d %*s seed %lu ms %lu", &trace.seed, &trace.ms) == 2;
+  unsigned long long us;
+  unsigned level;
+  while (ok && fgets(line, sizeof(line), file) != nullptr) {
+    ok = sscanf(line, "%llu %u", &us, &level) == 2 && level <= 255;
+    trace.steps.push_back({us, (uint8_t)level});
+  }
+  fclose(file);
+  if (!ok) {
+    fprintf(stderr, "%s: not a golden trace\n", path.c_str());
+  }
+  return ok;
+}
+
+// Shape of a trace against a threshold level.
+struct Shape {
+  double writesPerSecond;
+  double frequency; // Hz
+  double duty;      // percent of the time above threshold
+  double mean;      // percent of full scale
+};
+
+Shape shape(const Trace &trace, double threshold) {
+  uint64_t end = trace.ms * 1000ULL;
+  Shape result = {};
+  uint64_t above = 0;
+  double area = 0;
+  uint8_t level = 0;
+  uint64_t since = 0;
+  uint32_t rising = 0;
+  for (size_t i = 0; i <= trace.steps.size(); i++) {
+    uint64_t time = (i < trace.steps.size()) ? std::min(trace.steps[i].us, end) : end;
+    area += (double)level * (time - since);
+    if (level > threshold) {
+      above += time - since;
+    }
+    if (i < trace.steps.size()) {
+      if (level <= threshold && trace.steps[i].level > threshold) {
+        rising++;
+      }
+      level = trace.steps[i].level;
+      since = time;
+    }
+  }
+  double seconds = end / 1e6;
+  result.writesPerSecond = trace.steps.size() / seconds;
+  result.frequency = rising / seconds;
+  result.duty = 100.0 * above / end;
+  result.mean = 100.0 * area / 255 / end;
+  return result;
+}
+
+// Largest time from a golden change to the nearest new change to the same
+// level, in ms. Counts the golden changes with no such new change.
+double jitter(const Trace &golden, const Trace &trace, uint32_t &missing) {
+  std::map<uint8_t, std::vector<uint64_t>> times;
+  for (const Step &step : trace.steps) {
+    times[step.level].push_back(step.us);
+  }
+  uint64_t largest = 0;
+  missing = 0;
+  for (const Step &step : golden.steps) {
+    auto found = times.find(step.level);
+    if (found == times.end()) {
+      missing++;
+      continue;
+    }
+    const std::vector<uint64_t> &same = found->second;
+    auto next = std::lower_bound(same.begin(), same.end(), step.us);
+    uint64_t nearest = UINT64_MAX;
+    if (next != same.end()) {
+      nearest = *next - step.us;
+    }
+    if (next != same.begin()) {
+      nearest = std::min(nearest, step.us - *(next - 1));
+    }
+    largest = std::max(largest, nearest);
+  }
+  return largest / 1000.0;
+}
+
+// Compares a new rendering against the golden trace and prints a line.
+// Returns false when it is off by more than the tolerances.
+bool compare(int effect, const Trace &golden, const Trace &trace) {
+  // the levels the effect moves between, after the 0 of reset
+  uint8_t low = golden.steps.empty() ? 0 : 255;
+  uint8_t high = 0;
+  for (const Step &step : golden.steps) {
+    low = std::min(low, step.level);
+    high = std::max(high, step.level);
+  }
+  double threshold = (low + high) / 2.0;
+
+  Shape a = shape(golden, threshold);
+  Shape b = shape(trace, threshold);
+  double frequencyError = (a.frequency > 0) ? 100.0 * (b.frequency - a.frequency) / a.frequency
+                                            : ((b.frequency > 0) ? 100.0 : 0.0);
+  uint32_t missing;
+  double jitterMs = jitter(golden, trace, missing);
+  bool same = golden.steps.size() == trace.steps.size() &&
+              std::equal(golden.steps.begin(), golden.steps.end(), trace.steps.begin(),
+                         [](const Step &x, const Step &y) { return x.us == y.us && x.level == y.level; });
+  bool ok = same || (fabs(frequencyError) <= MAX_FREQUENCY_ERROR && fabs(b.duty - a.duty) <= MAX_DUTY_ERROR &&
+                     fabs(b.mean - a.mean) <= MAX_MEAN_ERROR && jitterMs <= MAX_JITTER_MS && missing == 0);
+
+  printf("%2d %-18s %7.1f %7.1f %+7.2f %+7.2f %+7.2f %7.2f", effect, EFFECT_NAMES[effect], a.writesPerSecond,
+         b.writesPerSecond, frequencyError, b.duty - a.duty, b.mean - a.mean, jitterMs);
+  if (missing > 0) {
+    printf(" %lu missing", (unsigned long)missing);
+  }
+  printf("  %s\n", same ? "same" : (ok ? "ok" : "OFF"));
+  return ok;
+}
+
+// Renders an effect at F_CPU and with the governor and prints a line of the
+// current report. Returns false when the governor changed the PWM frequency
+// or the output.
+bool reportCurrent(int effect, const Trace &settings) {
+  Trace full = settings;
+  Trace scaled = settings;
+  Current atFull = {false};
+  Current governed = {true};
+  if (!render(effect, full, &atFull) || !render(effect, scaled, &governed)) {
+    return false;
+  }
+  uint32_t missing;
+  double jitterMs = jitter(full, scaled, missing);
+  bool same = full.steps.size() == scaled.steps.size() &&
+              std::equal(full.steps.begin(), full.steps.end(), scaled.steps.begin(),
+                         [](const Step &x, const Step &y) { return x.us == y.us && x.level == y.level; });
+  bool pwmOk = governed.pwmMin == governed.pwmMax && governed.pwmMin == atFull.pwmMin;
+  bool outputOk = same || (jitterMs <= MAX_JITTER_MS && missing == 0);
+  double saving = (atFull.milliamps > 0) ? 100.0 * (atFull.milliamps - governed.milliamps) / atFull.milliamps : 0;
+
+  printf("%2d %-18s %7.3f %7.3f %6.1f %6.1f %6lu-%-6lu %s", effect, EFFECT_NAMES[effect], atFull.milliamps,
+         governed.milliamps, saving, governed.lowClock, (unsigned long)governed.pwmMin,
+         (unsigned long)governed.pwmMax, same ? "same" : (outputOk ? "ok" : "OFF"));
+  if (!same) {
+    printf(" (%.2f ms", jitterMs);
+    if (missing > 0) {
+      printf(", %lu missing", (unsigned long)missing);
+    }
+    printf(")");
+  }
+  if (!pwmOk) {
+    printf(" PWM %lu Hz at F_CPU", (unsigned long)atFull.pwmMin);
+  }
+  printf("\n");
+  return pwmOk && outputOk;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  const char *recordDir = nullptr;
+  const char *checkDir = nullptr;
+  bool current = false;
+  Trace settings;
+  std::vector<int> effects;
+
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--record") == 0 && i + 1 < argc) {
+      recordDir = argv[++i];
+    } else if (strcmp(argv[i], "--check") == 0 && i + 1 < argc) {
+      checkDir = argv[++i];
+    } else if (strcmp(argv[i], "--current") == 0) {
+      current = true;
+    } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+      settings.seed = (unsigned long)number(argv[++i]);
+    } else if (strcmp(argv[i], "--ms") == 0 && i + 1 < argc) {
+      settings.ms = (unsigned long)number(argv[++i]);
+    } else if (argv[i][0] != '-' && number(argv[i]) < EFFECT_COUNT) {
+      effects.push_back((int)number(argv[i]));
+    } else {
+      usage();
+    }
+  }
+  if ((recordDir != nullptr) + (checkDir != nullptr) + current != 1 || settings.ms == 0) {
+    usage();
+  }
+  if (effects.empty()) {
+    for (int effect = 0; effect < EFFECT_COUNT; effect++) {
+      effects.push_back(effect);
+    }
+  }
+
+  if (recordDir != nullptr) {
+    for (int effect : effects) {
+      Trace trace = settings;
+      if (!render(effect, trace) || !writeTrace(tracePath(recordDir, effect), effect, trace)) {
+        return 1;
+      }
+      printf("%2d %-18s %6zu changes\n", effect, EFFECT_NAMES[effect], trace.steps.size());
+    }
+    return 0;
+  }
+
+  if (current) {
+    printf("                      MCU mA at       saving    low  PWM Hz\n");
+    printf("   effect              F_CPU governed      %%  clock%%  governed      output\n");
+    int off = 0;
+    for (int effect : effects) {
+      if (!reportCurrent(effect, settings)) {
+        off++;
+      }
+    }
+    printf("%d of %zu effects changed by the governor\n", off, effects.size());
+    return (off > 0) ? 1 : 0;
+  }
+
+  printf("                      writes/s         freq    duty    mean  jitter\n");
+  printf("   effect             golden     new      %%  points       %%      ms\n");
+  int off = 0;
+  for (int effect : effects) {
+    Trace golden;
+    if (!readTrace(tracePath(checkDir, effect), golden)) {
+      return 1;
+    }
+    Trace trace;
+    trace.seed = golden.seed;
+    trace.ms = golden.ms;
+    if (!render(effect, trace)) {
+      return 1;
+    }
+    if (!compare(effect, golden, trace)) {
+      off++;
+    }
+  }
+  printf("%d of %zu effects off\n", off, effects.size());
+  return (off > 0) ? 1 : 0;
+}
@@ -0,0 +1,719 @@
+// incipit11_sim: run the Incipit11 controller firmware through a scripted
+// scenario in virtual time and report the estimated current per state.
+//
+// usage: incipit11_sim [-v] [--serial FILE] [--loop-cycles N] SCENARIO
+//
+// A scenario is a text file with one command per line. Times are virtual
+// milliseconds since reset and numbers can be given in hex (0x..).
+//
+//   eeprom <addr> <byte>...                initial EEPROM contents
+//   serial <byte>...                       SIGROW serial number (up to 10
+//                                          bytes, the rest are 0)
+//   at <ms> press <button|trigger> [<ms>]  hold a button down (default 100 ms)
+//   at <ms> i2c write <addr> <byte|last>... [-> ACK|NACK]
+//                                          controller write; last stands for
+//                                          the bytes of the last read, taken
+//                                          when the write is sent
+//   at <ms> i2c read <addr> <count> [<byte>...] [-> <byte|*>...|NACK]
+//                                          controller write of the register
+//                                          bytes (if any), then a read
+//   skew <ppm> [<rtc ppm>]                 the unit's clock (and RTC, by
+//                                          default the same) runs fast (slow
+//                                          when negative) against virtual time
+//   sync <addr> <ms>                       controller writes its time to
+//                                          DOA_SEESAW_SYNC_EPOCH every ms
+//   keypad <addr> <ms> [int]               controller reads the key events:
+//                                          polls SEESAW_KEYPAD_COUNT every
+//                                          ms, or with int turns the keypad
+//                                          interrupt on and only reads when
+//                                          the interrupt pin (checked every
+//                                          ms) is low
+//   end <ms>                               run until this time
+//
+// Expectations. The run exits with 1 if any of them doesn't hold.
+//
+//   ... -> ...                             the ACK of a write, the bytes of
+//                                          a read in hex as they are printed
+//                                          (* for any byte)
+//   at <ms> expect output <level> [<max>]  PWM output level, or range
+//   at <ms> expect state <name>            firmware state
+//   at <ms> expect clock <hz>              CPU clock (Clock.h)
+//   at <ms> expect pwm <hz>                TCA0 PWM frequency
+//   expect eeprom <addr> <byte>...         EEPROM contents at the end
+//   expect <run|idle|standby> <min%> [<max%>]
+//                                          share of the time in a CPU mode
+//   expect prescaled <min%> [<max%>]       share of the awake time with the
+//                                          CPU clock lowered (Clock.h)
+//   expect sync <ms>                       largest offset of the effect clock
+//                                          once settled (see sync)
+//   expect keypad <events> [<max>]         key events the keypad controller
+//                                          read, in at most max transactions
+//
+// '#' starts a comment.
+
+#include <Arduino.h>
+#include <EEPROM.h>
+
+#include "Firmware.h"
+#include "Sim.h"
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <functional>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// pins used by the firmware (Incipit11Controller.ino)
+#define SIM_PIN_PWM_OUTPUT PIN_PA5
+#define SIM_PIN_BUTTON     PIN_PA4
+#define SIM_PIN_TRIGGER    PIN_PA6
+#define SIM_PIN_INTERRUPT  PIN_PB3 // CONFIG_INTERRUPT_PIN
+
+namespace {
+
+bool verbose = false;
+FILE *serialOut = nullptr;
+
+// bytes of the last i2c read that was ACKed, for "last" in a write
+std::vector<uint8_t> lastRead;
+
+// Expectations checked at the end of the run.
+struct EndExpectation {
+  const char *path;
+  int line;
+  std::function<bool(std::string &)> check; // fills in the mismatch
+};
+std::vector<EndExpectation> endExpectations;
+int failures = 0;
+
+// shared effect clock (Sync.h) against the controller's, once synced
+uint32_t syncCount = 0;
+int64_t syncOffset = 0;        // ns, at the last loop() pass
+int64_t syncMaxOffset = 0;
+int64_t syncSettledMaxOffset = 0; // from the fourth sync on
+const uint32_t SYNC_SETTLED = 4;
+
+// key events read by the controller (SEESAW_KEYPAD_BASE)
+bool keypadUsed = false;
+bool keypadInterrupt = false;  // reads on the interrupt pin instead of polling
+uint64_t keypadPeriod = 0;
+uint32_t keypadChecks = 0;
+uint32_t keypadTransactions = 0;
+uint32_t keypadBytes = 0;      // on the bus, with the address bytes
+uint32_t keypadEvents = 0;
+uint64_t keypadPendingSince = sim::TIME_NEVER; // loop() pass that queued an event
+uint64_t keypadLatencyTotal = 0;
+uint64_t keypadLatencyMax = 0;
+uint32_t keypadLatencyCount = 0;
+uint64_t lastLoopStart = 0;
+
+void usage() {
+  fprintf(stderr, "usage: incipit11_sim [-v] [--serial FILE] [--loop-cycles N] SCENARIO\n");
+  exit(2);
+}
+
+void fail(const char *path, int line, const char *message) {
+  fprintf(stderr, "%s:%d: %s\n", path, line, message);
+  exit(1);
+}
+
+void mismatch(const char *path, int line, const std::string &message) {
+  fprintf(stderr, "%s:%d: expectation failed: %s\n", path, line, message.c_str());
+  failures++;
+}
+
+long number(const std::string &word, const char *path, int line) {
+  char *end;
+  long value = strtol(word.c_str(), &end, 0);
+  if (word.empty() || *end != '\0') {
+    fail(path, line, "expected a number");
+  }
+  return value;
+}
+
+void printTime(uint64_t time) {
+  printf("%10.3f s  ", time / 1e9);
+}
+
+void printBytes(const uint8_t *data, int length) {
+  for (int i = 0; i < length; i++) {
+    printf(" %02X", data[i]);
+  }
+}
+
+std::string formatBytes(const uint8_t *data, int length) {
+  std::string text;
+  char hex[4];
+  for (int i = 0; i < length; i++) {
+    snprintf(hex, sizeof(hex), " %02X", data[i]);
+    text += hex;
+  }
+  return text;
+}
+
+// Splits off the expected response after "->", if any.
+std::vector<std::string> expectedResponse(std::vector<std::string> &words) {
+  std::vector<std::string> expected;
+  for (size_t i = 0; i < words.size(); i++) {
+    if (words[i] == "->") {
+      expected.assign(words.begin() + i + 1, words.end());
+      words.resize(i);
+      break;
+    }
+  }
+  return expected;
+}
+
+// Expected bytes of a read in hex, as they are printed, -1 for any byte.
+std::vector<int> expectedBytes(const std::vector<std::string> &words, const char *path, int line) {
+  std::vector<int> bytes;
+  for (const std::string &word : words) {
+    char *end;
+    long value = strtol(word.c_str(), &end, 16);
+    if (word == "*") {
+      value = -1;
+    } else if (word.size() != 2 || *end != '\0') {
+      fail(path, line, "expected two hex digits or *");
+    }
+    bytes.push_back((int)value);
+  }
+  return bytes;
+}
+
+int cpuModeIndex(const std::string &name) {
+  for (uint8_t mode = 0; mode < sim::CPU_MODE_COUNT; mode++) {
+    if (name == sim::cpuModeName(mode)) {
+      return mode;
+    }
+  }
+  return -1;
+}
+
+void parseExpect(const std::vector<std::string> &words, const char *path, int line) {
+  if (words.size() >= 3 && words[1] == "eeprom") {
+    long address = number(words[2], path, line);
+    std::vector<uint8_t> expected;
+    for (size_t i = 3; i < words.size(); i++) {
+      expected.push_back((uint8_t)number(words[i], path, line));
+    }
+    endExpectations.push_back({path, line, [address, expected](std::string &message) {
+      std::vector<uint8_t> actual;
+      for (size_t i = 0; i < expected.size(); i++) {
+        actual.push_back(EEPROM.read(address + i));
+      }
+      message = "eeprom" + formatBytes(actual.data(), (int)actual.size()) + ", expected" +
+                formatBytes(expected.data(), (int)expected.size());
+      return actual == expected;
+    }});
+  } else if ((words.size() == 3 || words.size() == 4) && cpuModeIndex(words[1]) >= 0) {
+    uint8_t mode = (uint8_t)cpuModeIndex(words[1]);
+    double minimum = atof(words[2].c_str());
+    double maximum = (words.size() == 4) ? atof(words[3].c_str()) : 100.0;
+    endExpectations.push_back({path, line, [mode, minimum, maximum](std::string &message) {
+      double share = 100.0 * sim::modeTime(-1, mode) / sim::now();
+      char text[96];
+      snprintf(text, sizeof(text), "%s %.2f%%, expected %.2f%% to %.2f%%", sim::cpuModeName(mode),
+               share, minimum, maximum);
+      message = text;
+      return share >= minimum && share <= maximum;
+    }});
+  } else if ((words.size() == 3 || words.size() == 4) && words[1] == "prescaled") {
+    double minimum = atof(words[2].c_str());
+    double maximum = (words.size() == 4) ? atof(words[3].c_str()) : 100.0;
+    endExpectations.push_back({path, line, [minimum, maximum](std::string &message) {
+      uint64_t awake = sim::modeTime(-1, sim::CPU_RUN) + sim::modeTime(-1, sim::CPU_IDLE);
+      double share = awake ? 100.0 * sim::prescaledTime() / awake : 0.0;
+      char text[96];
+      snprintf(text, sizeof(text), "prescaled %.2f%%, expected %.2f%% to %.2f%%", share, minimum, maximum);
+      message = text;
+      return share >= minimum && share <= maximum;
+    }});
+  } else if (words.size() == 3 && words[1] == "sync") {
+    double maximum = atof(words[2].c_str());
+    endExpectations.push_back({path, line, [maximum](std::string &message) {
+      char text[96];
+      snprintf(text, sizeof(text), "settled sync offset %.3f ms, expected at most %.3f ms",
+               syncSettledMaxOffset / 1e6, maximum);
+      message = text;
+      return syncCount > SYNC_SETTLED && syncSettledMaxOffset / 1e6 <= maximum;
+    }});
+  } else if ((words.size() == 3 || words.size() == 4) && words[1] == "keypad") {
+    long events = number(words[2], path, line);
+    long maximum = (words.size() == 4) ? number(words[3], path, line) : LONG_MAX;
+    endExpectations.push_back({path, line, [events, maximum](std::string &message) {
+      char text[96];
+      snprintf(text, sizeof(text), "%lu key events in %lu transactions, expected %ld", (unsigned long)keypadEvents,
+               (unsigned long)keypadTransactions, events);
+      message = text;
+      if (maximum != LONG_MAX) {
+        message += " in at most " + std::to_string(maximum);
+      }
+      return keypadEvents == (uint32_t)events && keypadTransactions <= (uint32_t)maximum;
+    }});
+  } else {
+    fail(path, line, "expect <eeprom|run|idle|standby|prescaled|sync|keypad> ...");
+  }
+}
+
+void scheduleExpect(uint64_t time, const std::vector<std::string> &words, const char *path,
+                    int line) {
+  if ((words.size() == 5 || words.size() == 6) && words[3] == "output") {
+    long minimum = number(words[4], path, line);
+    long maximum = (words.size() == 6) ? number(words[5], path, line) : minimum;
+    sim::schedule(time, [path, line, minimum, maximum]() {
+      uint8_t level = sim::outputLevel(SIM_PIN_PWM_OUTPUT);
+      if (level < minimum || level > maximum) {
+        mismatch(path, line, "output " + std::to_string(level) + ", expected " +
+                             std::to_string(minimum) +
+                             (maximum != minimum ? " to " + std::to_string(maximum) : ""));
+      }
+      return false;
+    });
+  } else if (words.size() == 5 && words[3] == "state") {
+    std::string name = words[4];
+    sim::schedule(time, [path, line, name]() {
+      const char *state = firmware::stateNames()[firmware::state()];
+      if (name != state) {
+        mismatch(path, line, std::string("state ") + state + ", expected " + name);
+      }
+      return false;
+    });
+  } else if (words.size() == 5 && (words[3] == "clock" || words[3] == "pwm")) {
+    std::string what = words[3];
+    long hz = number(words[4], path, line);
+    sim::schedule(time, [path, line, what, hz]() {
+      uint32_t actual = (what == "clock") ? sim::cpuHz() : sim::pwmHz();
+      if (actual != (uint32_t)hz) {
+        mismatch(path, line, what + " " + std::to_string(actual) + " Hz, expected " + std::to_string(hz) + " Hz");
+      }
+      return false;
+    });
+  } else {
+    fail(path, line, "at <ms> expect <output|state|clock|pwm> ...");
+  }
+}
+
+// Controller write of its time (milliseconds) every period, from period on.
+void scheduleSync(uint64_t time, uint8_t address, uint64_t period) {
+  uint32_t ms = (uint32_t)(time / sim::NS_PER_MS);
+  uint8_t data[] = {0x84, 0x00, (uint8_t)(ms >> 24), (uint8_t)(ms >> 16), (uint8_t)(ms >> 8), (uint8_t)ms};
+  sim::scheduleI2CWrite(time, address, data, sizeof(data), [time, address, period](bool ack) {
+    if (ack) {
+      syncCount++;
+    }
+    scheduleSync(time + period, address, period);
+  });
+}
+
+// Bus time of the keypad reads: START, 9 clocks a byte, STOP.
+double keypadBusSeconds(uint32_t hz) {
+  return (double)(keypadBytes * 9 + keypadTransactions * 2) / hz;
+}
+
+// Notes when key events were queued: in the last loop() pass.
+void keypadNotice() {
+  if (keypadPendingSince == sim::TIME_NEVER && firmware::keyEvents() > 0) {
+    keypadPendingSince = lastLoopStart;
+  }
+}
+
+// Controller write of a register, counted as keypad bus traffic.
+void keypadWrite(uint8_t address, const uint8_t *data, uint8_t length) {
+  keypadTransactions++;
+  keypadBytes += 1 + length;
+  sim::scheduleI2CWrite(sim::now(), address, data, length);
+}
+
+// SEESAW_KEYPAD_COUNT, then SEESAW_KEYPAD_FIFO when there are events.
+void keypadRead(uint8_t address) {
+  static const uint8_t count[] = {0x10, 0x04};
+  keypadWrite(address, count, sizeof(count));
+  keypadTransactions++;
+  keypadBytes += 2;
+  sim::scheduleI2CRead(sim::now(), address, 1, [address](int read, const uint8_t *data) {
+    if (read != 1 || data[0] == 0) {
+      return;
+    }
+    uint8_t events = data[0];
+    static const uint8_t fifo[] = {0x10, 0x10};
+    keypadWrite(address, fifo, sizeof(fifo));
+    keypadTransactions++;
+    keypadBytes += 1 + events;
+    sim::scheduleI2CRead(sim::now(), address, events, [events](int read, const uint8_t *) {
+      if (read < 0) {
+        return;
+      }
+      keypadNotice();
+      keypadEvents += events;
+      if (keypadPendingSince != sim::TIME_NEVER) {
+        uint64_t latency = sim::now() - keypadPendingSince;
+        keypadLatencyTotal += latency;
+        keypadLatencyMax = std::max(keypadLatencyMax, latency);
+        keypadLatencyCount++;
+        keypadPendingSince = sim::TIME_NEVER;
+      }
+    });
+  });
+}
+
+// Controller check for key events every period, from time on.
+void scheduleKeypad(uint64_t time, uint8_t address) {
+  sim::schedule(time, [time, address]() {
+    keypadChecks++;
+    keypadNotice();
+    if (!keypadInterrupt || sim::readPin(SIM_PIN_INTERRUPT) == LOW) {
+      keypadRead(address);
+    }
+    scheduleKeypad(time + keypadPeriod, address);
+    return false;
+  });
+}
+
+// Returns the end time.
+uint64_t loadScenario(const char *path) {
+  FILE *file = fopen(path, "r");
+  if (file == nullptr) {
+    perror(path);
+    exit(1);
+  }
+
+  uint64_t end = 0;
+  char text[512];
+  int line = 0;
+  while (fgets(text, sizeof(text), file) != nullptr) {
+    line++;
+    char *comment = strchr(text, '#');
+    if (comment != nullptr) {
+      *comment = '\0';
+    }
+
+    std::istringstream in(text);
+    std::vector<std::string> words;
+    std::string word;
+    while (in >> word) {
+      words.push_back(word);
+    }
+    if (words.empty()) {
+      continue;
+    }
+    std::vector<std::string> expected = expectedResponse(words);
+    if (!expected.empty() && !(words.size() >= 4 && words[0] == "at" && words[2] == "i2c")) {
+      fail(path, line, "-> only follows an i2c command");
+    }
+
+    if (words[0] == "eeprom") {
+      if (words.size() < 3) {
+        fail(path, line, "eeprom <addr> <byte>...");
+      }
+      long address = number(words[1], path, line);
+      for (size_t i = 2; i < words.size(); i++) {
+        uint8_t value = (uint8_t)number(words[i], path, line);
+        EEPROM.hostLoad(address + (i - 2), &value, 1);
+      }
+    } else if (words[0] == "serial") {
+      if (words.size() < 2 || words.size() > 11) {
+        fail(path, line, "serial <byte>...");
+      }
+      for (size_t i = 1; i < words.size(); i++) {
+        (&SIGROW.SERNUM0)[i - 1] = (uint8_t)number(words[i], path, line);
+      }
+    } else if (words[0] == "skew") {
+      if (words.size() != 2 && words.size() != 3) {
+        fail(path, line, "skew <ppm> [<rtc ppm>]");
+      }
+      int32_t ppm = (int32_t)number(words[1], path, line);
+      sim::setClockSkew(ppm, (words.size() == 3) ? (int32_t)number(words[2], path, line) : ppm);
+    } else if (words[0] == "sync") {
+      if (words.size() != 3) {
+        fail(path, line, "sync <addr> <ms>");
+      }
+      uint8_t address = (uint8_t)number(words[1], path, line);
+      uint64_t period = (uint64_t)number(words[2], path, line) * sim::NS_PER_MS;
+      if (period == 0) {
+        fail(path, line, "sync period must be above 0");
+      }
+      scheduleSync(period, address, period);
+    } else if (words[0] == "keypad") {
+      if (words.size() != 3 && !(words.size() == 4 && words[3] == "int")) {
+        fail(path, line, "keypad <addr> <ms> [int]");
+      }
+      uint8_t address = (uint8_t)number(words[1], path, line);
+      keypadPeriod = (uint64_t)number(words[2], path, line) * sim::NS_PER_MS;
+      if (keypadPeriod == 0) {
+        fail(path, line, "keypad period must be above 0");
+      }
+      keypadUsed = true;
+      keypadInterrupt = (words.size() == 4);
+      if (keypadInterrupt) {
+        // SEESAW_KEYPAD_INTENSET; the line has a pull-up at the controller
+        sim::pullUpPin(SIM_PIN_INTERRUPT);
+        sim::schedule(keypadPeriod / 2, [address]() {
+          static const uint8_t intenset[] = {0x10, 0x02, 0x01};
+          keypadWrite(address, intenset, sizeof(intenset));
+          return false;
+        });
+      }
+      scheduleKeypad(keypadPeriod, address);
+    } else if (words[0] == "end") {
+      if (words.size() != 2) {
+        fail(path, line, "end <ms>");
+      }
+      end = (uint64_t)number(words[1], path, line) * sim::NS_PER_MS;
+    } else if (words[0] == "expect") {
+      parseExpect(words, path, line);
+    } else if (words[0] == "at" && words.size() >= 3) {
+      uint64_t time = (uint64_t)number(words[1], path, line) * sim::NS_PER_MS;
+      const std::string &command = words[2];
+
+      if (command == "press") {
+        if (words.size() < 4 || (words[3] != "button" && words[3] != "trigger")) {
+          fail(path, line, "at <ms> press <button|trigger> [<ms>]");
+        }
+        uint8_t pin = (words[3] == "button") ? SIM_PIN_BUTTON : SIM_PIN_TRIGGER;
+        long hold = (words.size() > 4) ? number(words[4], path, line) : 100;
+        sim::schedulePin(time, pin, LOW);
+        sim::schedulePin(time + hold * sim::NS_PER_MS, pin, -1);
+      } else if (command == "expect") {
+        scheduleExpect(time, words, path, line);
+      } else if (command == "i2c" && words.size() >= 5 && words[3] == "write") {
+        uint8_t address = (uint8_t)number(words[4], path, line);
+        std::vector<int> bytes; // -1 for last
+        for (size_t i = 5; i < words.size(); i++) {
+          bytes.push_back((words[i] == "last") ? -1 : (int)(uint8_t)number(words[i], path, line));
+        }
+        if (expected.size() > 1 || (expected.size() == 1 && expected[0] != "ACK" && expected[0] != "NACK")) {
+          fail(path, line, "expected ACK or NACK");
+        }
+        int expectAck = expected.empty() ? -1 : (expected[0] == "ACK");
+        std::function<void(bool)> done = [address, expectAck, path, line](bool ack) {
+          if (!ack) {
+            printTime(sim::now());
+            printf("i2c write 0x%02X NACK\n", address);
+          }
+          if (expectAck >= 0 && ack != (bool)expectAck) {
+            mismatch(path, line, ack ? "ACK, expected NACK" : "NACK, expected ACK");
+          }
+        };
+        sim::schedule(time, [address, bytes, done]() {
+          std::vector<uint8_t> data;
+          for (int byte : bytes) {
+            if (byte < 0) {
+              data.insert(data.end(), lastRead.begin(), lastRead.end());
+            } else {
+              data.push_back((uint8_t)byte);
+            }
+          }
+          sim::scheduleI2CWrite(sim::now(), address, data.data(), (uint8_t)data.size(), done);
+          return false;
+        });
+      } else if (command == "i2c" && words.size() >= 6 && words[3] == "read") {
+        uint8_t address = (uint8_t)number(words[4], path, line);
+        uint8_t count = (uint8_t)number(words[5], path, line);
+        std::vector<uint8_t> reg;
+        for (size_t i = 6; i < words.size(); i++) {
+          reg.push_back((uint8_t)number(words[i], path, line));
+        }
+        if (!reg.empty()) {
+          sim::scheduleI2CWrite(time, address, reg.data(), (uint8_t)reg.size());
+        }
+        bool expectNack = (expected.size() == 1 && expected[0] == "NACK");
+        std::vector<int> expectBytes;
+        if (!expected.empty() && !expectNack) {
+          expectBytes = expectedBytes(expected, path, line);
+          if (expectBytes.size() != count) {
+            fail(path, line, "expected response length differs from the count");
+          }
+        }
+        bool checked = !expected.empty();
+        sim::scheduleI2CRead(time, address, count,
+                             [address, reg, checked, expectNack, expectBytes, path, line](int read, const uint8_t *data) {
+          printTime(sim::now());
+          printf("i2c read 0x%02X", address);
+          printBytes(reg.data(), (int)reg.size());
+          if (read < 0) {
+            printf(" -> NACK\n");
+          } else {
+            lastRead.assign(data, data + read);
+            printf(" ->");
+            printBytes(data, read);
+            printf("\n");
+          }
+          if (!checked) {
+            return;
+          }
+          bool match = expectNack ? (read < 0) : (read == (int)expectBytes.size());
+          for (int i = 0; match && !expectNack && i < read; i++) {
+            match = (expectBytes[i] < 0 || expectBytes[i] == data[i]);
+          }
+          if (!match) {
+            mismatch(path, line, read < 0 ? std::string("NACK") : "read" + formatBytes(data, read));
+          }
+        });
+      } else {
+        fail(path, line, "unknown command");
+      }
+    } else {
+      fail(path, line, "unknown command");
+    }
+  }
+  fclose(file);
+
+  if (end == 0) {
+    fail(path, line, "missing end <ms>");
+  }
+  return end;
+}
+
+void printReport(uint64_t end) {
+  printf("\nEstimated MCU current per state (%.0f MHz, %llu loop() passes, %llu standby wakes)\n", F_CPU / 1e6,
+         (unsigned long long)sim::loopCount(), (unsigned long long)sim::standbyCount());
+  uint64_t awake = sim::modeTime(-1, sim::CPU_RUN) + sim::modeTime(-1, sim::CPU_IDLE);
+  if (sim::prescaledTime() > 0 && awake > 0) {
+    printf("The CPU clock was prescaled (Clock.h) for %.1f%% of the awake time\n",
+           100.0 * sim::prescaledTime() / awake);
+  }
+  sim::printPowerReport(stdout);
+
+  printf("\nDuty cycle counted by the firmware (DOA_SEESAW_POWER_BASE)\n");
+  uint32_t reported[sim::CPU_MODE_COUNT];
+  uint32_t reportedTotal = 0;
+  for (uint8_t mode = 0; mode < sim::CPU_MODE_COUNT; mode++) {
+    reported[mode] = firmware::reportedMillis(mode);
+    reportedTotal += reported[mode];
+  }
+  for (uint8_t mode = 0; mode < sim::CPU_MODE_COUNT; mode++) {
+    printf("  %-8s %10lu ms %7.2f%%   (simulated %10.1f ms)\n", sim::cpuModeName(mode),
+           (unsigned long)reported[mode], reportedTotal ? 100.0 * reported[mode] / reportedTotal : 0.0,
+           sim::modeTime(-1, mode) / 1e6);
+  }
+  printf("  standby  %10lu times\n", (unsigned long)firmware::reportedStandbyCount());
+  printf("  millis() %10lu ms      (simulated %10.1f ms)\n", (unsigned long)millis(), end / 1e6);
+
+  uint32_t writes = 0;
+  for (int i = 0; i < EEPROM_SIZE; i++) {
+    writes += EEPROM.hostWrites(i);
+  }
+  printf("\nEEPROM bytes written: %lu\n", (unsigned long)writes);
+
+  if (syncCount > 0) {
+    printf("\nEffect clock against the controller (Sync.h), %lu syncs\n", (unsigned long)syncCount);
+    printf("  max offset         %8.3f ms\n", syncMaxOffset / 1e6);
+    printf("  max offset settled %8.3f ms   (from sync %lu on)\n", syncSettledMaxOffset / 1e6,
+           (unsigned long)SYNC_SETTLED);
+    printf("  offset at the end  %+8.3f ms\n", syncOffset / 1e6);
+  }
+
+  if (keypadUsed) {
+    printf("\nKey events read by the controller (%s every %.0f ms)\n",
+           keypadInterrupt ? "interrupt pin checked" : "SEESAW_KEYPAD_COUNT polled", keypadPeriod / 1e6);
+    printf("  checks             %8lu\n", (unsigned long)keypadChecks);
+    printf("  bus transactions   %8lu   (%lu bytes)\n", (unsigned long)keypadTransactions,
+           (unsigned long)keypadBytes);
+    printf("  bus time           %8.1f ms   (%.3f%% of a 100 kHz bus)\n", keypadBusSeconds(100000) * 1000,
+           100.0 * keypadBusSeconds(100000) * sim::NS_PER_S / end);
+    printf("  events read        %8lu\n", (unsigned long)keypadEvents);
+    if (keypadLatencyCount > 0) {
+      printf("  latency            %8.1f ms mean, %.1f ms max\n",
+             keypadLatencyTotal / 1e6 / keypadLatencyCount, keypadLatencyMax / 1e6);
+    }
+  }
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  const char *scenario = nullptr;
+
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "-v") == 0) {
+      verbose = true;
+    } else if (strcmp(argv[i], "--serial") == 0 && i + 1 < argc) {
+      serialOut = fopen(argv[++i], "wb");
+      if (serialOut == nullptr) {
+        perror(argv[i]);
+        return 1;
+      }
+    } else if (strcmp(argv[i], "--loop-cycles") == 0 && i + 1 < argc) {
+      sim::costs.loopCycles = (uint32_t)atol(argv[++i]);
+    } else if (argv[i][0] == '-' || scenario != nullptr) {
+      usage();
+    } else {
+      scenario = argv[i];
+    }
+  }
+  if (scenario == nullptr) {
+    usage();
+  }
+
+  uint64_t end = loadScenario(scenario);
+
+  sim::setStateProbe(&firmware::state, firmware::stateNames(), firmware::STATE_COUNT);
+  sim::onState = [](uint64_t time, int state) {
+    if (verbose) {
+      printTime(time);
+      printf("state %s\n", sim::stateName(state));
+    }
+  };
+  sim::onOutput = [](uint64_t time, uint8_t pin, uint8_t level) {
+    if (verbose && pin == SIM_PIN_PWM_OUTPUT) {
+      printTime(time);
+      printf("output %u\n", level);
+    } else if (verbose && sim::pwmChannel(pin) != nullptr && pin != SIM_PIN_BUTTON) {
+      // the other channels of a multi-channel build
+      printTime(time);
+      printf("output %u (pin %u)\n", level, pin);
+    }
+  };
+  sim::onShow = [](uint64_t time, uint8_t, const uint8_t *pixels, uint16_t length) {
+    if (verbose) {
+      printTime(time);
+      printf("status");
+      printBytes(pixels, length);
+      printf("\n");
+    }
+  };
+  sim::onLoop = [](uint64_t start) {
+    keypadNotice();
+    lastLoopStart = start;
+    if (!firmware::synced()) {
+      return;
+    }
+    syncOffset = (int64_t)(firmware::syncClock() * sim::NS_PER_US) - (int64_t)start;
+    int64_t offset = (syncOffset < 0) ? -syncOffset : syncOffset;
+    syncMaxOffset = std::max(syncMaxOffset, offset);
+    if (syncCount >= SYNC_SETTLED) {
+      syncSettledMaxOffset = std::max(syncSettledMaxOffset, offset);
+    }
+  };
+  sim::onSerial = [](uint8_t c) {
+    if (serialOut != nullptr) {
+      fputc(c, serialOut);
+    }
+  };
+
+  sim::boot();
+  sim::runUntil(end);
+
+  printReport(end);
+
+  for (EndExpectation &expectation : endExpectations) {
+    std::string message;
+    if (!expectation.check(message)) {
+      mismatch(expectation.path, expectation.line, message);
+    }
+  }
+
+  if (serialOut != nullptr) {
+    fclose(serialOut);
+  }
+  if (failures > 0) {
+    fprintf(stderr, "%d expectation%s failed\n", failures, failures == 1 ? "" : "s");
+    return 1;
+  }
+  return 0;
+}
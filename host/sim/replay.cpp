@@ -0,0 +1,432 @@
+// incipit11_replay: saves the capture of a unit built with CAPTURE
+// (Capture.h) as a trace, and replays a trace through the simulator to check
+// the host build does what the unit did.
+//
+// usage: incipit11_replay --device DEV --address ADDR --save FILE
+//        incipit11_replay [--tolerance MS] FILE
+//
+//   --device DEV      Linux I2C adapter (/dev/i2c-N) with the unit on it
+//   --address ADDR    the unit
+//   --save FILE       write the trace of its capture to FILE
+//   --tolerance MS    how far the replay may be off in time (default 20)
+//
+// A trace is a text file in the manner of the incipit11_sim scenarios, one
+// line per record. Times are the unit's milliseconds since reset.
+//
+//   eeprom <addr> <byte>...          the EEPROM at reset: the EEPROM when
+//                                    the capture was read with the captured
+//                                    writes undone
+//   at <ms> input <button|trigger> <0|1>
+//                                    an input went low (0) or high
+//   at <ms> write <addr> <byte>...   seesaw write (address 0: general call)
+//   at <ms> read <addr>              seesaw read
+//   expect <ms> state <name>         the state machine went to a state
+//   expect <ms> effect <ch> <effect> a channel changed to an effect
+//   expect <ms> eeprom <addr> <byte> an EEPROM byte was written
+//   end <ms>                         the last record
+//
+// '#' starts a comment. The replay boots the unit with the EEPROM, drives the
+// inputs and sends the seesaw accesses at their times, and compares the
+// states, effects and EEPROM writes of each kind in order. Exits with 1 when
+// one is missing, different or off by more than the tolerance.
+
+#include <Arduino.h>
+#include <EEPROM.h>
+
+#include "Firmware.h"
+#include "Sim.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "Controller.h"
+#ifdef INCIPIT11_I2C_DEV
+#include "LinuxI2C.h"
+#endif
+
+// pins used by the firmware (Incipit11Controller.ino)
+#define REPLAY_PIN_BUTTON    PIN_PA4
+#define REPLAY_PIN_TRIGGER   PIN_PA6
+#define REPLAY_PIN_INTERRUPT PIN_PB3 // CONFIG_INTERRUPT_PIN
+
+namespace {
+
+// CaptureRecord of Capture.h
+enum {
+  CAPTURE_RECORD_INPUT = 1,
+  CAPTURE_RECORD_RECEIVE,
+  CAPTURE_RECORD_REQUEST,
+  CAPTURE_RECORD_STATE,
+  CAPTURE_RECORD_EFFECT,
+  CAPTURE_RECORD_EEPROM,
+};
+const uint8_t CAPTURE_HEADER_SIZE = 6;
+const uint8_t CAPTURE_FULL_bm = 0x01;
+const uint8_t CAPTURE_EEPROM_LOST_bm = 0x02;
+
+const char *const INPUT_NAMES[] = {"button", "trigger"};
+
+// A state, effect or EEPROM write, at the unit's millis().
+struct Expected {
+  uint32_t ms;
+  std::string what; // "state ambient", "effect 0 12", "eeprom 0x05 0x1a"
+};
+
+// The kinds compared separately, as the order of records of different kinds
+// in the same loop() pass doesn't matter.
+enum { KIND_STATE, KIND_EFFECT, KIND_EEPROM, KIND_COUNT };
+const char *const KIND_NAMES[KIND_COUNT] = {"states", "effects", "EEPROM writes"};
+
+void usage() {
+  fprintf(stderr, "usage: incipit11_replay --device DEV --address ADDR --save FILE\n"
+                  "       incipit11_replay [--tolerance MS] FILE\n");
+  exit(2);
+}
+
+long number(const char *word) {
+  char *end;
+  long value = strtol(word, &end, 0);
+  if (*word == '\0' || *end != '\0' || value < 0) {
+    usage();
+  }
+  return value;
+}
+
+std::string hex(uint8_t value) {
+  char text[8];
+  snprintf(text, sizeof(text), "0x%02x", value);
+  return text;
+}
+
+//***************************************************************
+// saving
+
+// Writes the trace of a capture. Returns false when the records don't parse.
+bool save(const incipit11::Capture &capture, FILE *out) {
+  std::vector<uint8_t> eeprom = capture.eeprom;
+  std::vector<std::string> lines;
+  const char *const *stateNames = firmware::stateNames();
+  uint32_t last = 0;
+
+  // the records, and the EEPROM writes to undo
+  std::vector<std::pair<uint8_t, uint8_t>> writes; // address, old byte
+  size_t offset = 0;
+  const std::vector<uint8_t> &records = capture.records;
+  while (offset < records.size()) {
+    if (offset + CAPTURE_HEADER_SIZE > records.size() ||
+        offset + CAPTURE_HEADER_SIZE + records[offset + 1] > records.size()) {
+      fprintf(stderr, "record at %zu runs past the end of the capture\n", offset);
+      return false;
+    }
+    uint8_t kind = records[offset];
+    uint8_t length = records[offset + 1];
+    const uint8_t *time = &records[offset + 2];
+    const uint8_t *data = &records[offset + CAPTURE_HEADER_SIZE];
+    uint32_t ms = ((uint32_t)time[0] << 24) | ((uint32_t)time[1] << 16) | ((uint32_t)time[2] << 8) | time[3];
+    offset += CAPTURE_HEADER_SIZE + length;
+    last = std::max(last, ms);
+
+    std::ostringstream line;
+    if (kind == CAPTURE_RECORD_INPUT && length == 2 && data[0] < 2) {
+      line << "at " << ms << " input " << INPUT_NAMES[data[0]] << " " << (int)data[1];
+    } else if (kind == CAPTURE_RECORD_RECEIVE && length >= 1) {
+      line << "at " << ms << " write " << hex(data[0]);
+      for (uint8_t i = 1; i < length; i++) {
+        line << " " << hex(data[i]);
+      }
+    } else if (kind == CAPTURE_RECORD_REQUEST && length == 1) {
+      line << "at " << ms << " read " << hex(data[0]);
+    } else if (kind == CAPTURE_RECORD_STATE && length == 1 && data[0] < firmware::STATE_COUNT) {
+      line << "expect " << ms << " state " << stateNames[data[0]];
+    } else if (kind == CAPTURE_RECORD_EFFECT && length == 2) {
+      line << "expect " << ms << " effect " << (int)data[0] << " " << (int)data[1];
+    } else if (kind == CAPTURE_RECORD_EEPROM && length == 3) {
+      line << "expect " << ms << " eeprom " << hex(data[0]) << " " << hex(data[2]);
+      writes.push_back({data[0], data[1]});
+    } else {
+      fprintf(stderr, "unknown record %u (%u bytes) at %zu\n", kind, length, offset);
+      return false;
+    }
+    lines.push_back(line.str());
+  }
+  for (auto write = writes.rbegin(); write != writes.rend(); ++write) {
+    eeprom[write->first] = write->second;
+  }
+
+  fprintf(out, "# incipit11_replay capture: %zu of %u bytes, %u records dropped\n", records.size(), capture.size,
+          capture.dropped);
+  for (size_t address = 0; address < eeprom.size(); address += 16) {
+    size_t end = std::min(address + 16, eeprom.size());
+    if (std::all_of(&eeprom[address], &eeprom[0] + end, [](uint8_t byte) { return byte == 0xFF; })) {
+      continue; // erased, as the simulator starts
+    }
+    fprintf(out, "eeprom %s", hex(address).c_str());
+    for (size_t i = address; i < end; i++) {
+      fprintf(out, " %s", hex(eeprom[i]).c_str());
+    }
+    fprintf(out, "\n");
+  }
+  for (const std::string &line : lines) {
+    fprintf(out, "%s\n", line.c_str());
+  }
+  fprintf(out, "end %lu\n", (unsigned long)last);
+  return true;
+}
+
+//***************************************************************
+// replay
+
+std::vector<Expected> expected[KIND_COUNT];
+std::vector<Expected> actual[KIND_COUNT];
+uint32_t endMs = 0;
+uint8_t channels = 0; // channels named in the trace
+uint8_t shadowEEPROM[EEPROM_SIZE];
+
+int lastState = -1;
+uint8_t lastEffect[8];
+
+// Parses the trace and schedules its inputs. The unit's millis() is taken
+// for virtual time, here and for what the replay does. Returns false on
+// errors.
+bool load(const char *path) {
+  FILE *file = fopen(path, "r");
+  if (file == nullptr) {
+    perror(path);
+    return false;
+  }
+  const char *const *stateNames = firmware::stateNames();
+  char text[512];
+  int lineNumber = 0;
+  bool ok = true;
+  while (fgets(text, sizeof(text), file) != nullptr) {
+    lineNumber++;
+    text[strcspn(text, "#")] = '\0';
+    std::istringstream line(text);
+    std::vector<std::string> words;
+    for (std::string word; line >> word;) {
+      words.push_back(word);
+    }
+    if (words.empty()) {
+      continue;
+    }
+    // numbers[i] is words[i + 1]; numeric(first) if the words from first on
+    // are all numbers
+    std::vector<long> numbers;
+    std::vector<bool> isNumber;
+    for (size_t i = 1; i < words.size(); i++) {
+      char *end;
+      numbers.push_back(strtol(words[i].c_str(), &end, 0));
+      isNumber.push_back(*end == '\0' && numbers.back() >= 0);
+    }
+    auto numeric = [&isNumber](size_t first) {
+      return std::all_of(isNumber.begin() + std::min(first - 1, isNumber.size()), isNumber.end(),
+                         [](bool number) { return number; });
+    };
+    size_t n = words.size();
+    if (n < 2 || !isNumber[0]) {
+      fprintf(stderr, "%s:%d: can't read \"%s\"\n", path, lineNumber, words[0].c_str());
+      ok = false;
+      continue;
+    }
+    uint64_t at = (uint64_t)numbers[0] * sim::NS_PER_MS;
+
+    if (words[0] == "eeprom" && n >= 3 && numeric(1)) {
+      for (size_t i = 2; i < n; i++) {
+        uint8_t value = numbers[i - 1];
+        EEPROM.hostLoad(numbers[0] + (i - 2), &value, 1);
+      }
+    } else if (words[0] == "end" && n == 2) {
+      endMs = numbers[0];
+    } else if (words[0] == "at" && n == 5 && words[2] == "input" &&
+               (words[3] == "button" || words[3] == "trigger") && (words[4] == "0" || words[4] == "1")) {
+      uint8_t pin = (words[3] == "button") ? REPLAY_PIN_BUTTON : REPLAY_PIN_TRIGGER;
+      sim::schedulePin(at, pin, (words[4] == "0") ? LOW : -1);
+    } else if (words[0] == "at" && n >= 4 && n - 4 <= 32 && words[2] == "write" && numeric(3)) {
+      std::vector<uint8_t> bytes(numbers.begin() + 3, numbers.end());
+      sim::scheduleI2CWrite(at, numbers[2], bytes.data(), bytes.size());
+    } else if (words[0] == "at" && n == 4 && words[2] == "read" && numeric(3)) {
+      sim::scheduleI2CRead(at, numbers[2], 32, [](int, const uint8_t *) {});
+    } else if (words[0] == "expect" && n == 4 && words[2] == "state" &&
+               std::find(stateNames, stateNames + firmware::STATE_COUNT, words[3]) !=
+                   stateNames + firmware::STATE_COUNT) {
+      expected[KIND_STATE].push_back({(uint32_t)numbers[0], "state " + words[3]});
+    } else if (words[0] == "expect" && n == 5 && words[2] == "effect" && numeric(3) &&
+               numbers[2] < (long)sizeof(lastEffect)) {
+      channels = std::max(channels, (uint8_t)(numbers[2] + 1));
+      expected[KIND_EFFECT].push_back({(uint32_t)numbers[0], "effect " + words[3] + " " + words[4]});
+    } else if (words[0] == "expect" && n == 5 && words[2] == "eeprom" && numeric(3)) {
+      expected[KIND_EEPROM].push_back(
+          {(uint32_t)numbers[0], "eeprom " + hex(numbers[2]) + " " + hex(numbers[3])});
+    } else {
+      fprintf(stderr, "%s:%d: can't read \"%s\"\n", path, lineNumber, words[0].c_str());
+      ok = false;
+    }
+  }
+  fclose(file);
+  return ok;
+}
+
+// The effects that changed. setup() sets them before it writes the EEPROM,
+// which takes a while on a new part, so they are looked at on every EEPROM
+// write as well as after every loop() pass.
+void noticeEffects(uint32_t ms) {
+  for (uint8_t channel = 0; channel < channels; channel++) {
+    uint8_t effect = firmware::effect(channel);
+    if (effect != lastEffect[channel]) {
+      lastEffect[channel] = effect;
+      actual[KIND_EFFECT].push_back({ms, "effect " + std::to_string(channel) + " " + std::to_string(effect)});
+    }
+  }
+}
+
+// After every loop() pass, like the capture: the state it went to and the
+// effects that changed. The capture has the time before loop() sleeps, so
+// this takes the time the pass started.
+void noticeLoop(uint64_t start) {
+  uint32_t ms = start / sim::NS_PER_MS;
+  int state = firmware::state();
+  if (state != lastState) {
+    lastState = state;
+    actual[KIND_STATE].push_back({ms, std::string("state ") + firmware::stateNames()[state]});
+  }
+  noticeEffects(ms);
+}
+
+// The EEPROM bytes that changed, as the capture only has those.
+void noticeEEPROMWrite(uint64_t time, uint8_t address, uint8_t value) {
+  uint32_t ms = time / sim::NS_PER_MS;
+  noticeEffects(ms);
+  if (shadowEEPROM[address] != value) {
+    shadowEEPROM[address] = value;
+    actual[KIND_EEPROM].push_back({ms, "eeprom " + hex(address) + " " + hex(value)});
+  }
+}
+
+// Compares a kind in order. Prints the first difference and returns false
+// if there is one.
+bool compare(int kind, uint32_t tolerance, uint32_t &maxOffset) {
+  const std::vector<Expected> &want = expected[kind];
+  std::vector<Expected> got;
+  // past the end of the capture the unit may have done more
+  for (const Expected &event : actual[kind]) {
+    if (event.ms <= endMs || got.size() < want.size()) {
+      got.push_back(event);
+    }
+  }
+  for (size_t i = 0; i < want.size(); i++) {
+    if (i >= got.size()) {
+      printf("%s: missing \"%s\" at %lu ms\n", KIND_NAMES[kind], want[i].what.c_str(), (unsigned long)want[i].ms);
+      return false;
+    }
+    uint32_t offset = (got[i].ms > want[i].ms) ? got[i].ms - want[i].ms : want[i].ms - got[i].ms;
+    if (got[i].what != want[i].what || offset > tolerance) {
+      printf("%s: \"%s\" at %lu ms, expected \"%s\" at %lu ms\n", KIND_NAMES[kind], got[i].what.c_str(),
+             (unsigned long)got[i].ms, want[i].what.c_str(), (unsigned long)want[i].ms);
+      return false;
+    }
+    maxOffset = std::max(maxOffset, offset);
+  }
+  if (got.size() > want.size() && got[want.size()].ms <= endMs) {
+    printf("%s: \"%s\" at %lu ms wasn't captured\n", KIND_NAMES[kind], got[want.size()].what.c_str(),
+           (unsigned long)got[want.size()].ms);
+    return false;
+  }
+  printf("%-14s %zu match\n", KIND_NAMES[kind], want.size());
+  return true;
+}
+
+int replay(const char *path, uint32_t tolerance) {
+  if (!load(path)) {
+    return 1;
+  }
+  memcpy(shadowEEPROM, EEPROM.hostData(), sizeof(shadowEEPROM));
+  memset(lastEffect, 0xFF, sizeof(lastEffect));
+
+  // the interrupt line has its pull-up at the controller
+  sim::pullUpPin(REPLAY_PIN_INTERRUPT);
+  sim::onLoop = &noticeLoop;
+  sim::onEEPROMWrite = &noticeEEPROMWrite;
+  sim::boot();
+  sim::runUntil((uint64_t)(endMs + tolerance) * sim::NS_PER_MS);
+
+  bool ok = true;
+  uint32_t maxOffset = 0;
+  for (int kind = 0; kind < KIND_COUNT; kind++) {
+    ok = compare(kind, tolerance, maxOffset) && ok;
+  }
+  printf("%s, largest time offset %lu ms\n", ok ? "replay matches" : "replay differs", (unsigned long)maxOffset);
+  return ok ? 0 : 1;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  const char *device = nullptr;
+  long address = -1;
+  const char *savePath = nullptr;
+  long tolerance = 20;
+  const char *tracePath = nullptr;
+
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--device") == 0 && i + 1 < argc) {
+      device = argv[++i];
+    } else if (strcmp(argv[i], "--address") == 0 && i + 1 < argc) {
+      address = number(argv[++i]);
+    } else if (strcmp(argv[i], "--save") == 0 && i + 1 < argc) {
+      savePath = argv[++i];
+    } else if (strcmp(argv[i], "--tolerance") == 0 && i + 1 < argc) {
+      tolerance = number(argv[++i]);
+    } else if (argv[i][0] != '-' && tracePath == nullptr) {
+      tracePath = argv[i];
+    } else {
+      usage();
+    }
+  }
+  if (tracePath != nullptr) {
+    if (device != nullptr || savePath != nullptr) {
+      usage();
+    }
+    return replay(tracePath, tolerance);
+  }
+  if (device == nullptr || savePath == nullptr || address < 0 || address > 0x7F) {
+    usage();
+  }
+
+#ifdef INCIPIT11_I2C_DEV
+  incipit11::LinuxI2CTransport i2c;
+  if (!i2c.open(device)) {
+    perror(device);
+    return 1;
+  }
+  incipit11::Controller controller(i2c);
+  incipit11::Capture capture;
+  controller.readCapture((uint8_t)address, capture);
+  if (!capture.ok) {
+    fprintf(stderr, "no capture from 0x%02lx: not there, or built without CAPTURE\n", address);
+    return 1;
+  }
+  if (capture.flags & CAPTURE_FULL_bm) {
+    fprintf(stderr, "the capture filled up: %u records dropped, the trace ends early\n", capture.dropped);
+  }
+  if (capture.flags & CAPTURE_EEPROM_LOST_bm) {
+    fprintf(stderr, "EEPROM written after the capture filled up: the EEPROM at reset is a guess\n");
+  }
+  FILE *out = fopen(savePath, "w");
+  if (out == nullptr) {
+    perror(savePath);
+    return 1;
+  }
+  bool ok = save(capture, out);
+  fclose(out);
+  return ok ? 0 : 1;
+#else
+  fprintf(stderr, "built without i2c-dev\n");
+  return 1;
+#endif
+}
@@ -0,0 +1,92 @@
+#!/usr/bin/env python3
+"""Turn an Arduino sketch (.ino) into a C++ file the way the Arduino builder does.
+
+Adds #include <Arduino.h> and a prototype for every function defined in the
+sketch in front of the first function definition, with #line directives so
+compiler messages point into the .ino.
+
+usage: ino2cpp.py SKETCH.ino -o OUTPUT.cpp
+"""
+
+import argparse
+import re
+import sys
+
+FUNCTION = re.compile(
+    r"^(?P<ret>[A-Za-z_][\w:<>]*(?:[ \t]+[A-Za-z_][\w:<>]*)*[ \t*&]+)"
+    r"(?P<name>[A-Za-z_]\w*)[ \t]*\((?P<args>[^;{}()]*)\)\s*\{",
+    re.M,
+)
+KEYWORDS = {"if", "for", "while", "switch", "return", "else", "do", "sizeof"}
+
+
+def strip_comments(text):
+    """Blank out comments and strings, keeping the line numbers."""
+    def blank(m):
+        return re.sub(r"[^\n]", " ", m.group(0))
+
+    return re.sub(r'//[^\n]*|/\*.*?\*/|"(?:\\.|[^"\\\n])*"|\'(?:\\.|[^\'\\\n])*\'',
+                  blank, text, flags=re.S)
+
+
+def top_level(code):
+    """Mask out everything inside braces so only top level code is matched."""
+    out = []
+    depth = 0
+    for c in code:
+        if c == "{":
+            out.append(c if depth == 0 else " ")
+            depth += 1
+        elif c == "}":
+            depth -= 1
+            out.append(c if depth == 0 else " ")
+        elif depth > 0 and c != "\n":
+            out.append(" ")
+        else:
+            out.append(c)
+    return "".join(out)
+
+
+def prototypes(text):
+    code = top_level(strip_comments(text))
+    found = []
+    first_line = None
+    for m in FUNCTION.finditer(code):
+        ret = " ".join(m.group("ret").split())
+        name = m.group("name")
+        if name in KEYWORDS or ret.split()[0] in KEYWORDS:
+            continue
+        args = re.sub(r"\s*=\s*[^,]+", "", " ".join(m.group("args").split()))
+        found.append("%s %s(%s);" % (ret, name, args))
+        line = code.count("\n", 0, m.start()) + 1
+        if first_line is None:
+            first_line = line
+    return found, first_line
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("sketch")
+    parser.add_argument("-o", "--output", required=True)
+    args = parser.parse_args()
+
+    text = open(args.sketch).read()
+    lines = text.splitlines(True)
+    found, first_line = prototypes(text)
+    if first_line is None:
+        first_line = len(lines) + 1
+
+    path = args.sketch.replace("\\", "/")
+    with open(args.output, "w") as out:
+        out.write("#include <Arduino.h>\n")
+        out.write('#line 1 "%s"\n' % path)
+        out.writelines(lines[:first_line - 1])
+        out.write("\n".join(found) + "\n")
+        out.write('#line %d "%s"\n' % (first_line, path))
+        out.writelines(lines[first_line - 1:])
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,175 @@
+#!/usr/bin/env python3
+"""Decode the binary trace records sent by the Incipit11 controller.
+
+The firmware (arduino/Incipit11Controller/Trace.h) sends 9 byte records on the
+debug serial port when it is built with DEBUG defined:
+
+    0x80 | event id, 4 x 7 bits of time in ms, 4 x 7 bits of argument
+
+Plain text printed with DPRINT is passed through unchanged. The event names
+and argument types are read from Trace.h and the effect names from
+Incipit11Controller.ino so this tool never goes out of date.
+
+Usage:
+    trace_decode.py /dev/ttyUSB0          # needs pyserial, 115200 baud
+    trace_decode.py capture.bin           # a file captured earlier
+    cat capture.bin | trace_decode.py -
+"""
+
+import argparse
+import os
+import re
+import sys
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+FIRMWARE = os.path.join(HERE, "..", "arduino", "Incipit11Controller")
+
+RECORD_SIZE = 9
+WRAP_28 = 1 << 28
+
+
+def load_events(path):
+    """Map event id -> (name, argument type) from the TraceEvent enum."""
+    events = {}
+    text = open(path).read()
+    body = re.search(r"enum TraceEvent\s*:\s*uint8_t\s*\{(.*?)\};", text, re.S).group(1)
+    value = 0
+    for line in body.splitlines():
+        m = re.match(r"\s*(TRACE_\w+)\s*(?:=\s*(\d+))?\s*,?\s*(?://\s*arg:\s*(\w+))?", line)
+        if not m:
+            continue
+        name, explicit, kind = m.groups()
+        if name == "TRACE_EVENT_COUNT":
+            break
+        if explicit is not None:
+            value = int(explicit)
+        events[value] = (name[len("TRACE_"):], kind)
+        value += 1
+    return events
+
+
+def load_effects(path):
+    """Map effect index -> name from the 'const uint8_t NAME = N;' lines."""
+    effects = {}
+    for m in re.finditer(r"^const uint8_t (\w+) = (\d+);", open(path).read(), re.M):
+        name, value = m.group(1), int(m.group(2))
+        if name in ("EFFECTS_COUNT", "DEFAULT_EFFECT"):
+            continue
+        effects.setdefault(value, name)
+    return effects
+
+
+def format_arg(kind, arg, effects):
+    if kind is None:
+        return ""
+    if kind == "effect":
+        name = effects.get(arg & 0xFF, "unknown effect %d" % (arg & 0xFF))
+        if arg >> 8:
+            name += " (channel %d)" % (arg >> 8)
+        return name
+    if kind == "hex":
+        return "0x%02X" % arg
+    if kind == "pwm":
+        return "pin %d value %d" % (arg >> 16, arg & 0xFFFF)
+    if kind == "milliseconds":
+        return "%d ms" % arg
+    if kind == "microseconds":
+        return "%d us" % arg
+    if kind == "recording":
+        return "%d events in %d bytes" % (arg >> 8, arg & 0xFF)
+    if kind == "sync":
+        if arg & 0x08000000:
+            arg -= 0x10000000
+        return "%+d us" % arg
+    if kind == "broadcast":
+        return "command %d groups 0x%02X" % (arg >> 8, arg & 0xFF)
+    if kind == "permille":
+        return "%d.%d%%" % (arg // 10, arg % 10)
+    return str(arg)
+
+
+def unpack28(data):
+    value = 0
+    for b in data:
+        value = (value << 7) | (b & 0x7F)
+    return value
+
+
+class Decoder:
+    def __init__(self, events, effects, out):
+        self.events = events
+        self.effects = effects
+        self.out = out
+        self.record = bytearray()
+        self.last_time = None
+        self.epoch = 0
+
+    def feed(self, data):
+        for b in data:
+            if b & 0x80:
+                if self.record:
+                    self.out.write("<truncated record>\n")
+                self.record = bytearray([b])
+            elif self.record:
+                self.record.append(b)
+                if len(self.record) == RECORD_SIZE:
+                    self.emit(self.record)
+                    self.record = bytearray()
+            else:
+                self.out.write(chr(b))
+        self.out.flush()
+
+    def emit(self, record):
+        event = record[0] & 0x7F
+        time = unpack28(record[1:5])
+        arg = unpack28(record[5:9])
+
+        # the time is sent with 28 bits, unwrap it
+        if self.last_time is not None and time < self.last_time:
+            self.epoch += WRAP_28
+        self.last_time = time
+        seconds = (self.epoch + time) / 1000.0
+
+        name, kind = self.events.get(event, ("UNKNOWN_%d" % event, "count"))
+        text = format_arg(kind, arg, self.effects)
+        self.out.write("%10.3f %s%s\n" % (seconds, name, " " + text if text else ""))
+
+
+def open_input(path, baud):
+    if path == "-":
+        return sys.stdin.buffer
+    if path.startswith("/dev/"):
+        import serial  # pyserial
+
+        return serial.Serial(path, baud, timeout=0.1)
+    return open(path, "rb")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.split("\n")[0])
+    parser.add_argument("input", help="serial port, capture file or - for stdin")
+    parser.add_argument("--baud", type=int, default=115200)
+    parser.add_argument("--firmware", default=FIRMWARE, help="Incipit11Controller sketch folder")
+    args = parser.parse_args()
+
+    events = load_events(os.path.join(args.firmware, "Trace.h"))
+    effects = load_effects(os.path.join(args.firmware, "Incipit11Controller.ino"))
+    decoder = Decoder(events, effects, sys.stdout)
+
+    source = open_input(args.input, args.baud)
+    try:
+        while True:
+            data = source.read(64)
+            if data is None:
+                continue
+            if not data:
+                if args.input.startswith("/dev/"):
+                    continue
+                break
+            decoder.feed(data)
+    except KeyboardInterrupt:
+        pass
+
+
+if __name__ == "__main__":
+    main()